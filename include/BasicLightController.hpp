@@ -4,6 +4,7 @@
 
 #include "Intersection.hpp"
 #include "SafetyChecker.hpp"
+#include "StateStream.hpp"
 
 namespace crossroads {
 
@@ -24,6 +25,10 @@ namespace crossroads {
         // Provide per-direction demand flags in order: North, South, East, West
         void setDemandByDirection(const std::array<bool, 4>& demand);
 
+        // Phase timing for engine checkpoints; the green durations come from the constructor and are not saved
+        void saveState(StateWriter& writer) const;
+        bool loadState(StateReader& reader);
+
        private:
         IntersectionState current_state;
         SafetyChecker checker;
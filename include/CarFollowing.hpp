@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Vehicle.hpp"
+
+namespace crossroads {
+    // The waiting vehicles of a set of lanes as structure of arrays. Lanes come in groups of kWidth; within a group
+    // the slots are rank-major, so vehicle `rank` of every lane of the group (the lane leader is rank 0) sits side by
+    // side. A vehicle follows the one rank before it in its lane, as updated in the same step, so a lane is a chain.
+    struct CarFollowingBatch {
+        static constexpr std::size_t kWidth = 4;  // Lanes per group
+
+        std::size_t lane_count = 0;
+        std::size_t stride = 0;  // lane_count rounded up to kWidth
+        std::size_t ranks = 0;   // Vehicles in the longest lane
+
+        // Per lane, stride entries
+        std::vector<double> stop_line;
+        std::vector<double> stop_target;
+        std::vector<std::size_t> lane_ranks;  // Vehicles in the lane
+
+        // Per slot, ranks * stride entries. position and speed are updated in place.
+        std::vector<double> position;
+        std::vector<double> speed;
+        std::vector<double> can_move;  // 1 when the signal lets the vehicle go, else 0
+        std::vector<double> length_m;
+        std::vector<double> accel;
+        std::vector<double> decel;
+        std::vector<double> desired_speed;
+        std::vector<double> headway_s;
+
+        // Sizes the arrays for lanes lanes of at most max_rank_count vehicles, all empty. The arrays only grow.
+        void reset(std::size_t lanes, std::size_t max_rank_count);
+        std::size_t slot(std::size_t rank, std::size_t lane) const {
+            return ((lane / kWidth) * ranks + rank) * kWidth + lane % kWidth;
+        }
+        void setLane(std::size_t lane, double lane_stop_line, double lane_stop_target, std::size_t vehicle_count);
+        void setVehicle(std::size_t rank, std::size_t lane, const Vehicle& vehicle, bool vehicle_can_move);
+    };
+
+    // One kinematics step of dt_seconds for every real slot, lane by lane and leader first
+    void advanceCarFollowing(CarFollowingBatch& batch, double dt_seconds);
+}  // namespace crossroads
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace crossroads {
+    // One config of a named-config bundle: NDJSON with one {"name": ..., "config": {...}} object per line.
+    struct ConfigBundleEntry {
+        std::string name;
+        std::string config_json;  // Normalized
+    };
+
+    struct ConfigBundleParseResult {
+        bool ok = false;
+        std::vector<ConfigBundleEntry> entries;  // In line order
+        std::vector<std::string> errors;         // "line N: ...", in line order
+    };
+
+    // Parses every line and checks it with SafetyChecker on worker_count threads (0 = hardware concurrency).
+    // Blank lines are skipped; names are trimmed and must be unique within the bundle. ok only when every line
+    // is a valid config, so a bundle is imported whole or not at all.
+    ConfigBundleParseResult parseConfigBundle(const std::string& ndjson, std::size_t worker_count = 0);
+
+    // Appends the bundle line for a stored config, newline included. config_json is embedded as is.
+    void appendConfigBundleLine(std::string& out, const std::string& name, const std::string& config_json);
+}  // namespace crossroads
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "IntersectionConfig.hpp"
+#include "IntersectionTopology.hpp"
+
+namespace crossroads {
+    // Compile-time tables for the makeDefaultIntersectionConfig() layout: four approaches, each with straight lanes
+    // 0-1 and an exclusive right-turn lane 2. Engines built from a matching config load these instead of sampling
+    // connection geometry and searching lane vectors.
+    struct DefaultIntersectionLayout {
+        static constexpr std::size_t kApproachCount = 4;
+        static constexpr std::size_t kLanesPerApproach = 3;
+        static constexpr std::size_t kRouteCount = kApproachCount * 3;
+        static constexpr std::size_t kRightTurnLaneIndex = 2;
+
+        // Indexed like the scheduler routes: approach * 3 + movement (straight, left, right).
+        static constexpr std::array<bool, kRouteCount> kRouteConfigured = [] {
+            std::array<bool, kRouteCount> configured{};
+            for (std::size_t approach = 0; approach < kApproachCount; ++approach) {
+                configured[approach * 3 + static_cast<std::size_t>(MovementType::Straight)] = true;
+                configured[approach * 3 + static_cast<std::size_t>(MovementType::Right)] = true;
+            }
+            return configured;
+        }();
+
+        // Straight movements of perpendicular approaches cross; right turns each merge into a lane nobody else uses.
+        static constexpr std::array<std::array<bool, kRouteCount>, kRouteCount> kRouteConflicts = [] {
+            std::array<std::array<bool, kRouteCount>, kRouteCount> conflicts{};
+            constexpr std::size_t straight = static_cast<std::size_t>(MovementType::Straight);
+            for (std::size_t lhs = 0; lhs < kApproachCount; ++lhs) {
+                for (std::size_t rhs = 0; rhs < kApproachCount; ++rhs) {
+                    conflicts[lhs * 3 + straight][rhs * 3 + straight] = (lhs + rhs) % 2 == 1;
+                }
+            }
+            return conflicts;
+        }();
+
+        // kRouteConflicts as one bit mask per route, the form the engine keeps.
+        static constexpr std::array<RouteMask, kRouteCount> kRouteConflictMasks = [] {
+            std::array<RouteMask, kRouteCount> masks{};
+            for (std::size_t lhs = 0; lhs < kRouteCount; ++lhs) {
+                for (std::size_t rhs = 0; rhs < kRouteCount; ++rhs) {
+                    if (kRouteConflicts[lhs][rhs]) {
+                        masks[lhs] |= RouteMask{1} << rhs;
+                    }
+                }
+            }
+            return masks;
+        }();
+    };
+
+    // True when the config is the default layout lane for lane and connection for connection; names are ignored.
+    inline bool matchesDefaultIntersectionLayout(const IntersectionConfig& config) {
+        static const IntersectionConfig reference = makeDefaultIntersectionConfig();
+        return config.signal_groups.empty() && sameLaneLayout(config, reference);
+    }
+}  // namespace crossroads
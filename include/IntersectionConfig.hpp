@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cmath>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -10,6 +11,10 @@ namespace crossroads {
 
     enum class MovementType : uint8_t { Straight = 0, Left = 1, Right = 2 };
 
+    // Small id into the per-class tables (see vehicleClassParams in Vehicle.hpp)
+    enum class VehicleClass : uint8_t { Car = 0, Truck = 1, Bus = 2, Bicycle = 3 };
+    constexpr std::size_t kVehicleClassCount = 4;
+
     using LaneId = uint16_t;
     using SignalGroupId = uint16_t;
 
@@ -60,13 +65,47 @@ namespace crossroads {
         bool has_traffic_light = true;
     };
 
+    constexpr double kDefaultApproachLengthMeters = 70.0;
+    constexpr double kMinApproachLengthMeters = 20.0;
+    constexpr double kMaxApproachLengthMeters = 5000.0;
+    constexpr double kStopTargetOffsetMeters = 0.5;   // Vehicles stop this far before the stop line
+    constexpr double kQueuedVehicleSpacingMeters = 6.0;  // Front to front when stopped: 4 m car + 2 m gap
+    constexpr uint16_t kMaxLaneCapacity = 1000;
+
     struct ApproachConfig {
         ApproachId id = ApproachId::North;
         std::string name;
         std::vector<LaneConfig> lanes;
         uint16_t to_lane_count = 1;
+        double length_m = kDefaultApproachLengthMeters;  // Spawn point to stop line
+        uint16_t lane_capacity = 0;                      // Vehicles per lane; 0 = as many as fit in length_m
+        // Share of the spawns per VehicleClass; the car share is what the other classes leave
+        std::array<double, kVehicleClassCount> vehicle_mix{1.0, 0.0, 0.0, 0.0};
     };
 
+    inline double stopTargetPosition(const ApproachConfig& approach) {
+        return approach.length_m - kStopTargetOffsetMeters;
+    }
+
+    inline std::size_t effectiveLaneCapacity(const ApproachConfig& approach) {
+        if (approach.lane_capacity > 0) {
+            return approach.lane_capacity;
+        }
+        return static_cast<std::size_t>(approach.length_m / kQueuedVehicleSpacingMeters) + 1;
+    }
+
+    // Every share within [0, 1] and together 1
+    inline bool validVehicleMix(const std::array<double, kVehicleClassCount>& mix) {
+        double total = 0.0;
+        for (double share : mix) {
+            if (!(share >= 0.0 && share <= 1.0)) {
+                return false;
+            }
+            total += share;
+        }
+        return std::abs(total - 1.0) < 1e-9;
+    }
+
     inline std::size_t effectiveToLaneCount(const ApproachConfig& approach) {
         if (approach.to_lane_count > 0) {
             return approach.to_lane_count;
@@ -100,6 +139,85 @@ namespace crossroads {
         std::vector<LaneConnectionConfig> lane_connections;
     };
 
+    // Same lanes, lane properties and lane connections; names may differ. Everything routing depends on.
+    inline bool sameLaneLayout(const IntersectionConfig& lhs, const IntersectionConfig& rhs) {
+        for (std::size_t a = 0; a < lhs.approaches.size(); ++a) {
+            const ApproachConfig& left = lhs.approaches[a];
+            const ApproachConfig& right = rhs.approaches[a];
+            if (left.id != right.id || left.to_lane_count != right.to_lane_count ||
+                left.lanes.size() != right.lanes.size()) {
+                return false;
+            }
+            for (std::size_t i = 0; i < left.lanes.size(); ++i) {
+                const LaneConfig& l = left.lanes[i];
+                const LaneConfig& r = right.lanes[i];
+                if (l.id != r.id || l.allowed_movements != r.allowed_movements ||
+                    l.supports_lane_change != r.supports_lane_change ||
+                    l.connected_to_intersection != r.connected_to_intersection ||
+                    l.has_traffic_light != r.has_traffic_light) {
+                    return false;
+                }
+            }
+        }
+
+        if (lhs.lane_connections.size() != rhs.lane_connections.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < lhs.lane_connections.size(); ++i) {
+            const LaneConnectionConfig& l = lhs.lane_connections[i];
+            const LaneConnectionConfig& r = rhs.lane_connections[i];
+            if (l.from_approach != r.from_approach || l.from_lane_index != r.from_lane_index ||
+                l.movement != r.movement || l.to_approach != r.to_approach || l.to_lane_index != r.to_lane_index) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Same signal groups, in the same order, releasing the same lanes and movements; timing and names may differ.
+    inline bool sameSignalPlan(const IntersectionConfig& lhs, const IntersectionConfig& rhs) {
+        if (lhs.signal_groups.size() != rhs.signal_groups.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < lhs.signal_groups.size(); ++i) {
+            const SignalGroupConfig& l = lhs.signal_groups[i];
+            const SignalGroupConfig& r = rhs.signal_groups[i];
+            if (l.id != r.id || l.controlled_lanes != r.controlled_lanes || l.green_movements != r.green_movements) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Equal in every field, names and timing included; what caches of anything derived from a config compare.
+    inline bool sameIntersectionConfig(const IntersectionConfig& lhs, const IntersectionConfig& rhs) {
+        if (!sameLaneLayout(lhs, rhs) || !sameSignalPlan(lhs, rhs)) {
+            return false;
+        }
+        for (std::size_t a = 0; a < lhs.approaches.size(); ++a) {
+            const ApproachConfig& left = lhs.approaches[a];
+            const ApproachConfig& right = rhs.approaches[a];
+            if (left.name != right.name || left.length_m != right.length_m ||
+                left.lane_capacity != right.lane_capacity || left.vehicle_mix != right.vehicle_mix) {
+                return false;
+            }
+            for (std::size_t i = 0; i < left.lanes.size(); ++i) {
+                if (left.lanes[i].name != right.lanes[i].name) {
+                    return false;
+                }
+            }
+        }
+        for (std::size_t i = 0; i < lhs.signal_groups.size(); ++i) {
+            const SignalGroupConfig& l = lhs.signal_groups[i];
+            const SignalGroupConfig& r = rhs.signal_groups[i];
+            if (l.name != r.name || l.min_green_seconds != r.min_green_seconds ||
+                l.orange_seconds != r.orange_seconds) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     inline IntersectionConfig makeDefaultIntersectionConfig() {
         IntersectionConfig config;
 
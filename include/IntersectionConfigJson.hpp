@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -15,4 +16,10 @@ namespace crossroads {
     std::string intersectionConfigToJson(const IntersectionConfig& config);
     ConfigParseResult intersectionConfigFromJson(const std::string& json_text);
     std::string validationErrorsToJson(const std::vector<std::string>& errors);
+    // Stable 64-bit FNV-1a hash of the normalized JSON, computed without building the JSON text. Equal configs
+    // hash equal, so caches use it to find an entry; they confirm a hit with sameIntersectionConfig.
+    uint64_t intersectionConfigFingerprint(const IntersectionConfig& config);
+    // The fingerprint as 16 hex digits, the form stored alongside configs and runs.
+    std::string intersectionConfigHash(uint64_t fingerprint);
+    std::string intersectionConfigHash(const IntersectionConfig& config);
 }  // namespace crossroads
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+
+namespace crossroads {
+    constexpr std::size_t kMinTopologyArms = 3;
+    constexpr std::size_t kMaxTopologyArms = 4;
+
+    // One bit per route. Four arms have 4 * 3 = 12 routes, so a 16-bit word covers every supported junction.
+    using RouteMask = uint16_t;
+
+    struct TopologyArm {
+        std::string name;
+        double heading_degrees = 0.0;  // Direction of the arm seen from the centre: 0 = north, clockwise
+        uint16_t lane_count = 0;       // Inbound lanes
+        uint16_t to_lane_count = 0;    // Outbound lanes
+    };
+
+    struct TopologyConnection {
+        uint8_t from_arm = 0;
+        uint16_t from_lane_index = 0;
+        uint8_t to_arm = 0;
+        uint16_t to_lane_index = 0;
+    };
+
+    // A route is an (inbound arm, outbound arm) pair. movement classifies the turn for right-hand traffic:
+    // within 45 degrees of straight on is Straight, sharper to the left or right is Left or Right.
+    struct TopologyRoute {
+        uint8_t from_arm = 0;
+        uint8_t to_arm = 0;
+        MovementType movement = MovementType::Straight;
+        bool configured = false;  // Some connection uses it
+    };
+
+    // A junction with three or four arms at the given headings. Routes of one arm are numbered consecutively,
+    // ordered by movement (straight, left, right) and then by turn angle, so the four-arm instance numbers them
+    // approach * 3 + movement like the scheduler does. Two routes conflict when they share a destination lane or
+    // their connection paths cross in the intersection core; a straight route and its exact reverse never
+    // conflict. See ADR-0005.
+    class IntersectionTopology {
+       public:
+        IntersectionTopology() = default;
+
+        // Conflicts are computed on worker_count threads (0 = hardware concurrency) for large junctions.
+        static bool build(std::vector<TopologyArm> arms,
+                          std::vector<TopologyConnection> connections,
+                          IntersectionTopology& topology,
+                          std::string* error = nullptr,
+                          std::size_t worker_count = 0);
+
+        std::size_t armCount() const {
+            return arms.size();
+        }
+        const TopologyArm& arm(std::size_t index) const {
+            return arms[index];
+        }
+        const std::vector<TopologyConnection>& connections() const {
+            return connection_list;
+        }
+        std::size_t routeCount() const {
+            return route_list.size();
+        }
+        const std::vector<TopologyRoute>& routes() const {
+            return route_list;
+        }
+        // -1 for a U-turn or an arm out of range
+        int routeIndex(std::size_t from_arm, std::size_t to_arm) const;
+        RouteMask configuredRoutes() const {
+            return configured_mask;
+        }
+        RouteMask conflictMask(std::size_t route) const {
+            return conflict_masks[route];
+        }
+        bool conflicts(std::size_t lhs, std::size_t rhs) const {
+            return (conflict_masks[lhs] >> rhs) & 1u;
+        }
+
+       private:
+        std::vector<TopologyArm> arms;
+        std::vector<TopologyConnection> connection_list;
+        std::vector<TopologyRoute> route_list;
+        std::vector<int> route_by_arm_pair;  // from_arm * armCount() + to_arm
+        std::vector<RouteMask> conflict_masks;
+        RouteMask configured_mask = 0;
+    };
+
+    // The four-approach model as a topology: arms in ApproachId order at 0, 90, 180 and 270 degrees.
+    IntersectionTopology topologyFor(const IntersectionConfig& config, std::size_t worker_count = 0);
+}  // namespace crossroads
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+#include "RingQueue.hpp"
+#include "StateStream.hpp"
+#include "Vehicle.hpp"
+
+namespace crossroads {
+    struct MesoscopicSettings {
+        double saturation_flow_per_hour = 1800.0;  // Per lane, while the vehicle at the head may go
+        double free_flow_speed = 10.0;             // m/s from the spawn point to the stop line
+    };
+
+    // Where a lane's vehicles of one movement go, resolved like TrafficGenerator routes a vehicle.
+    struct MesoscopicRoute {
+        ApproachId destination_approach = ApproachId::North;
+        uint16_t destination_lane_index = 0;
+        LaneId destination_lane_id = 0;
+    };
+
+    // Point-queue state of one approach lane. Vehicles reach the stop line length_m / free_flow_speed after they
+    // spawn and then queue there without a position. The head discharges at the saturation flow while its signal
+    // allows it, so the cost of a tick does not depend on how many vehicles are queued.
+    struct MesoscopicLane {
+        struct Entry {
+            uint32_t id = 0;
+            MovementType movement = MovementType::Straight;
+            VehicleClass vehicle_class = VehicleClass::Car;
+            double spawn_time = 0.0;
+            double stop_line_time = 0.0;
+        };
+
+        LaneId lane_id = 0;
+        RingQueue<Entry> vehicles;           // Spawn order; the first at_line have reached the stop line
+        std::size_t at_line = 0;
+        std::array<uint32_t, 3> queued{};    // By MovementType, including those at the line
+        std::array<uint32_t, 3> stopped{};   // At the stop line, by MovementType
+        std::array<uint32_t, 3> crossing{};  // Discharged and still in the intersection, by MovementType
+        std::array<MesoscopicRoute, 3> routes{};
+        double discharge_credit = 0.0;  // In passenger car equivalents (VehicleClassParams::pce)
+    };
+
+    struct MesoscopicCrossing {
+        uint32_t id = 0;
+        uint16_t lane_index = 0;
+        MovementType movement = MovementType::Straight;
+        VehicleClass vehicle_class = VehicleClass::Car;
+        double spawn_time = 0.0;
+        double start_time = 0.0;
+        double finish_time = 0.0;
+    };
+
+    struct MesoscopicApproach {
+        std::vector<MesoscopicLane> lanes;  // Indexed like ApproachConfig::lanes
+        std::vector<MesoscopicCrossing> crossing;
+        std::size_t queued = 0;             // Not yet discharged, all lanes
+        double queued_spawn_time_sum = 0.0;
+    };
+
+    // Mesoscopic counterpart of the per-vehicle queues in TrafficGenerator, indexed by ApproachId.
+    class MesoscopicQueues {
+       public:
+        struct StepResult {
+            uint32_t crossed = 0;
+            double crossed_wait_seconds = 0.0;
+            bool changed = false;  // A vehicle reached the stop line, started or finished crossing
+        };
+
+        // Rebuilds the lanes for a config. Vehicles on a lane that still exists and still allows their movement
+        // stay; the others are removed. Returns the number removed.
+        std::size_t configure(const IntersectionConfig& config);
+        void clear();
+
+        const MesoscopicApproach& approach(ApproachId approach) const {
+            return approaches[approachIndex(approach)];
+        }
+        std::size_t queuedOnLane(ApproachId approach, std::size_t lane_index) const;
+        std::size_t queued() const;
+        // Queued plus crossing, like the length of a TrafficGenerator queue
+        std::size_t vehicleCount(ApproachId approach) const;
+        double queuedDelaySeconds(double current_time) const;
+
+        void admit(ApproachId approach,
+                   std::size_t lane_index,
+                   uint32_t id,
+                   MovementType movement,
+                   VehicleClass vehicle_class,
+                   const MesoscopicRoute& route,
+                   double spawn_time,
+                   double stop_line_time);
+
+        // A stand-in for the vehicles of one lane and movement, for signal and demand rules written per vehicle.
+        Vehicle proxyVehicle(ApproachId approach, std::size_t lane_index, MovementType movement) const;
+
+        // Moves arrivals to the stop line, discharges lane heads that may_go allows and finishes crossings. The
+        // saturation flow is in passenger car equivalents, so a truck takes longer to discharge than a car.
+        StepResult advance(double dt_seconds,
+                           double current_time,
+                           double saturation_flow_per_second,
+                           const std::function<bool(Direction, const Vehicle&)>& may_go);
+
+        void saveState(StateWriter& writer) const;
+        bool loadState(StateReader& reader);
+
+       private:
+        std::array<MesoscopicApproach, 4> approaches;
+    };
+}  // namespace crossroads
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace crossroads {
+    // Threads for a worker_count option: the value itself, or the hardware concurrency (at least 1) for 0.
+    inline std::size_t resolveWorkerCount(std::size_t worker_count) {
+        return worker_count > 0 ? worker_count : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Calls body(index, slot) once for every index in [0, count) on worker_count threads (0 = hardware
+    // concurrency, never more than count), the calling thread included, and returns when all calls are done.
+    // Indices are handed out one at a time, so uneven items balance out; slot < worker_count names the thread,
+    // for per-thread results.
+    template <typename Body>
+    void parallelFor(std::size_t count, std::size_t worker_count, Body&& body) {
+        if (count == 0) {
+            return;
+        }
+        worker_count = std::min(resolveWorkerCount(worker_count), count);
+
+        std::atomic<std::size_t> next_index{0};
+        auto worker = [&](std::size_t slot) {
+            for (std::size_t i = next_index.fetch_add(1); i < count; i = next_index.fetch_add(1)) {
+                body(i, slot);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(worker_count - 1);
+        for (std::size_t slot = 1; slot < worker_count; ++slot) {
+            workers.emplace_back(worker, slot);
+        }
+        worker(0);
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
+}  // namespace crossroads
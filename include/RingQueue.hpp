@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace crossroads {
+    // FIFO on a ring buffer that only grows, for the vehicle queues. Once a queue has held its peak load, pushing,
+    // popping and erasing no longer touch the heap; copies reuse the target's storage too. Erasing from the middle
+    // shifts the shorter side.
+    template <typename T>
+    class RingQueue {
+       public:
+        template <bool Const>
+        class Iterator {
+           public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const T*, T*>;
+            using reference = std::conditional_t<Const, const T&, T&>;
+            using Queue = std::conditional_t<Const, const RingQueue, RingQueue>;
+
+            Iterator() = default;
+            Iterator(Queue* queue, std::size_t index) : queue(queue), index(index) {
+            }
+            template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+            Iterator(const Iterator<OtherConst>& other) : queue(other.queue), index(other.index) {
+            }
+
+            reference operator*() const {
+                return (*queue)[index];
+            }
+            pointer operator->() const {
+                return &(*queue)[index];
+            }
+            reference operator[](difference_type offset) const {
+                return (*queue)[static_cast<std::size_t>(static_cast<difference_type>(index) + offset)];
+            }
+
+            Iterator& operator++() {
+                ++index;
+                return *this;
+            }
+            Iterator operator++(int) {
+                Iterator copy = *this;
+                ++index;
+                return copy;
+            }
+            Iterator& operator--() {
+                --index;
+                return *this;
+            }
+            Iterator operator--(int) {
+                Iterator copy = *this;
+                --index;
+                return copy;
+            }
+            Iterator& operator+=(difference_type offset) {
+                index = static_cast<std::size_t>(static_cast<difference_type>(index) + offset);
+                return *this;
+            }
+            Iterator& operator-=(difference_type offset) {
+                return *this += -offset;
+            }
+            friend Iterator operator+(Iterator it, difference_type offset) {
+                return it += offset;
+            }
+            friend Iterator operator+(difference_type offset, Iterator it) {
+                return it += offset;
+            }
+            friend Iterator operator-(Iterator it, difference_type offset) {
+                return it -= offset;
+            }
+            friend difference_type operator-(const Iterator& a, const Iterator& b) {
+                return static_cast<difference_type>(a.index) - static_cast<difference_type>(b.index);
+            }
+            friend bool operator==(const Iterator& a, const Iterator& b) {
+                return a.index == b.index;
+            }
+            friend bool operator!=(const Iterator& a, const Iterator& b) {
+                return a.index != b.index;
+            }
+            friend bool operator<(const Iterator& a, const Iterator& b) {
+                return a.index < b.index;
+            }
+            friend bool operator>(const Iterator& a, const Iterator& b) {
+                return a.index > b.index;
+            }
+            friend bool operator<=(const Iterator& a, const Iterator& b) {
+                return a.index <= b.index;
+            }
+            friend bool operator>=(const Iterator& a, const Iterator& b) {
+                return a.index >= b.index;
+            }
+
+           private:
+            friend class RingQueue;
+            friend class Iterator<!Const>;
+
+            Queue* queue = nullptr;
+            std::size_t index = 0;
+        };
+
+        using value_type = T;
+        using size_type = std::size_t;
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        RingQueue() = default;
+        RingQueue(const RingQueue& other) = default;
+        RingQueue& operator=(const RingQueue& other) = default;  // std::vector keeps its buffer when it fits
+        RingQueue(RingQueue&& other) noexcept {
+            *this = std::move(other);
+        }
+        RingQueue& operator=(RingQueue&& other) noexcept {
+            slots.swap(other.slots);
+            head = other.head;
+            count = other.count;
+            other.clear();
+            return *this;
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+        bool empty() const {
+            return count == 0;
+        }
+        std::size_t capacity() const {
+            return slots.size();
+        }
+
+        T& operator[](std::size_t index) {
+            return slots[slot(index)];
+        }
+        const T& operator[](std::size_t index) const {
+            return slots[slot(index)];
+        }
+        T& front() {
+            return slots[head];
+        }
+        const T& front() const {
+            return slots[head];
+        }
+        T& back() {
+            return (*this)[count - 1];
+        }
+        const T& back() const {
+            return (*this)[count - 1];
+        }
+
+        iterator begin() {
+            return {this, 0};
+        }
+        iterator end() {
+            return {this, count};
+        }
+        const_iterator begin() const {
+            return {this, 0};
+        }
+        const_iterator end() const {
+            return {this, count};
+        }
+
+        void clear() {
+            head = 0;
+            count = 0;
+        }
+
+        void push_back(const T& value) {
+            if (count == slots.size()) {
+                grow(value);
+            }
+            slots[slot(count)] = value;
+            ++count;
+        }
+
+        void pop_front() {
+            head = slot(1);
+            --count;
+        }
+
+        iterator erase(const_iterator position) {
+            const std::size_t index = position.index;
+            if (index < count / 2) {
+                for (std::size_t i = index; i > 0; --i) {
+                    (*this)[i] = (*this)[i - 1];
+                }
+                pop_front();
+            } else {
+                for (std::size_t i = index; i + 1 < count; ++i) {
+                    (*this)[i] = (*this)[i + 1];
+                }
+                --count;
+            }
+            return {this, index};
+        }
+
+        iterator erase(const_iterator first, const_iterator last) {
+            const std::size_t index = first.index;
+            const std::size_t removed = last.index - first.index;
+            for (std::size_t i = last.index; i < count; ++i) {
+                (*this)[i - removed] = (*this)[i];
+            }
+            count -= removed;
+            return {this, index};
+        }
+
+       private:
+        // Doubles the ring and unwraps it. T need not be default-constructible: free slots hold copies of filler.
+        void grow(const T& filler) {
+            const std::size_t grown = slots.empty() ? 16 : slots.size() * 2;
+            std::vector<T> resized;
+            resized.reserve(grown);
+            for (std::size_t i = 0; i < count; ++i) {
+                resized.push_back((*this)[i]);
+            }
+            resized.resize(grown, filler);
+            slots.swap(resized);
+            head = 0;
+        }
+
+        std::size_t slot(std::size_t index) const {
+            const std::size_t position = head + index;
+            return position < slots.size() ? position : position - slots.size();
+        }
+
+        std::vector<T> slots;  // Every slot holds a T; only count of them, from head on, are live
+        std::size_t head = 0;
+        std::size_t count = 0;
+    };
+}  // namespace crossroads
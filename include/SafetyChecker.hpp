@@ -23,6 +23,7 @@ namespace crossroads {
         // Helper methods for isSafe()
         bool hasConflictingGreens(const IntersectionState& state) const;
         bool checkTurningLightSafety(const IntersectionState& state) const;
+        bool turningPairConflicts(ApproachId from_a, MovementType move_a, ApproachId from_b, MovementType move_b) const;
 
         // Helper methods for isValidTransition()
         bool checkPerLightTransitions(const IntersectionState& prev, const IntersectionState& next) const;
@@ -30,6 +31,7 @@ namespace crossroads {
         bool checkCrossingLightSafety(const IntersectionState& prev, const IntersectionState& next) const;
         bool checkTurningLightTransitions(const IntersectionState& next) const;
 
+        bool validateConfigCached(const IntersectionConfig& config) const;
         bool validateConfig(const IntersectionConfig& config) const;
         static ApproachId destinationFor(ApproachId from, MovementType movement);
         static bool isInNorthSouthCorridor(ApproachId from, MovementType movement);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+#include "SimulatorEngine.hpp"
+#include "TrafficGenerator.hpp"
+
+namespace crossroads {
+    // One external input to a live session. Events are keyed by the sim-loop tick they arrived before.
+    struct SessionEvent {
+        // ApplyConfig rebuilds the engine (cold start); SwapConfig reconfigures it in place (applyConfigLive).
+        enum class Type : uint8_t { Command = 1, ApplyConfig = 2, SpawnFilter = 3, TrafficRate = 4, SwapConfig = 5 };
+
+        Type type = Type::Command;
+        uint64_t tick = 0;
+        SimulatorEngine::UICommand command = SimulatorEngine::UICommand::Start;
+        double dt = 0.1;                // Command
+        std::string config_json;        // ApplyConfig, SwapConfig
+        std::optional<TrafficGenerator::SpawnLaneFilter> spawn_filter;  // SpawnFilter
+        double traffic_rate = 0.0;      // TrafficRate
+
+        static SessionEvent makeCommand(SimulatorEngine::UICommand command, double dt = 0.1);
+        static SessionEvent makeApplyConfig(const IntersectionConfig& config);
+        static SessionEvent makeSwapConfig(const IntersectionConfig& config);
+        static SessionEvent makeSpawnFilter(const std::optional<TrafficGenerator::SpawnLaneFilter>& filter);
+        static SessionEvent makeTrafficRate(double rate);
+    };
+
+    // Session-level inputs that outlive one engine (a config swap builds a new engine from them).
+    struct SessionInputs {
+        double traffic_rate = 0.5;
+        double ns_duration = 10.0;
+        double ew_duration = 10.0;
+        std::optional<TrafficGenerator::SpawnLaneFilter> spawn_filter;
+        SimulatorEngine::SchedulerMode scheduler_mode = SimulatorEngine::SchedulerMode::Adaptive;
+    };
+
+    // Applies one input the way the live server does. main.cpp and SessionReplayer both go through here, so a
+    // replay cannot drift from what was recorded. swap_report, when given, receives the outcome of a SwapConfig.
+    void applySessionEvent(SimulatorEngine& engine,
+                           SessionInputs& inputs,
+                           const SessionEvent& event,
+                           ConfigSwapReport* swap_report = nullptr);
+
+    struct SessionJournal {
+        double tick_seconds = 0.1;
+        SessionInputs initial_inputs;
+        std::string initial_config_json;
+        std::vector<SessionEvent> events;  // Ascending tick
+        uint64_t end_tick = 0;             // Last tick the recorder confirmed
+        bool truncated = false;            // Tail cut off mid-record (e.g. the process was killed)
+    };
+
+    // Append-only binary journal: a header with the starting state, then one small record per input and a
+    // progress marker every kProgressInterval ticks. Ticks are delta-encoded varints.
+    class SessionRecorder {
+       public:
+        static constexpr uint64_t kProgressInterval = 50;
+
+        SessionRecorder() = default;
+        ~SessionRecorder();
+
+        SessionRecorder(const SessionRecorder&) = delete;
+        SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+        bool open(const std::string& path,
+                  const IntersectionConfig& config,
+                  const SessionInputs& inputs,
+                  double tick_seconds,
+                  std::string* error = nullptr);
+        bool isOpen() const;
+        void record(const SessionEvent& event);
+        // Call once per sim-loop tick, after the engine ticked.
+        void advanceTick();
+        uint64_t tick() const;
+        void close();
+
+       private:
+        void writeRecordHead(uint8_t type);
+
+        std::ofstream out;
+        uint64_t current_tick = 0;
+        uint64_t last_record_tick = 0;
+    };
+
+    bool readSessionJournal(const std::string& path, SessionJournal& journal, std::string* error = nullptr);
+
+    // Re-runs a journal at full speed. Engine checkpoints are taken every checkpoint_interval ticks on the way,
+    // so seeking back only replays from the nearest earlier checkpoint.
+    class SessionReplayer {
+       public:
+        explicit SessionReplayer(SessionJournal journal, uint64_t checkpoint_interval = 600);
+
+        uint64_t tick() const;
+        uint64_t endTick() const;
+        const SimulatorEngine& engine() const;
+        std::size_t checkpointCount() const;
+
+        // Runs forward to the given tick (clamped to the journal end). Never goes backwards.
+        void runTo(uint64_t target_tick);
+        void seek(uint64_t target_tick);
+        // Runs until safety_violations increases; returns the tick after the violating tick.
+        std::optional<uint64_t> runToNextSafetyViolation();
+
+       private:
+        struct Checkpoint {
+            std::string config_json;
+            SessionInputs inputs;
+            std::size_t next_event = 0;
+            std::unique_ptr<SimulatorEngine> engine;
+        };
+
+        void restart();
+        void stepOnce();
+        void maybeCheckpoint();
+        std::unique_ptr<SimulatorEngine> makeEngine(const std::string& config_json) const;
+
+        SessionJournal journal;
+        uint64_t checkpoint_interval;
+        std::unique_ptr<SimulatorEngine> current_engine;
+        SessionInputs inputs;
+        std::string config_json;
+        std::size_t next_event = 0;
+        uint64_t current_tick = 0;
+        std::map<uint64_t, Checkpoint> checkpoints;
+    };
+}  // namespace crossroads
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+
+namespace crossroads {
+    struct LaneDemand {
+        LaneId lane_id = 0;
+        double vehicles_per_hour = 0.0;
+    };
+
+    struct SignalPlanOptimizerOptions {
+        double saturation_flow_per_lane_hour = 1800.0;
+        double startup_lost_seconds = 2.0;  // Lost time per phase on top of its orange time
+        double min_green_seconds = 3.0;
+        double max_green_seconds = 60.0;
+        double min_cycle_seconds = 20.0;
+        double max_cycle_seconds = 150.0;
+        double evaluation_seconds = 300.0;  // Simulated time per candidate plan
+        double time_step_seconds = 0.1;
+        std::size_t max_evaluations = 200;
+        std::size_t worker_count = 0;  // 0 = hardware concurrency
+        bool search_phase_order = true;
+    };
+
+    struct SignalPlanResult {
+        bool ok = false;
+        IntersectionConfig config{};
+        std::string config_json;
+        double cycle_seconds = 0.0;
+        double average_delay_seconds = 0.0;
+        double initial_average_delay_seconds = 0.0;  // Delay of the Webster starting plan
+        std::size_t evaluations = 0;
+        std::vector<std::string> errors;
+    };
+
+    class SignalPlanOptimizer {
+       public:
+        explicit SignalPlanOptimizer(SignalPlanOptimizerOptions options = {});
+
+        // Webster cycle and green splits for the config's signal groups; phase order is kept.
+        IntersectionConfig websterPlan(const IntersectionConfig& config, const std::vector<LaneDemand>& demand) const;
+
+        // Average delay per generated vehicle for a fixed-time plan, simulated headless.
+        double evaluatePlan(const IntersectionConfig& config, const std::vector<LaneDemand>& demand) const;
+
+        // Webster initialization followed by local search over greens, cycle length and phase order.
+        SignalPlanResult optimize(const IntersectionConfig& config, const std::vector<LaneDemand>& demand) const;
+
+       private:
+        std::vector<double> evaluatePlans(const std::vector<IntersectionConfig>& candidates,
+                                          const std::vector<LaneDemand>& demand) const;
+
+        SignalPlanOptimizerOptions options;
+    };
+
+    double signalPlanCycleSeconds(const IntersectionConfig& config);
+}  // namespace crossroads
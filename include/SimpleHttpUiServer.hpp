@@ -8,21 +8,44 @@
 namespace crossroads {
     class SimpleHttpUiServer {
        public:
+        // Returns false once the peer is gone, so the stream can stop producing.
+        using BodyWriter = std::function<bool(const std::string&)>;
+        // Writes the body piece by piece; false when it failed and the response should not complete.
+        using BodyStream = std::function<bool(const BodyWriter&)>;
+
         struct ConfigMutationResult {
             int status_code = 200;
             std::string body;
+            std::string content_type = "application/json";
+            // When set, replaces body: each piece goes out as a chunk as soon as it is written, so a large body
+            // is never held in memory. A stream that fails before its first piece gets a 500 instead; one that
+            // fails later ends the response without its final chunk.
+            BodyStream stream{};
         };
 
-        using SnapshotProvider = std::function<std::string()>;
-        using CommandHandler = std::function<void(const std::string&)>;
+        // Both receive the full request path, so they can pick the session named by ?session=.
+        using SnapshotProvider = std::function<ConfigMutationResult(const std::string&)>;
+        // Receives the decoded cmd and the full request path.
+        using CommandHandler = std::function<ConfigMutationResult(const std::string&, const std::string&)>;
         using ConfigProvider = std::function<std::string()>;
         using ConfigMutationHandler = std::function<ConfigMutationResult(const std::string&)>;
+        // Receives the method and the full request path (query string included) for everything under /runs.
+        using RunsHandler = std::function<ConfigMutationResult(const std::string&, const std::string&)>;
+        // Receives the method, the full request path and the body for everything under /config/library.
+        using LibraryHandler =
+            std::function<ConfigMutationResult(const std::string&, const std::string&, const std::string&)>;
+        // Receives the method, the full request path and the body for everything under /sessions.
+        using SessionsHandler =
+            std::function<ConfigMutationResult(const std::string&, const std::string&, const std::string&)>;
 
         SimpleHttpUiServer(int port,
                            SnapshotProvider snapshot_provider,
                            CommandHandler command_handler,
                            ConfigProvider config_provider,
-                           ConfigMutationHandler config_mutation_handler);
+                           ConfigMutationHandler config_mutation_handler,
+                           RunsHandler runs_handler = nullptr,
+                           LibraryHandler library_handler = nullptr,
+                           SessionsHandler sessions_handler = nullptr);
         ~SimpleHttpUiServer();
 
         bool start();
@@ -34,6 +57,7 @@ namespace crossroads {
         std::string buildHttpResponse(const std::string& status,
                                       const std::string& content_type,
                                       const std::string& body) const;
+        void sendResult(int client_fd, const ConfigMutationResult& result) const;
 
         int port;
         int server_fd;
@@ -43,5 +67,8 @@ namespace crossroads {
         CommandHandler command_handler;
         ConfigProvider config_provider;
         ConfigMutationHandler config_mutation_handler;
+        RunsHandler runs_handler;
+        LibraryHandler library_handler;
+        SessionsHandler sessions_handler;
     };
 }  // namespace crossroads
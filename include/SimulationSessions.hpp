@@ -0,0 +1,174 @@
+#pragma once
+
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+#include "SessionJournal.hpp"
+#include "SimulatorEngine.hpp"
+
+namespace crossroads {
+    // One sandbox: an engine with its own config, spawn filter and rate, ticked by SimulationSessions.
+    struct SimulationSession {
+        SimulationSession(std::string id,
+                          const IntersectionConfig& config,
+                          const SessionInputs& inputs,
+                          double tick_seconds,
+                          std::chrono::milliseconds tick_interval);
+
+        const std::string id;
+        const double tick_seconds;                      // Sim time per tick
+        const std::chrono::milliseconds tick_interval;  // Wall time between ticks
+
+        std::mutex mutex;  // Guards everything below; hold it to read or drive the engine
+        SimulatorEngine engine;
+        SessionInputs inputs;
+        std::optional<IntersectionConfig> pending_config;  // Applied on the next start or reset
+        // Runs under mutex after every tick (journal, run history). Must not call back into SimulationSessions.
+        std::function<void(SimulationSession&)> after_tick;
+    };
+
+    struct SimulationSessionInfo {
+        std::string id;
+        bool pinned = false;
+        bool running = false;
+        double sim_time = 0.0;
+        double traffic_rate = 0.0;
+        double tick_seconds = 0.0;
+        int64_t tick_interval_ms = 0;
+        double idle_seconds = 0.0;  // Wall time since the session was last looked up
+        std::size_t home_worker = 0;
+    };
+
+    struct SimulationWorkerStats {
+        std::size_t worker = 0;
+        std::size_t home_sessions = 0;  // Sessions that run here unless another worker steals a tick
+        uint64_t ticks = 0;
+        uint64_t stolen_ticks = 0;  // Ticks of other workers' sessions
+        double busy_seconds = 0.0;
+        double utilization = 0.0;  // busy_seconds over the time from start() to now or stop(); 0 before start()
+    };
+
+    // Hosts independent SimulationSessions and ticks them on a shared pool of worker threads. Each session ticks
+    // once per its own tick_interval of wall time; a session that falls behind skips the backlog instead of
+    // bursting. Unpinned sessions that nobody looked up for idle_timeout are evicted to bound memory.
+    //
+    // Every session has a home worker (the least loaded one when it was added) whose queue holds its next tick,
+    // ordered by deadline, so a session keeps running on the same thread and its engine stays in that core's cache.
+    // A worker with nothing due steals the most overdue tick from the other queues; the session goes back to its
+    // home queue afterwards. A session has one tick queued or running at a time, so its ticks never overlap and
+    // run in order.
+    class SimulationSessions {
+       public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Limits {
+            std::size_t worker_count = 0;  // 0 = hardware concurrency
+            std::size_t max_sessions = 64;  // Pinned sessions included
+            std::chrono::milliseconds idle_timeout = std::chrono::minutes(30);
+        };
+
+        SimulationSessions();
+        explicit SimulationSessions(const Limits& limits);
+        ~SimulationSessions();
+
+        SimulationSessions(const SimulationSessions&) = delete;
+        SimulationSessions& operator=(const SimulationSessions&) = delete;
+
+        // Adds a session under a new id; nullptr when max_sessions is reached
+        std::shared_ptr<SimulationSession> create(const IntersectionConfig& config,
+                                                  const SessionInputs& inputs,
+                                                  double tick_seconds,
+                                                  std::chrono::milliseconds tick_interval,
+                                                  std::string* error = nullptr);
+        // Adds a session under a fixed id that is never evicted; nullptr when the id is taken or the limit reached
+        std::shared_ptr<SimulationSession> createPinned(const std::string& id,
+                                                        const IntersectionConfig& config,
+                                                        const SessionInputs& inputs,
+                                                        double tick_seconds,
+                                                        std::chrono::milliseconds tick_interval,
+                                                        std::string* error = nullptr);
+        // Looks a session up and marks it used; nullptr when unknown or evicted
+        std::shared_ptr<SimulationSession> find(const std::string& id);
+        // Pinned sessions cannot be destroyed. A worker still ticking the session finishes that tick.
+        bool destroy(const std::string& id, std::string* error = nullptr);
+        std::vector<SimulationSessionInfo> list() const;
+        std::size_t size() const;
+        std::vector<SimulationWorkerStats> workerStats() const;
+
+        // Removes the unpinned sessions idle for longer than idle_timeout at now; returns how many
+        std::size_t evictIdle(Clock::time_point now);
+        // Ticks every session due at now on the calling thread; returns the number of ticks. The workers do the
+        // same thing continuously; this is for tests and for hosting without workers.
+        std::size_t tickDue(Clock::time_point now);
+
+        void start();
+        void stop();
+
+       private:
+        // Scheduling state of one session; shared by the entries map and the queue holding its next tick
+        struct Slot {
+            std::shared_ptr<SimulationSession> session;
+            bool pinned = false;
+            std::size_t home = 0;
+            std::atomic<bool> removed{false};
+            Clock::time_point last_used;  // Guarded by mutex
+        };
+        struct Job {
+            Clock::time_point due;
+            std::shared_ptr<Slot> slot;
+        };
+        struct WorkerQueue {
+            std::mutex mutex;  // Guards everything below
+            std::condition_variable wake;
+            std::vector<Job> heap;  // Earliest due first
+            uint64_t ticks = 0;
+            uint64_t stolen_ticks = 0;
+            Clock::duration busy{};
+        };
+        static bool laterDue(const Job& a, const Job& b) {
+            return a.due > b.due;
+        }
+
+        std::shared_ptr<SimulationSession> add(std::string id,
+                                               bool pinned,
+                                               const IntersectionConfig& config,
+                                               const SessionInputs& inputs,
+                                               double tick_seconds,
+                                               std::chrono::milliseconds tick_interval,
+                                               std::string* error);
+        void schedule(Job job);
+        // Under mutex
+        void removeLocked(std::map<std::string, std::shared_ptr<Slot>>::iterator it);
+        std::size_t evictIdleLocked(Clock::time_point now);
+        // Takes the most overdue tick that is late by the steal grace from the queues other than worker's. When
+        // there is none, lowers next_stealable to when the earliest of those ticks will be.
+        bool steal(std::size_t worker, Clock::time_point now, Job* job, Clock::time_point* next_stealable);
+        // Ticks the job's session unless it was removed and queues its next tick, skipping any backlog at now.
+        // worker is the index whose statistics get the tick, or queues.size() for none.
+        bool runJob(Job job, std::size_t worker, Clock::time_point now);
+        void workerLoop(std::size_t worker);
+
+        Limits limits;
+        mutable std::mutex mutex;  // Guards entries, home_counts, next_id and each Slot's last_used
+        std::map<std::string, std::shared_ptr<Slot>> entries;
+        std::vector<std::size_t> home_counts;
+        uint64_t next_id = 1;
+        std::vector<std::unique_ptr<WorkerQueue>> queues;  // One per worker, fixed at construction
+        std::atomic<bool> stopping{false};
+        Clock::time_point started_at{};  // Guarded by mutex, like stopped_at
+        Clock::time_point stopped_at{};
+        std::vector<std::thread> workers;
+    };
+}  // namespace crossroads
@@ -1,13 +1,16 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "DefaultIntersectionLayout.hpp"
 #include "IntersectionConfig.hpp"
 #include "SafetyChecker.hpp"
+#include "StateStream.hpp"
 #include "TrafficGenerator.hpp"
 #include "TrafficLightControllers.hpp"
 
@@ -19,9 +22,19 @@ namespace crossroads {
         double average_wait_time = 0.0;
         std::array<size_t, 4> queue_lengths{};
         size_t total_queue_length = 0;
+        double queued_delay_seconds = 0.0;  // Delay accumulated so far by vehicles that have not crossed yet
         size_t safety_violations = 0;
     };
 
+    // Per-route state indexed like the scheduler (approach * 3 + movement), for external policies.
+    struct RouteObservation {
+        std::array<bool, 12> configured{};
+        std::array<int, 12> waiting{};
+        std::array<int, 12> stopped{};
+        std::array<double, 12> wait_seconds{};
+        std::array<LightState, 12> lights{};
+    };
+
     struct SimulatorSnapshot {
         double sim_time = 0.0;
         bool running = false;
@@ -29,12 +42,38 @@ namespace crossroads {
         IntersectionState lights;
     };
 
+    // Outcome of the last predictive scheduler decision. Costs are the rollout objective: waiting vehicle-seconds
+    // over the horizon, infinite for a rollout that hit a safety violation.
+    struct PredictiveDecision {
+        std::size_t rollout_ticks = 0;  // 0 when no rollouts ran and the greedy anchor stood unchecked
+        int forced_route = -1;          // Route index (approach * 3 + movement) forced as anchor; -1 = greedy kept
+        double greedy_cost = 0.0;       // Rollout under the greedy anchor
+        double chosen_cost = 0.0;       // Rollout under the anchor that was kept or forced
+    };
+
+    // What SimulatorEngine::applyConfigLive changed.
+    struct ConfigSwapReport {
+        bool layout_changed = false;       // Lanes or connections differ; route tables were rebuilt
+        bool timing_changed = false;       // Same signal plan with new timing; the running plan was retimed
+        bool signal_plan_changed = false;  // Signal groups differ; a running plan hands over via orange and all-red
+        std::size_t vehicles_kept = 0;
+        std::size_t vehicles_removed = 0;  // Waiting on lanes that no longer exist or no longer reach the exit
+    };
+
     class SimulatorEngine {
        public:
         enum class ControlMode { Basic, NullControl };
 
         enum class UICommand { Start, Stop, Reset, Step };
 
+        // Adaptive: route scheduler overrides the controller. FixedTime: controller output is used as-is.
+        // Predictive: adaptive, but anchor choices are checked with short rollouts of cloned engine state.
+        enum class SchedulerMode { Adaptive, FixedTime, Predictive };
+
+        // Microscopic follows every vehicle. Mesoscopic runs each lane as a point queue that discharges at the
+        // saturation flow (MesoscopicQueues): same metrics and signal logic, no per-vehicle positions.
+        enum class Fidelity { Microscopic, Mesoscopic };
+
         SimulatorEngine(double traffic_rate = 0.5, double ns_duration = 10.0, double ew_duration = 10.0);
         SimulatorEngine(const IntersectionConfig& intersection_config,
                         double traffic_rate,
@@ -60,24 +99,117 @@ namespace crossroads {
         std::optional<TrafficGenerator::SpawnLaneFilter> getSpawnLaneFilter() const;
         void setTrafficRate(double rate);
         double getTrafficRate() const;
+        void setApproachArrivalRates(const std::optional<std::array<double, 4>>& rates);
+        void setSchedulerMode(SchedulerMode mode);
+        SchedulerMode getSchedulerMode() const;
+        // Per engine, so per intersection. Switching drops the vehicles on the road.
+        void setFidelity(Fidelity fidelity, const MesoscopicSettings& settings = {});
+        Fidelity getFidelity() const;
+        // Rollout ticks the predictive scheduler may spend per decision, across all candidates.
+        void setPredictiveRolloutBudget(std::size_t max_rollout_ticks);
+        std::size_t getLastPredictiveRolloutTicks() const;
+        PredictiveDecision getLastPredictiveDecision() const;
+        // Fills caller-owned arrays; does not allocate.
+        void getRouteObservation(RouteObservation& observation) const;
+        std::size_t countWaitingVehicles() const;
+        double getSimTime() const;
+        // Vehicles queued or crossing on one approach, into a caller-owned buffer that is cleared first.
+        void getLaneVehicleStates(Direction dir, std::vector<LaneVehicleState>& states) const;
+        // The default 4x3 layout runs on compile-time route tables; disabling forces the generic path (for
+        // equivalence checks). Other layouts always use the generic path.
+        void setLayoutFastPathEnabled(bool enabled);
+        bool usesLayoutFastPath() const;
+        // Re-ranking routes only when a vehicle event, a threshold or a predicted rank change happens picks the
+        // same routes as re-ranking every tick; disabling re-ranks every tick (for equivalence checks).
+        void setIncrementalSchedulingEnabled(bool enabled);
+        // Number of times the scheduler re-ranked routes; quiet ticks reuse the previous anchor selection.
+        std::size_t getSchedulerSelectionCount() const;
+        // Takes over the complete simulation state of an engine built from the same config, controller
+        // included. False when the other engine's controller cannot be copied.
+        bool copyStateFrom(const SimulatorEngine& other);
+        // Versioned binary checkpoint of the complete simulation state, controller included. A checkpoint only
+        // loads into an engine built from the same config with the same controller type. A failed load leaves
+        // the engine as it was, or reset when its own controller cannot be checkpointed.
+        bool saveState(std::string& out, std::string* error = nullptr) const;
+        bool loadState(const std::string& bytes, std::string* error = nullptr);
+        // Switches a running engine to a new config without a restart: time, statistics and the vehicles that
+        // still have a lane are kept, route tables are rebuilt only when the lane layout changed, a timing-only
+        // change retimes the running plan and any other signal change hands over through orange and all-red.
+        // Fails, leaving the engine untouched, for configs that fail validation or when a custom controller
+        // would have to be rebuilt for a new signal plan.
+        bool applyConfigLive(const IntersectionConfig& config,
+                             ConfigSwapReport* report = nullptr,
+                             std::string* error = nullptr);
 
        private:
+        // Per-approach demand, recounted only when the traffic generator reports a vehicle event.
+        struct ApproachDemand {
+            std::array<int, 3> waiting{};   // Indexed by movement; left counts effective left turns
+            std::array<int, 3> crossing{};
+            std::array<int, 3> stopped{};   // Waiting at or below STOPPED_SPEED_THRESHOLD
+            bool queue_empty = true;
+            bool right_lane_demand = false;       // Waiting or crossing in a dedicated right-turn lane
+            bool right_exclusive_demand = false;  // Same, for right lanes with an exclusive connection
+            bool main_light_demand = false;       // Anything outside dedicated right lanes or not turning right
+            bool left_lane_demand = false;
+            bool left_lane_crossing = false;
+            bool unprotected_left_demand = false;  // Left turners queued in a shared lane
+        };
+
+        struct ApproachLaneClasses {
+            std::vector<LaneId> dedicated_right;
+            std::vector<LaneId> exclusive_right;
+            std::vector<LaneId> dedicated_left;
+        };
+
         void generateTraffic(double dt);
         void processVehicleCrossings();
         void completeVehicleCrossings();
+        // Counts a vehicle that starts crossing towards route_vehicles_started_this_green
+        void countRouteStart(Direction lane, const Vehicle& vehicle);
         void advanceController(double dt);
+        std::unique_ptr<ITrafficLightController> makeConfiguredController() const;
         void refreshEffectiveSignalState(double dt_seconds);
+        void rebuildRouteConflictMatrix();
+        template <typename Layout>
+        void loadLayoutRouteTables();
+        const LaneConfig* laneConfigFor(Direction dir, LaneId lane_id) const;
+        // Recomputes movement_permissions when the effective lights or the config changed
+        void refreshMovementPermissions();
+        void refreshApproachDemand();
+        void applyApproachLightRules();
+        void updateMovementWaitTimers(double dt_seconds);
+        void updateRouteDemand();
+        void updateConflictClearance();
+        bool schedulerSelectionStale(const std::array<bool, 12>& prev_route_green_active) const;
+        void selectSchedulerRoutes(const std::array<bool, 12>& prev_route_green_active);
+        // Score as of the last signal refresh, extrapolated from the last selection
+        double currentPriorityScore(std::size_t route_idx) const;
+        void applySchedulerSelection();
+        bool routeConflictsHeld(std::size_t route_idx, const IntersectionState& state) const;
+        bool routesConflict(std::size_t lhs, std::size_t rhs) const {
+            return (route_conflict_masks[lhs] >> rhs) & 1u;
+        }
+        void applyTransitionDiscipline(const IntersectionState& prev_effective);
+        void updateRouteSignalTracking(const std::array<bool, 12>& prev_route_green_active);
         bool signalAllowsVehicle(Direction dir,
                                  const Vehicle& vehicle,
                                  const LaneConfig* lane_cfg,
                                  const IntersectionState& state) const;
         bool isLightGreen(Direction dir) const;
-        std::vector<SignalGroupId> resolveActiveSignalGroups(const IntersectionState& state) const;
+        // Fills active_ids (cleared first) with the signal groups showing green or orange
+        void resolveActiveSignalGroups(const IntersectionState& state, std::vector<SignalGroupId>& active_ids) const;
         bool isConfigSignalStateSafe(const IntersectionState& state) const;
+        void planPredictiveAnchor(double dt);
+        bool syncRolloutEngine(SimulatorEngine& rollout) const;
+        void copyDynamicStateFrom(const SimulatorEngine& other);
+        bool readStateHeader(StateReader& reader, std::string* error) const;
+        bool readStateBody(StateReader& reader, std::string* error);
 
         SafetyChecker checker;
         std::unique_ptr<ITrafficLightController> controller;
         ControlMode control_mode;
+        SchedulerMode scheduler_mode = SchedulerMode::Adaptive;
         TrafficGenerator traffic;
         double ns_duration;
         double ew_duration;
@@ -90,6 +222,10 @@ namespace crossroads {
         IntersectionState previous_controller_state{};
         bool has_previous_effective_light_state = false;
         bool has_previous_controller_state = false;
+        // signalAllowsVehicle per lane, movement and destination under movement_permissions_state
+        TrafficGenerator::MovementPermissions movement_permissions;
+        IntersectionState movement_permissions_state{};
+        bool movement_permissions_stale = true;
         std::array<double, 12> minimum_green_hold_until_seconds{};
         std::array<double, 12> minimum_orange_hold_until_seconds{};
         std::array<double, 4> right_turn_green_hold_until{};
@@ -98,7 +234,9 @@ namespace crossroads {
         std::array<double, 4> right_wait_seconds{};
         std::array<bool, 12> route_waiting_demand{};
         std::array<double, 12> route_wait_seconds{};
-        std::array<double, 12> route_priority_score{};
+        std::array<double, 12> route_priority_score{};            // At scheduler_selection_time
+        std::array<double, 12> route_priority_score_slope{};      // Per second, at scheduler_selection_time
+        std::array<double, 12> route_priority_score_curvature{};  // Per second squared
         std::array<bool, 12> route_green_active{};
         std::array<bool, 12> route_configured{};
         std::array<double, 12> route_last_served_time{};
@@ -109,14 +247,41 @@ namespace crossroads {
         std::array<int, 12> route_stopped_waiting_count{};    // Stopped waiting vehicles per route
         std::array<double, 12> route_conflicts_cleared_at{};  // When conflicts first became clear (-1 = not clear)
         std::array<double, 12> route_red_since{};             // When route last turned red (-1 = not red)
-        std::array<std::array<bool, 12>, 12> route_conflict_matrix{};
+        std::array<RouteMask, 12> route_conflict_masks{};  // Bit j of entry i: routes i and j conflict
         bool route_conflict_matrix_ready = false;
+        bool default_layout_fast_path = false;
+        uint64_t config_fingerprint = 0;  // Finds entries in the shared route table cache
+        std::string config_hash;          // Stamped into checkpoints
+        std::array<ApproachLaneClasses, 4> approach_lane_classes{};
+        std::array<ApproachDemand, 4> approach_demand{};
+        std::array<int, 12> route_waiting_count{};
+        uint64_t approach_demand_version = 0;  // Generator demand version the counters reflect (0 = stale)
         int scheduler_anchor_route_index = -1;
         std::array<bool, 12> scheduler_parallel_routes{};
         std::array<bool, 12> scheduler_blocked_routes{};
         std::array<bool, 12> scheduler_safety_blocked_routes{};
         std::array<bool, 12> scheduler_clearance_blocked_routes{};  // Blocked by crossing vehicles
         std::array<bool, 12> scheduler_served_this_cycle{};         // Routes served in current scheduling cycle
+        int scheduler_forced_anchor_route = -1;
+        std::array<std::size_t, 12> scheduler_parallel_order{};  // Parallel candidates, best score first
+        std::size_t scheduler_parallel_order_count = 0;
+        uint64_t scheduler_selection_version = 0;  // Demand version of the last selection (0 = stale)
+        double scheduler_next_selection_time = 0.0;
+        double scheduler_selection_time = 0.0;
+        double scheduler_score_time = 0.0;  // Signal refresh the current scores belong to
+        bool incremental_scheduling = true;
+        std::array<bool, 12> scheduler_selection_green{};
+        int scheduler_selection_forced_anchor = -1;
+        std::size_t scheduler_selection_count = 0;
+        double predictive_next_decision_time = 0.0;
+        double predictive_horizon_seconds = 4.0;
+        double predictive_decision_interval_seconds = 1.0;
+        std::size_t predictive_candidate_count = 4;
+        std::size_t predictive_rollout_tick_budget = 200;
+        PredictiveDecision predictive_last_decision;
+        std::vector<std::unique_ptr<SimulatorEngine>> rollout_engines;
+        // Per-tick scratch, kept so a steady-state tick does not allocate
+        mutable std::vector<SignalGroupId> active_signal_groups;
         double minimum_green_seconds = 3.0;
         double right_turn_min_green_seconds = 2.0;
         double straight_starvation_threshold_seconds = 2.0;
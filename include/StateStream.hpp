@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "Intersection.hpp"
+
+namespace crossroads {
+    // Little-endian byte sink for engine checkpoints. Appends to a caller-owned buffer so repeated checkpoints
+    // reuse its capacity.
+    class StateWriter {
+       public:
+        explicit StateWriter(std::string& out) : out(out) {
+        }
+
+        void u8(uint8_t value) {
+            out.push_back(static_cast<char>(value));
+        }
+
+        void u16(uint16_t value) {
+            writeLittleEndian(value, 2);
+        }
+
+        void u32(uint32_t value) {
+            writeLittleEndian(value, 4);
+        }
+
+        void u64(uint64_t value) {
+            writeLittleEndian(value, 8);
+        }
+
+        void i32(int32_t value) {
+            u32(static_cast<uint32_t>(value));
+        }
+
+        void f64(double value) {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            u64(bits);
+        }
+
+        void boolean(bool value) {
+            u8(value ? 1 : 0);
+        }
+
+        void bytes(const std::string& value) {
+            u32(static_cast<uint32_t>(value.size()));
+            out.append(value);
+        }
+
+        void lights(const IntersectionState& state) {
+            for (LightState light : {state.north,
+                                     state.east,
+                                     state.south,
+                                     state.west,
+                                     state.turnSouthEast,
+                                     state.turnNorthWest,
+                                     state.turnWestSouth,
+                                     state.turnEastNorth,
+                                     state.turnNorthEast,
+                                     state.turnSouthWest,
+                                     state.turnEastSouth,
+                                     state.turnWestNorth}) {
+                u8(static_cast<uint8_t>(light));
+            }
+        }
+
+        template <typename Array>
+        void f64Array(const Array& values) {
+            for (double value : values) {
+                f64(value);
+            }
+        }
+
+        template <typename Array>
+        void boolArray(const Array& values) {
+            for (bool value : values) {
+                boolean(value);
+            }
+        }
+
+        template <typename Array>
+        void i32Array(const Array& values) {
+            for (auto value : values) {
+                i32(static_cast<int32_t>(value));
+            }
+        }
+
+        std::size_t size() const {
+            return out.size();
+        }
+
+       private:
+        void writeLittleEndian(uint64_t value, int byte_count) {
+            char buffer[8];
+            for (int i = 0; i < byte_count; ++i) {
+                buffer[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+            }
+            out.append(buffer, static_cast<std::size_t>(byte_count));
+        }
+
+        std::string& out;
+    };
+
+    // Bounds-checked counterpart of StateWriter. The first short or invalid read makes the reader fail for good;
+    // callers read a whole section and check ok() once.
+    class StateReader {
+       public:
+        StateReader(const char* data, std::size_t size) : data(data), size(size) {
+        }
+
+        explicit StateReader(const std::string& bytes) : StateReader(bytes.data(), bytes.size()) {
+        }
+
+        bool ok() const {
+            return !failed;
+        }
+
+        bool atEnd() const {
+            return pos == size;
+        }
+
+        void fail() {
+            failed = true;
+        }
+
+        uint8_t u8() {
+            if (!require(1)) {
+                return 0;
+            }
+            return static_cast<uint8_t>(data[pos++]);
+        }
+
+        uint16_t u16() {
+            return static_cast<uint16_t>(readLittleEndian(2));
+        }
+
+        uint32_t u32() {
+            return static_cast<uint32_t>(readLittleEndian(4));
+        }
+
+        uint64_t u64() {
+            return readLittleEndian(8);
+        }
+
+        int32_t i32() {
+            return static_cast<int32_t>(u32());
+        }
+
+        double f64() {
+            const uint64_t bits = u64();
+            double value = 0.0;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        bool boolean() {
+            const uint8_t value = u8();
+            if (value > 1) {
+                failed = true;
+            }
+            return value == 1;
+        }
+
+        std::string bytes() {
+            const uint32_t length = u32();
+            if (!require(length)) {
+                return {};
+            }
+            std::string value(data + pos, length);
+            pos += length;
+            return value;
+        }
+
+        IntersectionState lights() {
+            IntersectionState state;
+            for (LightState* light : {&state.north,
+                                      &state.east,
+                                      &state.south,
+                                      &state.west,
+                                      &state.turnSouthEast,
+                                      &state.turnNorthWest,
+                                      &state.turnWestSouth,
+                                      &state.turnEastNorth,
+                                      &state.turnNorthEast,
+                                      &state.turnSouthWest,
+                                      &state.turnEastSouth,
+                                      &state.turnWestNorth}) {
+                *light = lightState();
+            }
+            return state;
+        }
+
+        LightState lightState() {
+            const uint8_t value = u8();
+            if (value > static_cast<uint8_t>(LightState::Green)) {
+                failed = true;
+                return LightState::Red;
+            }
+            return static_cast<LightState>(value);
+        }
+
+        template <typename Array>
+        void f64Array(Array& values) {
+            for (auto& value : values) {
+                value = f64();
+            }
+        }
+
+        template <typename Array>
+        void boolArray(Array& values) {
+            for (auto& value : values) {
+                value = boolean();
+            }
+        }
+
+        template <typename Array>
+        void i32Array(Array& values) {
+            for (auto& value : values) {
+                value = static_cast<std::decay_t<decltype(value)>>(i32());
+            }
+        }
+
+       private:
+        bool require(std::size_t count) {
+            if (failed || count > size - pos) {
+                failed = true;
+                return false;
+            }
+            return true;
+        }
+
+        uint64_t readLittleEndian(int byte_count) {
+            if (!require(static_cast<std::size_t>(byte_count))) {
+                return 0;
+            }
+            uint64_t value = 0;
+            for (int i = 0; i < byte_count; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(data[pos + i])) << (8 * i);
+            }
+            pos += static_cast<std::size_t>(byte_count);
+            return value;
+        }
+
+        const char* data;
+        std::size_t size;
+        std::size_t pos = 0;
+        bool failed = false;
+    };
+}  // namespace crossroads
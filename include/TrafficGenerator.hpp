@@ -2,19 +2,24 @@
 
 #include <array>
 #include <cstdint>
-#include <deque>
 #include <functional>
 #include <optional>
 #include <vector>
 
+#include "CarFollowing.hpp"
 #include "Intersection.hpp"
 #include "IntersectionConfig.hpp"
+#include "MesoscopicQueues.hpp"
+#include "RingQueue.hpp"
+#include "StateStream.hpp"
 #include "Vehicle.hpp"
 
-// Add these constants after the class declaration begins:
-static constexpr double VEHICLE_SPACING = 5.0;  // meters
-static constexpr size_t LANE_CAPACITY = 10;     // vehicles
+static constexpr double STOPPED_SPEED_THRESHOLD = 0.2;  // m/s, waiting vehicles at or below count as stopped
 namespace crossroads {
+    using VehicleQueue = RingQueue<Vehicle>;
+
+    // One crossing list per turning flag and VehicleClass (see TrafficGenerator::getCrossingQueue)
+    constexpr std::size_t kCrossingListCount = 2 * kVehicleClassCount;
 
     struct LaneVehicleState {
         uint32_t id = 0;
@@ -31,6 +36,7 @@ namespace crossroads {
         uint16_t destination_lane_index = 0;
         LaneId destination_lane_id = 0;
         bool lane_change_allowed = true;
+        VehicleClass vehicle_class = VehicleClass::Car;
     };
 
     class TrafficGenerator {
@@ -40,6 +46,17 @@ namespace crossroads {
             uint16_t lane_index = 0;
         };
 
+        // Which waiting vehicles the signal lets go, per lane, movement and destination; the permission does not
+        // depend on anything else about the vehicle, so the engine fills this in once per light state.
+        struct MovementPermissions {
+            static constexpr uint16_t bit(MovementType movement, ApproachId destination) {
+                return static_cast<uint16_t>(1u << (static_cast<unsigned>(movement) * 4 +
+                                                    static_cast<unsigned>(destination)));
+            }
+            std::array<std::vector<uint16_t>, 4> lanes;  // By Direction, then lane index of the approach config
+            std::array<uint16_t, 4> unconfigured{};      // Lanes the config does not have, by Direction
+        };
+
         TrafficGenerator(double arrival_rate = 0.5);  // vehicles per second, per lane
         TrafficGenerator(const IntersectionConfig& config, double arrival_rate = 0.5);
 
@@ -49,10 +66,16 @@ namespace crossroads {
         // Move a vehicle from lane queue to crossing state
         bool startCrossing(Direction lane, uint32_t vehicle_id, double current_time);
 
+        // Move the waiting vehicle at queue_index to the crossing lists (used by the engine once the signal lets it go)
+        void startCrossingAt(Direction lane, std::size_t queue_index, double current_time);
+
         // Mark a vehicle as having completed crossing
-        bool completeCrossing(uint32_t vehicle_id, double current_time);
+        bool completeCrossing(uint32_t vehicle_id);
+
+        // Completes the crossings from one approach that have lasted their crossing duration; returns how many
+        std::size_t completeFinishedCrossings(Direction lane, double current_time);
 
-        // Get number of waiting vehicles in a lane
+        // Get number of vehicles on an approach, waiting or crossing
         size_t getQueueLength(Direction lane) const;
 
         // Get total number of vehicles waiting across all lanes
@@ -68,30 +91,95 @@ namespace crossroads {
 
         // Statistics: total vehicles that have crossed
         uint32_t getTotalCrossed() const {
-            return crossed_vehicles.size();
+            return total_crossed;
         }
 
         // Statistics: average wait time for crossed vehicles
         double getAverageWaitTime() const;
 
+        // Bumped whenever a vehicle spawns, leaves, starts crossing, changes lane or route, or stops/pulls away
+        uint64_t getDemandVersion() const {
+            return demand_version;
+        }
+
         // Reset all state
         void reset();
 
+        // Copy queues, counters and spawn state from a generator built from the same config
+        void copyDynamicStateFrom(const TrafficGenerator& other);
+
+        // Switches to a new config and keeps the traffic. Waiting vehicles on a lane that still exists and still
+        // reaches the intersection keep their place and get their route re-resolved, falling back to another
+        // movement of the lane; the others are removed. Crossing vehicles finish the crossing they started.
+        // Returns the number of vehicles removed.
+        std::size_t reconfigure(const IntersectionConfig& config);
+
+        // Same state as copyDynamicStateFrom, as bytes. loadState leaves the generator untouched on failure.
+        void saveState(StateWriter& writer) const;
+        bool loadState(StateReader& reader);
+
+        // Vehicles may go where lane_can_move says, or per permissions when given
         void updateVehicleSpeeds(double dt_seconds,
                                  const std::array<bool, 4>& lane_can_move,
-                                 const std::function<bool(Direction, const Vehicle&)>& can_vehicle_move_override = {});
+                                 const MovementPermissions* permissions = nullptr);
+        // Queued vehicles over the approach capacity (lanes times effectiveLaneCapacity), at most 1
         double getAverageQueueDensity(Direction dir) const;
         std::vector<LaneVehicleState> getLaneVehicleStates(Direction dir) const;
+        // Same, into a caller-owned buffer that is cleared first
+        void getLaneVehicleStates(Direction dir, std::vector<LaneVehicleState>& states) const;
         void setSpawnLaneFilter(const std::optional<SpawnLaneFilter>& filter);
         std::optional<SpawnLaneFilter> getSpawnLaneFilter() const;
         void setArrivalRate(double rate);
         double getArrivalRate() const;
 
-        // Get queue reference by direction (for direct iteration)
-        std::deque<Vehicle>& getQueueByDirection(Direction dir);
-        const std::deque<Vehicle>& getQueueByDirection(Direction dir) const;
+        // Optional per-approach arrival rates (vehicles per second, indexed by ApproachId) that replace the
+        // uniform arrival rate while set.
+        void setApproachArrivalRates(const std::optional<std::array<double, 4>>& rates);
+        std::optional<std::array<double, 4>> getApproachArrivalRates() const;
+
+        // Sum of the time queued vehicles have waited so far without starting to cross
+        double getQueuedDelaySeconds(double current_time) const;
+
+        // Switches between the per-vehicle queues and lane point queues (MesoscopicQueues). The traffic of the
+        // previous mode is dropped. Mesoscopic spawning needs a configured intersection.
+        void setMesoscopic(bool enabled, const MesoscopicSettings& settings = {});
+        bool isMesoscopic() const {
+            return mesoscopic;
+        }
+        const MesoscopicSettings& getMesoscopicSettings() const {
+            return mesoscopic_settings;
+        }
+        const MesoscopicQueues& getMesoscopicQueues() const {
+            return meso_queues;
+        }
+        // Mesoscopic counterpart of updateVehicleSpeeds plus the engine's crossing start and completion. may_go is
+        // asked once per lane head that would start crossing and must allow it for the head to leave.
+        void advanceMesoscopic(double dt_seconds,
+                               double current_time,
+                               const std::function<bool(Direction, const Vehicle&)>& may_go);
+
+        // Get queue reference by direction (for direct iteration). Waiting vehicles only; empty in mesoscopic mode.
+        VehicleQueue& getQueueByDirection(Direction dir);
+        const VehicleQueue& getQueueByDirection(Direction dir) const;
+        // Vehicles crossing from an approach, in the order they started, per turning flag and class. A crossing
+        // lasts getCrossingDuration(vehicles on the approach), which at any moment is the same for the whole list,
+        // so each list finishes from the front.
+        const VehicleQueue& getCrossingQueue(Direction dir,
+                                             bool turning,
+                                             VehicleClass vehicle_class = VehicleClass::Car) const;
+        const std::array<VehicleQueue, kCrossingListCount>& getCrossingQueues(Direction dir) const {
+            return crossing_queues[static_cast<std::size_t>(dir)];
+        }
 
        private:
+        struct LaneOccupant {
+            double position = 0.0;
+            VehicleClass vehicle_class = VehicleClass::Car;
+        };
+        static bool occupantBefore(const LaneOccupant& occupant, double position) {
+            return occupant.position < position;
+        }
+
         const ApproachConfig* getApproachConfig(Direction dir) const;
         bool laneAllowsMovement(const LaneConfig& lane, MovementType movement) const;
         const LaneConnectionConfig* findLaneConnection(ApproachId from_approach,
@@ -101,15 +189,21 @@ namespace crossroads {
                                  ApproachId from_approach,
                                  uint16_t from_lane_index,
                                  MovementType movement) const;
+        bool migrateWaitingVehicle(const ApproachConfig& approach, Vehicle& vehicle) const;
         void enforceSpawnLaneFilterOnExistingQueues();
+        void trySpawnVehicle(Direction dir, double current_time);
         size_t chooseSpawnMovementIndex(const std::vector<MovementType>& movements, uint32_t vehicle_id) const;
         size_t choosePreferredLaneIndex(const ApproachConfig& approach,
                                         MovementType movement,
                                         size_t current_index) const;
-        void maybeApplyLaneChanges(Direction dir, std::deque<Vehicle>& queue);
-        bool hasSafeGapForLaneChange(const std::deque<Vehicle>& queue,
-                                     size_t vehicle_index,
-                                     LaneId target_lane_id) const;
+        void maybeApplyLaneChanges(Direction dir, VehicleQueue& queue);
+        // Fills lane_order from first_lane on for the queue; returns first_lane plus the number of lanes it used
+        std::size_t buildLaneOrder(const VehicleQueue& queue, std::size_t first_lane);
+        // target_lane: the waiting vehicles in the target lane, by ascending position
+        static bool hasSafeGapForLaneChange(const std::vector<LaneOccupant>& target_lane,
+                                            double position,
+                                            VehicleClass vehicle_class);
+        VehicleQueue& crossingQueue(Direction dir, bool turning, VehicleClass vehicle_class);
 
         IntersectionConfig intersection_config;
         bool use_configured_spawns = false;
@@ -118,17 +212,38 @@ namespace crossroads {
 
         double arrival_rate;       // vehicles per second per lane
         double time_accumulated;   // accumulated time for next spawn calculation
+        std::optional<std::array<double, 4>> approach_arrival_rates;
+        std::array<double, 4> approach_time_accumulated{};
         uint32_t next_vehicle_id;  // counter for unique IDs
         uint32_t total_generated = 0;
+        uint64_t demand_version = 1;
 
         // Vehicle queues for each direction
-        std::deque<Vehicle> north_queue;
-        std::deque<Vehicle> east_queue;
-        std::deque<Vehicle> south_queue;
-        std::deque<Vehicle> west_queue;
-
-        // Vehicles that have completed crossing
-        std::vector<Vehicle> crossed_vehicles;
+        VehicleQueue north_queue;
+        VehicleQueue east_queue;
+        VehicleQueue south_queue;
+        VehicleQueue west_queue;
+        // Crossing vehicles, indexed by Direction and then class and turning (see getCrossingQueue)
+        std::array<std::array<VehicleQueue, kCrossingListCount>, 4> crossing_queues;
+
+        // Scratch for trySpawnVehicle: connected lane indices and the movements they offer
+        std::vector<size_t> spawn_lane_indices;
+        std::vector<MovementType> spawn_movements;
+        // Scratch for maybeApplyLaneChanges: waiting vehicles by position, per lane index of the approach processed
+        std::vector<std::vector<LaneOccupant>> lane_change_positions;
+        // Scratch for updateVehicleSpeeds: queue indices of the non-crossing vehicles of each lane, front first
+        std::vector<LaneId> lane_order_ids;
+        std::vector<std::vector<uint32_t>> lane_order;
+        std::array<std::size_t, 5> lane_order_begin{};  // Lanes of Direction d are [begin[d], begin[d + 1])
+        CarFollowingBatch car_following;
+
+        bool mesoscopic = false;
+        MesoscopicSettings mesoscopic_settings;
+        MesoscopicQueues meso_queues;
+
+        // Aggregates over vehicles that have completed crossing
+        uint32_t total_crossed = 0;
+        double total_crossed_wait_seconds = 0.0;
 
         // Helper to calculate next spawn time using Poisson-like distribution
         double getNextSpawnInterval();
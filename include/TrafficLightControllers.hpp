@@ -2,14 +2,67 @@
 
 #include <algorithm>
 #include <array>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 #include "BasicLightController.hpp"
 #include "Intersection.hpp"
 #include "IntersectionConfig.hpp"
+#include "StateStream.hpp"
 
 namespace crossroads {
+    inline void setMovementLight(IntersectionState& s, ApproachId approach, MovementType movement, LightState color) {
+        if (movement == MovementType::Right) {
+            switch (approach) {
+                case ApproachId::North:
+                    s.turnNorthWest = color;
+                    return;
+                case ApproachId::East:
+                    s.turnEastNorth = color;
+                    return;
+                case ApproachId::South:
+                    s.turnSouthEast = color;
+                    return;
+                case ApproachId::West:
+                    s.turnWestSouth = color;
+                    return;
+            }
+        }
+
+        if (movement == MovementType::Left) {
+            switch (approach) {
+                case ApproachId::North:
+                    s.turnNorthEast = color;
+                    return;
+                case ApproachId::East:
+                    s.turnEastSouth = color;
+                    return;
+                case ApproachId::South:
+                    s.turnSouthWest = color;
+                    return;
+                case ApproachId::West:
+                    s.turnWestNorth = color;
+                    return;
+            }
+        }
+
+        switch (approach) {
+            case ApproachId::North:
+                s.north = color;
+                break;
+            case ApproachId::East:
+                s.east = color;
+                break;
+            case ApproachId::South:
+                s.south = color;
+                break;
+            case ApproachId::West:
+                s.west = color;
+                break;
+        }
+    }
+
     class ITrafficLightController {
        public:
         virtual ~ITrafficLightController() = default;
@@ -18,6 +71,22 @@ namespace crossroads {
         virtual void reset() = 0;
         virtual void setDemandByDirection(const std::array<bool, 4>&) {
         }
+        // Deep copy for engine rollouts; controllers that cannot be copied return nullptr.
+        virtual std::unique_ptr<ITrafficLightController> clone() const {
+            return nullptr;
+        }
+        // Take over the timing state of a controller of the same type and config; false when not possible.
+        virtual bool copyStateFrom(const ITrafficLightController&) {
+            return false;
+        }
+        // Checkpoint hooks for SimulatorEngine::saveState/loadState. Implementations start with their own type tag
+        // so a checkpoint cannot be loaded into a different controller; false when checkpoints are not supported.
+        virtual bool saveState(StateWriter&) const {
+            return false;
+        }
+        virtual bool loadState(StateReader&) {
+            return false;
+        }
     };
 
     class BasicControllerAdapter : public ITrafficLightController {
@@ -42,7 +111,32 @@ namespace crossroads {
             basic_controller.setDemandByDirection(demand);
         }
 
+        std::unique_ptr<ITrafficLightController> clone() const override {
+            return std::make_unique<BasicControllerAdapter>(*this);
+        }
+
+        bool copyStateFrom(const ITrafficLightController& other) override {
+            const auto* source = dynamic_cast<const BasicControllerAdapter*>(&other);
+            if (!source) {
+                return false;
+            }
+            basic_controller = source->basic_controller;
+            return true;
+        }
+
+        bool saveState(StateWriter& writer) const override {
+            writer.u8(kStateTag);
+            basic_controller.saveState(writer);
+            return true;
+        }
+
+        bool loadState(StateReader& reader) override {
+            return reader.u8() == kStateTag && basic_controller.loadState(reader);
+        }
+
        private:
+        static constexpr uint8_t kStateTag = 1;
+
         BasicLightController basic_controller;
     };
 
@@ -71,7 +165,46 @@ namespace crossroads {
             applyPattern();
         }
 
+        std::unique_ptr<ITrafficLightController> clone() const override {
+            return std::make_unique<NullControlController>(*this);
+        }
+
+        bool copyStateFrom(const ITrafficLightController& other) override {
+            const auto* source = dynamic_cast<const NullControlController*>(&other);
+            if (!source) {
+                return false;
+            }
+            state = source->state;
+            elapsed = source->elapsed;
+            orange_on = source->orange_on;
+            return true;
+        }
+
+        bool saveState(StateWriter& writer) const override {
+            writer.u8(kStateTag);
+            writer.f64(elapsed);
+            writer.boolean(orange_on);
+            return true;
+        }
+
+        bool loadState(StateReader& reader) override {
+            if (reader.u8() != kStateTag) {
+                return false;
+            }
+            const double saved_elapsed = reader.f64();
+            const bool saved_orange_on = reader.boolean();
+            if (!reader.ok()) {
+                return false;
+            }
+            elapsed = saved_elapsed;
+            orange_on = saved_orange_on;
+            applyPattern();
+            return true;
+        }
+
        private:
+        static constexpr uint8_t kStateTag = 2;
+
         void applyPattern() {
             LightState active = orange_on ? LightState::Orange : LightState::Red;
             state.north = active;
@@ -143,7 +276,63 @@ namespace crossroads {
             applyCurrentPhase();
         }
 
+        std::unique_ptr<ITrafficLightController> clone() const override {
+            return std::make_unique<ConfigurableSignalGroupController>(*this);
+        }
+
+        bool copyStateFrom(const ITrafficLightController& other) override {
+            const auto* source = dynamic_cast<const ConfigurableSignalGroupController*>(&other);
+            if (!source || source->phase_order != phase_order) {
+                return false;
+            }
+            phase_index = source->phase_index;
+            in_orange = source->in_orange;
+            phase_elapsed = source->phase_elapsed;
+            state = source->state;
+            return true;
+        }
+
+        bool saveState(StateWriter& writer) const override {
+            writer.u8(kStateTag);
+            writer.u32(static_cast<uint32_t>(phase_order.size()));
+            writer.u32(static_cast<uint32_t>(phase_index));
+            writer.boolean(in_orange);
+            writer.f64(phase_elapsed);
+            return true;
+        }
+
+        bool loadState(StateReader& reader) override {
+            if (reader.u8() != kStateTag || reader.u32() != phase_order.size()) {
+                return false;
+            }
+            const uint32_t saved_phase_index = reader.u32();
+            const bool saved_in_orange = reader.boolean();
+            const double saved_phase_elapsed = reader.f64();
+            if (!reader.ok() || (!phase_order.empty() && saved_phase_index >= phase_order.size())) {
+                return false;
+            }
+            phase_index = saved_phase_index;
+            in_orange = saved_in_orange;
+            phase_elapsed = saved_phase_elapsed;
+            applyCurrentPhase();
+            return true;
+        }
+
+        // Takes over new timing for the same signal plan (see sameSignalPlan). The running phase keeps its elapsed
+        // time, so a phase that is now too long ends on the next tick. False when the plan differs.
+        bool retime(const IntersectionConfig& config) {
+            if (!sameSignalPlan(intersection_config, config)) {
+                return false;
+            }
+            intersection_config = config;
+            rebuildLaneApproachMap();
+            applyCurrentPhase();
+            return true;
+        }
+
        private:
+        static constexpr uint8_t kStateTag = 3;
+
         void rebuildLaneApproachMap() {
             lane_to_approach.clear();
             for (const auto& approach : intersection_config.approaches) {
@@ -165,57 +354,6 @@ namespace crossroads {
             return it == intersection_config.signal_groups.end() ? nullptr : &(*it);
         }
 
-        static void applyMovement(IntersectionState& s, ApproachId approach, MovementType movement, LightState color) {
-            if (movement == MovementType::Right) {
-                switch (approach) {
-                    case ApproachId::North:
-                        s.turnNorthWest = color;
-                        return;
-                    case ApproachId::East:
-                        s.turnEastNorth = color;
-                        return;
-                    case ApproachId::South:
-                        s.turnSouthEast = color;
-                        return;
-                    case ApproachId::West:
-                        s.turnWestSouth = color;
-                        return;
-                }
-            }
-
-            if (movement == MovementType::Left) {
-                switch (approach) {
-                    case ApproachId::North:
-                        s.turnNorthEast = color;
-                        return;
-                    case ApproachId::East:
-                        s.turnEastSouth = color;
-                        return;
-                    case ApproachId::South:
-                        s.turnSouthWest = color;
-                        return;
-                    case ApproachId::West:
-                        s.turnWestNorth = color;
-                        return;
-                }
-            }
-
-            switch (approach) {
-                case ApproachId::North:
-                    s.north = color;
-                    break;
-                case ApproachId::East:
-                    s.east = color;
-                    break;
-                case ApproachId::South:
-                    s.south = color;
-                    break;
-                case ApproachId::West:
-                    s.west = color;
-                    break;
-            }
-        }
-
         void applyCurrentPhase() {
             state = IntersectionState{};
             const SignalGroupConfig* group = currentGroup();
@@ -231,7 +369,7 @@ namespace crossroads {
                 }
 
                 for (MovementType movement : group->green_movements) {
-                    applyMovement(state, approach_it->second, movement, color);
+                    setMovementLight(state, approach_it->second, movement, color);
                 }
             }
         }
@@ -244,4 +382,356 @@ namespace crossroads {
         double phase_elapsed;
         IntersectionState state{};
     };
+    // Replaces a running controller without an unsafe jump: the lights it showed go to orange, then all-red for
+    // the clearance time, and only then does the next controller take over from its first phase. Used for live
+    // config swaps; the engine unwraps the next controller once finished(). A checkpoint holds the handover
+    // timing followed by the state of the next controller.
+    class HandoverController : public ITrafficLightController {
+       public:
+        HandoverController(const IntersectionState& from_state,
+                           std::unique_ptr<ITrafficLightController> next,
+                           double orange_seconds = 2.0,
+                           double clearance_seconds = 2.0)
+            : from_state(from_state)
+            , next(std::move(next))
+            , orange_seconds(orange_seconds)
+            , clearance_seconds(clearance_seconds) {
+            this->next->reset();
+            applyStage();
+        }
+
+        void tick(double dt_seconds) override {
+            if (finished()) {
+                next->tick(dt_seconds);
+                return;
+            }
+            elapsed += dt_seconds;
+            applyStage();
+        }
+
+        IntersectionState getCurrentState() const override {
+            return finished() ? next->getCurrentState() : state;
+        }
+
+        // A reset skips the rest of the handover.
+        void reset() override {
+            elapsed = orange_seconds + clearance_seconds;
+            next->reset();
+            applyStage();
+        }
+
+        void setDemandByDirection(const std::array<bool, 4>& demand) override {
+            next->setDemandByDirection(demand);
+        }
+
+        std::unique_ptr<ITrafficLightController> clone() const override {
+            std::unique_ptr<ITrafficLightController> next_copy = next->clone();
+            if (!next_copy) {
+                return nullptr;
+            }
+            auto copy = std::make_unique<HandoverController>(from_state, std::move(next_copy), orange_seconds,
+                                                             clearance_seconds);
+            copy->elapsed = elapsed;
+            copy->applyStage();
+            return copy;
+        }
+
+        bool copyStateFrom(const ITrafficLightController& other) override {
+            const auto* source = dynamic_cast<const HandoverController*>(&other);
+            if (!source || !next->copyStateFrom(*source->next)) {
+                return false;
+            }
+            from_state = source->from_state;
+            orange_seconds = source->orange_seconds;
+            clearance_seconds = source->clearance_seconds;
+            elapsed = source->elapsed;
+            applyStage();
+            return true;
+        }
+
+        bool saveState(StateWriter& writer) const override {
+            writer.u8(kStateTag);
+            writer.lights(from_state);
+            writer.f64(orange_seconds);
+            writer.f64(clearance_seconds);
+            writer.f64(elapsed);
+            return next->saveState(writer);
+        }
+
+        bool loadState(StateReader& reader) override {
+            if (reader.u8() != kStateTag) {
+                return false;
+            }
+            const IntersectionState saved_from_state = reader.lights();
+            const double saved_orange_seconds = reader.f64();
+            const double saved_clearance_seconds = reader.f64();
+            const double saved_elapsed = reader.f64();
+            if (!reader.ok() || !next->loadState(reader)) {
+                return false;
+            }
+            from_state = saved_from_state;
+            orange_seconds = saved_orange_seconds;
+            clearance_seconds = saved_clearance_seconds;
+            elapsed = saved_elapsed;
+            applyStage();
+            return true;
+        }
+
+        // Whether the controller state the reader is at belongs to a handover; reads from a copy.
+        static bool startsState(StateReader reader) {
+            return reader.u8() == kStateTag;
+        }
+
+        bool finished() const {
+            return elapsed >= orange_seconds + clearance_seconds;
+        }
+
+        ITrafficLightController& nextController() {
+            return *next;
+        }
+
+        // The handover timing runs on; the replacement starts from its first phase once it is over.
+        void replaceNext(std::unique_ptr<ITrafficLightController> replacement) {
+            next = std::move(replacement);
+            next->reset();
+        }
+
+        std::unique_ptr<ITrafficLightController> releaseNext() {
+            return std::move(next);
+        }
+
+       private:
+        static constexpr uint8_t kStateTag = 5;
+
+        void applyStage() {
+            state = IntersectionState{};
+            if (elapsed >= orange_seconds) {
+                return;
+            }
+
+            state = from_state;
+            for (LightState* light : {&state.north,
+                                      &state.south,
+                                      &state.east,
+                                      &state.west,
+                                      &state.turnSouthEast,
+                                      &state.turnNorthWest,
+                                      &state.turnWestSouth,
+                                      &state.turnEastNorth,
+                                      &state.turnNorthEast,
+                                      &state.turnSouthWest,
+                                      &state.turnEastSouth,
+                                      &state.turnWestNorth}) {
+                if (*light == LightState::Green) {
+                    *light = LightState::Orange;
+                }
+            }
+        }
+
+        IntersectionState from_state;
+        std::unique_ptr<ITrafficLightController> next;
+        double orange_seconds;
+        double clearance_seconds;
+        double elapsed = 0.0;
+        IntersectionState state{};
+    };
+
+    // Serves the phase an external policy asks for. Phases are the config's signal groups, or one phase per
+    // configured route when there are none. Switching always runs green -> orange -> all-red -> green.
+    class ActionSignalController : public ITrafficLightController {
+       public:
+        ActionSignalController(const IntersectionConfig& config,
+                               double min_green_seconds = 3.0,
+                               double orange_seconds = 2.0,
+                               double clearance_seconds = 2.0)
+            : min_green_seconds(min_green_seconds)
+            , orange_seconds(orange_seconds)
+            , clearance_seconds(clearance_seconds) {
+            std::unordered_map<LaneId, ApproachId> lane_to_approach;
+            for (const auto& approach : config.approaches) {
+                for (const auto& lane : approach.lanes) {
+                    lane_to_approach[lane.id] = approach.id;
+                }
+            }
+
+            for (const auto& group : config.signal_groups) {
+                IntersectionState green{};
+                for (LaneId lane_id : group.controlled_lanes) {
+                    auto approach_it = lane_to_approach.find(lane_id);
+                    if (approach_it == lane_to_approach.end()) {
+                        continue;
+                    }
+                    for (MovementType movement : group.green_movements) {
+                        setMovementLight(green, approach_it->second, movement, LightState::Green);
+                    }
+                }
+                phase_states.push_back(green);
+            }
+
+            if (phase_states.empty()) {
+                std::array<bool, 12> seen{};
+                for (const auto& connection : config.lane_connections) {
+                    seen[approachIndex(connection.from_approach) * 3 + static_cast<std::size_t>(connection.movement)] =
+                        true;
+                }
+                for (std::size_t route_idx = 0; route_idx < seen.size(); ++route_idx) {
+                    if (!seen[route_idx]) {
+                        continue;
+                    }
+                    IntersectionState green{};
+                    setMovementLight(green,
+                                     static_cast<ApproachId>(route_idx / 3),
+                                     static_cast<MovementType>(route_idx % 3),
+                                     LightState::Green);
+                    phase_states.push_back(green);
+                }
+            }
+            reset();
+        }
+
+        std::size_t phaseCount() const {
+            return phase_states.size();
+        }
+
+        // Out-of-range requests are ignored; the switch happens once the active phase met its minimum green.
+        void setRequestedPhase(std::size_t phase) {
+            if (phase < phase_states.size()) {
+                requested_phase = phase;
+            }
+        }
+
+        std::size_t getActivePhase() const {
+            return active_phase;
+        }
+
+        void tick(double dt_seconds) override {
+            if (phase_states.empty()) {
+                return;
+            }
+
+            stage_elapsed += dt_seconds;
+            switch (stage) {
+                case Stage::Green:
+                    if (requested_phase != active_phase && stage_elapsed >= min_green_seconds) {
+                        enterStage(Stage::Orange);
+                    }
+                    break;
+                case Stage::Orange:
+                    if (stage_elapsed >= orange_seconds) {
+                        enterStage(Stage::Clearance);
+                    }
+                    break;
+                case Stage::Clearance:
+                    if (stage_elapsed >= clearance_seconds) {
+                        active_phase = requested_phase;
+                        enterStage(Stage::Green);
+                    }
+                    break;
+            }
+        }
+
+        IntersectionState getCurrentState() const override {
+            return state;
+        }
+
+        void reset() override {
+            active_phase = 0;
+            requested_phase = 0;
+            enterStage(Stage::Green);
+        }
+
+        std::unique_ptr<ITrafficLightController> clone() const override {
+            return std::make_unique<ActionSignalController>(*this);
+        }
+
+        bool copyStateFrom(const ITrafficLightController& other) override {
+            const auto* source = dynamic_cast<const ActionSignalController*>(&other);
+            if (!source || source->phase_states.size() != phase_states.size()) {
+                return false;
+            }
+            stage = source->stage;
+            stage_elapsed = source->stage_elapsed;
+            active_phase = source->active_phase;
+            requested_phase = source->requested_phase;
+            state = source->state;
+            return true;
+        }
+
+        bool saveState(StateWriter& writer) const override {
+            writer.u8(kStateTag);
+            writer.u32(static_cast<uint32_t>(phase_states.size()));
+            writer.u8(static_cast<uint8_t>(stage));
+            writer.f64(stage_elapsed);
+            writer.u32(static_cast<uint32_t>(active_phase));
+            writer.u32(static_cast<uint32_t>(requested_phase));
+            writer.lights(state);
+            return true;
+        }
+
+        bool loadState(StateReader& reader) override {
+            if (reader.u8() != kStateTag || reader.u32() != phase_states.size()) {
+                return false;
+            }
+            const uint8_t saved_stage = reader.u8();
+            const double saved_stage_elapsed = reader.f64();
+            const uint32_t saved_active_phase = reader.u32();
+            const uint32_t saved_requested_phase = reader.u32();
+            const IntersectionState saved_state = reader.lights();
+            const bool phases_valid = phase_states.empty() || (saved_active_phase < phase_states.size() &&
+                                                               saved_requested_phase < phase_states.size());
+            if (!reader.ok() || saved_stage > static_cast<uint8_t>(Stage::Clearance) || !phases_valid) {
+                return false;
+            }
+            stage = static_cast<Stage>(saved_stage);
+            stage_elapsed = saved_stage_elapsed;
+            active_phase = saved_active_phase;
+            requested_phase = saved_requested_phase;
+            state = saved_state;
+            return true;
+        }
+
+       private:
+        static constexpr uint8_t kStateTag = 4;
+
+        enum class Stage { Green, Orange, Clearance };
+
+        void enterStage(Stage next) {
+            stage = next;
+            stage_elapsed = 0.0;
+            state = IntersectionState{};
+            if (phase_states.empty() || stage == Stage::Clearance) {
+                return;
+            }
+
+            state = phase_states[active_phase];
+            if (stage == Stage::Orange) {
+                for (LightState* light : {&state.north,
+                                          &state.south,
+                                          &state.east,
+                                          &state.west,
+                                          &state.turnSouthEast,
+                                          &state.turnNorthWest,
+                                          &state.turnWestSouth,
+                                          &state.turnEastNorth,
+                                          &state.turnNorthEast,
+                                          &state.turnSouthWest,
+                                          &state.turnEastSouth,
+                                          &state.turnWestNorth}) {
+                    if (*light == LightState::Green) {
+                        *light = LightState::Orange;
+                    }
+                }
+            }
+        }
+
+        std::vector<IntersectionState> phase_states;
+        double min_green_seconds;
+        double orange_seconds;
+        double clearance_seconds;
+        Stage stage = Stage::Green;
+        double stage_elapsed = 0.0;
+        std::size_t active_phase = 0;
+        std::size_t requested_phase = 0;
+        IntersectionState state{};
+    };
 }  // namespace crossroads
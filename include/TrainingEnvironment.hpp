@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+#include "SimulatorEngine.hpp"
+#include "TrafficLightControllers.hpp"
+
+namespace crossroads {
+    struct TrainingEnvironmentOptions {
+        double time_step_seconds = 0.1;
+        std::size_t ticks_per_step = 10;  // Engine ticks per policy action
+        double episode_seconds = 600.0;
+        double traffic_rate = 0.5;
+        double rate_jitter = 0.25;  // Seeded per-approach spread around traffic_rate, as a fraction
+        double min_green_seconds = 3.0;
+        double clearance_seconds = 2.0;  // All-red between two phases
+        double safety_violation_penalty = 1000.0;
+    };
+
+    struct TrainingStepResult {
+        double reward = 0.0;  // Minus the vehicle-seconds spent waiting during the step
+        bool done = false;
+    };
+
+    // Gym-style wrapper around one engine. The policy picks a phase of an ActionSignalController; the engine runs
+    // in fixed-time mode so the chosen phase is served as-is and still safety-checked every tick.
+    class TrainingEnvironment {
+       public:
+        // Per route: waiting vehicles, stopped vehicles, wait seconds, light (0 red, 0.5 orange, 1 green).
+        static constexpr std::size_t kObservationSize = 12 * 4;
+
+        explicit TrainingEnvironment(const IntersectionConfig& config, TrainingEnvironmentOptions options = {});
+
+        std::size_t actionCount() const;
+        void reset(uint64_t seed, float* observation);
+        TrainingStepResult step(std::size_t action, float* observation);
+        double simTime() const;
+        const SimulatorEngine& getEngine() const;
+
+       private:
+        void writeObservation(float* observation) const;
+
+        TrainingEnvironmentOptions options;
+        SimulatorEngine engine;
+        ActionSignalController* action_controller = nullptr;  // Owned by the engine until a safety fallback
+        std::size_t action_count = 0;
+        double elapsed_seconds = 0.0;
+        mutable RouteObservation route_observation;
+    };
+
+    // N environments stepped in one call. Workers are started once and each owns a fixed slice of the engines,
+    // so a step only wakes the pool; it never allocates. Finished environments reset themselves with the next
+    // seed and report done for that step.
+    class VectorTrainingEnvironment {
+       public:
+        VectorTrainingEnvironment(const IntersectionConfig& config,
+                                  std::size_t env_count,
+                                  TrainingEnvironmentOptions options = {},
+                                  std::size_t worker_count = 0);  // 0 = hardware concurrency
+        ~VectorTrainingEnvironment();
+
+        VectorTrainingEnvironment(const VectorTrainingEnvironment&) = delete;
+        VectorTrainingEnvironment& operator=(const VectorTrainingEnvironment&) = delete;
+
+        std::size_t size() const;
+        std::size_t actionCount() const;
+        // Environment i is seeded with seed + i. Buffers hold size() * kObservationSize floats.
+        void reset(uint64_t seed, float* observations);
+        void step(const int32_t* actions, float* observations, float* rewards, uint8_t* dones);
+
+       private:
+        void runSlice(std::size_t worker_index);
+        void workerLoop(std::size_t worker_index);
+        void runOnWorkers();
+
+        std::vector<std::unique_ptr<TrainingEnvironment>> environments;
+        std::vector<uint64_t> next_seeds;
+        std::size_t slice_count = 1;
+
+        const int32_t* step_actions = nullptr;
+        float* step_observations = nullptr;
+        float* step_rewards = nullptr;
+        uint8_t* step_dones = nullptr;
+
+        std::vector<std::thread> workers;
+        std::mutex pool_mutex;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        uint64_t generation = 0;
+        std::size_t pending_workers = 0;
+        bool stopping = false;
+    };
+}  // namespace crossroads
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IntersectionConfig.hpp"
+#include "SimulatorEngine.hpp"
+#include "TrafficGenerator.hpp"
+
+namespace crossroads {
+    // Per-vehicle trajectories, one row per vehicle per recorded tick, stored column by column.
+    //
+    // File layout (all integers little-endian):
+    //   "XRTJ", u16 version
+    //   chunks: u32 row_count, u8 codec (0 = raw, 1 = deflate), u32 raw_size, u32 stored_size, stored bytes
+    // A chunk body holds the columns below back to back, row_count values each, every value written as the
+    // zigzag varint of its difference to the previous row of the same column. Rows in a chunk are sorted by
+    // vehicle and then time, so a column mostly holds one-byte steps.
+    //   vehicle_id, time_ms, approach (ApproachId), lane_id, movement (MovementType), flags (1 crossing,
+    //   2 turning), position_cm, speed_cm_s, crossing_start_ms (-1 while waiting)
+    struct TrajectoryColumns {
+        std::vector<uint32_t> vehicle_id;
+        std::vector<double> time_seconds;
+        std::vector<ApproachId> approach;
+        std::vector<LaneId> lane_id;
+        std::vector<MovementType> movement;
+        std::vector<uint8_t> crossing;
+        std::vector<uint8_t> turning;
+        std::vector<double> position;        // Meters from the start of the lane
+        std::vector<double> speed;           // m/s
+        std::vector<double> crossing_start;  // Sim seconds, -1 while waiting
+
+        std::size_t size() const {
+            return vehicle_id.size();
+        }
+        void clear();
+    };
+
+    // Samples the engine on the sim thread into a row buffer; full chunks are sorted, encoded, compressed and
+    // written by a background thread. record() only blocks when the writer falls kMaxQueuedChunks behind.
+    class TrajectoryRecorder {
+       public:
+        static constexpr std::size_t kDefaultChunkRows = 64 * 1024;
+        static constexpr std::size_t kMaxQueuedChunks = 4;
+
+        TrajectoryRecorder() = default;
+        ~TrajectoryRecorder();
+
+        TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+        TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+        bool open(const std::string& path, std::string* error = nullptr, std::size_t chunk_rows = kDefaultChunkRows);
+        bool isOpen() const;
+        // Appends one row per vehicle currently in the engine, at the engine's sim time.
+        void record(const SimulatorEngine& engine);
+        // Writes the partial chunk, waits for the writer and closes the file.
+        void close();
+
+        uint64_t rowsRecorded() const;
+        uint64_t bytesWritten() const;
+        bool failed() const;
+
+       private:
+        struct Row {
+            uint32_t vehicle_id = 0;
+            int64_t time_ms = 0;
+            uint8_t approach = 0;
+            uint16_t lane_id = 0;
+            uint8_t movement = 0;
+            uint8_t flags = 0;
+            int64_t position_cm = 0;
+            int64_t speed_cm_s = 0;
+            int64_t crossing_start_ms = -1;
+        };
+
+        void handOffChunk();
+        void writerLoop();
+        void writeChunk(const std::vector<Row>& rows);
+
+        std::ofstream out;
+        bool recording = false;  // Sim-thread view; the file itself belongs to the writer thread
+        std::size_t chunk_rows = kDefaultChunkRows;
+        std::vector<Row> pending;
+        std::vector<LaneVehicleState> lane_scratch;
+        uint64_t rows_recorded = 0;
+
+        std::thread worker;
+        mutable std::mutex queue_mutex;
+        std::condition_variable queue_changed;
+        std::deque<std::vector<Row>> queued_chunks;
+        std::vector<std::vector<Row>> spare_chunks;  // Drained buffers handed back to keep their capacity
+        bool stopping = false;
+        bool write_failed = false;
+        uint64_t bytes_written = 0;
+        std::vector<Row> sorted_rows;  // Writer-thread scratch, like the buffers below
+        std::vector<uint32_t> id_offsets;
+        std::string encode_buffer;
+        std::string compress_buffer;
+    };
+
+    // Reads a trajectory file chunk by chunk.
+    class TrajectoryReader {
+       public:
+        bool open(const std::string& path, std::string* error = nullptr);
+        // Replaces columns with the next chunk. False at the end of the file (error left empty) or on a bad chunk.
+        bool readChunk(TrajectoryColumns& columns, std::string* error = nullptr);
+
+       private:
+        std::ifstream in;
+        std::string stored;
+        std::string raw;
+    };
+
+    // Appends all rows of a file to columns, chunk after chunk.
+    bool readTrajectoryFile(const std::string& path, TrajectoryColumns& columns, std::string* error = nullptr);
+}  // namespace crossroads
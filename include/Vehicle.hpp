@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cmath>
 #include <cstdint>
 
@@ -8,13 +9,37 @@
 namespace crossroads {
     enum class Direction { North = 0, South = 1, East = 2, West = 3 };
 
+    struct VehicleClassParams {
+        double length_m;
+        double accel;            // m/s², largest speed change per second, up or down
+        double decel;            // m/s², braking assumed when planning a stop
+        double desired_speed;    // m/s
+        double headway_s;        // Time gap kept to the vehicle ahead while moving
+        double crossing_factor;  // Crossing duration relative to a car
+        double pce;              // Passenger car equivalents at the stop line (mesoscopic discharge)
+    };
+
+    // Indexed by VehicleClass, so the kinematics look parameters up instead of branching on the class.
+    inline constexpr std::array<VehicleClassParams, kVehicleClassCount> kVehicleClassParams{{
+        {4.0, 3.0, 4.5, 10.0, 1.5, 1.0, 1.0},   // Car
+        {12.0, 1.5, 3.0, 8.0, 2.5, 1.6, 2.0},   // Truck
+        {12.0, 1.8, 3.5, 9.0, 2.0, 1.5, 2.0},   // Bus
+        {2.0, 1.2, 3.0, 5.0, 1.0, 1.4, 0.5},    // Bicycle
+    }};
+
+    constexpr double kStoppedGapMeters = 2.0;  // Bumper to bumper behind a stopped vehicle
+
+    inline const VehicleClassParams& vehicleClassParams(VehicleClass vehicle_class) {
+        return kVehicleClassParams[static_cast<std::size_t>(vehicle_class)];
+    }
+
     struct Vehicle {
         uint32_t id;
         Direction entry_lane;
         double arrival_time;
         double crossing_time;
         double exit_time;
-        double current_speed;     // m/s, range [0, 10]
+        double current_speed;     // m/s, up to the class desired speed
         double position_in_lane;  // meters from queue start
         bool turning;             // true when vehicle uses turn lane
         uint8_t queue_index;      // 0 or 1 for straight lanes, 2 for turn lane
@@ -24,6 +49,7 @@ namespace crossroads {
         uint16_t destination_lane_index;
         LaneId destination_lane_id;
         bool lane_change_allowed;
+        VehicleClass vehicle_class;
 
         Vehicle(uint32_t vid, Direction lane, double arrival)
             : id(vid)
@@ -40,7 +66,8 @@ namespace crossroads {
             , destination_approach(ApproachId::North)
             , destination_lane_index(0)
             , destination_lane_id(0)
-            , lane_change_allowed(true) {
+            , lane_change_allowed(true)
+            , vehicle_class(VehicleClass::Car) {
         }
 
         bool isWaiting() const {
@@ -66,11 +93,11 @@ namespace crossroads {
         }
 
         void updateSpeed(double target_speed, double dt_seconds) {
-            const double ACCEL = 3.0;  // m/s² - realistic car acceleration
-            target_speed = std::max(0.0, std::min(10.0, target_speed));
+            const VehicleClassParams& params = vehicleClassParams(vehicle_class);
+            target_speed = std::max(0.0, std::min(params.desired_speed, target_speed));
 
             double delta = target_speed - current_speed;
-            double max_change = ACCEL * dt_seconds;
+            double max_change = params.accel * dt_seconds;
 
             if (std::abs(delta) <= max_change)
                 current_speed = target_speed;
@@ -85,7 +112,8 @@ namespace crossroads {
             double base = 2.2 + (density * 1.6);             // 2.2-3.8 sec range
             constexpr double kCrossingDurationScale = 0.85;  // ~15% faster crossing through junction
             // Turning vehicles travel longer arc path, need more time
-            return turning ? base * 1.3 * kCrossingDurationScale : base * kCrossingDurationScale;
+            const double duration = turning ? base * 1.3 * kCrossingDurationScale : base * kCrossingDurationScale;
+            return duration * vehicleClassParams(vehicle_class).crossing_factor;
         }
     };
 
@@ -0,0 +1,40 @@
+#pragma once
+
+/* C ABI over VectorTrainingEnvironment for Python/ctypes-style bindings. A single environment is a vector of one. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct crossroads_env crossroads_env;
+
+/* config_json may be NULL for the default intersection. worker_count 0 = hardware concurrency.
+   Returns NULL when the config does not parse, fails the safety validation rules, or the environments cannot be
+   built. No entry point lets a C++ exception escape. */
+crossroads_env* crossroads_env_create(const char* config_json,
+                                      size_t env_count,
+                                      size_t worker_count,
+                                      double traffic_rate,
+                                      double episode_seconds);
+void crossroads_env_destroy(crossroads_env* env);
+
+size_t crossroads_env_size(const crossroads_env* env);
+size_t crossroads_env_action_count(const crossroads_env* env);
+size_t crossroads_env_observation_size(void);
+
+/* observations: size * observation_size floats. Environment i is seeded with seed + i. */
+void crossroads_env_reset(crossroads_env* env, uint64_t seed, float* observations);
+
+/* actions, rewards and dones hold size entries. Finished environments reset themselves before returning. */
+void crossroads_env_step(crossroads_env* env,
+                         const int32_t* actions,
+                         float* observations,
+                         float* rewards,
+                         uint8_t* dones);
+
+#ifdef __cplusplus
+}
+#endif
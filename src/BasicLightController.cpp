@@ -21,6 +21,36 @@ namespace crossroads {
         demand_by_direction = demand;
     }
 
+    void BasicLightController::saveState(StateWriter& writer) const {
+        writer.lights(current_state);
+        writer.u8(static_cast<uint8_t>(current_phase));
+        writer.f64(phase_elapsed);
+        writer.boolArray(demand_by_direction);
+        writer.f64(ns_red_elapsed);
+        writer.f64(ew_red_elapsed);
+    }
+
+    bool BasicLightController::loadState(StateReader& reader) {
+        const IntersectionState saved_state = reader.lights();
+        const uint8_t saved_phase = reader.u8();
+        const double saved_phase_elapsed = reader.f64();
+        std::array<bool, 4> saved_demand{};
+        reader.boolArray(saved_demand);
+        const double saved_ns_red_elapsed = reader.f64();
+        const double saved_ew_red_elapsed = reader.f64();
+        if (!reader.ok() || saved_phase > EW_ORANGE) {
+            return false;
+        }
+
+        current_state = saved_state;
+        current_phase = static_cast<Phase>(saved_phase);
+        phase_elapsed = saved_phase_elapsed;
+        demand_by_direction = saved_demand;
+        ns_red_elapsed = saved_ns_red_elapsed;
+        ew_red_elapsed = saved_ew_red_elapsed;
+        return true;
+    }
+
     void BasicLightController::applyPhasePattern(Phase phase, IntersectionState& state) {
         // Initialize all lights to red
         state.north = LightState::Red;
@@ -0,0 +1,135 @@
+#include "CarFollowing.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace crossroads {
+    namespace {
+        constexpr double kStoppedSpeed = 0.5;  // m/s, below this the follower keeps the standstill gap
+    }  // namespace
+
+    void CarFollowingBatch::reset(std::size_t lanes, std::size_t max_rank_count) {
+        lane_count = lanes;
+        stride = (lanes + kWidth - 1) / kWidth * kWidth;
+        ranks = max_rank_count;
+        stop_line.assign(stride, 0.0);
+        stop_target.assign(stride, 0.0);
+        lane_ranks.assign(stride, 0);
+        const std::size_t slots = ranks * stride;
+        for (auto* column : {&position, &speed, &can_move, &length_m, &accel, &decel, &desired_speed, &headway_s}) {
+            if (column->size() < slots) {
+                column->resize(slots, 0.0);
+            }
+        }
+    }
+
+    void CarFollowingBatch::setLane(std::size_t lane,
+                                    double lane_stop_line,
+                                    double lane_stop_target,
+                                    std::size_t vehicle_count) {
+        stop_line[lane] = lane_stop_line;
+        stop_target[lane] = lane_stop_target;
+        lane_ranks[lane] = vehicle_count;
+    }
+
+    void CarFollowingBatch::setVehicle(std::size_t rank,
+                                       std::size_t lane,
+                                       const Vehicle& vehicle,
+                                       bool vehicle_can_move) {
+        const std::size_t s = slot(rank, lane);
+        const VehicleClassParams& params = vehicleClassParams(vehicle.vehicle_class);
+        position[s] = vehicle.position_in_lane;
+        speed[s] = vehicle.current_speed;
+        can_move[s] = vehicle_can_move ? 1.0 : 0.0;
+        length_m[s] = params.length_m;
+        accel[s] = params.accel;
+        decel[s] = params.decel;
+        desired_speed[s] = params.desired_speed;
+        headway_s[s] = params.headway_s;
+    }
+
+    void advanceCarFollowing(CarFollowingBatch& batch, double dt_seconds) {
+        for (std::size_t lane = 0; lane < batch.lane_count; ++lane) {
+            for (std::size_t rank = 0; rank < batch.lane_ranks[lane]; ++rank) {
+                const std::size_t s = batch.slot(rank, lane);
+                const bool has_ahead = rank > 0;
+                const std::size_t a = has_ahead ? s - CarFollowingBatch::kWidth : s;
+                const bool can_move = batch.can_move[s] != 0.0;
+                double position = batch.position[s];
+                double speed = batch.speed[s];
+                const double max_speed = batch.desired_speed[s];
+                const double stop_target = batch.stop_target[lane];
+
+                double target_speed = max_speed;
+                double target_position = stop_target;
+                const double min_front = batch.length_m[a] + kStoppedGapMeters;
+                if (has_ahead) {
+                    const double ahead_position = batch.position[a];
+                    const double ahead_speed = batch.speed[a];
+                    target_position = std::min(target_position, ahead_position - min_front);
+
+                    const double spacing = ahead_position - position;
+                    const double desired_gap =
+                        speed < kStoppedSpeed ? min_front : batch.length_m[a] + batch.headway_s[s] * speed;
+
+                    if (can_move) {
+                        // Time-gap following
+                        if (spacing < desired_gap) {
+                            const double ratio = spacing / desired_gap;
+                            target_speed =
+                                std::min(target_speed, ahead_speed + (max_speed - ahead_speed) * ratio);
+                        }
+                        if (spacing < min_front) {
+                            target_speed = 0.0;
+                        }
+                    } else {
+                        // Red/orange: brake to the stop target or behind the vehicle ahead
+                        const double dist_to_target = target_position - position;
+                        if (dist_to_target <= 0.0) {
+                            target_speed = 0.0;
+                        } else {
+                            target_speed =
+                                std::min(target_speed, std::sqrt(2.0 * batch.decel[s] * dist_to_target));
+                        }
+                    }
+                } else if (!can_move && position < batch.stop_line[lane]) {
+                    const double dist_to_stop = stop_target - position;
+                    if (dist_to_stop <= 0.0) {
+                        target_speed = 0.0;
+                    } else {
+                        target_speed = std::min(target_speed, std::sqrt(2.0 * batch.decel[s] * dist_to_stop));
+                    }
+                }
+
+                // Vehicle::updateSpeed
+                target_speed = std::max(0.0, std::min(max_speed, target_speed));
+                const double delta = target_speed - speed;
+                const double max_change = batch.accel[s] * dt_seconds;
+                if (std::abs(delta) <= max_change) {
+                    speed = target_speed;
+                } else if (delta > 0.0) {
+                    speed += max_change;
+                } else {
+                    speed -= max_change;
+                }
+
+                position += speed * dt_seconds;
+
+                if (!can_move && position > target_position) {
+                    position = target_position;
+                    speed = 0.0;
+                }
+                if (has_ahead) {
+                    const double max_position = batch.position[a] - min_front;
+                    if (position > max_position) {
+                        position = max_position;
+                        speed = std::min(speed, batch.speed[a]);
+                    }
+                }
+
+                batch.position[s] = position;
+                batch.speed[s] = speed;
+            }
+        }
+    }
+}  // namespace crossroads
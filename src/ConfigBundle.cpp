@@ -0,0 +1,125 @@
+#include "ConfigBundle.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <nlohmann/json.hpp>
+#include <unordered_map>
+
+#include "IntersectionConfigJson.hpp"
+#include "ParallelFor.hpp"
+#include "SafetyChecker.hpp"
+
+namespace crossroads {
+    namespace {
+        struct BundleLine {
+            std::size_t number = 0;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+        };
+
+        struct LineOutcome {
+            ConfigBundleEntry entry;
+            std::string error;
+        };
+
+        std::string trimmed(const std::string& value) {
+            auto not_space = [](unsigned char ch) { return !std::isspace(ch); };
+            auto first = std::find_if(value.begin(), value.end(), not_space);
+            auto last = std::find_if(value.rbegin(), value.rend(), not_space).base();
+            return first < last ? std::string(first, last) : std::string();
+        }
+
+        std::vector<BundleLine> splitLines(const std::string& ndjson) {
+            std::vector<BundleLine> lines;
+            std::size_t number = 0;
+            std::size_t begin = 0;
+            while (begin < ndjson.size()) {
+                std::size_t end = ndjson.find('\n', begin);
+                if (end == std::string::npos) {
+                    end = ndjson.size();
+                }
+                ++number;
+                const bool blank = std::all_of(ndjson.begin() + static_cast<std::ptrdiff_t>(begin),
+                                               ndjson.begin() + static_cast<std::ptrdiff_t>(end),
+                                               [](unsigned char ch) { return std::isspace(ch); });
+                if (!blank) {
+                    lines.push_back({number, begin, end});
+                }
+                begin = end + 1;
+            }
+            return lines;
+        }
+
+        LineOutcome parseLine(const std::string& ndjson, const BundleLine& line) {
+            LineOutcome outcome;
+            const nlohmann::json object = nlohmann::json::parse(ndjson.begin() + static_cast<std::ptrdiff_t>(line.begin),
+                                                                ndjson.begin() + static_cast<std::ptrdiff_t>(line.end),
+                                                                nullptr,
+                                                                false);
+            if (!object.is_object()) {
+                outcome.error = "not a JSON object";
+                return outcome;
+            }
+            if (!object.contains("name") || !object["name"].is_string() ||
+                (outcome.entry.name = trimmed(object["name"].get<std::string>())).empty()) {
+                outcome.error = "name is required";
+                return outcome;
+            }
+            if (!object.contains("config")) {
+                outcome.error = "config is required";
+                return outcome;
+            }
+
+            const nlohmann::json& config = object["config"];
+            const ConfigParseResult parsed =
+                intersectionConfigFromJson(config.is_string() ? config.get<std::string>() : config.dump());
+            if (!parsed.ok) {
+                outcome.error = parsed.errors.empty() ? "invalid config" : parsed.errors.front();
+                return outcome;
+            }
+            if (!SafetyChecker(parsed.config).isConfigValid()) {
+                outcome.error = "config failed safety validation rules";
+                return outcome;
+            }
+            outcome.entry.config_json = intersectionConfigToJson(parsed.config);
+            return outcome;
+        }
+    }  // namespace
+
+    ConfigBundleParseResult parseConfigBundle(const std::string& ndjson, std::size_t worker_count) {
+        ConfigBundleParseResult result;
+        const std::vector<BundleLine> lines = splitLines(ndjson);
+        std::vector<LineOutcome> outcomes(lines.size());
+        parallelFor(lines.size(), worker_count, [&](std::size_t i, std::size_t) {
+            outcomes[i] = parseLine(ndjson, lines[i]);
+        });
+
+        std::unordered_map<std::string, std::size_t> first_line_by_name;
+        result.entries.reserve(outcomes.size());
+        for (std::size_t i = 0; i < outcomes.size(); ++i) {
+            const std::string prefix = "line " + std::to_string(lines[i].number) + ": ";
+            if (!outcomes[i].error.empty()) {
+                result.errors.push_back(prefix + outcomes[i].error);
+                continue;
+            }
+            const auto [it, inserted] = first_line_by_name.emplace(outcomes[i].entry.name, lines[i].number);
+            if (!inserted) {
+                result.errors.push_back(prefix + "name \"" + outcomes[i].entry.name + "\" already used on line " +
+                                        std::to_string(it->second));
+                continue;
+            }
+            result.entries.push_back(std::move(outcomes[i].entry));
+        }
+
+        result.ok = result.errors.empty();
+        return result;
+    }
+
+    void appendConfigBundleLine(std::string& out, const std::string& name, const std::string& config_json) {
+        out += "{\"name\":";
+        out += nlohmann::json(name).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        out += ",\"config\":";
+        out += config_json;
+        out += "}\n";
+    }
+}  // namespace crossroads
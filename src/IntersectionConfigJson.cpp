@@ -2,6 +2,11 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
 #include <nlohmann/json.hpp>
 #include <unordered_set>
 
@@ -9,7 +14,10 @@ namespace crossroads {
     namespace {
         using nlohmann::json;
 
-        std::string approachToString(ApproachId id) {
+        constexpr uint64_t kFnvOffsetBasis = 1469598103934665603ULL;
+        constexpr uint64_t kFnvPrime = 1099511628211ULL;
+
+        const char* approachToString(ApproachId id) {
             switch (id) {
                 case ApproachId::North:
                     return "north";
@@ -43,7 +51,7 @@ namespace crossroads {
             return false;
         }
 
-        std::string movementToString(MovementType movement) {
+        const char* movementToString(MovementType movement) {
             switch (movement) {
                 case MovementType::Straight:
                     return "straight";
@@ -116,367 +124,1207 @@ namespace crossroads {
             }
             return false;
         }
-    }  // namespace
 
-    std::string intersectionConfigToJson(const IntersectionConfig& config) {
-        json root;
-        root["approaches"] = json::array();
-
-        for (const auto& approach : config.approaches) {
-            json approach_json;
-            approach_json["id"] = approachToString(approach.id);
-            approach_json["name"] = approach.name;
-            approach_json["to_lane_count"] = approach.to_lane_count;
-            approach_json["lanes"] = json::array();
-
-            for (const auto& lane : approach.lanes) {
-                json lane_json;
-                lane_json["id"] = lane.id;
-                lane_json["index"] = lane.id - laneIdFor(approach.id, 0);
-                lane_json["name"] = lane.name;
-                lane_json["supports_lane_change"] = lane.supports_lane_change;
-                lane_json["connected_to_intersection"] = lane.connected_to_intersection;
-                lane_json["has_traffic_light"] = lane.has_traffic_light;
-                lane_json["allowed_movements"] = json::array();
-                for (MovementType movement : lane.allowed_movements) {
-                    lane_json["allowed_movements"].push_back(movementToString(movement));
-                }
-                approach_json["lanes"].push_back(lane_json);
-            }
-
-            root["approaches"].push_back(approach_json);
-        }
-
-        root["signal_groups"] = json::array();
-        for (const auto& group : config.signal_groups) {
-            json group_json;
-            group_json["id"] = group.id;
-            group_json["name"] = group.name;
-            group_json["controlled_lanes"] = group.controlled_lanes;
-            group_json["green_movements"] = json::array();
-            for (MovementType movement : group.green_movements) {
-                group_json["green_movements"].push_back(movementToString(movement));
-            }
-            group_json["min_green_seconds"] = group.min_green_seconds;
-            group_json["orange_seconds"] = group.orange_seconds;
-            root["signal_groups"].push_back(group_json);
-        }
-
-        root["lane_connections"] = json::array();
-        for (const auto& connection : config.lane_connections) {
-            json connection_json;
-            connection_json["from_approach"] = approachToString(connection.from_approach);
-            connection_json["from_lane_index"] = connection.from_lane_index;
-            connection_json["from_lane_id"] = laneIdFor(connection.from_approach, connection.from_lane_index);
-            connection_json["movement"] = movementToString(connection.movement);
-            connection_json["to_approach"] = approachToString(connection.to_approach);
-            connection_json["to_lane_index"] = connection.to_lane_index;
-            connection_json["to_lane_id"] = laneIdFor(connection.to_approach, connection.to_lane_index);
-            root["lane_connections"].push_back(connection_json);
+        // --- Writing -------------------------------------------------------------------------------------------
+        // The writer emits exactly what nlohmann's dump() made of the old DOM (keys in sorted order, no spaces),
+        // so stored configs and hashes stay byte-for-byte the same. Sinks only need put() and write().
+
+        struct StringSink {
+            std::string& out;
+
+            void put(char ch) {
+                out.push_back(ch);
+            }
+
+            void write(const char* data, std::size_t size) {
+                out.append(data, size);
+            }
+        };
+
+        struct FnvSink {
+            uint64_t hash = kFnvOffsetBasis;
+
+            void put(char ch) {
+                hash ^= static_cast<unsigned char>(ch);
+                hash *= kFnvPrime;
+            }
+
+            void write(const char* data, std::size_t size) {
+                for (std::size_t i = 0; i < size; ++i) {
+                    put(data[i]);
+                }
+            }
+        };
+
+        template <typename Sink>
+        void writeLiteral(Sink& sink, const char* text) {
+            sink.write(text, std::strlen(text));
         }
 
-        return root.dump();
-    }
+        template <typename Sink>
+        void writeString(Sink& sink, const char* data, std::size_t size) {
+            sink.put('"');
+            std::size_t run_start = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                const auto ch = static_cast<unsigned char>(data[i]);
+                const char* escape = nullptr;
+                switch (ch) {
+                    case '"':
+                        escape = "\\\"";
+                        break;
+                    case '\\':
+                        escape = "\\\\";
+                        break;
+                    case '\b':
+                        escape = "\\b";
+                        break;
+                    case '\f':
+                        escape = "\\f";
+                        break;
+                    case '\n':
+                        escape = "\\n";
+                        break;
+                    case '\r':
+                        escape = "\\r";
+                        break;
+                    case '\t':
+                        escape = "\\t";
+                        break;
+                    default:
+                        if (ch >= 0x20) {
+                            continue;
+                        }
+                        break;
+                }
 
-    ConfigParseResult intersectionConfigFromJson(const std::string& json_text) {
-        ConfigParseResult result;
+                sink.write(data + run_start, i - run_start);
+                if (escape != nullptr) {
+                    writeLiteral(sink, escape);
+                } else {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(ch));
+                    sink.write(buffer, 6);
+                }
+                run_start = i + 1;
+            }
+            sink.write(data + run_start, size - run_start);
+            sink.put('"');
+        }
 
-        json root;
-        try {
-            root = json::parse(json_text);
-        } catch (const std::exception& e) {
-            result.errors.push_back(std::string("invalid JSON: ") + e.what());
-            return result;
+        template <typename Sink>
+        void writeString(Sink& sink, const std::string& value) {
+            writeString(sink, value.data(), value.size());
         }
 
-        if (!root.is_object()) {
-            result.errors.push_back("root must be an object");
-            return result;
+        template <typename Sink>
+        void writeString(Sink& sink, const char* value) {
+            writeString(sink, value, std::strlen(value));
         }
 
-        if (!root.contains("approaches") || !root["approaches"].is_array()) {
-            result.errors.push_back("approaches must be an array");
-            return result;
+        template <typename Sink>
+        void writeUnsigned(Sink& sink, uint64_t value) {
+            char buffer[20];
+            std::size_t pos = sizeof(buffer);
+            do {
+                buffer[--pos] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            sink.write(buffer + pos, sizeof(buffer) - pos);
         }
 
-        const json& approaches_json = root["approaches"];
-        if (approaches_json.size() != 4) {
-            result.errors.push_back("approaches must contain exactly 4 entries");
-            return result;
+        template <typename Sink>
+        void writeSigned(Sink& sink, int64_t value) {
+            if (value < 0) {
+                sink.put('-');
+                writeUnsigned(sink, 0 - static_cast<uint64_t>(value));
+                return;
+            }
+            writeUnsigned(sink, static_cast<uint64_t>(value));
         }
 
-        std::array<bool, 4> seen_approaches = {false, false, false, false};
-        std::unordered_set<LaneId> seen_lanes;
+        template <typename Sink>
+        void writeDouble(Sink& sink, double value) {
+            if (!std::isfinite(value)) {
+                writeLiteral(sink, "null");
+                return;
+            }
+            char buffer[64];
+            const char* end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value);
+            sink.write(buffer, static_cast<std::size_t>(end - buffer));
+        }
+
+        template <typename Sink>
+        void writeBool(Sink& sink, bool value) {
+            writeLiteral(sink, value ? "true" : "false");
+        }
+
+        template <typename Sink>
+        void writeMovements(Sink& sink, const std::vector<MovementType>& movements) {
+            sink.put('[');
+            for (std::size_t i = 0; i < movements.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeString(sink, movementToString(movements[i]));
+            }
+            sink.put(']');
+        }
+
+        template <typename Sink>
+        void writeLane(Sink& sink, const ApproachConfig& approach, const LaneConfig& lane) {
+            writeLiteral(sink, "{\"allowed_movements\":");
+            writeMovements(sink, lane.allowed_movements);
+            writeLiteral(sink, ",\"connected_to_intersection\":");
+            writeBool(sink, lane.connected_to_intersection);
+            writeLiteral(sink, ",\"has_traffic_light\":");
+            writeBool(sink, lane.has_traffic_light);
+            writeLiteral(sink, ",\"id\":");
+            writeUnsigned(sink, lane.id);
+            writeLiteral(sink, ",\"index\":");
+            writeSigned(sink, lane.id - laneIdFor(approach.id, 0));
+            writeLiteral(sink, ",\"name\":");
+            writeString(sink, lane.name);
+            writeLiteral(sink, ",\"supports_lane_change\":");
+            writeBool(sink, lane.supports_lane_change);
+            sink.put('}');
+        }
 
-        for (const auto& approach_json : approaches_json) {
-            if (!approach_json.is_object()) {
-                result.errors.push_back("each approach entry must be an object");
-                continue;
+        template <typename Sink>
+        void writeApproach(Sink& sink, const ApproachConfig& approach) {
+            // The whole mix is written unless it is the default, so configs from before the mix keep their
+            // fingerprint and any two mixes, valid or not, fingerprint differently.
+            const bool write_mix = approach.vehicle_mix != ApproachConfig{}.vehicle_mix;
+            auto writeShare = [&](const char* key, VehicleClass vehicle_class) {
+                writeLiteral(sink, key);
+                writeDouble(sink, approach.vehicle_mix[static_cast<std::size_t>(vehicle_class)]);
+            };
+            sink.put('{');
+            if (write_mix) {
+                writeShare("\"bicycle_share\":", VehicleClass::Bicycle);
+                writeShare(",\"bus_share\":", VehicleClass::Bus);
+                writeShare(",\"car_share\":", VehicleClass::Car);
+                sink.put(',');
             }
+            writeLiteral(sink, "\"id\":");
+            writeString(sink, approachToString(approach.id));
+            if (approach.lane_capacity > 0) {
+                writeLiteral(sink, ",\"lane_capacity\":");
+                writeUnsigned(sink, approach.lane_capacity);
+            }
+            writeLiteral(sink, ",\"lanes\":[");
+            for (std::size_t i = 0; i < approach.lanes.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeLane(sink, approach, approach.lanes[i]);
+            }
+            sink.put(']');
+            if (approach.length_m != kDefaultApproachLengthMeters) {
+                writeLiteral(sink, ",\"length_m\":");
+                writeDouble(sink, approach.length_m);
+            }
+            writeLiteral(sink, ",\"name\":");
+            writeString(sink, approach.name);
+            writeLiteral(sink, ",\"to_lane_count\":");
+            writeUnsigned(sink, approach.to_lane_count);
+            if (write_mix) {
+                writeShare(",\"truck_share\":", VehicleClass::Truck);
+            }
+            sink.put('}');
+        }
+
+        template <typename Sink>
+        void writeConnection(Sink& sink, const LaneConnectionConfig& connection) {
+            writeLiteral(sink, "{\"from_approach\":");
+            writeString(sink, approachToString(connection.from_approach));
+            writeLiteral(sink, ",\"from_lane_id\":");
+            writeUnsigned(sink, laneIdFor(connection.from_approach, connection.from_lane_index));
+            writeLiteral(sink, ",\"from_lane_index\":");
+            writeUnsigned(sink, connection.from_lane_index);
+            writeLiteral(sink, ",\"movement\":");
+            writeString(sink, movementToString(connection.movement));
+            writeLiteral(sink, ",\"to_approach\":");
+            writeString(sink, approachToString(connection.to_approach));
+            writeLiteral(sink, ",\"to_lane_id\":");
+            writeUnsigned(sink, laneIdFor(connection.to_approach, connection.to_lane_index));
+            writeLiteral(sink, ",\"to_lane_index\":");
+            writeUnsigned(sink, connection.to_lane_index);
+            sink.put('}');
+        }
 
-            if (!approach_json.contains("id") || !approach_json["id"].is_string()) {
-                result.errors.push_back("approach.id must be a string");
-                continue;
+        template <typename Sink>
+        void writeSignalGroup(Sink& sink, const SignalGroupConfig& group) {
+            writeLiteral(sink, "{\"controlled_lanes\":[");
+            for (std::size_t i = 0; i < group.controlled_lanes.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeUnsigned(sink, group.controlled_lanes[i]);
             }
+            writeLiteral(sink, "],\"green_movements\":");
+            writeMovements(sink, group.green_movements);
+            writeLiteral(sink, ",\"id\":");
+            writeUnsigned(sink, group.id);
+            writeLiteral(sink, ",\"min_green_seconds\":");
+            writeDouble(sink, group.min_green_seconds);
+            writeLiteral(sink, ",\"name\":");
+            writeString(sink, group.name);
+            writeLiteral(sink, ",\"orange_seconds\":");
+            writeDouble(sink, group.orange_seconds);
+            sink.put('}');
+        }
 
-            ApproachId approach_id{};
-            const std::string id_value = approach_json["id"].get<std::string>();
-            if (!approachFromString(id_value, approach_id)) {
-                result.errors.push_back("unknown approach id: " + id_value);
-                continue;
+        template <typename Sink>
+        void writeConfig(Sink& sink, const IntersectionConfig& config) {
+            writeLiteral(sink, "{\"approaches\":[");
+            for (std::size_t i = 0; i < config.approaches.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeApproach(sink, config.approaches[i]);
+            }
+            writeLiteral(sink, "],\"lane_connections\":[");
+            for (std::size_t i = 0; i < config.lane_connections.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeConnection(sink, config.lane_connections[i]);
             }
+            writeLiteral(sink, "],\"signal_groups\":[");
+            for (std::size_t i = 0; i < config.signal_groups.size(); ++i) {
+                if (i > 0) {
+                    sink.put(',');
+                }
+                writeSignalGroup(sink, config.signal_groups[i]);
+            }
+            writeLiteral(sink, "]}");
+        }
+
+        // --- Parsing -------------------------------------------------------------------------------------------
+        // The SAX handler copies only the fields the config schema knows into flat Raw* records (anything else is
+        // skipped without being stored); buildConfig() then validates them with the rules and messages the DOM
+        // parser used. Duplicate keys keep the last value, as the DOM did.
 
-            const size_t idx = approachIndexLocal(approach_id);
-            if (seen_approaches[idx]) {
-                result.errors.push_back("duplicate approach id: " + id_value);
-                continue;
+        enum class RawKind : uint8_t { Missing, Null, Boolean, Unsigned, Integer, Float, String, Object, Array, Binary };
+
+        struct RawScalar {
+            RawKind kind = RawKind::Missing;
+            bool boolean = false;
+            uint64_t unsigned_value = 0;
+            int64_t integer_value = 0;
+            double float_value = 0.0;
+            std::string text;
+
+            bool isNumber() const {
+                return kind == RawKind::Unsigned || kind == RawKind::Integer || kind == RawKind::Float;
             }
-            seen_approaches[idx] = true;
 
-            ApproachConfig approach;
-            approach.id = approach_id;
-            approach.name = approach_json.value("name", id_value);
-            if (approach_json.contains("to_lane_count") && approach_json["to_lane_count"].is_number_unsigned()) {
-                approach.to_lane_count = std::min<uint16_t>(approach_json["to_lane_count"].get<uint16_t>(), 64);
-            } else {
-                approach.to_lane_count = 0;
+            double number() const {
+                if (kind == RawKind::Unsigned) {
+                    return static_cast<double>(unsigned_value);
+                }
+                if (kind == RawKind::Integer) {
+                    return static_cast<double>(integer_value);
+                }
+                return float_value;
             }
+        };
 
-            if (!approach_json.contains("lanes") || !approach_json["lanes"].is_array()) {
-                result.errors.push_back("approach " + id_value + " lanes must be an array");
-                continue;
+        struct RawList {
+            RawKind kind = RawKind::Missing;
+            std::vector<RawScalar> items;
+        };
+
+        template <typename Entry>
+        struct RawEntries {
+            RawKind kind = RawKind::Missing;
+            std::vector<Entry> entries;
+
+            void reset(RawKind new_kind) {
+                kind = new_kind;
+                entries.clear();
             }
+        };
 
-            size_t lane_index = 0;
-            for (const auto& lane_json : approach_json["lanes"]) {
-                if (!lane_json.is_object()) {
-                    result.errors.push_back("lane entries must be objects");
-                    continue;
+        struct RawLane {
+            bool is_object = false;
+            RawScalar name;
+            RawScalar supports_lane_change;
+            RawScalar connected_to_intersection;
+            RawScalar has_traffic_light;
+            RawList allowed_movements;
+        };
+
+        struct RawApproach {
+            bool is_object = false;
+            RawScalar id;
+            RawScalar name;
+            RawScalar to_lane_count;
+            RawScalar length_m;
+            RawScalar lane_capacity;
+            RawScalar car_share;
+            RawScalar truck_share;
+            RawScalar bus_share;
+            RawScalar bicycle_share;
+            RawEntries<RawLane> lanes;
+        };
+
+        struct RawGroup {
+            bool is_object = false;
+            RawScalar id;
+            RawScalar name;
+            RawScalar min_green_seconds;
+            RawScalar orange_seconds;
+            RawList controlled_lanes;
+            RawList green_movements;
+        };
+
+        struct RawConnection {
+            bool is_object = false;
+            RawScalar from_approach;
+            RawScalar from_lane_index;
+            RawScalar from_lane_id;
+            RawScalar movement;
+            RawScalar to_approach;
+            RawScalar to_lane_index;
+            RawScalar to_lane_id;
+        };
+
+        struct RawConfig {
+            RawKind root_kind = RawKind::Missing;
+            RawEntries<RawApproach> approaches;
+            RawEntries<RawGroup> signal_groups;
+            RawEntries<RawConnection> lane_connections;
+        };
+
+        class ConfigSaxHandler {
+           public:
+            RawConfig config;
+            std::string parse_error_message;
+
+            ConfigSaxHandler() {
+                frames.reserve(8);
+            }
+
+            bool null() {
+                return scalar(makeScalar(RawKind::Null));
+            }
+
+            bool boolean(bool value) {
+                RawScalar raw = makeScalar(RawKind::Boolean);
+                raw.boolean = value;
+                return scalar(std::move(raw));
+            }
+
+            bool number_integer(json::number_integer_t value) {
+                RawScalar raw = makeScalar(RawKind::Integer);
+                raw.integer_value = value;
+                return scalar(std::move(raw));
+            }
+
+            bool number_unsigned(json::number_unsigned_t value) {
+                RawScalar raw = makeScalar(RawKind::Unsigned);
+                raw.unsigned_value = value;
+                return scalar(std::move(raw));
+            }
+
+            bool number_float(json::number_float_t value, const json::string_t& /*text*/) {
+                RawScalar raw = makeScalar(RawKind::Float);
+                raw.float_value = value;
+                return scalar(std::move(raw));
+            }
+
+            bool string(json::string_t& value) {
+                RawScalar raw = makeScalar(RawKind::String);
+                raw.text = std::move(value);
+                return scalar(std::move(raw));
+            }
+
+            bool binary(json::binary_t& /*value*/) {
+                return scalar(makeScalar(RawKind::Binary));
+            }
+
+            bool start_object(std::size_t /*elements*/) {
+                return open(RawKind::Object);
+            }
+
+            bool end_object() {
+                frames.pop_back();
+                return true;
+            }
+
+            bool start_array(std::size_t /*elements*/) {
+                return open(RawKind::Array);
+            }
+
+            bool end_array() {
+                frames.pop_back();
+                return true;
+            }
+
+            bool key(json::string_t& name) {
+                pending = selectField(frames.back(), name);
+                return true;
+            }
+
+            bool parse_error(std::size_t /*position*/,
+                             const std::string& /*last_token*/,
+                             const nlohmann::detail::exception& error) {
+                parse_error_message = error.what();
+                return false;
+            }
+
+           private:
+            enum class FrameType : uint8_t {
+                Skip,
+                Root,
+                Approaches,
+                Approach,
+                Lanes,
+                Lane,
+                Groups,
+                Group,
+                Connections,
+                Connection,
+                List
+            };
+
+            // One open object or array. Containers the schema does not know are Skip frames.
+            struct Frame {
+                FrameType type = FrameType::Skip;
+                RawApproach* approach = nullptr;
+                RawLane* lane = nullptr;
+                RawGroup* group = nullptr;
+                RawConnection* connection = nullptr;
+                RawList* list = nullptr;
+            };
+
+            enum class SlotType : uint8_t {
+                Skip,
+                Root,
+                Scalar,
+                List,
+                Approaches,
+                Lanes,
+                Groups,
+                Connections,
+                ApproachEntry,
+                LaneEntry,
+                GroupEntry,
+                ConnectionEntry,
+                ListItem
+            };
+
+            // Where the next value goes: chosen by the last key inside an object, by the frame inside an array.
+            struct Slot {
+                SlotType type = SlotType::Skip;
+                RawScalar* scalar = nullptr;
+                RawList* list = nullptr;
+                RawApproach* approach = nullptr;
+            };
+
+            static RawScalar makeScalar(RawKind kind) {
+                RawScalar raw;
+                raw.kind = kind;
+                return raw;
+            }
+
+            static Slot scalarSlot(RawScalar& target) {
+                Slot slot;
+                slot.type = SlotType::Scalar;
+                slot.scalar = &target;
+                return slot;
+            }
+
+            static Slot listSlot(RawList& target) {
+                Slot slot;
+                slot.type = SlotType::List;
+                slot.list = &target;
+                return slot;
+            }
+
+            static Slot selectField(const Frame& frame, const std::string& name) {
+                Slot slot;
+                switch (frame.type) {
+                    case FrameType::Root:
+                        if (name == "approaches") {
+                            slot.type = SlotType::Approaches;
+                        } else if (name == "signal_groups") {
+                            slot.type = SlotType::Groups;
+                        } else if (name == "lane_connections") {
+                            slot.type = SlotType::Connections;
+                        }
+                        break;
+                    case FrameType::Approach:
+                        if (name == "id") {
+                            slot = scalarSlot(frame.approach->id);
+                        } else if (name == "name") {
+                            slot = scalarSlot(frame.approach->name);
+                        } else if (name == "to_lane_count") {
+                            slot = scalarSlot(frame.approach->to_lane_count);
+                        } else if (name == "length_m") {
+                            slot = scalarSlot(frame.approach->length_m);
+                        } else if (name == "lane_capacity") {
+                            slot = scalarSlot(frame.approach->lane_capacity);
+                        } else if (name == "car_share") {
+                            slot = scalarSlot(frame.approach->car_share);
+                        } else if (name == "truck_share") {
+                            slot = scalarSlot(frame.approach->truck_share);
+                        } else if (name == "bus_share") {
+                            slot = scalarSlot(frame.approach->bus_share);
+                        } else if (name == "bicycle_share") {
+                            slot = scalarSlot(frame.approach->bicycle_share);
+                        } else if (name == "lanes") {
+                            slot.type = SlotType::Lanes;
+                            slot.approach = frame.approach;
+                        }
+                        break;
+                    case FrameType::Lane:
+                        if (name == "name") {
+                            slot = scalarSlot(frame.lane->name);
+                        } else if (name == "supports_lane_change") {
+                            slot = scalarSlot(frame.lane->supports_lane_change);
+                        } else if (name == "connected_to_intersection") {
+                            slot = scalarSlot(frame.lane->connected_to_intersection);
+                        } else if (name == "has_traffic_light") {
+                            slot = scalarSlot(frame.lane->has_traffic_light);
+                        } else if (name == "allowed_movements") {
+                            slot = listSlot(frame.lane->allowed_movements);
+                        }
+                        break;
+                    case FrameType::Group:
+                        if (name == "id") {
+                            slot = scalarSlot(frame.group->id);
+                        } else if (name == "name") {
+                            slot = scalarSlot(frame.group->name);
+                        } else if (name == "min_green_seconds") {
+                            slot = scalarSlot(frame.group->min_green_seconds);
+                        } else if (name == "orange_seconds") {
+                            slot = scalarSlot(frame.group->orange_seconds);
+                        } else if (name == "controlled_lanes") {
+                            slot = listSlot(frame.group->controlled_lanes);
+                        } else if (name == "green_movements") {
+                            slot = listSlot(frame.group->green_movements);
+                        }
+                        break;
+                    case FrameType::Connection:
+                        if (name == "from_approach") {
+                            slot = scalarSlot(frame.connection->from_approach);
+                        } else if (name == "from_lane_index") {
+                            slot = scalarSlot(frame.connection->from_lane_index);
+                        } else if (name == "from_lane_id") {
+                            slot = scalarSlot(frame.connection->from_lane_id);
+                        } else if (name == "movement") {
+                            slot = scalarSlot(frame.connection->movement);
+                        } else if (name == "to_approach") {
+                            slot = scalarSlot(frame.connection->to_approach);
+                        } else if (name == "to_lane_index") {
+                            slot = scalarSlot(frame.connection->to_lane_index);
+                        } else if (name == "to_lane_id") {
+                            slot = scalarSlot(frame.connection->to_lane_id);
+                        }
+                        break;
+                    default:
+                        break;
                 }
+                return slot;
+            }
 
-                LaneConfig lane;
-                lane.id = laneIdFor(approach_id, lane_index);
-                const std::string default_lane_name =
-                    std::string(1, static_cast<char>(std::toupper(id_value[0]))) + "-" + std::to_string(lane_index);
-                lane.name = lane_json.value("name", default_lane_name);
-                lane.supports_lane_change = lane_json.value("supports_lane_change", true);
-                lane.connected_to_intersection = lane_json.value("connected_to_intersection", true);
-                lane.has_traffic_light = lane_json.value("has_traffic_light", true);
-                if (!lane.connected_to_intersection) {
-                    lane.has_traffic_light = false;
+            Slot currentSlot() const {
+                Slot slot;
+                if (frames.empty()) {
+                    slot.type = SlotType::Root;
+                    return slot;
                 }
 
-                if (!seen_lanes.insert(lane.id).second) {
-                    result.errors.push_back("duplicate lane id: " + std::to_string(lane.id));
+                const Frame& top = frames.back();
+                switch (top.type) {
+                    case FrameType::Root:
+                    case FrameType::Approach:
+                    case FrameType::Lane:
+                    case FrameType::Group:
+                    case FrameType::Connection:
+                        return pending;
+                    case FrameType::Approaches:
+                        slot.type = SlotType::ApproachEntry;
+                        break;
+                    case FrameType::Lanes:
+                        slot.type = SlotType::LaneEntry;
+                        slot.approach = top.approach;
+                        break;
+                    case FrameType::Groups:
+                        slot.type = SlotType::GroupEntry;
+                        break;
+                    case FrameType::Connections:
+                        slot.type = SlotType::ConnectionEntry;
+                        break;
+                    case FrameType::List:
+                        slot.type = SlotType::ListItem;
+                        slot.list = top.list;
+                        break;
+                    case FrameType::Skip:
+                        break;
                 }
+                return slot;
+            }
 
-                if (!lane_json.contains("allowed_movements") || !lane_json["allowed_movements"].is_array()) {
-                    result.errors.push_back("lane " + std::to_string(lane.id) + " allowed_movements must be an array");
-                    continue;
+            bool scalar(RawScalar value) {
+                const Slot slot = currentSlot();
+                switch (slot.type) {
+                    case SlotType::Root:
+                        config.root_kind = value.kind;
+                        break;
+                    case SlotType::Scalar:
+                        *slot.scalar = std::move(value);
+                        break;
+                    case SlotType::List:
+                        slot.list->kind = value.kind;
+                        slot.list->items.clear();
+                        break;
+                    case SlotType::Approaches:
+                        config.approaches.reset(value.kind);
+                        break;
+                    case SlotType::Lanes:
+                        slot.approach->lanes.reset(value.kind);
+                        break;
+                    case SlotType::Groups:
+                        config.signal_groups.reset(value.kind);
+                        break;
+                    case SlotType::Connections:
+                        config.lane_connections.reset(value.kind);
+                        break;
+                    case SlotType::ApproachEntry:
+                        config.approaches.entries.emplace_back();
+                        break;
+                    case SlotType::LaneEntry:
+                        slot.approach->lanes.entries.emplace_back();
+                        break;
+                    case SlotType::GroupEntry:
+                        config.signal_groups.entries.emplace_back();
+                        break;
+                    case SlotType::ConnectionEntry:
+                        config.lane_connections.entries.emplace_back();
+                        break;
+                    case SlotType::ListItem:
+                        slot.list->items.push_back(std::move(value));
+                        break;
+                    case SlotType::Skip:
+                        break;
                 }
+                return true;
+            }
 
-                for (const auto& movement_json : lane_json["allowed_movements"]) {
-                    if (!movement_json.is_string()) {
-                        result.errors.push_back("lane " + std::to_string(lane.id) + " movement must be a string");
-                        continue;
+            bool open(RawKind kind) {
+                const Slot slot = currentSlot();
+                const bool is_object = kind == RawKind::Object;
+                const bool is_array = kind == RawKind::Array;
+                Frame frame;
+                switch (slot.type) {
+                    case SlotType::Root:
+                        config.root_kind = kind;
+                        if (is_object) {
+                            frame.type = FrameType::Root;
+                        }
+                        break;
+                    case SlotType::Scalar:
+                        *slot.scalar = makeScalar(kind);
+                        break;
+                    case SlotType::List:
+                        slot.list->kind = kind;
+                        slot.list->items.clear();
+                        if (is_array) {
+                            frame.type = FrameType::List;
+                            frame.list = slot.list;
+                        }
+                        break;
+                    case SlotType::Approaches:
+                        config.approaches.reset(kind);
+                        if (is_array) {
+                            frame.type = FrameType::Approaches;
+                        }
+                        break;
+                    case SlotType::Lanes:
+                        slot.approach->lanes.reset(kind);
+                        if (is_array) {
+                            frame.type = FrameType::Lanes;
+                            frame.approach = slot.approach;
+                        }
+                        break;
+                    case SlotType::Groups:
+                        config.signal_groups.reset(kind);
+                        if (is_array) {
+                            frame.type = FrameType::Groups;
+                        }
+                        break;
+                    case SlotType::Connections:
+                        config.lane_connections.reset(kind);
+                        if (is_array) {
+                            frame.type = FrameType::Connections;
+                        }
+                        break;
+                    case SlotType::ApproachEntry: {
+                        RawApproach& approach = config.approaches.entries.emplace_back();
+                        approach.is_object = is_object;
+                        if (is_object) {
+                            frame.type = FrameType::Approach;
+                            frame.approach = &approach;
+                        }
+                        break;
                     }
-
-                    MovementType movement;
-                    const std::string movement_value = movement_json.get<std::string>();
-                    if (!movementFromString(movement_value, movement)) {
-                        result.errors.push_back("lane " + std::to_string(lane.id) +
-                                                " unknown movement: " + movement_value);
-                        continue;
+                    case SlotType::LaneEntry: {
+                        RawLane& lane = slot.approach->lanes.entries.emplace_back();
+                        lane.is_object = is_object;
+                        if (is_object) {
+                            frame.type = FrameType::Lane;
+                            frame.lane = &lane;
+                        }
+                        break;
                     }
-
-                    if (std::find(lane.allowed_movements.begin(), lane.allowed_movements.end(), movement) ==
-                        lane.allowed_movements.end()) {
-                        lane.allowed_movements.push_back(movement);
+                    case SlotType::GroupEntry: {
+                        RawGroup& group = config.signal_groups.entries.emplace_back();
+                        group.is_object = is_object;
+                        if (is_object) {
+                            frame.type = FrameType::Group;
+                            frame.group = &group;
+                        }
+                        break;
+                    }
+                    case SlotType::ConnectionEntry: {
+                        RawConnection& connection = config.lane_connections.entries.emplace_back();
+                        connection.is_object = is_object;
+                        if (is_object) {
+                            frame.type = FrameType::Connection;
+                            frame.connection = &connection;
+                        }
+                        break;
                     }
+                    case SlotType::ListItem:
+                        slot.list->items.push_back(makeScalar(kind));
+                        break;
+                    case SlotType::Skip:
+                        break;
                 }
-
-                approach.lanes.push_back(lane);
-                lane_index += 1;
+                frames.push_back(frame);
+                pending = Slot{};
+                return true;
             }
 
-            result.config.approaches[idx] = approach;
+            std::vector<Frame> frames;
+            Slot pending;
+        };
+
+        // Optional fields fall back to their default when absent; a value of the wrong type is reported and
+        // the default used, so one bad field does not hide the rest of the errors.
+        std::string optionalString(const RawScalar& field,
+                                   const std::string& fallback,
+                                   const std::string& owner,
+                                   const char* key,
+                                   std::vector<std::string>& errors) {
+            if (field.kind == RawKind::Missing) {
+                return fallback;
+            }
+            if (field.kind != RawKind::String) {
+                errors.push_back(owner + " " + key + " must be a string");
+                return fallback;
+            }
+            return field.text;
         }
 
-        for (auto& approach : result.config.approaches) {
-            if (approach.to_lane_count == 0) {
-                if (!approach.lanes.empty()) {
-                    approach.to_lane_count = static_cast<uint16_t>(approach.lanes.size());
-                } else {
-                    approach.to_lane_count = 1;
-                }
+        bool optionalBool(const RawScalar& field,
+                          bool fallback,
+                          const std::string& owner,
+                          const char* key,
+                          std::vector<std::string>& errors) {
+            if (field.kind == RawKind::Missing) {
+                return fallback;
             }
+            if (field.kind != RawKind::Boolean) {
+                errors.push_back(owner + " " + key + " must be a boolean");
+                return fallback;
+            }
+            return field.boolean;
         }
 
-        for (size_t i = 0; i < seen_approaches.size(); ++i) {
-            if (!seen_approaches[i]) {
-                result.errors.push_back("missing approach entry");
+        double optionalNumber(const RawScalar& field,
+                              double fallback,
+                              const std::string& owner,
+                              const char* key,
+                              std::vector<std::string>& errors) {
+            if (field.kind == RawKind::Missing) {
+                return fallback;
+            }
+            if (!field.isNumber()) {
+                errors.push_back(owner + " " + key + " must be a number");
+                return fallback;
             }
+            return field.number();
         }
 
-        if (root.contains("signal_groups")) {
-            if (!root["signal_groups"].is_array()) {
-                result.errors.push_back("signal_groups must be an array");
-            } else {
-                std::unordered_set<SignalGroupId> seen_groups;
-                for (const auto& group_json : root["signal_groups"]) {
-                    if (!group_json.is_object()) {
-                        result.errors.push_back("signal_group entries must be objects");
-                        continue;
-                    }
+        void buildApproaches(const RawConfig& raw, ConfigParseResult& result) {
+            std::array<bool, 4> seen_approaches = {false, false, false, false};
+            // An explicit to_lane_count of 0 on an approach without lanes marks an absent arm (T-junction)
+            std::array<bool, 4> explicit_to_lane_count = {false, false, false, false};
+            std::unordered_set<LaneId> seen_lanes;
 
-                    if (!group_json.contains("id") || !group_json["id"].is_number_unsigned()) {
-                        result.errors.push_back("signal_group.id must be an unsigned number");
+            for (const RawApproach& approach_raw : raw.approaches.entries) {
+                if (!approach_raw.is_object) {
+                    result.errors.push_back("each approach entry must be an object");
+                    continue;
+                }
+
+                if (approach_raw.id.kind != RawKind::String) {
+                    result.errors.push_back("approach.id must be a string");
+                    continue;
+                }
+
+                ApproachId approach_id{};
+                const std::string& id_value = approach_raw.id.text;
+                if (!approachFromString(id_value, approach_id)) {
+                    result.errors.push_back("unknown approach id: " + id_value);
+                    continue;
+                }
+
+                const size_t idx = approachIndexLocal(approach_id);
+                if (seen_approaches[idx]) {
+                    result.errors.push_back("duplicate approach id: " + id_value);
+                    continue;
+                }
+                seen_approaches[idx] = true;
+
+                const std::string approach_owner = "approach " + id_value;
+                ApproachConfig approach;
+                approach.id = approach_id;
+                approach.name = optionalString(approach_raw.name, id_value, approach_owner, "name", result.errors);
+                if (approach_raw.to_lane_count.kind == RawKind::Unsigned) {
+                    approach.to_lane_count =
+                        std::min<uint16_t>(static_cast<uint16_t>(approach_raw.to_lane_count.unsigned_value), 64);
+                    explicit_to_lane_count[idx] = true;
+                } else {
+                    approach.to_lane_count = 0;
+                }
+                approach.length_m = optionalNumber(
+                    approach_raw.length_m, kDefaultApproachLengthMeters, approach_owner, "length_m", result.errors);
+                if (!(approach.length_m >= kMinApproachLengthMeters && approach.length_m <= kMaxApproachLengthMeters)) {
+                    result.errors.push_back(approach_owner + " length_m must be between " +
+                                            std::to_string(static_cast<int>(kMinApproachLengthMeters)) + " and " +
+                                            std::to_string(static_cast<int>(kMaxApproachLengthMeters)));
+                }
+                if (approach_raw.lane_capacity.kind == RawKind::Unsigned &&
+                    approach_raw.lane_capacity.unsigned_value <= kMaxLaneCapacity) {
+                    approach.lane_capacity = static_cast<uint16_t>(approach_raw.lane_capacity.unsigned_value);
+                } else if (approach_raw.lane_capacity.kind != RawKind::Missing) {
+                    result.errors.push_back(approach_owner + " lane_capacity must be an unsigned number up to " +
+                                            std::to_string(kMaxLaneCapacity));
+                }
+                double other_shares = 0.0;
+                for (auto [raw_share, vehicle_class, key] :
+                     {std::make_tuple(&approach_raw.truck_share, VehicleClass::Truck, "truck_share"),
+                      std::make_tuple(&approach_raw.bus_share, VehicleClass::Bus, "bus_share"),
+                      std::make_tuple(&approach_raw.bicycle_share, VehicleClass::Bicycle, "bicycle_share")}) {
+                    const double share = optionalNumber(*raw_share, 0.0, approach_owner, key, result.errors);
+                    if (!(share >= 0.0 && share <= 1.0)) {
+                        result.errors.push_back(approach_owner + " " + key + " must be between 0 and 1");
                         continue;
                     }
+                    approach.vehicle_mix[static_cast<std::size_t>(vehicle_class)] = share;
+                    other_shares += share;
+                }
+                if (other_shares > 1.0 + 1e-9) {
+                    result.errors.push_back(approach_owner + " truck_share, bus_share and bicycle_share must add up to "
+                                            "at most 1");
+                }
+                // car_share is the rest unless given; the writer gives it so a written mix reads back exactly
+                const double car_share = optionalNumber(
+                    approach_raw.car_share, std::max(0.0, 1.0 - other_shares), approach_owner, "car_share", result.errors);
+                if (!(car_share >= 0.0 && car_share <= 1.0)) {
+                    result.errors.push_back(approach_owner + " car_share must be between 0 and 1");
+                }
+                approach.vehicle_mix[static_cast<std::size_t>(VehicleClass::Car)] = car_share;
 
-                    SignalGroupConfig group;
-                    group.id = group_json["id"].get<SignalGroupId>();
-                    if (!seen_groups.insert(group.id).second) {
-                        result.errors.push_back("duplicate signal_group id: " + std::to_string(group.id));
-                    }
-                    group.name = group_json.value("name", std::string("group-" + std::to_string(group.id)));
-                    group.min_green_seconds = group_json.value("min_green_seconds", 10.0);
-                    group.orange_seconds = group_json.value("orange_seconds", 2.0);
+                if (approach_raw.lanes.kind != RawKind::Array) {
+                    result.errors.push_back(approach_owner + " lanes must be an array");
+                    continue;
+                }
 
-                    if (!group_json.contains("controlled_lanes") || !group_json["controlled_lanes"].is_array()) {
-                        result.errors.push_back("signal_group " + std::to_string(group.id) +
-                                                " controlled_lanes must be an array");
+                size_t lane_index = 0;
+                for (const RawLane& lane_raw : approach_raw.lanes.entries) {
+                    if (!lane_raw.is_object) {
+                        result.errors.push_back("lane entries must be objects");
                         continue;
                     }
 
-                    for (const auto& lane_json : group_json["controlled_lanes"]) {
-                        if (!lane_json.is_number_unsigned()) {
-                            result.errors.push_back("signal_group " + std::to_string(group.id) +
-                                                    " controlled lane ids must be unsigned numbers");
-                            continue;
-                        }
-                        group.controlled_lanes.push_back(lane_json.get<LaneId>());
+                    LaneConfig lane;
+                    lane.id = laneIdFor(approach_id, lane_index);
+                    const std::string lane_owner = "lane " + std::to_string(lane.id);
+                    const std::string default_lane_name =
+                        std::string(1, static_cast<char>(std::toupper(id_value[0]))) + "-" + std::to_string(lane_index);
+                    lane.name = optionalString(lane_raw.name, default_lane_name, lane_owner, "name", result.errors);
+                    lane.supports_lane_change = optionalBool(
+                        lane_raw.supports_lane_change, true, lane_owner, "supports_lane_change", result.errors);
+                    lane.connected_to_intersection = optionalBool(lane_raw.connected_to_intersection,
+                                                                  true,
+                                                                  lane_owner,
+                                                                  "connected_to_intersection",
+                                                                  result.errors);
+                    lane.has_traffic_light = optionalBool(
+                        lane_raw.has_traffic_light, true, lane_owner, "has_traffic_light", result.errors);
+                    if (!lane.connected_to_intersection) {
+                        lane.has_traffic_light = false;
+                    }
+
+                    if (!seen_lanes.insert(lane.id).second) {
+                        result.errors.push_back("duplicate lane id: " + std::to_string(lane.id));
                     }
 
-                    if (!group_json.contains("green_movements") || !group_json["green_movements"].is_array()) {
-                        result.errors.push_back("signal_group " + std::to_string(group.id) +
-                                                " green_movements must be an array");
+                    if (lane_raw.allowed_movements.kind != RawKind::Array) {
+                        result.errors.push_back(lane_owner + " allowed_movements must be an array");
                         continue;
                     }
 
-                    for (const auto& movement_json : group_json["green_movements"]) {
-                        if (!movement_json.is_string()) {
-                            result.errors.push_back("signal_group " + std::to_string(group.id) +
-                                                    " movement must be a string");
+                    for (const RawScalar& movement_raw : lane_raw.allowed_movements.items) {
+                        if (movement_raw.kind != RawKind::String) {
+                            result.errors.push_back(lane_owner + " movement must be a string");
                             continue;
                         }
 
                         MovementType movement;
-                        const std::string movement_value = movement_json.get<std::string>();
-                        if (!movementFromString(movement_value, movement)) {
-                            result.errors.push_back("signal_group " + std::to_string(group.id) +
-                                                    " unknown movement: " + movement_value);
+                        if (!movementFromString(movement_raw.text, movement)) {
+                            result.errors.push_back(lane_owner + " unknown movement: " + movement_raw.text);
                             continue;
                         }
 
-                        if (std::find(group.green_movements.begin(), group.green_movements.end(), movement) ==
-                            group.green_movements.end()) {
-                            group.green_movements.push_back(movement);
+                        if (std::find(lane.allowed_movements.begin(), lane.allowed_movements.end(), movement) ==
+                            lane.allowed_movements.end()) {
+                            lane.allowed_movements.push_back(movement);
                         }
                     }
 
-                    result.config.signal_groups.push_back(group);
+                    approach.lanes.push_back(std::move(lane));
+                    lane_index += 1;
                 }
+
+                result.config.approaches[idx] = std::move(approach);
             }
-        }
 
-        if (root.contains("lane_connections")) {
-            if (!root["lane_connections"].is_array()) {
-                result.errors.push_back("lane_connections must be an array");
-            } else {
-                for (const auto& connection_json : root["lane_connections"]) {
-                    if (!connection_json.is_object()) {
-                        result.errors.push_back("lane_connection entries must be objects");
-                        continue;
+            for (auto& approach : result.config.approaches) {
+                if (approach.to_lane_count == 0) {
+                    if (!approach.lanes.empty()) {
+                        approach.to_lane_count = static_cast<uint16_t>(approach.lanes.size());
+                    } else if (!explicit_to_lane_count[approachIndexLocal(approach.id)]) {
+                        approach.to_lane_count = 1;
                     }
+                }
+            }
 
-                    LaneConnectionConfig connection;
-                    bool from_ok = false;
-                    bool to_ok = false;
-
-                    if (connection_json.contains("from_approach") && connection_json.contains("from_lane_index") &&
-                        connection_json["from_approach"].is_string() &&
-                        connection_json["from_lane_index"].is_number_unsigned()) {
-                        from_ok = approachFromString(connection_json["from_approach"].get<std::string>(),
-                                                     connection.from_approach);
-                        connection.from_lane_index = connection_json["from_lane_index"].get<uint16_t>();
-                    } else if (connection_json.contains("from_lane_id") &&
-                               connection_json["from_lane_id"].is_number_unsigned()) {
-                        from_ok = resolveLaneIdToApproachIndex(result.config,
-                                                               connection_json["from_lane_id"].get<LaneId>(),
-                                                               connection.from_approach,
-                                                               connection.from_lane_index);
-                    }
+            for (size_t i = 0; i < seen_approaches.size(); ++i) {
+                if (!seen_approaches[i]) {
+                    result.errors.push_back("missing approach entry");
+                }
+            }
+        }
+
+        void buildSignalGroups(const RawConfig& raw, ConfigParseResult& result) {
+            if (raw.signal_groups.kind == RawKind::Missing) {
+                return;
+            }
+            if (raw.signal_groups.kind != RawKind::Array) {
+                result.errors.push_back("signal_groups must be an array");
+                return;
+            }
 
-                    if (!from_ok) {
-                        result.errors.push_back("lane_connection has invalid source lane reference");
+            std::unordered_set<SignalGroupId> seen_groups;
+            for (const RawGroup& group_raw : raw.signal_groups.entries) {
+                if (!group_raw.is_object) {
+                    result.errors.push_back("signal_group entries must be objects");
+                    continue;
+                }
+
+                if (group_raw.id.kind != RawKind::Unsigned) {
+                    result.errors.push_back("signal_group.id must be an unsigned number");
+                    continue;
+                }
+
+                SignalGroupConfig group;
+                group.id = static_cast<SignalGroupId>(group_raw.id.unsigned_value);
+                if (!seen_groups.insert(group.id).second) {
+                    result.errors.push_back("duplicate signal_group id: " + std::to_string(group.id));
+                }
+                const std::string owner = "signal_group " + std::to_string(group.id);
+                group.name = optionalString(
+                    group_raw.name, "group-" + std::to_string(group.id), owner, "name", result.errors);
+                group.min_green_seconds =
+                    optionalNumber(group_raw.min_green_seconds, 10.0, owner, "min_green_seconds", result.errors);
+                group.orange_seconds =
+                    optionalNumber(group_raw.orange_seconds, 2.0, owner, "orange_seconds", result.errors);
+
+                if (group_raw.controlled_lanes.kind != RawKind::Array) {
+                    result.errors.push_back(owner + " controlled_lanes must be an array");
+                    continue;
+                }
+
+                for (const RawScalar& lane_raw : group_raw.controlled_lanes.items) {
+                    if (lane_raw.kind != RawKind::Unsigned) {
+                        result.errors.push_back(owner + " controlled lane ids must be unsigned numbers");
                         continue;
                     }
+                    group.controlled_lanes.push_back(static_cast<LaneId>(lane_raw.unsigned_value));
+                }
 
-                    if (!connection_json.contains("movement") || !connection_json["movement"].is_string()) {
-                        result.errors.push_back("lane_connection.movement must be a string");
+                if (group_raw.green_movements.kind != RawKind::Array) {
+                    result.errors.push_back(owner + " green_movements must be an array");
+                    continue;
+                }
+
+                for (const RawScalar& movement_raw : group_raw.green_movements.items) {
+                    if (movement_raw.kind != RawKind::String) {
+                        result.errors.push_back(owner + " movement must be a string");
                         continue;
                     }
 
-                    if (!movementFromString(connection_json["movement"].get<std::string>(), connection.movement)) {
-                        result.errors.push_back("lane_connection has unknown movement");
+                    MovementType movement;
+                    if (!movementFromString(movement_raw.text, movement)) {
+                        result.errors.push_back(owner + " unknown movement: " + movement_raw.text);
                         continue;
                     }
 
-                    if (connection_json.contains("to_approach") && connection_json.contains("to_lane_index") &&
-                        connection_json["to_approach"].is_string() &&
-                        connection_json["to_lane_index"].is_number_unsigned()) {
-                        to_ok = approachFromString(connection_json["to_approach"].get<std::string>(),
-                                                   connection.to_approach);
-                        connection.to_lane_index = connection_json["to_lane_index"].get<uint16_t>();
-                    } else if (connection_json.contains("to_lane_id") &&
-                               connection_json["to_lane_id"].is_number_unsigned()) {
-                        to_ok = resolveLaneIdToApproachIndex(result.config,
-                                                             connection_json["to_lane_id"].get<LaneId>(),
-                                                             connection.to_approach,
-                                                             connection.to_lane_index);
+                    if (std::find(group.green_movements.begin(), group.green_movements.end(), movement) ==
+                        group.green_movements.end()) {
+                        group.green_movements.push_back(movement);
                     }
+                }
 
-                    if (!to_ok) {
-                        result.errors.push_back("lane_connection has invalid target lane reference");
-                        continue;
-                    }
+                result.config.signal_groups.push_back(std::move(group));
+            }
+        }
 
-                    if (!laneIndexValid(result.config, connection.from_approach, connection.from_lane_index) ||
-                        !toLaneIndexValid(result.config, connection.to_approach, connection.to_lane_index)) {
-                        result.errors.push_back("lane_connection references lane index outside configured range");
-                        continue;
-                    }
+        // Resolves one end of a connection, by approach + lane index or else by lane id.
+        bool resolveConnectionEnd(const IntersectionConfig& config,
+                                  const RawScalar& approach_raw,
+                                  const RawScalar& lane_index_raw,
+                                  const RawScalar& lane_id_raw,
+                                  ApproachId& approach,
+                                  uint16_t& lane_index) {
+            if (approach_raw.kind == RawKind::String && lane_index_raw.kind == RawKind::Unsigned) {
+                lane_index = static_cast<uint16_t>(lane_index_raw.unsigned_value);
+                return approachFromString(approach_raw.text, approach);
+            }
+            if (lane_id_raw.kind == RawKind::Unsigned) {
+                return resolveLaneIdToApproachIndex(
+                    config, static_cast<LaneId>(lane_id_raw.unsigned_value), approach, lane_index);
+            }
+            return false;
+        }
 
-                    result.config.lane_connections.push_back(connection);
-                }
-            }
-        } else {
-            for (const auto& approach : result.config.approaches) {
-                for (uint16_t lane_idx = 0; lane_idx < approach.lanes.size(); ++lane_idx) {
-                    const auto& lane = approach.lanes[lane_idx];
-                    for (MovementType movement : lane.allowed_movements) {
-                        const ApproachId to = destinationApproachFor(approach.id, movement);
-                        const std::size_t to_idx = approachIndexLocal(to);
-                        const std::size_t to_count = effectiveToLaneCount(result.config.approaches[to_idx]);
-                        const std::size_t max_target_lane = to_count == 0 ? 0 : (to_count - 1);
-                        const std::size_t target_lane = lane_idx <= max_target_lane ? lane_idx : max_target_lane;
-                        result.config.lane_connections.push_back(
-                            {approach.id, lane_idx, movement, to, static_cast<uint16_t>(target_lane)});
+        void buildLaneConnections(const RawConfig& raw, ConfigParseResult& result) {
+            if (raw.lane_connections.kind == RawKind::Missing) {
+                for (const auto& approach : result.config.approaches) {
+                    for (uint16_t lane_idx = 0; lane_idx < approach.lanes.size(); ++lane_idx) {
+                        const auto& lane = approach.lanes[lane_idx];
+                        for (MovementType movement : lane.allowed_movements) {
+                            const ApproachId to = destinationApproachFor(approach.id, movement);
+                            const std::size_t to_idx = approachIndexLocal(to);
+                            const std::size_t to_count = effectiveToLaneCount(result.config.approaches[to_idx]);
+                            const std::size_t max_target_lane = to_count == 0 ? 0 : (to_count - 1);
+                            const std::size_t target_lane = lane_idx <= max_target_lane ? lane_idx : max_target_lane;
+                            result.config.lane_connections.push_back(
+                                {approach.id, lane_idx, movement, to, static_cast<uint16_t>(target_lane)});
+                        }
                     }
                 }
+                return;
+            }
+
+            if (raw.lane_connections.kind != RawKind::Array) {
+                result.errors.push_back("lane_connections must be an array");
+                return;
+            }
+
+            for (const RawConnection& connection_raw : raw.lane_connections.entries) {
+                if (!connection_raw.is_object) {
+                    result.errors.push_back("lane_connection entries must be objects");
+                    continue;
+                }
+
+                LaneConnectionConfig connection;
+                if (!resolveConnectionEnd(result.config,
+                                          connection_raw.from_approach,
+                                          connection_raw.from_lane_index,
+                                          connection_raw.from_lane_id,
+                                          connection.from_approach,
+                                          connection.from_lane_index)) {
+                    result.errors.push_back("lane_connection has invalid source lane reference");
+                    continue;
+                }
+
+                if (connection_raw.movement.kind != RawKind::String) {
+                    result.errors.push_back("lane_connection.movement must be a string");
+                    continue;
+                }
+
+                if (!movementFromString(connection_raw.movement.text, connection.movement)) {
+                    result.errors.push_back("lane_connection has unknown movement");
+                    continue;
+                }
+
+                if (!resolveConnectionEnd(result.config,
+                                          connection_raw.to_approach,
+                                          connection_raw.to_lane_index,
+                                          connection_raw.to_lane_id,
+                                          connection.to_approach,
+                                          connection.to_lane_index)) {
+                    result.errors.push_back("lane_connection has invalid target lane reference");
+                    continue;
+                }
+
+                if (!laneIndexValid(result.config, connection.from_approach, connection.from_lane_index) ||
+                    !toLaneIndexValid(result.config, connection.to_approach, connection.to_lane_index)) {
+                    result.errors.push_back("lane_connection references lane index outside configured range");
+                    continue;
+                }
+
+                result.config.lane_connections.push_back(connection);
             }
         }
+    }  // namespace
+
+    std::string intersectionConfigToJson(const IntersectionConfig& config) {
+        std::string out;
+        out.reserve(4096);
+        StringSink sink{out};
+        writeConfig(sink, config);
+        return out;
+    }
+
+    ConfigParseResult intersectionConfigFromJson(const std::string& json_text) {
+        ConfigParseResult result;
+
+        ConfigSaxHandler handler;
+        if (!json::sax_parse(json_text, &handler)) {
+            result.errors.push_back("invalid JSON: " + handler.parse_error_message);
+            return result;
+        }
+
+        const RawConfig& raw = handler.config;
+        if (raw.root_kind != RawKind::Object) {
+            result.errors.push_back("root must be an object");
+            return result;
+        }
+
+        if (raw.approaches.kind != RawKind::Array) {
+            result.errors.push_back("approaches must be an array");
+            return result;
+        }
+
+        if (raw.approaches.entries.size() != 4) {
+            result.errors.push_back("approaches must contain exactly 4 entries");
+            return result;
+        }
+
+        // Connections may name lanes by id, so they are resolved only once every approach is known, wherever
+        // they appear in the text.
+        buildApproaches(raw, result);
+        buildSignalGroups(raw, result);
+        buildLaneConnections(raw, result);
 
         result.ok = result.errors.empty();
         return result;
@@ -488,4 +1336,20 @@ namespace crossroads {
         root["errors"] = errors;
         return root.dump();
     }
+
+    uint64_t intersectionConfigFingerprint(const IntersectionConfig& config) {
+        FnvSink sink;
+        writeConfig(sink, config);
+        return sink.hash;
+    }
+
+    std::string intersectionConfigHash(uint64_t fingerprint) {
+        char buffer[17] = {};
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(fingerprint));
+        return std::string(buffer);
+    }
+
+    std::string intersectionConfigHash(const IntersectionConfig& config) {
+        return intersectionConfigHash(intersectionConfigFingerprint(config));
+    }
 }  // namespace crossroads
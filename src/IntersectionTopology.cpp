@@ -0,0 +1,417 @@
+#include "IntersectionTopology.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+
+#include "ParallelFor.hpp"
+
+namespace crossroads {
+    namespace {
+        constexpr double kPi = 3.14159265358979323846;
+        constexpr double kStraightToleranceDegrees = 45.0;
+        constexpr double kMinHeadingSeparationDegrees = 1.0;
+        constexpr double kLaneStep = 0.22;
+        constexpr double kCoreHalfWidth = 0.55;
+        constexpr double kLeftControlDistance = 0.55;
+        constexpr double kRightControlDistance = 0.18;
+        constexpr int kCurveSamples = 18;
+        constexpr std::size_t kMaxConflictGridCells = 64;  // Per axis
+        constexpr std::size_t kParallelConflictSegmentThreshold = 4096;
+
+        struct RoutePoint {
+            double x = 0.0;
+            double y = 0.0;
+        };
+
+        // A sampled path segment that touches the intersection core, tagged with its route.
+        struct CoreSegment {
+            RoutePoint a;
+            RoutePoint b;
+            std::size_t route = 0;
+        };
+
+        double normalizedHeading(double degrees) {
+            const double wrapped = std::fmod(degrees, 360.0);
+            return wrapped < 0.0 ? wrapped + 360.0 : wrapped;
+        }
+
+        // Exact at multiples of 90 degrees, so the four-arm instance reproduces the axis-aligned geometry.
+        double snapUnit(double value) {
+            if (std::abs(value) < 1e-12) {
+                return 0.0;
+            }
+            if (std::abs(std::abs(value) - 1.0) < 1e-12) {
+                return value < 0.0 ? -1.0 : 1.0;
+            }
+            return value;
+        }
+
+        RoutePoint outwardDirection(const TopologyArm& arm) {
+            const double radians = arm.heading_degrees * kPi / 180.0;
+            return {snapUnit(std::sin(radians)), snapUnit(std::cos(radians))};
+        }
+
+        // Where lane lane_index of lane_count meets the edge of the junction on this arm. Lanes are laid out from
+        // the centre line outwards on the right-hand side of the arm's inbound direction.
+        RoutePoint laneEndPoint(const TopologyArm& arm, std::size_t lane_index, std::size_t lane_count) {
+            const RoutePoint out = outwardDirection(arm);
+            if (lane_count <= 1) {
+                return out;
+            }
+            const double half_span = (static_cast<double>(lane_count - 1) * kLaneStep) * 0.5;
+            const double offset = -half_span + static_cast<double>(lane_index) * kLaneStep;
+            const RoutePoint side = {-out.y, out.x};
+            return {out.x + offset * side.x, out.y + offset * side.y};
+        }
+
+        MovementType classifyTurn(double from_heading, double to_heading) {
+            const double turn = normalizedHeading(to_heading - from_heading);
+            if (std::abs(turn - 180.0) <= kStraightToleranceDegrees) {
+                return MovementType::Straight;
+            }
+            return turn < 180.0 ? MovementType::Left : MovementType::Right;
+        }
+
+        std::vector<RoutePoint> sampleConnectionPath(const std::vector<TopologyArm>& arms,
+                                                     const TopologyConnection& connection,
+                                                     MovementType movement) {
+            const TopologyArm& from = arms[connection.from_arm];
+            const TopologyArm& to = arms[connection.to_arm];
+            const RoutePoint p0 =
+                laneEndPoint(from, connection.from_lane_index, std::max<std::size_t>(1, from.lane_count));
+            const RoutePoint p3 = laneEndPoint(to, connection.to_lane_index, std::max<std::size_t>(1, to.to_lane_count));
+            if (movement == MovementType::Straight) {
+                return {p0, p3};
+            }
+
+            const RoutePoint from_out = outwardDirection(from);
+            const RoutePoint in_dir = {-from_out.x, -from_out.y};
+            const RoutePoint out_dir = outwardDirection(to);
+            const double control_distance =
+                movement == MovementType::Left ? kLeftControlDistance : kRightControlDistance;
+            const RoutePoint c1 = {p0.x + in_dir.x * control_distance, p0.y + in_dir.y * control_distance};
+            const RoutePoint c2 = {p3.x - out_dir.x * control_distance, p3.y - out_dir.y * control_distance};
+
+            std::vector<RoutePoint> path;
+            path.reserve(kCurveSamples + 1);
+            for (int i = 0; i <= kCurveSamples; ++i) {
+                const double t = static_cast<double>(i) / static_cast<double>(kCurveSamples);
+                const double mt = 1.0 - t;
+                const double b0 = mt * mt * mt;
+                const double b1 = 3.0 * mt * mt * t;
+                const double b2 = 3.0 * mt * t * t;
+                const double b3 = t * t * t;
+                path.push_back(
+                    {b0 * p0.x + b1 * c1.x + b2 * c2.x + b3 * p3.x, b0 * p0.y + b1 * c1.y + b2 * c2.y + b3 * p3.y});
+            }
+            return path;
+        }
+
+        double crossProduct(const RoutePoint& a, const RoutePoint& b, const RoutePoint& c) {
+            return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        }
+
+        bool segmentIntersects(const RoutePoint& a, const RoutePoint& b, const RoutePoint& c, const RoutePoint& d) {
+            constexpr double eps = 1e-9;
+
+            const double o1 = crossProduct(a, b, c);
+            const double o2 = crossProduct(a, b, d);
+            const double o3 = crossProduct(c, d, a);
+            const double o4 = crossProduct(c, d, b);
+
+            const bool ab_straddles_cd = (o1 >= eps && o2 <= -eps) || (o1 <= -eps && o2 >= eps);
+            const bool cd_straddles_ab = (o3 >= eps && o4 <= -eps) || (o3 <= -eps && o4 >= eps);
+            return ab_straddles_cd && cd_straddles_ab;
+        }
+
+        bool pointInCore(const RoutePoint& p) {
+            return std::abs(p.x) <= kCoreHalfWidth && std::abs(p.y) <= kCoreHalfWidth;
+        }
+
+        bool segmentIntersectsCore(const RoutePoint& a, const RoutePoint& b) {
+            if (pointInCore(a) || pointInCore(b)) {
+                return true;
+            }
+
+            constexpr double eps = 1e-12;
+            double t0 = 0.0;
+            double t1 = 1.0;
+            const double dx = b.x - a.x;
+            const double dy = b.y - a.y;
+
+            auto clip = [&](double p, double q) {
+                if (std::abs(p) <= eps) {
+                    return q >= 0.0;
+                }
+
+                const double r = q / p;
+                if (p < 0.0) {
+                    if (r > t1) {
+                        return false;
+                    }
+                    if (r > t0) {
+                        t0 = r;
+                    }
+                } else {
+                    if (r < t0) {
+                        return false;
+                    }
+                    if (r < t1) {
+                        t1 = r;
+                    }
+                }
+
+                return true;
+            };
+
+            return clip(-dx, a.x + kCoreHalfWidth) && clip(dx, kCoreHalfWidth - a.x) &&
+                   clip(-dy, a.y + kCoreHalfWidth) && clip(dy, kCoreHalfWidth - a.y);
+        }
+
+        RouteMask routeBit(std::size_t route) {
+            return RouteMask{1} << route;
+        }
+
+        // Path segments are binned into a uniform grid and only segments sharing a cell are tested. Two segments
+        // that cross share the crossing point, so both land in the cell holding it.
+        void markPathConflicts(const std::vector<CoreSegment>& segments,
+                               const std::vector<RouteMask>& candidates,
+                               std::vector<RouteMask>& conflicts,
+                               std::size_t worker_count) {
+            if (segments.empty()) {
+                return;
+            }
+
+            double min_x = segments.front().a.x;
+            double max_x = min_x;
+            double min_y = segments.front().a.y;
+            double max_y = min_y;
+            for (const auto& segment : segments) {
+                min_x = std::min({min_x, segment.a.x, segment.b.x});
+                max_x = std::max({max_x, segment.a.x, segment.b.x});
+                min_y = std::min({min_y, segment.a.y, segment.b.y});
+                max_y = std::max({max_y, segment.a.y, segment.b.y});
+            }
+            const std::size_t cells_per_axis = std::clamp<std::size_t>(
+                static_cast<std::size_t>(std::sqrt(static_cast<double>(segments.size()))), 1, kMaxConflictGridCells);
+            const double cell_width = std::max(max_x - min_x, 1e-9) / static_cast<double>(cells_per_axis);
+            const double cell_height = std::max(max_y - min_y, 1e-9) / static_cast<double>(cells_per_axis);
+            auto cellX = [&](double x) {
+                return std::min(cells_per_axis - 1, static_cast<std::size_t>((x - min_x) / cell_width));
+            };
+            auto cellY = [&](double y) {
+                return std::min(cells_per_axis - 1, static_cast<std::size_t>((y - min_y) / cell_height));
+            };
+
+            // Compressed cell lists: count, prefix-sum, fill.
+            std::vector<std::size_t> cell_start(cells_per_axis * cells_per_axis + 1, 0);
+            auto forEachCell = [&](const CoreSegment& segment, auto&& visit) {
+                const std::size_t x0 = cellX(std::min(segment.a.x, segment.b.x));
+                const std::size_t x1 = cellX(std::max(segment.a.x, segment.b.x));
+                const std::size_t y0 = cellY(std::min(segment.a.y, segment.b.y));
+                const std::size_t y1 = cellY(std::max(segment.a.y, segment.b.y));
+                for (std::size_t y = y0; y <= y1; ++y) {
+                    for (std::size_t x = x0; x <= x1; ++x) {
+                        visit(y * cells_per_axis + x);
+                    }
+                }
+            };
+            for (const auto& segment : segments) {
+                forEachCell(segment, [&](std::size_t cell) { ++cell_start[cell + 1]; });
+            }
+            for (std::size_t cell = 1; cell < cell_start.size(); ++cell) {
+                cell_start[cell] += cell_start[cell - 1];
+            }
+            std::vector<uint32_t> cell_segments(cell_start.back());
+            std::vector<std::size_t> cell_fill(cell_start.begin(), cell_start.end() - 1);
+            for (std::size_t i = 0; i < segments.size(); ++i) {
+                forEachCell(segments[i],
+                            [&](std::size_t cell) { cell_segments[cell_fill[cell]++] = static_cast<uint32_t>(i); });
+            }
+
+            if (segments.size() < kParallelConflictSegmentThreshold) {
+                worker_count = 1;
+            }
+            const std::size_t cell_count = cell_start.size() - 1;
+            worker_count = std::min(resolveWorkerCount(worker_count), cell_count);
+
+            // Each worker fills its own masks; they are OR-ed together afterwards.
+            std::vector<std::vector<RouteMask>> found(worker_count, conflicts);
+            parallelFor(cell_count, worker_count, [&](std::size_t cell, std::size_t slot) {
+                std::vector<RouteMask>& local = found[slot];
+                for (std::size_t i = cell_start[cell]; i < cell_start[cell + 1]; ++i) {
+                    const CoreSegment& lhs = segments[cell_segments[i]];
+                    for (std::size_t j = i + 1; j < cell_start[cell + 1]; ++j) {
+                        const CoreSegment& rhs = segments[cell_segments[j]];
+                        const RouteMask rhs_bit = routeBit(rhs.route);
+                        if ((local[lhs.route] & rhs_bit) || !(candidates[lhs.route] & rhs_bit)) {
+                            continue;
+                        }
+                        if (segmentIntersects(lhs.a, lhs.b, rhs.a, rhs.b)) {
+                            local[lhs.route] |= rhs_bit;
+                            local[rhs.route] |= routeBit(lhs.route);
+                        }
+                    }
+                }
+            });
+
+            for (const auto& local : found) {
+                for (std::size_t route = 0; route < conflicts.size(); ++route) {
+                    conflicts[route] |= local[route];
+                }
+            }
+        }
+
+        void setError(std::string* error, const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+        }
+    }  // namespace
+
+    bool IntersectionTopology::build(std::vector<TopologyArm> arms,
+                                     std::vector<TopologyConnection> connections,
+                                     IntersectionTopology& topology,
+                                     std::string* error,
+                                     std::size_t worker_count) {
+        const std::size_t arm_count = arms.size();
+        if (arm_count < kMinTopologyArms || arm_count > kMaxTopologyArms) {
+            setError(error,
+                     "a junction needs " + std::to_string(kMinTopologyArms) + " to " +
+                         std::to_string(kMaxTopologyArms) + " arms");
+            return false;
+        }
+        for (std::size_t i = 0; i < arm_count; ++i) {
+            for (std::size_t j = i + 1; j < arm_count; ++j) {
+                const double gap = normalizedHeading(arms[i].heading_degrees - arms[j].heading_degrees);
+                if (std::min(gap, 360.0 - gap) < kMinHeadingSeparationDegrees) {
+                    setError(error, "arms " + std::to_string(i) + " and " + std::to_string(j) + " share a heading");
+                    return false;
+                }
+            }
+        }
+        for (const auto& connection : connections) {
+            if (connection.from_arm >= arm_count || connection.to_arm >= arm_count) {
+                setError(error, "connection refers to an arm that does not exist");
+                return false;
+            }
+            if (connection.from_arm == connection.to_arm) {
+                setError(error, "U-turn connections are not supported");
+                return false;
+            }
+        }
+
+        IntersectionTopology built;
+        built.arms = std::move(arms);
+        built.route_by_arm_pair.assign(arm_count * arm_count, -1);
+        for (std::size_t from = 0; from < arm_count; ++from) {
+            std::vector<TopologyRoute> outgoing;
+            for (std::size_t to = 0; to < arm_count; ++to) {
+                if (to != from) {
+                    outgoing.push_back({static_cast<uint8_t>(from),
+                                        static_cast<uint8_t>(to),
+                                        classifyTurn(built.arms[from].heading_degrees, built.arms[to].heading_degrees),
+                                        false});
+                }
+            }
+            auto turnOf = [&](const TopologyRoute& route) {
+                return normalizedHeading(built.arms[route.to_arm].heading_degrees -
+                                         built.arms[route.from_arm].heading_degrees);
+            };
+            std::stable_sort(outgoing.begin(), outgoing.end(), [&](const TopologyRoute& lhs, const TopologyRoute& rhs) {
+                if (lhs.movement != rhs.movement) {
+                    return lhs.movement < rhs.movement;
+                }
+                return turnOf(lhs) < turnOf(rhs);
+            });
+            for (const auto& route : outgoing) {
+                built.route_by_arm_pair[from * arm_count + route.to_arm] = static_cast<int>(built.route_list.size());
+                built.route_list.push_back(route);
+            }
+        }
+
+        const std::size_t route_count = built.route_list.size();
+        // Routes that may conflict at all: not the same route and not a straight route and its exact reverse.
+        std::vector<RouteMask> candidates(route_count, 0);
+        for (std::size_t lhs = 0; lhs < route_count; ++lhs) {
+            for (std::size_t rhs = 0; rhs < route_count; ++rhs) {
+                const TopologyRoute& a = built.route_list[lhs];
+                const TopologyRoute& b = built.route_list[rhs];
+                const bool reverse_straights = a.movement == MovementType::Straight &&
+                                               b.movement == MovementType::Straight && a.from_arm == b.to_arm &&
+                                               a.to_arm == b.from_arm;
+                if (lhs != rhs && !reverse_straights) {
+                    candidates[lhs] |= routeBit(rhs);
+                }
+            }
+        }
+
+        // Sharing a destination lane is a conflict regardless of the path geometry.
+        built.conflict_masks.assign(route_count, 0);
+        std::unordered_map<uint32_t, RouteMask> routes_by_destination;
+        std::vector<CoreSegment> segments;
+        for (const auto& connection : connections) {
+            const auto route = static_cast<std::size_t>(built.routeIndex(connection.from_arm, connection.to_arm));
+            built.route_list[route].configured = true;
+            built.configured_mask |= routeBit(route);
+            routes_by_destination[static_cast<uint32_t>(connection.to_arm) << 16 | connection.to_lane_index] |=
+                routeBit(route);
+
+            const std::vector<RoutePoint> path =
+                sampleConnectionPath(built.arms, connection, built.route_list[route].movement);
+            for (std::size_t i = 1; i < path.size(); ++i) {
+                if (segmentIntersectsCore(path[i - 1], path[i])) {
+                    segments.push_back({path[i - 1], path[i], route});
+                }
+            }
+        }
+        for (const auto& [destination, routes] : routes_by_destination) {
+            (void)destination;
+            for (std::size_t route = 0; route < route_count; ++route) {
+                if (routes & routeBit(route)) {
+                    built.conflict_masks[route] |= routes & candidates[route];
+                }
+            }
+        }
+        markPathConflicts(segments, candidates, built.conflict_masks, worker_count);
+
+        built.connection_list = std::move(connections);
+        topology = std::move(built);
+        return true;
+    }
+
+    int IntersectionTopology::routeIndex(std::size_t from_arm, std::size_t to_arm) const {
+        if (from_arm >= arms.size() || to_arm >= arms.size()) {
+            return -1;
+        }
+        return route_by_arm_pair[from_arm * arms.size() + to_arm];
+    }
+
+    IntersectionTopology topologyFor(const IntersectionConfig& config, std::size_t worker_count) {
+        static constexpr double kApproachHeadings[] = {0.0, 90.0, 180.0, 270.0};
+
+        std::vector<TopologyArm> arms;
+        arms.reserve(config.approaches.size());
+        for (const auto& approach : config.approaches) {
+            arms.push_back({approach.name,
+                            kApproachHeadings[approachIndex(approach.id)],
+                            static_cast<uint16_t>(approach.lanes.size()),
+                            static_cast<uint16_t>(effectiveToLaneCount(approach))});
+        }
+
+        std::vector<TopologyConnection> connections;
+        connections.reserve(config.lane_connections.size());
+        for (const auto& connection : config.lane_connections) {
+            connections.push_back({static_cast<uint8_t>(approachIndex(connection.from_approach)),
+                                   connection.from_lane_index,
+                                   static_cast<uint8_t>(approachIndex(connection.to_approach)),
+                                   connection.to_lane_index});
+        }
+
+        IntersectionTopology topology;
+        IntersectionTopology::build(std::move(arms), std::move(connections), topology, nullptr, worker_count);
+        return topology;
+    }
+}  // namespace crossroads
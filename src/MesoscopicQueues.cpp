@@ -0,0 +1,356 @@
+#include "MesoscopicQueues.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace crossroads {
+    namespace {
+        constexpr uint16_t kOrphanLane = std::numeric_limits<uint16_t>::max();
+
+        Direction directionFor(ApproachId approach) {
+            switch (approach) {
+                case ApproachId::North:
+                    return Direction::North;
+                case ApproachId::East:
+                    return Direction::East;
+                case ApproachId::South:
+                    return Direction::South;
+                case ApproachId::West:
+                    return Direction::West;
+            }
+            return Direction::North;
+        }
+
+        std::size_t movementIndex(MovementType movement) {
+            return static_cast<std::size_t>(movement);
+        }
+
+        bool laneAllows(const LaneConfig& lane, MovementType movement) {
+            return std::find(lane.allowed_movements.begin(), lane.allowed_movements.end(), movement) !=
+                   lane.allowed_movements.end();
+        }
+
+        // Counters follow from the vehicles and the crossing list; recomputed after a reconfigure or a load.
+        void recount(MesoscopicApproach& approach) {
+            approach.queued = 0;
+            approach.queued_spawn_time_sum = 0.0;
+            for (MesoscopicLane& lane : approach.lanes) {
+                lane.queued = {};
+                lane.stopped = {};
+                lane.crossing = {};
+                for (std::size_t i = 0; i < lane.vehicles.size(); ++i) {
+                    const MesoscopicLane::Entry& entry = lane.vehicles[i];
+                    ++lane.queued[movementIndex(entry.movement)];
+                    if (i < lane.at_line) {
+                        ++lane.stopped[movementIndex(entry.movement)];
+                    }
+                    approach.queued_spawn_time_sum += entry.spawn_time;
+                }
+                approach.queued += lane.vehicles.size();
+            }
+            for (const MesoscopicCrossing& crossing : approach.crossing) {
+                if (crossing.lane_index < approach.lanes.size()) {
+                    ++approach.lanes[crossing.lane_index].crossing[movementIndex(crossing.movement)];
+                }
+            }
+        }
+    }  // namespace
+
+    std::size_t MesoscopicQueues::configure(const IntersectionConfig& config) {
+        std::size_t removed = 0;
+        for (const ApproachConfig& approach_cfg : config.approaches) {
+            MesoscopicApproach& approach = approaches[approachIndex(approach_cfg.id)];
+            std::vector<MesoscopicLane> lanes(approach_cfg.lanes.size());
+            std::vector<uint16_t> new_index(approach.lanes.size(), kOrphanLane);
+
+            for (std::size_t old_index = 0; old_index < approach.lanes.size(); ++old_index) {
+                MesoscopicLane& old_lane = approach.lanes[old_index];
+                const auto found =
+                    std::find_if(approach_cfg.lanes.begin(), approach_cfg.lanes.end(), [&](const LaneConfig& lane) {
+                        return lane.id == old_lane.lane_id;
+                    });
+                if (found == approach_cfg.lanes.end() || !found->connected_to_intersection) {
+                    removed += old_lane.vehicles.size();
+                    continue;
+                }
+
+                const std::size_t index = static_cast<std::size_t>(std::distance(approach_cfg.lanes.begin(), found));
+                new_index[old_index] = static_cast<uint16_t>(index);
+                MesoscopicLane& lane = lanes[index];
+                lane.discharge_credit = old_lane.discharge_credit;
+                lane.routes = old_lane.routes;
+                for (std::size_t i = 0; i < old_lane.vehicles.size(); ++i) {
+                    if (!laneAllows(*found, old_lane.vehicles[i].movement)) {
+                        ++removed;
+                        continue;
+                    }
+                    lane.at_line += i < old_lane.at_line ? 1 : 0;
+                    lane.vehicles.push_back(old_lane.vehicles[i]);
+                }
+            }
+            for (std::size_t index = 0; index < lanes.size(); ++index) {
+                lanes[index].lane_id = approach_cfg.lanes[index].id;
+            }
+            for (MesoscopicCrossing& crossing : approach.crossing) {
+                crossing.lane_index =
+                    crossing.lane_index < new_index.size() ? new_index[crossing.lane_index] : kOrphanLane;
+            }
+
+            approach.lanes = std::move(lanes);
+            recount(approach);
+        }
+        return removed;
+    }
+
+    void MesoscopicQueues::clear() {
+        for (MesoscopicApproach& approach : approaches) {
+            for (MesoscopicLane& lane : approach.lanes) {
+                lane.vehicles.clear();
+                lane.at_line = 0;
+                lane.discharge_credit = 0.0;
+            }
+            approach.crossing.clear();
+            recount(approach);
+        }
+    }
+
+    std::size_t MesoscopicQueues::queuedOnLane(ApproachId approach, std::size_t lane_index) const {
+        const auto& lanes = approaches[approachIndex(approach)].lanes;
+        return lane_index < lanes.size() ? lanes[lane_index].vehicles.size() : 0;
+    }
+
+    std::size_t MesoscopicQueues::queued() const {
+        std::size_t total = 0;
+        for (const MesoscopicApproach& approach : approaches) {
+            total += approach.queued;
+        }
+        return total;
+    }
+
+    std::size_t MesoscopicQueues::vehicleCount(ApproachId approach) const {
+        const MesoscopicApproach& entry = approaches[approachIndex(approach)];
+        return entry.queued + entry.crossing.size();
+    }
+
+    double MesoscopicQueues::queuedDelaySeconds(double current_time) const {
+        double total = 0.0;
+        for (const MesoscopicApproach& approach : approaches) {
+            total += std::max(0.0, static_cast<double>(approach.queued) * current_time - approach.queued_spawn_time_sum);
+        }
+        return total;
+    }
+
+    void MesoscopicQueues::admit(ApproachId approach,
+                                 std::size_t lane_index,
+                                 uint32_t id,
+                                 MovementType movement,
+                                 VehicleClass vehicle_class,
+                                 const MesoscopicRoute& route,
+                                 double spawn_time,
+                                 double stop_line_time) {
+        MesoscopicApproach& entry = approaches[approachIndex(approach)];
+        if (lane_index >= entry.lanes.size()) {
+            return;
+        }
+        MesoscopicLane& lane = entry.lanes[lane_index];
+        lane.vehicles.push_back({id, movement, vehicle_class, spawn_time, stop_line_time});
+        lane.routes[movementIndex(movement)] = route;
+        ++lane.queued[movementIndex(movement)];
+        ++entry.queued;
+        entry.queued_spawn_time_sum += spawn_time;
+    }
+
+    Vehicle MesoscopicQueues::proxyVehicle(ApproachId approach, std::size_t lane_index, MovementType movement) const {
+        Vehicle vehicle(0, directionFor(approach), 0.0);
+        const auto& lanes = approaches[approachIndex(approach)].lanes;
+        if (lane_index < lanes.size()) {
+            const MesoscopicRoute& route = lanes[lane_index].routes[movementIndex(movement)];
+            vehicle.lane_id = lanes[lane_index].lane_id;
+            vehicle.destination_approach = route.destination_approach;
+            vehicle.destination_lane_index = route.destination_lane_index;
+            vehicle.destination_lane_id = route.destination_lane_id;
+        }
+        vehicle.queue_index = static_cast<uint8_t>(lane_index % 3);
+        vehicle.movement = movement;
+        vehicle.turning = movement != MovementType::Straight;
+        return vehicle;
+    }
+
+    MesoscopicQueues::StepResult MesoscopicQueues::advance(
+        double dt_seconds,
+        double current_time,
+        double saturation_flow_per_second,
+        const std::function<bool(Direction, const Vehicle&)>& may_go) {
+        StepResult result;
+        const double step_capacity = std::max(0.0, saturation_flow_per_second * dt_seconds);
+
+        for (std::size_t a = 0; a < approaches.size(); ++a) {
+            const ApproachId approach_id = static_cast<ApproachId>(a);
+            const Direction dir = directionFor(approach_id);
+            MesoscopicApproach& approach = approaches[a];
+
+            for (std::size_t lane_index = 0; lane_index < approach.lanes.size(); ++lane_index) {
+                MesoscopicLane& lane = approach.lanes[lane_index];
+                while (lane.at_line < lane.vehicles.size() && lane.vehicles[lane.at_line].stop_line_time <= current_time) {
+                    ++lane.stopped[movementIndex(lane.vehicles[lane.at_line].movement)];
+                    ++lane.at_line;
+                    result.changed = true;
+                }
+
+                // A blocked lane banks at most its head vehicle, so that one goes at once on green and the rest
+                // follow at the saturation headway.
+                const double head_pce =
+                    lane.vehicles.empty() ? 1.0 : vehicleClassParams(lane.vehicles.front().vehicle_class).pce;
+                lane.discharge_credit =
+                    std::min(lane.discharge_credit + step_capacity, std::max(head_pce, step_capacity));
+                while (lane.at_line > 0 &&
+                       lane.discharge_credit >= vehicleClassParams(lane.vehicles.front().vehicle_class).pce) {
+                    const MesoscopicLane::Entry head = lane.vehicles.front();
+                    Vehicle proxy = proxyVehicle(approach_id, lane_index, head.movement);
+                    if (may_go && !may_go(dir, proxy)) {
+                        break;
+                    }
+
+                    const std::size_t movement = movementIndex(head.movement);
+                    lane.vehicles.pop_front();
+                    --lane.at_line;
+                    --lane.queued[movement];
+                    --lane.stopped[movement];
+                    ++lane.crossing[movement];
+                    --approach.queued;
+                    approach.queued_spawn_time_sum -= head.spawn_time;
+                    lane.discharge_credit -= vehicleClassParams(head.vehicle_class).pce;
+
+                    proxy.vehicle_class = head.vehicle_class;
+                    const double duration = proxy.getCrossingDuration(approach.queued + approach.crossing.size());
+                    approach.crossing.push_back({head.id,
+                                                 static_cast<uint16_t>(lane_index),
+                                                 head.movement,
+                                                 head.vehicle_class,
+                                                 head.spawn_time,
+                                                 current_time,
+                                                 current_time + duration});
+                    result.changed = true;
+                }
+            }
+
+            for (std::size_t i = 0; i < approach.crossing.size();) {
+                const MesoscopicCrossing& crossing = approach.crossing[i];
+                if (crossing.finish_time > current_time) {
+                    ++i;
+                    continue;
+                }
+                ++result.crossed;
+                result.crossed_wait_seconds += crossing.start_time - crossing.spawn_time;
+                if (crossing.lane_index < approach.lanes.size()) {
+                    --approach.lanes[crossing.lane_index].crossing[movementIndex(crossing.movement)];
+                }
+                approach.crossing[i] = approach.crossing.back();
+                approach.crossing.pop_back();
+                result.changed = true;
+            }
+            if (approach.crossing.empty() && approach.queued == 0) {
+                approach.queued_spawn_time_sum = 0.0;  // Drop rounding drift while the approach is empty
+            }
+        }
+        return result;
+    }
+
+    void MesoscopicQueues::saveState(StateWriter& writer) const {
+        for (const MesoscopicApproach& approach : approaches) {
+            writer.u32(static_cast<uint32_t>(approach.lanes.size()));
+            for (const MesoscopicLane& lane : approach.lanes) {
+                writer.u16(lane.lane_id);
+                writer.u32(static_cast<uint32_t>(lane.at_line));
+                writer.f64(lane.discharge_credit);
+                for (const MesoscopicRoute& route : lane.routes) {
+                    writer.u8(static_cast<uint8_t>(route.destination_approach));
+                    writer.u16(route.destination_lane_index);
+                    writer.u16(route.destination_lane_id);
+                }
+                writer.u32(static_cast<uint32_t>(lane.vehicles.size()));
+                for (const MesoscopicLane::Entry& entry : lane.vehicles) {
+                    writer.u32(entry.id);
+                    writer.u8(static_cast<uint8_t>(entry.movement));
+                    writer.u8(static_cast<uint8_t>(entry.vehicle_class));
+                    writer.f64(entry.spawn_time);
+                    writer.f64(entry.stop_line_time);
+                }
+            }
+            writer.u32(static_cast<uint32_t>(approach.crossing.size()));
+            for (const MesoscopicCrossing& crossing : approach.crossing) {
+                writer.u32(crossing.id);
+                writer.u16(crossing.lane_index);
+                writer.u8(static_cast<uint8_t>(crossing.movement));
+                writer.u8(static_cast<uint8_t>(crossing.vehicle_class));
+                writer.f64(crossing.spawn_time);
+                writer.f64(crossing.start_time);
+                writer.f64(crossing.finish_time);
+            }
+        }
+    }
+
+    bool MesoscopicQueues::loadState(StateReader& reader) {
+        std::array<MesoscopicApproach, 4> loaded;
+        for (MesoscopicApproach& approach : loaded) {
+            const uint32_t lane_count = reader.u32();
+            for (uint32_t l = 0; l < lane_count && reader.ok(); ++l) {
+                MesoscopicLane lane;
+                lane.lane_id = reader.u16();
+                lane.at_line = reader.u32();
+                lane.discharge_credit = reader.f64();
+                for (MesoscopicRoute& route : lane.routes) {
+                    const uint8_t destination = reader.u8();
+                    route.destination_approach = static_cast<ApproachId>(destination & 3);
+                    route.destination_lane_index = reader.u16();
+                    route.destination_lane_id = reader.u16();
+                    if (destination > 3) {
+                        reader.fail();
+                    }
+                }
+                const uint32_t vehicle_count = reader.u32();
+                for (uint32_t i = 0; i < vehicle_count && reader.ok(); ++i) {
+                    MesoscopicLane::Entry entry;
+                    entry.id = reader.u32();
+                    const uint8_t movement = reader.u8();
+                    entry.movement = static_cast<MovementType>(movement % 3);
+                    const uint8_t vehicle_class = reader.u8();
+                    entry.vehicle_class = static_cast<VehicleClass>(vehicle_class % kVehicleClassCount);
+                    entry.spawn_time = reader.f64();
+                    entry.stop_line_time = reader.f64();
+                    if (movement > 2 || vehicle_class >= kVehicleClassCount) {
+                        reader.fail();
+                    }
+                    lane.vehicles.push_back(entry);
+                }
+                if (lane.at_line > lane.vehicles.size()) {
+                    reader.fail();
+                }
+                approach.lanes.push_back(std::move(lane));
+            }
+            const uint32_t crossing_count = reader.u32();
+            for (uint32_t i = 0; i < crossing_count && reader.ok(); ++i) {
+                MesoscopicCrossing crossing;
+                crossing.id = reader.u32();
+                crossing.lane_index = reader.u16();
+                const uint8_t movement = reader.u8();
+                crossing.movement = static_cast<MovementType>(movement % 3);
+                const uint8_t vehicle_class = reader.u8();
+                crossing.vehicle_class = static_cast<VehicleClass>(vehicle_class % kVehicleClassCount);
+                crossing.spawn_time = reader.f64();
+                crossing.start_time = reader.f64();
+                crossing.finish_time = reader.f64();
+                if (movement > 2 || vehicle_class >= kVehicleClassCount) {
+                    reader.fail();
+                }
+                approach.crossing.push_back(crossing);
+            }
+            recount(approach);
+        }
+        if (!reader.ok()) {
+            return false;
+        }
+        approaches = std::move(loaded);
+        return true;
+    }
+}  // namespace crossroads
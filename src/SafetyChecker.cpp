@@ -1,21 +1,60 @@
 #include "SafetyChecker.hpp"
 
 #include <algorithm>
+#include <array>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
+#include "IntersectionConfigJson.hpp"
+#include "IntersectionTopology.hpp"
+
 namespace crossroads {
+    namespace {
+        // Validation depends on the config alone, and most processes build checkers for a handful of configs over
+        // and over (every engine, reset and training episode), so results are shared. The fingerprint only finds
+        // the entry; a hit counts once the stored config compares equal in full.
+        constexpr std::size_t kValidationCacheCapacity = 256;
+
+        struct CachedValidation {
+            IntersectionConfig config;
+            bool valid = false;
+        };
+
+        std::mutex validation_cache_mutex;
+        std::unordered_map<uint64_t, CachedValidation> validation_cache;
+    }  // namespace
 
     SafetyChecker::SafetyChecker() : SafetyChecker(makeDefaultIntersectionConfig()) {
     }
 
     SafetyChecker::SafetyChecker(const IntersectionConfig& config)
-        : intersection_config(config), config_valid(validateConfig(config)) {
+        : intersection_config(config), config_valid(validateConfigCached(config)) {
     }
 
     bool SafetyChecker::isConfigValid() const {
         return config_valid;
     }
 
+    bool SafetyChecker::validateConfigCached(const IntersectionConfig& config) const {
+        const uint64_t fingerprint = intersectionConfigFingerprint(config);
+        {
+            std::lock_guard<std::mutex> lock(validation_cache_mutex);
+            const auto found = validation_cache.find(fingerprint);
+            if (found != validation_cache.end() && sameIntersectionConfig(found->second.config, config)) {
+                return found->second.valid;
+            }
+        }
+
+        const bool valid = validateConfig(config);
+        std::lock_guard<std::mutex> lock(validation_cache_mutex);
+        if (validation_cache.size() >= kValidationCacheCapacity) {
+            validation_cache.clear();
+        }
+        validation_cache[fingerprint] = CachedValidation{config, valid};
+        return valid;
+    }
+
     bool SafetyChecker::validateConfig(const IntersectionConfig& config) const {
         std::unordered_set<LaneId> seen_lanes;
         std::unordered_set<SignalGroupId> seen_groups;
@@ -33,8 +72,20 @@ namespace crossroads {
             return false;
         };
 
+        // An approach without inbound lanes and without outbound lanes is an absent arm, e.g. the missing leg of
+        // a T-junction. Nothing may drive into it.
+        auto arm_present = [&](ApproachId approach) {
+            const ApproachConfig& entry = config.approaches[approachIndex(approach)];
+            return !entry.lanes.empty() || entry.to_lane_count > 0;
+        };
+
+        std::size_t present_arms = 0;
         for (const auto& approach : config.approaches) {
-            if (approach.lanes.empty()) {
+            if (arm_present(approach.id)) {
+                ++present_arms;
+            }
+            if (!(approach.length_m >= kMinApproachLengthMeters && approach.length_m <= kMaxApproachLengthMeters) ||
+                approach.lane_capacity > kMaxLaneCapacity || !validVehicleMix(approach.vehicle_mix)) {
                 return false;
             }
 
@@ -45,6 +96,19 @@ namespace crossroads {
                 if (!seen_lanes.insert(lane.id).second) {
                     return false;
                 }
+                for (MovementType movement : lane.allowed_movements) {
+                    if (!arm_present(destinationFor(approach.id, movement))) {
+                        return false;
+                    }
+                }
+            }
+        }
+        if (present_arms < kMinTopologyArms || seen_lanes.empty()) {
+            return false;
+        }
+        for (const auto& connection : config.lane_connections) {
+            if (!arm_present(connection.to_approach)) {
+                return false;
             }
         }
 
@@ -225,12 +289,8 @@ namespace crossroads {
             return false;
         };
 
-        struct MovementRef {
-            ApproachId from;
-            MovementType movement;
-        };
-
-        std::vector<MovementRef> active_movements;
+        // Indexed approach * 3 + movement. A movement never conflicts with itself, so duplicates need no list.
+        std::array<bool, 12> active_movements{};
         for (SignalGroupId group_id : active_group_ids) {
             auto group_it = std::find_if(intersection_config.signal_groups.begin(),
                                          intersection_config.signal_groups.end(),
@@ -255,7 +315,7 @@ namespace crossroads {
                         continue;
                     }
 
-                    active_movements.push_back({approach, movement});
+                    active_movements[approachIndex(approach) * 3 + static_cast<std::size_t>(movement)] = true;
                     lane_has_supported_group_movement = true;
                 }
 
@@ -267,10 +327,11 @@ namespace crossroads {
 
         for (size_t i = 0; i < active_movements.size(); ++i) {
             for (size_t j = i + 1; j < active_movements.size(); ++j) {
-                if (hasMovementConflict(active_movements[i].from,
-                                        active_movements[i].movement,
-                                        active_movements[j].from,
-                                        active_movements[j].movement)) {
+                if (active_movements[i] && active_movements[j] &&
+                    hasMovementConflict(static_cast<ApproachId>(i / 3),
+                                        static_cast<MovementType>(i % 3),
+                                        static_cast<ApproachId>(j / 3),
+                                        static_cast<MovementType>(j % 3))) {
                     return false;
                 }
             }
@@ -289,57 +350,59 @@ namespace crossroads {
         return !(nsGreen && ewGreen);
     }
 
-    bool SafetyChecker::checkTurningLightSafety(const IntersectionState& state) const {
-        auto is_active = [](LightState s) { return s == LightState::Green || s == LightState::Orange; };
-
-        auto turning_pair_conflicts =
-            [&](ApproachId from_a, MovementType move_a, ApproachId from_b, MovementType move_b) {
-                auto collect_target_lanes = [&](ApproachId from, MovementType movement) {
-                    std::vector<LaneId> targets;
-                    for (const auto& connection : intersection_config.lane_connections) {
-                        if (connection.from_approach != from || connection.movement != movement) {
-                            continue;
-                        }
-                        targets.push_back(
-                            laneIdFor(connection.to_approach, static_cast<std::size_t>(connection.to_lane_index)));
-                    }
-                    std::sort(targets.begin(), targets.end());
-                    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
-                    return targets;
-                };
-
-                const auto a_targets = collect_target_lanes(from_a, move_a);
-                const auto b_targets = collect_target_lanes(from_b, move_b);
-                if (!a_targets.empty() && !b_targets.empty()) {
-                    for (LaneId lane_id : a_targets) {
-                        if (std::find(b_targets.begin(), b_targets.end(), lane_id) != b_targets.end()) {
-                            return true;
-                        }
-                    }
-                    return false;
+    bool SafetyChecker::turningPairConflicts(ApproachId from_a,
+                                             MovementType move_a,
+                                             ApproachId from_b,
+                                             MovementType move_b) const {
+        // Connected movements conflict when they share a target lane. Compared in place: this runs every tick.
+        const auto& connections = intersection_config.lane_connections;
+        auto target_lane = [](const LaneConnectionConfig& connection) {
+            return laneIdFor(connection.to_approach, static_cast<std::size_t>(connection.to_lane_index));
+        };
+        const bool b_connected =
+            std::any_of(connections.begin(), connections.end(), [&](const LaneConnectionConfig& connection) {
+                return connection.from_approach == from_b && connection.movement == move_b;
+            });
+        bool a_connected = false;
+        for (const auto& a : connections) {
+            if (a.from_approach != from_a || a.movement != move_a) {
+                continue;
+            }
+            a_connected = true;
+            for (const auto& b : connections) {
+                if (b.from_approach == from_b && b.movement == move_b && target_lane(a) == target_lane(b)) {
+                    return true;
                 }
+            }
+        }
+        if (a_connected && b_connected) {
+            return false;
+        }
 
-                return hasMovementConflict(from_a, move_a, from_b, move_b);
-            };
+        return hasMovementConflict(from_a, move_a, from_b, move_b);
+    }
+
+    bool SafetyChecker::checkTurningLightSafety(const IntersectionState& state) const {
+        auto is_active = [](LightState s) { return s == LightState::Green || s == LightState::Orange; };
 
         // turnSouthEast cannot be green if West is active
         if (state.turnSouthEast == LightState::Green && is_active(state.west) &&
-            turning_pair_conflicts(ApproachId::South, MovementType::Right, ApproachId::West, MovementType::Straight))
+            turningPairConflicts(ApproachId::South, MovementType::Right, ApproachId::West, MovementType::Straight))
             return false;
 
         // turnNorthWest cannot be green if East is active
         if (state.turnNorthWest == LightState::Green && is_active(state.east) &&
-            turning_pair_conflicts(ApproachId::North, MovementType::Right, ApproachId::East, MovementType::Straight))
+            turningPairConflicts(ApproachId::North, MovementType::Right, ApproachId::East, MovementType::Straight))
             return false;
 
         // turnWestSouth cannot be green if North is active
         if (state.turnWestSouth == LightState::Green && is_active(state.north) &&
-            turning_pair_conflicts(ApproachId::West, MovementType::Right, ApproachId::North, MovementType::Straight))
+            turningPairConflicts(ApproachId::West, MovementType::Right, ApproachId::North, MovementType::Straight))
             return false;
 
         // turnEastNorth cannot be green if South is active
         if (state.turnEastNorth == LightState::Green && is_active(state.south) &&
-            turning_pair_conflicts(ApproachId::East, MovementType::Right, ApproachId::South, MovementType::Straight))
+            turningPairConflicts(ApproachId::East, MovementType::Right, ApproachId::South, MovementType::Straight))
             return false;
 
         // Dedicated left-turns cannot be green if opposing main corridor is active
@@ -435,54 +498,24 @@ namespace crossroads {
     bool SafetyChecker::checkTurningLightTransitions(const IntersectionState& next) const {
         auto is_active = [](LightState s) { return s == LightState::Green || s == LightState::Orange; };
 
-        auto turning_pair_conflicts =
-            [&](ApproachId from_a, MovementType move_a, ApproachId from_b, MovementType move_b) {
-                auto collect_target_lanes = [&](ApproachId from, MovementType movement) {
-                    std::vector<LaneId> targets;
-                    for (const auto& connection : intersection_config.lane_connections) {
-                        if (connection.from_approach != from || connection.movement != movement) {
-                            continue;
-                        }
-                        targets.push_back(
-                            laneIdFor(connection.to_approach, static_cast<std::size_t>(connection.to_lane_index)));
-                    }
-                    std::sort(targets.begin(), targets.end());
-                    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
-                    return targets;
-                };
-
-                const auto a_targets = collect_target_lanes(from_a, move_a);
-                const auto b_targets = collect_target_lanes(from_b, move_b);
-                if (!a_targets.empty() && !b_targets.empty()) {
-                    for (LaneId lane_id : a_targets) {
-                        if (std::find(b_targets.begin(), b_targets.end(), lane_id) != b_targets.end()) {
-                            return true;
-                        }
-                    }
-                    return false;
-                }
-
-                return hasMovementConflict(from_a, move_a, from_b, move_b);
-            };
-
         // turnSouthEast cannot go green if West is active
         if (next.turnSouthEast == LightState::Green && is_active(next.west) &&
-            turning_pair_conflicts(ApproachId::South, MovementType::Right, ApproachId::West, MovementType::Straight))
+            turningPairConflicts(ApproachId::South, MovementType::Right, ApproachId::West, MovementType::Straight))
             return false;
 
         // turnNorthWest cannot go green if East is active
         if (next.turnNorthWest == LightState::Green && is_active(next.east) &&
-            turning_pair_conflicts(ApproachId::North, MovementType::Right, ApproachId::East, MovementType::Straight))
+            turningPairConflicts(ApproachId::North, MovementType::Right, ApproachId::East, MovementType::Straight))
             return false;
 
         // turnWestSouth cannot go green if North is active
         if (next.turnWestSouth == LightState::Green && is_active(next.north) &&
-            turning_pair_conflicts(ApproachId::West, MovementType::Right, ApproachId::North, MovementType::Straight))
+            turningPairConflicts(ApproachId::West, MovementType::Right, ApproachId::North, MovementType::Straight))
             return false;
 
         // turnEastNorth cannot go green if South is active
         if (next.turnEastNorth == LightState::Green && is_active(next.south) &&
-            turning_pair_conflicts(ApproachId::East, MovementType::Right, ApproachId::South, MovementType::Straight))
+            turningPairConflicts(ApproachId::East, MovementType::Right, ApproachId::South, MovementType::Straight))
             return false;
 
         // Dedicated left-turns cannot go green while opposing main is active
@@ -0,0 +1,530 @@
+#include "SessionJournal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "IntersectionConfigJson.hpp"
+
+namespace crossroads {
+    namespace {
+        constexpr char kJournalMagic[4] = {'X', 'R', 'S', 'J'};
+        // Version 2 adds the scheduler mode to the header; version 1 journals replay as Adaptive.
+        constexpr uint16_t kJournalVersion = 2;
+        constexpr uint8_t kProgressRecord = 0x7f;
+
+        void writeU8(std::ostream& out, uint8_t value) {
+            out.put(static_cast<char>(value));
+        }
+
+        void writeU16(std::ostream& out, uint16_t value) {
+            writeU8(out, static_cast<uint8_t>(value & 0xff));
+            writeU8(out, static_cast<uint8_t>(value >> 8));
+        }
+
+        void writeVarint(std::ostream& out, uint64_t value) {
+            while (value >= 0x80) {
+                writeU8(out, static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            writeU8(out, static_cast<uint8_t>(value));
+        }
+
+        void writeF64(std::ostream& out, double value) {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int shift = 0; shift < 64; shift += 8) {
+                writeU8(out, static_cast<uint8_t>(bits >> shift));
+            }
+        }
+
+        void writeString(std::ostream& out, const std::string& value) {
+            writeVarint(out, value.size());
+            out.write(value.data(), static_cast<std::streamsize>(value.size()));
+        }
+
+        void writeSpawnFilter(std::ostream& out, const std::optional<TrafficGenerator::SpawnLaneFilter>& filter) {
+            writeU8(out, filter.has_value() ? 1 : 0);
+            if (filter.has_value()) {
+                writeU8(out, static_cast<uint8_t>(approachIndex(filter->approach)));
+                writeU16(out, filter->lane_index);
+            }
+        }
+
+        // Bounds-checked cursor over the journal bytes; any short read marks the reader as exhausted.
+        class ByteReader {
+           public:
+            explicit ByteReader(const std::string& bytes) : bytes(bytes) {
+            }
+
+            bool atEnd() const {
+                return pos >= bytes.size();
+            }
+            std::size_t position() const {
+                return pos;
+            }
+
+            bool skip(std::size_t count) {
+                if (count > bytes.size() - pos) {
+                    return false;
+                }
+                pos += count;
+                return true;
+            }
+
+            bool u8(uint8_t& value) {
+                if (pos + 1 > bytes.size()) {
+                    return false;
+                }
+                value = static_cast<uint8_t>(bytes[pos++]);
+                return true;
+            }
+
+            bool u16(uint16_t& value) {
+                uint8_t lo = 0;
+                uint8_t hi = 0;
+                if (!u8(lo) || !u8(hi)) {
+                    return false;
+                }
+                value = static_cast<uint16_t>(lo | (hi << 8));
+                return true;
+            }
+
+            bool varint(uint64_t& value) {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    uint8_t byte = 0;
+                    if (!u8(byte)) {
+                        return false;
+                    }
+                    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                    if ((byte & 0x80) == 0) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool f64(double& value) {
+                uint64_t bits = 0;
+                for (int shift = 0; shift < 64; shift += 8) {
+                    uint8_t byte = 0;
+                    if (!u8(byte)) {
+                        return false;
+                    }
+                    bits |= static_cast<uint64_t>(byte) << shift;
+                }
+                std::memcpy(&value, &bits, sizeof(value));
+                return true;
+            }
+
+            bool string(std::string& value) {
+                uint64_t size = 0;
+                if (!varint(size) || size > bytes.size() - pos) {
+                    return false;
+                }
+                value.assign(bytes, pos, static_cast<std::size_t>(size));
+                pos += static_cast<std::size_t>(size);
+                return true;
+            }
+
+            bool spawnFilter(std::optional<TrafficGenerator::SpawnLaneFilter>& filter) {
+                uint8_t present = 0;
+                if (!u8(present)) {
+                    return false;
+                }
+                filter.reset();
+                if (present == 0) {
+                    return true;
+                }
+                uint8_t approach = 0;
+                uint16_t lane_index = 0;
+                if (!u8(approach) || !u16(lane_index) || approach > 3) {
+                    return false;
+                }
+                filter = TrafficGenerator::SpawnLaneFilter{static_cast<ApproachId>(approach), lane_index};
+                return true;
+            }
+
+           private:
+            const std::string& bytes;
+            std::size_t pos = 0;
+        };
+
+        void setError(std::string* error, const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+        }
+    }  // namespace
+
+    SessionEvent SessionEvent::makeCommand(SimulatorEngine::UICommand command, double dt) {
+        SessionEvent event;
+        event.type = Type::Command;
+        event.command = command;
+        event.dt = dt;
+        return event;
+    }
+
+    SessionEvent SessionEvent::makeApplyConfig(const IntersectionConfig& config) {
+        SessionEvent event;
+        event.type = Type::ApplyConfig;
+        event.config_json = intersectionConfigToJson(config);
+        return event;
+    }
+
+    SessionEvent SessionEvent::makeSwapConfig(const IntersectionConfig& config) {
+        SessionEvent event;
+        event.type = Type::SwapConfig;
+        event.config_json = intersectionConfigToJson(config);
+        return event;
+    }
+
+    SessionEvent SessionEvent::makeSpawnFilter(const std::optional<TrafficGenerator::SpawnLaneFilter>& filter) {
+        SessionEvent event;
+        event.type = Type::SpawnFilter;
+        event.spawn_filter = filter;
+        return event;
+    }
+
+    SessionEvent SessionEvent::makeTrafficRate(double rate) {
+        SessionEvent event;
+        event.type = Type::TrafficRate;
+        event.traffic_rate = rate;
+        return event;
+    }
+
+    void applySessionEvent(SimulatorEngine& engine,
+                           SessionInputs& inputs,
+                           const SessionEvent& event,
+                           ConfigSwapReport* swap_report) {
+        switch (event.type) {
+            case SessionEvent::Type::Command:
+                engine.handleCommand(event.command, event.dt);
+                break;
+            case SessionEvent::Type::ApplyConfig: {
+                // Built from the journaled JSON, not the caller's struct, so live and replayed engines match.
+                const ConfigParseResult parsed = intersectionConfigFromJson(event.config_json);
+                if (!parsed.ok) {
+                    break;
+                }
+                engine = SimulatorEngine(parsed.config, inputs.traffic_rate, inputs.ns_duration, inputs.ew_duration);
+                engine.setTrafficRate(inputs.traffic_rate);
+                engine.setSpawnLaneFilter(inputs.spawn_filter);
+                if (inputs.scheduler_mode != engine.getSchedulerMode()) {
+                    engine.setSchedulerMode(inputs.scheduler_mode);
+                }
+                break;
+            }
+            case SessionEvent::Type::SwapConfig: {
+                const ConfigParseResult parsed = intersectionConfigFromJson(event.config_json);
+                if (parsed.ok) {
+                    engine.applyConfigLive(parsed.config, swap_report);
+                }
+                break;
+            }
+            case SessionEvent::Type::SpawnFilter:
+                inputs.spawn_filter = event.spawn_filter;
+                engine.setSpawnLaneFilter(inputs.spawn_filter);
+                break;
+            case SessionEvent::Type::TrafficRate:
+                inputs.traffic_rate = event.traffic_rate;
+                engine.setTrafficRate(inputs.traffic_rate);
+                break;
+        }
+    }
+
+    SessionRecorder::~SessionRecorder() {
+        close();
+    }
+
+    bool SessionRecorder::open(const std::string& path,
+                               const IntersectionConfig& config,
+                               const SessionInputs& inputs,
+                               double tick_seconds,
+                               std::string* error) {
+        close();
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out.good()) {
+            setError(error, "failed to open session journal " + path);
+            return false;
+        }
+
+        out.write(kJournalMagic, sizeof(kJournalMagic));
+        writeU16(out, kJournalVersion);
+        writeF64(out, tick_seconds);
+        writeF64(out, inputs.traffic_rate);
+        writeF64(out, inputs.ns_duration);
+        writeF64(out, inputs.ew_duration);
+        writeSpawnFilter(out, inputs.spawn_filter);
+        writeU8(out, static_cast<uint8_t>(inputs.scheduler_mode));
+        writeString(out, intersectionConfigToJson(config));
+        out.flush();
+
+        current_tick = 0;
+        last_record_tick = 0;
+        return out.good();
+    }
+
+    bool SessionRecorder::isOpen() const {
+        return out.is_open();
+    }
+
+    void SessionRecorder::writeRecordHead(uint8_t type) {
+        writeU8(out, type);
+        writeVarint(out, current_tick - last_record_tick);
+        last_record_tick = current_tick;
+    }
+
+    void SessionRecorder::record(const SessionEvent& event) {
+        if (!out.is_open()) {
+            return;
+        }
+
+        writeRecordHead(static_cast<uint8_t>(event.type));
+        switch (event.type) {
+            case SessionEvent::Type::Command:
+                writeU8(out, static_cast<uint8_t>(event.command));
+                writeF64(out, event.dt);
+                break;
+            case SessionEvent::Type::ApplyConfig:
+            case SessionEvent::Type::SwapConfig:
+                writeString(out, event.config_json);
+                break;
+            case SessionEvent::Type::SpawnFilter:
+                writeSpawnFilter(out, event.spawn_filter);
+                break;
+            case SessionEvent::Type::TrafficRate:
+                writeF64(out, event.traffic_rate);
+                break;
+        }
+        // Inputs are rare; flushing each one keeps the journal usable after a crash.
+        out.flush();
+    }
+
+    void SessionRecorder::advanceTick() {
+        if (!out.is_open()) {
+            return;
+        }
+        ++current_tick;
+        if (current_tick % kProgressInterval == 0) {
+            writeRecordHead(kProgressRecord);
+            out.flush();
+        }
+    }
+
+    uint64_t SessionRecorder::tick() const {
+        return current_tick;
+    }
+
+    void SessionRecorder::close() {
+        if (!out.is_open()) {
+            return;
+        }
+        if (current_tick != last_record_tick) {
+            writeRecordHead(kProgressRecord);
+        }
+        out.close();
+    }
+
+    bool readSessionJournal(const std::string& path, SessionJournal& journal, std::string* error) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.good()) {
+            setError(error, "failed to open session journal " + path);
+            return false;
+        }
+        const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        journal = SessionJournal{};
+        if (bytes.size() < sizeof(kJournalMagic) || bytes.compare(0, sizeof(kJournalMagic), kJournalMagic, 4) != 0) {
+            setError(error, "not a session journal");
+            return false;
+        }
+
+        ByteReader reader(bytes);
+        reader.skip(sizeof(kJournalMagic));
+
+        uint16_t version = 0;
+        if (!reader.u16(version) || version < 1 || version > kJournalVersion) {
+            setError(error, "unsupported session journal version");
+            return false;
+        }
+        uint8_t scheduler_mode = 0;
+        if (!reader.f64(journal.tick_seconds) || !reader.f64(journal.initial_inputs.traffic_rate) ||
+            !reader.f64(journal.initial_inputs.ns_duration) || !reader.f64(journal.initial_inputs.ew_duration) ||
+            !reader.spawnFilter(journal.initial_inputs.spawn_filter) ||
+            (version >= 2 && !reader.u8(scheduler_mode)) || !reader.string(journal.initial_config_json)) {
+            setError(error, "session journal header is incomplete");
+            return false;
+        }
+        if (scheduler_mode > static_cast<uint8_t>(SimulatorEngine::SchedulerMode::Predictive)) {
+            setError(error, "session journal header has an unknown scheduler mode");
+            return false;
+        }
+        journal.initial_inputs.scheduler_mode = static_cast<SimulatorEngine::SchedulerMode>(scheduler_mode);
+
+        uint64_t tick = 0;
+        while (!reader.atEnd()) {
+            uint8_t type = 0;
+            uint64_t delta = 0;
+            if (!reader.u8(type) || !reader.varint(delta)) {
+                journal.truncated = true;
+                break;
+            }
+            const uint64_t record_tick = tick + delta;
+
+            if (type == kProgressRecord) {
+                tick = record_tick;
+                journal.end_tick = std::max(journal.end_tick, tick);
+                continue;
+            }
+
+            SessionEvent event;
+            event.tick = record_tick;
+            bool complete = false;
+            switch (static_cast<SessionEvent::Type>(type)) {
+                case SessionEvent::Type::Command: {
+                    uint8_t command = 0;
+                    complete = reader.u8(command) && reader.f64(event.dt) && command <= 3;
+                    event.type = SessionEvent::Type::Command;
+                    event.command = static_cast<SimulatorEngine::UICommand>(command);
+                    break;
+                }
+                case SessionEvent::Type::ApplyConfig:
+                case SessionEvent::Type::SwapConfig:
+                    event.type = static_cast<SessionEvent::Type>(type);
+                    complete = reader.string(event.config_json);
+                    break;
+                case SessionEvent::Type::SpawnFilter:
+                    event.type = SessionEvent::Type::SpawnFilter;
+                    complete = reader.spawnFilter(event.spawn_filter);
+                    break;
+                case SessionEvent::Type::TrafficRate:
+                    event.type = SessionEvent::Type::TrafficRate;
+                    complete = reader.f64(event.traffic_rate);
+                    break;
+                default:
+                    setError(error, "unknown session journal record at byte " + std::to_string(reader.position()));
+                    return false;
+            }
+            if (!complete) {
+                journal.truncated = true;
+                break;
+            }
+
+            tick = record_tick;
+            journal.end_tick = std::max(journal.end_tick, tick);
+            journal.events.push_back(std::move(event));
+        }
+        return true;
+    }
+
+    SessionReplayer::SessionReplayer(SessionJournal journal, uint64_t checkpoint_interval)
+        : journal(std::move(journal)), checkpoint_interval(std::max<uint64_t>(1, checkpoint_interval)) {
+        restart();
+    }
+
+    uint64_t SessionReplayer::tick() const {
+        return current_tick;
+    }
+
+    uint64_t SessionReplayer::endTick() const {
+        return journal.end_tick;
+    }
+
+    const SimulatorEngine& SessionReplayer::engine() const {
+        return *current_engine;
+    }
+
+    std::size_t SessionReplayer::checkpointCount() const {
+        return checkpoints.size();
+    }
+
+    std::unique_ptr<SimulatorEngine> SessionReplayer::makeEngine(const std::string& json) const {
+        const ConfigParseResult parsed = intersectionConfigFromJson(json);
+        const IntersectionConfig config = parsed.ok ? parsed.config : makeDefaultIntersectionConfig();
+        auto engine =
+            std::make_unique<SimulatorEngine>(config, inputs.traffic_rate, inputs.ns_duration, inputs.ew_duration);
+        if (inputs.scheduler_mode != engine->getSchedulerMode()) {
+            engine->setSchedulerMode(inputs.scheduler_mode);
+        }
+        return engine;
+    }
+
+    void SessionReplayer::restart() {
+        inputs = journal.initial_inputs;
+        config_json = journal.initial_config_json;
+        current_engine = makeEngine(config_json);
+        next_event = 0;
+        current_tick = 0;
+        maybeCheckpoint();
+    }
+
+    void SessionReplayer::maybeCheckpoint() {
+        if (current_tick % checkpoint_interval != 0 || checkpoints.count(current_tick) != 0) {
+            return;
+        }
+
+        Checkpoint checkpoint;
+        checkpoint.config_json = config_json;
+        checkpoint.inputs = inputs;
+        checkpoint.next_event = next_event;
+        checkpoint.engine = makeEngine(config_json);
+        if (!checkpoint.engine->copyStateFrom(*current_engine)) {
+            return;
+        }
+        checkpoints.emplace(current_tick, std::move(checkpoint));
+    }
+
+    void SessionReplayer::stepOnce() {
+        while (next_event < journal.events.size() && journal.events[next_event].tick == current_tick) {
+            const SessionEvent& event = journal.events[next_event++];
+            applySessionEvent(*current_engine, inputs, event);
+            if (event.type == SessionEvent::Type::ApplyConfig || event.type == SessionEvent::Type::SwapConfig) {
+                config_json = event.config_json;
+            }
+        }
+        current_engine->tick(journal.tick_seconds);
+        ++current_tick;
+        maybeCheckpoint();
+    }
+
+    void SessionReplayer::runTo(uint64_t target_tick) {
+        target_tick = std::min(target_tick, journal.end_tick);
+        while (current_tick < target_tick) {
+            stepOnce();
+        }
+    }
+
+    void SessionReplayer::seek(uint64_t target_tick) {
+        target_tick = std::min(target_tick, journal.end_tick);
+        if (target_tick < current_tick) {
+            auto it = checkpoints.upper_bound(target_tick);
+            if (it == checkpoints.begin()) {
+                restart();
+            } else {
+                --it;
+                const Checkpoint& checkpoint = it->second;
+                inputs = checkpoint.inputs;
+                config_json = checkpoint.config_json;
+                current_engine = makeEngine(config_json);
+                current_engine->copyStateFrom(*checkpoint.engine);
+                next_event = checkpoint.next_event;
+                current_tick = it->first;
+            }
+        }
+        runTo(target_tick);
+    }
+
+    std::optional<uint64_t> SessionReplayer::runToNextSafetyViolation() {
+        const std::size_t violations = current_engine->getMetrics().safety_violations;
+        while (current_tick < journal.end_tick) {
+            stepOnce();
+            if (current_engine->getMetrics().safety_violations > violations) {
+                return current_tick;
+            }
+        }
+        return std::nullopt;
+    }
+}  // namespace crossroads
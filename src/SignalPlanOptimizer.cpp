@@ -0,0 +1,252 @@
+#include "SignalPlanOptimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "IntersectionConfigJson.hpp"
+#include "ParallelFor.hpp"
+#include "SafetyChecker.hpp"
+#include "SimulatorEngine.hpp"
+
+namespace crossroads {
+    namespace {
+        constexpr double kSecondsPerHour = 3600.0;
+        constexpr double kMaxFlowRatio = 0.95;
+        constexpr double kImprovementEpsilon = 1e-9;
+
+        std::unordered_map<LaneId, double> demandByLane(const std::vector<LaneDemand>& demand) {
+            std::unordered_map<LaneId, double> by_lane;
+            for (const auto& entry : demand) {
+                by_lane[entry.lane_id] += std::max(0.0, entry.vehicles_per_hour);
+            }
+            return by_lane;
+        }
+
+        std::array<double, 4> approachRatesFromDemand(const IntersectionConfig& config,
+                                                      const std::vector<LaneDemand>& demand) {
+            const auto by_lane = demandByLane(demand);
+            std::array<double, 4> rates{};
+            for (const auto& approach : config.approaches) {
+                for (const auto& lane : approach.lanes) {
+                    auto it = by_lane.find(lane.id);
+                    if (it != by_lane.end()) {
+                        rates[approachIndex(approach.id)] += it->second / kSecondsPerHour;
+                    }
+                }
+            }
+            return rates;
+        }
+
+        void setGreens(IntersectionConfig& config, const std::vector<double>& greens) {
+            for (std::size_t i = 0; i < config.signal_groups.size() && i < greens.size(); ++i) {
+                config.signal_groups[i].min_green_seconds = greens[i];
+            }
+        }
+
+        std::vector<double> greensOf(const IntersectionConfig& config) {
+            std::vector<double> greens;
+            greens.reserve(config.signal_groups.size());
+            for (const auto& group : config.signal_groups) {
+                greens.push_back(group.min_green_seconds);
+            }
+            return greens;
+        }
+    }  // namespace
+
+    double signalPlanCycleSeconds(const IntersectionConfig& config) {
+        double cycle = 0.0;
+        for (const auto& group : config.signal_groups) {
+            cycle += group.min_green_seconds + group.orange_seconds;
+        }
+        return cycle;
+    }
+
+    SignalPlanOptimizer::SignalPlanOptimizer(SignalPlanOptimizerOptions options) : options(options) {
+    }
+
+    IntersectionConfig SignalPlanOptimizer::websterPlan(const IntersectionConfig& config,
+                                                        const std::vector<LaneDemand>& demand) const {
+        IntersectionConfig plan = config;
+        if (plan.signal_groups.empty()) {
+            return plan;
+        }
+
+        const auto by_lane = demandByLane(demand);
+        const double saturation = std::max(1.0, options.saturation_flow_per_lane_hour);
+
+        // Critical flow ratio per group: the busiest lane it controls.
+        std::vector<double> flow_ratios;
+        flow_ratios.reserve(plan.signal_groups.size());
+        double total_flow_ratio = 0.0;
+        double lost_seconds = 0.0;
+        for (const auto& group : plan.signal_groups) {
+            double ratio = 0.0;
+            for (LaneId lane_id : group.controlled_lanes) {
+                auto it = by_lane.find(lane_id);
+                if (it != by_lane.end()) {
+                    ratio = std::max(ratio, it->second / saturation);
+                }
+            }
+            flow_ratios.push_back(ratio);
+            total_flow_ratio += ratio;
+            lost_seconds += group.orange_seconds + options.startup_lost_seconds;
+        }
+
+        const double bounded_flow_ratio = std::min(total_flow_ratio, kMaxFlowRatio);
+        const double webster_cycle = (1.5 * lost_seconds + 5.0) / (1.0 - bounded_flow_ratio);
+        const double cycle = std::clamp(webster_cycle, options.min_cycle_seconds, options.max_cycle_seconds);
+        const double effective_green = std::max(0.0, cycle - lost_seconds);
+
+        for (std::size_t i = 0; i < plan.signal_groups.size(); ++i) {
+            const double share = total_flow_ratio > 0.0 ? flow_ratios[i] / total_flow_ratio
+                                                        : 1.0 / static_cast<double>(plan.signal_groups.size());
+            plan.signal_groups[i].min_green_seconds =
+                std::clamp(std::round(effective_green * share), options.min_green_seconds, options.max_green_seconds);
+        }
+        return plan;
+    }
+
+    double SignalPlanOptimizer::evaluatePlan(const IntersectionConfig& config,
+                                             const std::vector<LaneDemand>& demand) const {
+        SimulatorEngine engine(config, 0.0, 10.0, 10.0);
+        engine.setSchedulerMode(SimulatorEngine::SchedulerMode::FixedTime);
+        engine.setApproachArrivalRates(approachRatesFromDemand(config, demand));
+        engine.start();
+
+        const double dt = options.time_step_seconds > 0.0 ? options.time_step_seconds : 0.1;
+        const auto steps = static_cast<std::size_t>(std::ceil(options.evaluation_seconds / dt));
+        for (std::size_t step = 0; step < steps; ++step) {
+            engine.tick(dt);
+            if (engine.getControlMode() == SimulatorEngine::ControlMode::NullControl) {
+                return std::numeric_limits<double>::infinity();
+            }
+        }
+
+        // Vehicles still queued count with the delay they built up so far, so starving an approach never looks
+        // cheaper than serving it.
+        const SimulatorMetrics metrics = engine.getMetrics();
+        const double crossed_delay = metrics.average_wait_time * static_cast<double>(metrics.vehicles_crossed);
+        const double generated = static_cast<double>(std::max<std::size_t>(1, metrics.vehicles_generated));
+        return (crossed_delay + metrics.queued_delay_seconds) / generated;
+    }
+
+    std::vector<double> SignalPlanOptimizer::evaluatePlans(const std::vector<IntersectionConfig>& candidates,
+                                                           const std::vector<LaneDemand>& demand) const {
+        std::vector<double> delays(candidates.size(), std::numeric_limits<double>::infinity());
+        if (candidates.empty()) {
+            return delays;
+        }
+
+        parallelFor(candidates.size(), options.worker_count, [&](std::size_t i, std::size_t) {
+            delays[i] = evaluatePlan(candidates[i], demand);
+        });
+        return delays;
+    }
+
+    SignalPlanResult SignalPlanOptimizer::optimize(const IntersectionConfig& config,
+                                                   const std::vector<LaneDemand>& demand) const {
+        SignalPlanResult result;
+        if (config.signal_groups.empty()) {
+            result.errors.push_back("config has no signal groups to time");
+            return result;
+        }
+
+        SafetyChecker checker(config);
+        if (!checker.isConfigValid()) {
+            result.errors.push_back("config failed safety validation rules");
+            return result;
+        }
+
+        IntersectionConfig best = websterPlan(config, demand);
+        double best_delay = evaluatePlans({best}, demand).front();
+        result.evaluations = 1;
+        result.initial_average_delay_seconds = best_delay;
+
+        const std::array<double, 3> step_sizes = {4.0, 2.0, 1.0};
+        std::size_t step_slot = 0;
+        while (step_slot < step_sizes.size() && result.evaluations < options.max_evaluations) {
+            const double step = step_sizes[step_slot];
+            const std::vector<double> greens = greensOf(best);
+
+            std::vector<IntersectionConfig> neighbours;
+            auto add_greens = [&](std::vector<double> candidate) {
+                for (double& green : candidate) {
+                    green = std::clamp(green, options.min_green_seconds, options.max_green_seconds);
+                }
+                if (candidate == greens) {
+                    return;
+                }
+                IntersectionConfig neighbour = best;
+                setGreens(neighbour, candidate);
+                const double cycle = signalPlanCycleSeconds(neighbour);
+                if (cycle < options.min_cycle_seconds || cycle > options.max_cycle_seconds) {
+                    return;
+                }
+                neighbours.push_back(std::move(neighbour));
+            };
+
+            for (std::size_t i = 0; i < greens.size(); ++i) {
+                for (double delta : {step, -step}) {
+                    std::vector<double> candidate = greens;
+                    candidate[i] += delta;
+                    add_greens(std::move(candidate));
+                }
+            }
+
+            // Stretch or shrink the whole cycle while keeping the splits.
+            for (double scale : {1.0 + 0.05 * step, 1.0 - 0.05 * step}) {
+                std::vector<double> candidate = greens;
+                for (double& green : candidate) {
+                    green = std::round(green * scale);
+                }
+                add_greens(std::move(candidate));
+            }
+
+            // With two groups a swap is only a phase shift of the same cycle.
+            if (options.search_phase_order && best.signal_groups.size() > 2) {
+                for (std::size_t i = 0; i + 1 < best.signal_groups.size(); ++i) {
+                    IntersectionConfig neighbour = best;
+                    std::swap(neighbour.signal_groups[i], neighbour.signal_groups[i + 1]);
+                    neighbours.push_back(std::move(neighbour));
+                }
+            }
+
+            const std::size_t budget = options.max_evaluations - result.evaluations;
+            if (neighbours.size() > budget) {
+                neighbours.resize(budget);
+            }
+            if (neighbours.empty()) {
+                ++step_slot;
+                continue;
+            }
+
+            const std::vector<double> delays = evaluatePlans(neighbours, demand);
+            result.evaluations += neighbours.size();
+
+            const auto best_it = std::min_element(delays.begin(), delays.end());
+            if (*best_it + kImprovementEpsilon < best_delay) {
+                best_delay = *best_it;
+                best = neighbours[static_cast<std::size_t>(std::distance(delays.begin(), best_it))];
+            } else {
+                ++step_slot;
+            }
+        }
+
+        if (!std::isfinite(best_delay)) {
+            result.errors.push_back("no safe fixed-time plan found");
+            return result;
+        }
+
+        result.ok = true;
+        result.config = best;
+        result.config_json = intersectionConfigToJson(best);
+        result.cycle_seconds = signalPlanCycleSeconds(best);
+        result.average_delay_seconds = best_delay;
+        return result;
+    }
+}  // namespace crossroads
@@ -5,6 +5,10 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -14,6 +18,56 @@
 
 namespace crossroads {
     namespace {
+        constexpr std::size_t kMaxRequestBytes = 64u * 1024u * 1024u;
+
+        // Content-Length of a request head, 0 when absent or malformed.
+        std::size_t contentLength(const std::string& head) {
+            std::istringstream lines(head);
+            std::string line;
+            while (std::getline(lines, line)) {
+                const std::size_t colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                std::string key = line.substr(0, colon);
+                std::transform(key.begin(), key.end(), key.begin(), [](unsigned char ch) {
+                    return static_cast<char>(std::tolower(ch));
+                });
+                if (key == "content-length") {
+                    return static_cast<std::size_t>(std::strtoull(line.c_str() + colon + 1, nullptr, 10));
+                }
+            }
+            return 0;
+        }
+
+        // A large response can exceed one socket buffer; send until everything is written or the peer is gone.
+        // False once the peer is gone; MSG_NOSIGNAL keeps a closed peer from raising SIGPIPE mid-stream.
+        bool sendAll(int client_fd, const std::string& data) {
+            std::size_t sent = 0;
+            while (sent < data.size()) {
+                const ssize_t n = send(client_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return false;
+                }
+                sent += static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        // Status line and headers; framing is the Content-Length or Transfer-Encoding header.
+        std::string responseHead(const std::string& status,
+                                 const std::string& content_type,
+                                 const std::string& framing) {
+            std::string head = "HTTP/1.1 " + status + "\r\n";
+            head += "Content-Type: " + content_type + "\r\n";
+            head += "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n";
+            head += "Pragma: no-cache\r\n";
+            head += "Expires: 0\r\n";
+            head += framing + "\r\n";
+            head += "Connection: close\r\n\r\n";
+            return head;
+        }
+
         void configureClientSocketTimeouts(int client_fd) {
             timeval timeout{};
             timeout.tv_sec = 1;
@@ -38,6 +92,15 @@ namespace crossroads {
             if (path.rfind("/config/api", 0) == 0 || path == "/config.json") {
                 return "config_api";
             }
+            if (path == "/config/library" || path.rfind("/config/library/", 0) == 0) {
+                return "config_library";
+            }
+            if (path == "/runs" || path.rfind("/runs/", 0) == 0) {
+                return "runs";
+            }
+            if (path == "/sessions" || path.rfind("/sessions/", 0) == 0) {
+                return "sessions";
+            }
             return "unknown";
         }
 
@@ -51,8 +114,12 @@ namespace crossroads {
                     return "404 Not Found";
                 case 405:
                     return "405 Method Not Allowed";
+                case 413:
+                    return "413 Payload Too Large";
                 case 500:
                     return "500 Internal Server Error";
+                case 503:
+                    return "503 Service Unavailable";
                 default:
                     return std::to_string(status_code) + " Unknown";
             }
@@ -166,14 +233,20 @@ namespace crossroads {
                                            SnapshotProvider snapshot_provider,
                                            CommandHandler command_handler,
                                            ConfigProvider config_provider,
-                                           ConfigMutationHandler config_mutation_handler)
+                                           ConfigMutationHandler config_mutation_handler,
+                                           RunsHandler runs_handler,
+                                           LibraryHandler library_handler,
+                                           SessionsHandler sessions_handler)
         : port(port)
         , server_fd(-1)
         , running(false)
         , snapshot_provider(std::move(snapshot_provider))
         , command_handler(std::move(command_handler))
         , config_provider(std::move(config_provider))
-        , config_mutation_handler(std::move(config_mutation_handler)) {
+        , config_mutation_handler(std::move(config_mutation_handler))
+        , runs_handler(std::move(runs_handler))
+        , library_handler(std::move(library_handler))
+        , sessions_handler(std::move(sessions_handler)) {
     }
 
     SimpleHttpUiServer::~SimpleHttpUiServer() {
@@ -267,7 +340,22 @@ namespace crossroads {
         std::string body;
         std::size_t body_start = req.find("\r\n\r\n");
         if (body_start != std::string::npos) {
+            // Bodies larger than one read (bulk config imports) arrive in several segments.
+            const std::size_t expected = contentLength(req.substr(0, body_start));
+            if (expected > kMaxRequestBytes) {
+                std::string resp = buildHttpResponse(
+                    "413 Payload Too Large", "application/json", "{\"ok\":false,\"error\":\"request too large\"}");
+                send(client_fd, resp.c_str(), resp.size(), 0);
+                return;
+            }
             body = req.substr(body_start + 4);
+            while (body.size() < expected) {
+                const int more = recv(client_fd, buffer, sizeof(buffer), 0);
+                if (more <= 0) {
+                    break;
+                }
+                body.append(buffer, static_cast<std::size_t>(more));
+            }
         }
 
         std::size_t qmark = path.find('?');
@@ -299,16 +387,18 @@ namespace crossroads {
         }
 
         if (route == "snapshot") {
-            std::string body = snapshot_provider();
-            std::string resp = buildHttpResponse("200 OK", "application/json", body);
-            send(client_fd, resp.c_str(), resp.size(), 0);
+            ConfigMutationResult result = snapshot_provider(path);
+            std::string resp =
+                buildHttpResponse(statusTextFromCode(result.status_code), result.content_type, result.body);
+            sendAll(client_fd, resp);
             return;
         }
 
         if (route == "command") {
             std::string cmd = extractCmd(path);
-            command_handler(cmd);
-            std::string resp = buildHttpResponse("200 OK", "text/plain", "ok");
+            ConfigMutationResult result = command_handler(cmd, path);
+            std::string resp =
+                buildHttpResponse(statusTextFromCode(result.status_code), result.content_type, result.body);
             send(client_fd, resp.c_str(), resp.size(), 0);
             return;
         }
@@ -352,6 +442,26 @@ namespace crossroads {
             return;
         }
 
+        if (route == "config_library" && library_handler) {
+            sendResult(client_fd, library_handler(method, path, body));
+            return;
+        }
+
+        if (route == "runs" && runs_handler) {
+            ConfigMutationResult result = runs_handler(method, path);
+            std::string resp = buildHttpResponse(statusTextFromCode(result.status_code), "application/json", result.body);
+            send(client_fd, resp.c_str(), resp.size(), 0);
+            return;
+        }
+
+        if (route == "sessions" && sessions_handler) {
+            ConfigMutationResult result = sessions_handler(method, path, body);
+            std::string resp =
+                buildHttpResponse(statusTextFromCode(result.status_code), result.content_type, result.body);
+            send(client_fd, resp.c_str(), resp.size(), 0);
+            return;
+        }
+
         std::string not_found = buildHttpResponse("404 Not Found", "text/plain", "not found");
         send(client_fd, not_found.c_str(), not_found.size(), 0);
     }
@@ -359,15 +469,48 @@ namespace crossroads {
     std::string SimpleHttpUiServer::buildHttpResponse(const std::string& status,
                                                       const std::string& content_type,
                                                       const std::string& body) const {
-        std::ostringstream out;
-        out << "HTTP/1.1 " << status << "\r\n";
-        out << "Content-Type: " << content_type << "\r\n";
-        out << "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n";
-        out << "Pragma: no-cache\r\n";
-        out << "Expires: 0\r\n";
-        out << "Content-Length: " << body.size() << "\r\n";
-        out << "Connection: close\r\n\r\n";
-        out << body;
-        return out.str();
+        return responseHead(status, content_type, "Content-Length: " + std::to_string(body.size())) + body;
+    }
+
+    void SimpleHttpUiServer::sendResult(int client_fd, const ConfigMutationResult& result) const {
+        const std::string status = statusTextFromCode(result.status_code);
+        if (!result.stream) {
+            sendAll(client_fd, buildHttpResponse(status, result.content_type, result.body));
+            return;
+        }
+
+        // The head waits for the first piece, so a stream that fails right away still gets a proper error.
+        bool head_sent = false;
+        bool peer_gone = false;
+        std::string chunk;
+        const bool ok = result.stream([&](const std::string& piece) {
+            if (piece.empty() || peer_gone) {
+                return !peer_gone;
+            }
+            chunk.clear();
+            if (!head_sent) {
+                chunk = responseHead(status, result.content_type, "Transfer-Encoding: chunked");
+                head_sent = true;
+            }
+            char size[32];
+            std::snprintf(size, sizeof(size), "%zx\r\n", piece.size());
+            chunk += size;
+            chunk += piece;
+            chunk += "\r\n";
+            peer_gone = !sendAll(client_fd, chunk);
+            return !peer_gone;
+        });
+
+        if (!head_sent) {
+            sendAll(client_fd,
+                    ok ? buildHttpResponse(status, result.content_type, "")
+                       : buildHttpResponse(statusTextFromCode(500),
+                                           "application/json",
+                                           "{\"ok\":false,\"error\":\"response failed\"}"));
+            return;
+        }
+        if (ok && !peer_gone) {
+            sendAll(client_fd, "0\r\n\r\n");
+        }
     }
 }  // namespace crossroads
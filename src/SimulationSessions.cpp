@@ -0,0 +1,427 @@
+#include "SimulationSessions.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "ParallelFor.hpp"
+
+namespace crossroads {
+    namespace {
+        constexpr std::chrono::seconds kEvictionPeriod{1};
+        // How late a tick must be before another worker steals it; the home worker, which wakes at the deadline
+        // itself, normally gets there first.
+        constexpr std::chrono::milliseconds kStealGrace{2};
+    }  // namespace
+
+    SimulationSession::SimulationSession(std::string id,
+                                         const IntersectionConfig& config,
+                                         const SessionInputs& inputs,
+                                         double tick_seconds,
+                                         std::chrono::milliseconds tick_interval)
+        : id(std::move(id))
+        , tick_seconds(tick_seconds)
+        , tick_interval(tick_interval)
+        , engine(config, inputs.traffic_rate, inputs.ns_duration, inputs.ew_duration)
+        , inputs(inputs) {
+        if (inputs.spawn_filter.has_value()) {
+            engine.setSpawnLaneFilter(inputs.spawn_filter);
+        }
+        if (inputs.scheduler_mode != engine.getSchedulerMode()) {
+            engine.setSchedulerMode(inputs.scheduler_mode);
+        }
+    }
+
+    SimulationSessions::SimulationSessions() : SimulationSessions(Limits{}) {}
+
+    SimulationSessions::SimulationSessions(const Limits& limits) : limits(limits) {
+        const std::size_t worker_count = resolveWorkerCount(limits.worker_count);
+        queues.reserve(worker_count);
+        for (std::size_t i = 0; i < worker_count; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        home_counts.assign(worker_count, 0);
+    }
+
+    SimulationSessions::~SimulationSessions() {
+        stop();
+    }
+
+    std::shared_ptr<SimulationSession> SimulationSessions::create(const IntersectionConfig& config,
+                                                                  const SessionInputs& inputs,
+                                                                  double tick_seconds,
+                                                                  std::chrono::milliseconds tick_interval,
+                                                                  std::string* error) {
+        return add({}, false, config, inputs, tick_seconds, tick_interval, error);
+    }
+
+    std::shared_ptr<SimulationSession> SimulationSessions::createPinned(const std::string& id,
+                                                                        const IntersectionConfig& config,
+                                                                        const SessionInputs& inputs,
+                                                                        double tick_seconds,
+                                                                        std::chrono::milliseconds tick_interval,
+                                                                        std::string* error) {
+        if (id.empty()) {
+            if (error) {
+                *error = "session id is empty";
+            }
+            return nullptr;
+        }
+        return add(id, true, config, inputs, tick_seconds, tick_interval, error);
+    }
+
+    std::shared_ptr<SimulationSession> SimulationSessions::add(std::string id,
+                                                               bool pinned,
+                                                               const IntersectionConfig& config,
+                                                               const SessionInputs& inputs,
+                                                               double tick_seconds,
+                                                               std::chrono::milliseconds tick_interval,
+                                                               std::string* error) {
+        if (tick_seconds <= 0.0 || tick_interval.count() <= 0) {
+            if (error) {
+                *error = "tick_seconds and tick_interval must be positive";
+            }
+            return nullptr;
+        }
+
+        auto slot = std::make_shared<Slot>();
+        const Clock::time_point now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (entries.size() >= limits.max_sessions) {
+                evictIdleLocked(now);
+            }
+            if (entries.size() >= limits.max_sessions) {
+                if (error) {
+                    *error = "session limit reached";
+                }
+                return nullptr;
+            }
+            if (id.empty()) {
+                do {
+                    id = std::to_string(next_id++);
+                } while (entries.count(id) != 0);
+            } else if (entries.count(id) != 0) {
+                if (error) {
+                    *error = "session id already exists";
+                }
+                return nullptr;
+            }
+
+            slot->session = std::make_shared<SimulationSession>(id, config, inputs, tick_seconds, tick_interval);
+            slot->pinned = pinned;
+            slot->home = static_cast<std::size_t>(
+                std::min_element(home_counts.begin(), home_counts.end()) - home_counts.begin());
+            slot->last_used = now;
+            ++home_counts[slot->home];
+            entries.emplace(std::move(id), slot);
+        }
+        schedule({now + tick_interval, slot});
+        return slot->session;
+    }
+
+    void SimulationSessions::schedule(Job job) {
+        WorkerQueue& queue = *queues[job.slot->home];
+        bool earliest = false;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            earliest = queue.heap.empty() || job.due < queue.heap.front().due;
+            queue.heap.push_back(std::move(job));
+            std::push_heap(queue.heap.begin(), queue.heap.end(), laterDue);
+        }
+        // The home worker may be sleeping until a later deadline
+        if (earliest) {
+            queue.wake.notify_one();
+        }
+    }
+
+    std::shared_ptr<SimulationSession> SimulationSessions::find(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            return nullptr;
+        }
+        it->second->last_used = Clock::now();
+        return it->second->session;
+    }
+
+    bool SimulationSessions::destroy(const std::string& id, std::string* error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            if (error) {
+                *error = "session not found";
+            }
+            return false;
+        }
+        if (it->second->pinned) {
+            if (error) {
+                *error = "session cannot be destroyed";
+            }
+            return false;
+        }
+        removeLocked(it);
+        return true;
+    }
+
+    void SimulationSessions::removeLocked(std::map<std::string, std::shared_ptr<Slot>>::iterator it) {
+        // The queued tick holds the slot until it comes up and is dropped, at most one tick_interval later
+        it->second->removed = true;
+        --home_counts[it->second->home];
+        entries.erase(it);
+    }
+
+    std::vector<SimulationSessionInfo> SimulationSessions::list() const {
+        std::vector<SimulationSessionInfo> infos;
+        std::vector<std::shared_ptr<SimulationSession>> sessions;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const Clock::time_point now = Clock::now();
+            infos.reserve(entries.size());
+            sessions.reserve(entries.size());
+            for (const auto& [id, slot] : entries) {
+                SimulationSessionInfo info;
+                info.id = id;
+                info.pinned = slot->pinned;
+                info.tick_seconds = slot->session->tick_seconds;
+                info.tick_interval_ms = static_cast<int64_t>(slot->session->tick_interval.count());
+                info.idle_seconds = std::chrono::duration<double>(now - slot->last_used).count();
+                info.home_worker = slot->home;
+                infos.push_back(std::move(info));
+                sessions.push_back(slot->session);
+            }
+        }
+
+        // Session locks are taken without the manager lock so a slow tick does not stall the other sessions
+        for (std::size_t i = 0; i < sessions.size(); ++i) {
+            std::lock_guard<std::mutex> lock(sessions[i]->mutex);
+            infos[i].running = sessions[i]->engine.isRunning();
+            infos[i].sim_time = sessions[i]->engine.getSimTime();
+            infos[i].traffic_rate = sessions[i]->inputs.traffic_rate;
+        }
+        return infos;
+    }
+
+    std::size_t SimulationSessions::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    std::vector<SimulationWorkerStats> SimulationSessions::workerStats() const {
+        std::vector<SimulationWorkerStats> stats(queues.size());
+        double elapsed = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (started_at != Clock::time_point{}) {
+                elapsed = std::chrono::duration<double>((workers.empty() ? stopped_at : Clock::now()) - started_at)
+                              .count();
+            }
+            for (std::size_t i = 0; i < queues.size(); ++i) {
+                stats[i].home_sessions = home_counts[i];
+            }
+        }
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            std::lock_guard<std::mutex> lock(queues[i]->mutex);
+            stats[i].worker = i;
+            stats[i].ticks = queues[i]->ticks;
+            stats[i].stolen_ticks = queues[i]->stolen_ticks;
+            stats[i].busy_seconds = std::chrono::duration<double>(queues[i]->busy).count();
+            stats[i].utilization = elapsed > 0.0 ? std::min(1.0, stats[i].busy_seconds / elapsed) : 0.0;
+        }
+        return stats;
+    }
+
+    std::size_t SimulationSessions::evictIdle(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evictIdleLocked(now);
+    }
+
+    std::size_t SimulationSessions::evictIdleLocked(Clock::time_point now) {
+        std::size_t evicted = 0;
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (!it->second->pinned && now - it->second->last_used > limits.idle_timeout) {
+                removeLocked(it++);
+                ++evicted;
+            } else {
+                ++it;
+            }
+        }
+        return evicted;
+    }
+
+    std::size_t SimulationSessions::tickDue(Clock::time_point now) {
+        std::vector<Job> due;
+        for (const auto& queue : queues) {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            while (!queue->heap.empty() && queue->heap.front().due <= now) {
+                std::pop_heap(queue->heap.begin(), queue->heap.end(), laterDue);
+                due.push_back(std::move(queue->heap.back()));
+                queue->heap.pop_back();
+            }
+        }
+        std::sort(due.begin(), due.end(), [](const Job& a, const Job& b) { return a.due < b.due; });
+
+        std::size_t ticks = 0;
+        for (Job& job : due) {
+            ticks += runJob(std::move(job), queues.size(), now) ? 1 : 0;
+        }
+        return ticks;
+    }
+
+    bool SimulationSessions::steal(std::size_t worker,
+                                   Clock::time_point now,
+                                   Job* job,
+                                   Clock::time_point* next_stealable) {
+        std::size_t victim = queues.size();
+        Clock::time_point most_overdue = now - kStealGrace;
+        for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+            const std::size_t candidate = (worker + offset) % queues.size();
+            std::lock_guard<std::mutex> lock(queues[candidate]->mutex);
+            const std::vector<Job>& heap = queues[candidate]->heap;
+            if (heap.empty()) {
+                continue;
+            }
+            if (heap.front().due <= most_overdue) {
+                most_overdue = heap.front().due;
+                victim = candidate;
+            } else {
+                *next_stealable = std::min(*next_stealable, heap.front().due + kStealGrace);
+            }
+        }
+        if (victim == queues.size()) {
+            return false;
+        }
+
+        // The victim may have taken the tick itself in the meantime
+        WorkerQueue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.heap.empty() || queue.heap.front().due + kStealGrace > now) {
+            return false;
+        }
+        std::pop_heap(queue.heap.begin(), queue.heap.end(), laterDue);
+        *job = std::move(queue.heap.back());
+        queue.heap.pop_back();
+        return true;
+    }
+
+    bool SimulationSessions::runJob(Job job, std::size_t worker, Clock::time_point now) {
+        if (job.slot->removed) {
+            return false;
+        }
+
+        SimulationSession& session = *job.slot->session;
+        const Clock::time_point started = Clock::now();
+        {
+            std::lock_guard<std::mutex> session_lock(session.mutex);
+            session.engine.tick(session.tick_seconds);
+            if (session.after_tick) {
+                session.after_tick(session);
+            }
+        }
+        if (worker < queues.size()) {
+            WorkerQueue& queue = *queues[worker];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            ++queue.ticks;
+            queue.stolen_ticks += worker != job.slot->home ? 1 : 0;
+            queue.busy += Clock::now() - started;
+        }
+
+        job.due += session.tick_interval;
+        if (job.due <= now) {
+            job.due = now + session.tick_interval;
+        }
+        if (!job.slot->removed) {
+            schedule(std::move(job));
+        }
+        return true;
+    }
+
+    void SimulationSessions::workerLoop(std::size_t worker) {
+        WorkerQueue& queue = *queues[worker];
+        Clock::time_point last_eviction = Clock::now();
+        while (!stopping) {
+            const Clock::time_point now = Clock::now();
+            // Eviction is rare and takes the manager lock, so one worker does it for all
+            if (worker == 0 && now - last_eviction >= kEvictionPeriod) {
+                evictIdle(now);
+                last_eviction = now;
+            }
+
+            Job job;
+            bool have_job = false;
+            bool backlog = false;
+            Clock::time_point next_due = now + kEvictionPeriod;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.heap.empty() && queue.heap.front().due <= now) {
+                    std::pop_heap(queue.heap.begin(), queue.heap.end(), laterDue);
+                    job = std::move(queue.heap.back());
+                    queue.heap.pop_back();
+                    have_job = true;
+                    backlog = !queue.heap.empty() && queue.heap.front().due <= now;
+                } else if (!queue.heap.empty()) {
+                    next_due = std::min(next_due, queue.heap.front().due);
+                }
+            }
+            if (have_job) {
+                // More is due here than this worker can run now; wake the next worker to steal it once it is late
+                if (backlog && queues.size() > 1) {
+                    queues[(worker + 1) % queues.size()]->wake.notify_one();
+                }
+                runJob(std::move(job), worker, now);
+                continue;
+            }
+            if (steal(worker, now, &job, &next_due)) {
+                runJob(std::move(job), worker, now);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            if (stopping || (!queue.heap.empty() && queue.heap.front().due < next_due)) {
+                continue;
+            }
+            queue.wake.wait_until(lock, next_due);
+        }
+    }
+
+    void SimulationSessions::start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!workers.empty()) {
+            return;
+        }
+        stopping = false;
+        started_at = Clock::now();
+        // Statistics cover the current run of the workers
+        for (const auto& queue : queues) {
+            std::lock_guard<std::mutex> queue_lock(queue->mutex);
+            queue->ticks = 0;
+            queue->stolen_ticks = 0;
+            queue->busy = Clock::duration::zero();
+        }
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            workers.emplace_back(&SimulationSessions::workerLoop, this, i);
+        }
+    }
+
+    void SimulationSessions::stop() {
+        std::vector<std::thread> joining;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            joining.swap(workers);
+        }
+        for (const auto& queue : queues) {
+            // Taking the lock orders the flag before a worker's check-then-wait
+            { std::lock_guard<std::mutex> lock(queue->mutex); }
+            queue->wake.notify_all();
+        }
+        for (std::thread& worker : joining) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        if (!joining.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped_at = Clock::now();
+        }
+    }
+}  // namespace crossroads
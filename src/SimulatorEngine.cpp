@@ -2,12 +2,19 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <sstream>
-#include <unordered_set>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 
+#include "IntersectionConfigJson.hpp"
+#include "IntersectionTopology.hpp"
+
 namespace crossroads {
     namespace {
         ApproachId approachFromDirection(Direction dir) {
@@ -307,29 +314,69 @@ namespace crossroads {
         }
 
         constexpr std::size_t kRouteCount = 12;
+        constexpr double kClearanceBufferSeconds = 2.0;
+        constexpr double kRedHoldSeconds = 2.0;
+        constexpr double kSchedulerTimeEpsilon = 1e-9;
+        // Re-rank this long before a predicted rank change, so rounding in the tick-accumulated wait timers cannot
+        // carry a crossing past the tick on which a per-tick re-rank would see it.
+        constexpr double kSchedulerRankMarginSeconds = 1e-6;
+        constexpr char kStateMagic[4] = {'X', 'R', 'E', 'S'};
+        constexpr uint16_t kStateVersion = 6;
 
-        std::size_t routeIndex(ApproachId approach, MovementType movement) {
-            std::size_t approach_idx = approachIndex(approach);
-            std::size_t movement_idx = 0;
+        void setStateError(std::string* error, const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+        }
+
+        std::size_t movementIndex(MovementType movement) {
             switch (movement) {
                 case MovementType::Straight:
-                    movement_idx = 0;
-                    break;
+                    return 0;
                 case MovementType::Left:
-                    movement_idx = 1;
-                    break;
+                    return 1;
                 case MovementType::Right:
-                    movement_idx = 2;
-                    break;
+                    return 2;
+            }
+            return 0;
+        }
+
+        std::size_t routeIndex(ApproachId approach, MovementType movement) {
+            return approachIndex(approach) * 3 + movementIndex(movement);
+        }
+
+        // Seconds until gap + slope * t + curvature * t^2, the score difference of two routes, first reaches zero;
+        // 0 for a tie that is about to break and infinity when the two routes never swap places.
+        double rankFlipDelay(double gap, double slope, double curvature) {
+            constexpr double kNever = std::numeric_limits<double>::infinity();
+            if (gap < 0.0) {
+                gap = -gap;
+                slope = -slope;
+                curvature = -curvature;
+            }
+            if (gap == 0.0) {
+                return slope == 0.0 && curvature == 0.0 ? kNever : 0.0;
+            }
+            if (curvature == 0.0) {
+                return slope < 0.0 ? gap / -slope : kNever;
+            }
+            const double discriminant = slope * slope - 4.0 * curvature * gap;
+            if (discriminant < 0.0) {
+                return kNever;
+            }
+            // Stable form of the two roots; q is never zero because gap is positive.
+            const double q = -0.5 * (slope + std::copysign(std::sqrt(discriminant), slope));
+            double delay = kNever;
+            for (const double root : {q / curvature, gap / q}) {
+                if (root > 0.0) {
+                    delay = std::min(delay, root);
+                }
             }
-            return approach_idx * 3 + movement_idx;
+            return delay;
         }
 
-        bool areOpposingApproaches(ApproachId lhs, ApproachId rhs) {
-            return (lhs == ApproachId::North && rhs == ApproachId::South) ||
-                   (lhs == ApproachId::South && rhs == ApproachId::North) ||
-                   (lhs == ApproachId::East && rhs == ApproachId::West) ||
-                   (lhs == ApproachId::West && rhs == ApproachId::East);
+        bool containsLane(const std::vector<LaneId>& lanes, LaneId lane_id) {
+            return std::find(lanes.begin(), lanes.end(), lane_id) != lanes.end();
         }
 
         const char* routeName(ApproachId approach, MovementType movement) {
@@ -404,236 +451,77 @@ namespace crossroads {
             return false;
         }
 
-        struct RoutePoint {
-            double x = 0.0;
-            double y = 0.0;
-        };
-
-        double laneLateralOffset(ApproachId approach, std::size_t lane_index, std::size_t lane_count) {
-            if (lane_count <= 1) {
-                return 0.0;
-            }
-
-            const double step = 0.22;
-            const double half_span = (static_cast<double>(lane_count - 1) * step) * 0.5;
-            const double raw = -half_span + static_cast<double>(lane_index) * step;
-
-            switch (approach) {
-                case ApproachId::North:
-                    return -raw;
-                case ApproachId::South:
-                    return raw;
-                case ApproachId::East:
-                    return raw;
-                case ApproachId::West:
-                    return -raw;
-            }
-            return raw;
-        }
-
-        RoutePoint entryPointFor(ApproachId approach, std::size_t lane_index, std::size_t lane_count) {
-            const double lateral = laneLateralOffset(approach, lane_index, lane_count);
-            switch (approach) {
-                case ApproachId::North:
-                    return {lateral, 1.0};
-                case ApproachId::South:
-                    return {lateral, -1.0};
-                case ApproachId::East:
-                    return {1.0, lateral};
-                case ApproachId::West:
-                    return {-1.0, lateral};
-            }
-            return {0.0, 0.0};
-        }
-
-        RoutePoint exitPointFor(ApproachId approach, std::size_t lane_index, std::size_t lane_count) {
-            const double lateral = laneLateralOffset(approach, lane_index, lane_count);
-            switch (approach) {
-                case ApproachId::North:
-                    return {lateral, 1.0};
-                case ApproachId::South:
-                    return {lateral, -1.0};
-                case ApproachId::East:
-                    return {1.0, lateral};
-                case ApproachId::West:
-                    return {-1.0, lateral};
+        LightState routeLight(const IntersectionState& state, ApproachId approach, MovementType movement) {
+            switch (movement) {
+                case MovementType::Straight:
+                    return approachMainLight(approach, state);
+                case MovementType::Left:
+                    return leftTurnLightFor(directionFromApproach(approach), state);
+                case MovementType::Right:
+                    return rightTurnLightFor(directionFromApproach(approach), state);
             }
-            return {0.0, 0.0};
+            return LightState::Red;
         }
 
-        RoutePoint inboundDirection(ApproachId approach) {
-            switch (approach) {
-                case ApproachId::North:
-                    return {0.0, -1.0};
-                case ApproachId::South:
-                    return {0.0, 1.0};
-                case ApproachId::East:
-                    return {-1.0, 0.0};
-                case ApproachId::West:
-                    return {1.0, 0.0};
-            }
-            return {0.0, 0.0};
+        bool routeIsRed(const IntersectionState& state, ApproachId approach, MovementType movement) {
+            return routeLight(state, approach, movement) == LightState::Red;
         }
 
-        RoutePoint outboundDirection(ApproachId approach) {
-            switch (approach) {
-                case ApproachId::North:
-                    return {0.0, 1.0};
-                case ApproachId::South:
-                    return {0.0, -1.0};
-                case ApproachId::East:
-                    return {1.0, 0.0};
-                case ApproachId::West:
-                    return {-1.0, 0.0};
-            }
-            return {0.0, 0.0};
-        }
-
-        std::vector<RoutePoint> sampleConnectionPath(const IntersectionConfig& config,
-                                                     const LaneConnectionConfig& connection) {
-            const auto& from_cfg = config.approaches[approachIndex(connection.from_approach)];
-            const auto& to_cfg = config.approaches[approachIndex(connection.to_approach)];
-            const std::size_t from_count = std::max<std::size_t>(1, from_cfg.lanes.size());
-            const std::size_t to_count = std::max<std::size_t>(1, effectiveToLaneCount(to_cfg));
-
-            const RoutePoint p0 = entryPointFor(connection.from_approach, connection.from_lane_index, from_count);
-            const RoutePoint p3 = exitPointFor(connection.to_approach, connection.to_lane_index, to_count);
+        // The route tables depend on the config alone. Engines are rebuilt for the same few configs all the time
+        // (resets, training episodes, replays), so the path sampling is done once per config. The fingerprint only
+        // finds the entry; a hit counts once the stored config compares equal in full.
+        struct RouteTables {
+            std::array<bool, kRouteCount> configured{};
+            std::array<RouteMask, kRouteCount> conflicts{};
+        };
 
-            if (connection.movement == MovementType::Straight) {
-                return {p0, p3};
-            }
+        struct CachedRouteTables {
+            IntersectionConfig config;
+            RouteTables tables;
+        };
 
-            const RoutePoint in_dir = inboundDirection(connection.from_approach);
-            const RoutePoint out_dir = outboundDirection(connection.to_approach);
+        constexpr std::size_t kRouteTableCacheCapacity = 64;
 
-            if (connection.movement == MovementType::Left) {
-                const double control_distance = 0.55;
-                const RoutePoint c1 = {p0.x + in_dir.x * control_distance, p0.y + in_dir.y * control_distance};
-                const RoutePoint c2 = {p3.x - out_dir.x * control_distance, p3.y - out_dir.y * control_distance};
+        std::mutex route_table_cache_mutex;
+        std::unordered_map<uint64_t, CachedRouteTables> route_table_cache;
 
-                constexpr int samples = 18;
-                std::vector<RoutePoint> path;
-                path.reserve(samples + 1);
-                for (int i = 0; i <= samples; ++i) {
-                    const double t = static_cast<double>(i) / static_cast<double>(samples);
-                    const double mt = 1.0 - t;
-                    const double b0 = mt * mt * mt;
-                    const double b1 = 3.0 * mt * mt * t;
-                    const double b2 = 3.0 * mt * t * t;
-                    const double b3 = t * t * t;
-                    path.push_back(
-                        {b0 * p0.x + b1 * c1.x + b2 * c2.x + b3 * p3.x, b0 * p0.y + b1 * c1.y + b2 * c2.y + b3 * p3.y});
+        bool signalTimingDiffers(const IntersectionConfig& lhs, const IntersectionConfig& rhs) {
+            for (std::size_t i = 0; i < lhs.signal_groups.size() && i < rhs.signal_groups.size(); ++i) {
+                if (lhs.signal_groups[i].min_green_seconds != rhs.signal_groups[i].min_green_seconds ||
+                    lhs.signal_groups[i].orange_seconds != rhs.signal_groups[i].orange_seconds) {
+                    return true;
                 }
-                return path;
             }
-
-            const double control_distance = 0.18;
-
-            const RoutePoint c1 = {p0.x + in_dir.x * control_distance, p0.y + in_dir.y * control_distance};
-            const RoutePoint c2 = {p3.x - out_dir.x * control_distance, p3.y - out_dir.y * control_distance};
-
-            constexpr int samples = 18;
-            std::vector<RoutePoint> path;
-            path.reserve(samples + 1);
-            for (int i = 0; i <= samples; ++i) {
-                const double t = static_cast<double>(i) / static_cast<double>(samples);
-                const double mt = 1.0 - t;
-                const double b0 = mt * mt * mt;
-                const double b1 = 3.0 * mt * mt * t;
-                const double b2 = 3.0 * mt * t * t;
-                const double b3 = t * t * t;
-                path.push_back(
-                    {b0 * p0.x + b1 * c1.x + b2 * c2.x + b3 * p3.x, b0 * p0.y + b1 * c1.y + b2 * c2.y + b3 * p3.y});
-            }
-            return path;
-        }
-
-        double crossProduct(const RoutePoint& a, const RoutePoint& b, const RoutePoint& c) {
-            return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
-        }
-
-        bool segmentIntersects(const RoutePoint& a, const RoutePoint& b, const RoutePoint& c, const RoutePoint& d) {
-            constexpr double eps = 1e-9;
-
-            const double o1 = crossProduct(a, b, c);
-            const double o2 = crossProduct(a, b, d);
-            const double o3 = crossProduct(c, d, a);
-            const double o4 = crossProduct(c, d, b);
-
-            const bool ab_straddles_cd = (o1 >= eps && o2 <= -eps) || (o1 <= -eps && o2 >= eps);
-            const bool cd_straddles_ab = (o3 >= eps && o4 <= -eps) || (o3 <= -eps && o4 >= eps);
-            return ab_straddles_cd && cd_straddles_ab;
-        }
-
-        bool pointInCore(const RoutePoint& p) {
-            return std::abs(p.x) <= 0.55 && std::abs(p.y) <= 0.55;
+            return false;
         }
 
-        bool segmentIntersectsCore(const RoutePoint& a, const RoutePoint& b) {
-            if (pointInCore(a) || pointInCore(b)) {
-                return true;
+        bool findCachedRouteTables(uint64_t fingerprint, const IntersectionConfig& config, RouteTables& tables) {
+            std::lock_guard<std::mutex> lock(route_table_cache_mutex);
+            const auto found = route_table_cache.find(fingerprint);
+            if (found == route_table_cache.end() || !sameIntersectionConfig(found->second.config, config)) {
+                return false;
             }
-
-            constexpr double core = 0.55;
-            constexpr double eps = 1e-12;
-            double t0 = 0.0;
-            double t1 = 1.0;
-            const double dx = b.x - a.x;
-            const double dy = b.y - a.y;
-
-            auto clip = [&](double p, double q) {
-                if (std::abs(p) <= eps) {
-                    return q >= 0.0;
-                }
-
-                const double r = q / p;
-                if (p < 0.0) {
-                    if (r > t1) {
-                        return false;
-                    }
-                    if (r > t0) {
-                        t0 = r;
-                    }
-                } else {
-                    if (r < t0) {
-                        return false;
-                    }
-                    if (r < t1) {
-                        t1 = r;
-                    }
-                }
-
-                return true;
-            };
-
-            return clip(-dx, a.x + core) && clip(dx, core - a.x) && clip(-dy, a.y + core) && clip(dy, core - a.y);
+            tables = found->second.tables;
+            return true;
         }
 
-        bool pathsConflictInCore(const std::vector<RoutePoint>& lhs, const std::vector<RoutePoint>& rhs) {
-            if (lhs.size() < 2 || rhs.size() < 2) {
-                return false;
+        // The four-approach config is the four-arm topology instance, whose routes are numbered like ours.
+        RouteTables computeRouteTables(const IntersectionConfig& config) {
+            const IntersectionTopology topology = topologyFor(config);
+            RouteTables tables;
+            for (std::size_t route = 0; route < kRouteCount && route < topology.routeCount(); ++route) {
+                tables.configured[route] = topology.routes()[route].configured;
+                tables.conflicts[route] = topology.conflictMask(route);
             }
+            return tables;
+        }
 
-            for (std::size_t i = 1; i < lhs.size(); ++i) {
-                const RoutePoint a = lhs[i - 1];
-                const RoutePoint b = lhs[i];
-                if (!segmentIntersectsCore(a, b)) {
-                    continue;
-                }
-
-                for (std::size_t j = 1; j < rhs.size(); ++j) {
-                    const RoutePoint c = rhs[j - 1];
-                    const RoutePoint d = rhs[j];
-                    if (!segmentIntersectsCore(c, d)) {
-                        continue;
-                    }
-
-                    if (segmentIntersects(a, b, c, d)) {
-                        return true;
-                    }
-                }
+        void cacheRouteTables(uint64_t fingerprint, const IntersectionConfig& config, const RouteTables& tables) {
+            std::lock_guard<std::mutex> lock(route_table_cache_mutex);
+            if (route_table_cache.size() >= kRouteTableCacheCapacity) {
+                route_table_cache.clear();
             }
-            return false;
+            route_table_cache[fingerprint] = CachedRouteTables{config, tables};
         }
     }  // namespace
 
@@ -653,12 +541,11 @@ namespace crossroads {
         , intersection_config(intersection_config)
         , current_time(0.0)
         , safety_violations(0) {
-        if (this->intersection_config.signal_groups.empty()) {
-            controller = std::make_unique<BasicControllerAdapter>(ns_duration, ew_duration);
-        } else {
-            controller = std::make_unique<ConfigurableSignalGroupController>(this->intersection_config);
-        }
+        controller = makeConfiguredController();
 
+        default_layout_fast_path = matchesDefaultIntersectionLayout(this->intersection_config);
+        config_fingerprint = intersectionConfigFingerprint(this->intersection_config);
+        config_hash = intersectionConfigHash(config_fingerprint);
         route_last_served_time.fill(-1.0);
         route_green_started_at.fill(-1.0);
         route_vehicles_started_this_green.fill(0);
@@ -688,10 +575,14 @@ namespace crossroads {
             return;
         }
 
-        std::array<bool, 4> approach_demand = {!traffic.getQueueByDirection(Direction::North).empty(),
-                                               !traffic.getQueueByDirection(Direction::South).empty(),
-                                               !traffic.getQueueByDirection(Direction::East).empty(),
-                                               !traffic.getQueueByDirection(Direction::West).empty()};
+        if (scheduler_mode == SchedulerMode::Predictive) {
+            planPredictiveAnchor(dt);
+        }
+
+        std::array<bool, 4> approach_demand = {traffic.getQueueLength(Direction::North) > 0,
+                                               traffic.getQueueLength(Direction::South) > 0,
+                                               traffic.getQueueLength(Direction::East) > 0,
+                                               traffic.getQueueLength(Direction::West) > 0};
         if (controller) {
             controller->setDemandByDirection(approach_demand);
         }
@@ -704,15 +595,22 @@ namespace crossroads {
                                              effective_light_state.south == LightState::Green,
                                              effective_light_state.east == LightState::Green,
                                              effective_light_state.west == LightState::Green};
-        traffic.updateVehicleSpeeds(dt, lane_can_move, [&](Direction dir, const Vehicle& vehicle) {
-            const LaneConfig* lane_cfg = findLaneConfigForVehicle(intersection_config, dir, vehicle.lane_id);
-            if (lane_cfg && !lane_cfg->connected_to_intersection) {
-                return false;
-            }
-            return signalAllowsVehicle(dir, vehicle, lane_cfg, effective_light_state);
-        });
-        processVehicleCrossings();
-        completeVehicleCrossings();
+        if (traffic.isMesoscopic()) {
+            traffic.advanceMesoscopic(dt, current_time, [&](Direction dir, const Vehicle& vehicle) {
+                const LaneConfig* lane_cfg = laneConfigFor(dir, vehicle.lane_id);
+                if ((lane_cfg && !lane_cfg->connected_to_intersection) ||
+                    !signalAllowsVehicle(dir, vehicle, lane_cfg, effective_light_state)) {
+                    return false;
+                }
+                countRouteStart(dir, vehicle);
+                return true;
+            });
+        } else {
+            refreshMovementPermissions();
+            traffic.updateVehicleSpeeds(dt, lane_can_move, &movement_permissions);
+            processVehicleCrossings();
+            completeVehicleCrossings();
+        }
 
         IntersectionState current_state = controller ? controller->getCurrentState() : IntersectionState{};
         bool transition_valid = true;
@@ -734,119 +632,54 @@ namespace crossroads {
     }
 
     void SimulatorEngine::refreshEffectiveSignalState(double dt_seconds) {
-        IntersectionState base_state = controller ? controller->getCurrentState() : IntersectionState{};
+        const IntersectionState base_state = controller ? controller->getCurrentState() : IntersectionState{};
         const IntersectionState prev_effective =
             has_previous_effective_light_state ? previous_effective_light_state : IntersectionState{};
         const auto prev_route_green_active = route_green_active;
 
         if (!route_conflict_matrix_ready) {
-            route_conflict_matrix = {};
-            route_configured.fill(false);
-
-            std::array<std::vector<std::vector<RoutePoint>>, kRouteCount> route_paths;
-            std::array<std::vector<LaneConnectionConfig>, kRouteCount> route_connections;
-            for (const auto& connection : intersection_config.lane_connections) {
-                const std::size_t idx = routeIndex(connection.from_approach, connection.movement);
-                route_paths[idx].push_back(sampleConnectionPath(intersection_config, connection));
-                route_connections[idx].push_back(connection);
-                route_configured[idx] = true;
-            }
-
-            for (std::size_t i = 0; i < kRouteCount; ++i) {
-                for (std::size_t j = 0; j < kRouteCount; ++j) {
-                    if (i == j || !route_configured[i] || !route_configured[j]) {
-                        route_conflict_matrix[i][j] = false;
-                        continue;
-                    }
-
-                    const ApproachId route_i_approach = static_cast<ApproachId>(i / 3);
-                    const ApproachId route_j_approach = static_cast<ApproachId>(j / 3);
-                    const MovementType route_i_movement = static_cast<MovementType>(i % 3);
-                    const MovementType route_j_movement = static_cast<MovementType>(j % 3);
-                    if (route_i_movement == MovementType::Straight && route_j_movement == MovementType::Straight &&
-                        areOpposingApproaches(route_i_approach, route_j_approach)) {
-                        route_conflict_matrix[i][j] = false;
-                        continue;
-                    }
-
-                    bool has_conflict = false;
-
-                    for (const auto& lhs_connection : route_connections[i]) {
-                        for (const auto& rhs_connection : route_connections[j]) {
-                            if (lhs_connection.to_approach == rhs_connection.to_approach &&
-                                lhs_connection.to_lane_index == rhs_connection.to_lane_index) {
-                                has_conflict = true;
-                                break;
-                            }
-                        }
-                        if (has_conflict) {
-                            break;
-                        }
-                    }
-
-                    for (const auto& lhs_path : route_paths[i]) {
-                        for (const auto& rhs_path : route_paths[j]) {
-                            if (pathsConflictInCore(lhs_path, rhs_path)) {
-                                has_conflict = true;
-                                break;
-                            }
-                        }
-                        if (has_conflict) {
-                            break;
-                        }
-                    }
-
-                    route_conflict_matrix[i][j] = has_conflict;
-                }
-            }
-
-            for (std::size_t i = 0; i < kRouteCount; ++i) {
-                for (std::size_t j = 0; j < kRouteCount; ++j) {
-                    if (!route_configured[i] || !route_configured[j]) {
-                        route_conflict_matrix[i][j] = false;
-                        continue;
-                    }
-                    route_conflict_matrix[i][j] = route_conflict_matrix[i][j] || route_conflict_matrix[j][i];
-                }
-            }
-
-            route_conflict_matrix_ready = true;
+            rebuildRouteConflictMatrix();
         }
 
-        scheduler_anchor_route_index = -1;
         scheduler_parallel_routes.fill(false);
         scheduler_blocked_routes.fill(false);
         scheduler_safety_blocked_routes.fill(false);
         scheduler_clearance_blocked_routes.fill(false);
-        route_waiting_demand.fill(false);
-        route_wait_seconds.fill(0.0);
-        route_priority_score.fill(0.0);
         route_green_active.fill(false);
 
-        std::array<bool, 4> has_left_waiting_demand = {false, false, false, false};
-        std::array<bool, 4> has_straight_waiting_demand = {false, false, false, false};
-        std::array<bool, 4> has_right_waiting_demand = {false, false, false, false};
-
-        for (const auto& approach_cfg : intersection_config.approaches) {
-            const ApproachId approach = approach_cfg.id;
-            const Direction dir = directionFromApproach(approach);
-            const auto& queue = traffic.getQueueByDirection(dir);
-            const std::size_t idx = approachIndex(approach);
-
-            has_left_waiting_demand[idx] = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                return vehicle.isWaiting() && isEffectiveLeftTurn(dir, vehicle);
-            });
-
-            has_straight_waiting_demand[idx] = std::any_of(queue.begin(), queue.end(), [](const Vehicle& vehicle) {
-                return vehicle.isWaiting() && vehicle.movement == MovementType::Straight;
-            });
+        auto clear_selection = [&]() {
+            scheduler_anchor_route_index = -1;
+            scheduler_parallel_order_count = 0;
+            scheduler_selection_version = 0;
+            route_priority_score.fill(0.0);
+            route_priority_score_slope.fill(0.0);
+            route_priority_score_curvature.fill(0.0);
+        };
 
-            has_right_waiting_demand[idx] = std::any_of(queue.begin(), queue.end(), [](const Vehicle& vehicle) {
-                return vehicle.isWaiting() && vehicle.movement == MovementType::Right;
-            });
+        refreshApproachDemand();
+
+        if (scheduler_mode == SchedulerMode::FixedTime) {
+            // Fixed-time plans run exactly as the controller times them; the tick still safety-checks them.
+            // Route demand is still tracked so external policies can observe it.
+            clear_selection();
+            updateMovementWaitTimers(dt_seconds);
+            updateRouteDemand();
+            effective_light_state = base_state;
+            for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+                route_green_active[route_idx] =
+                    route_configured[route_idx] && routeIsGreen(effective_light_state,
+                                                                static_cast<ApproachId>(route_idx / 3),
+                                                                static_cast<MovementType>(route_idx % 3));
+            }
+            previous_effective_light_state = effective_light_state;
+            has_previous_effective_light_state = true;
+            return;
         }
 
         if (traffic.getTotalWaiting() == 0) {
+            clear_selection();
+            route_waiting_demand.fill(false);
+            route_wait_seconds.fill(0.0);
             effective_light_state = IntersectionState{};
             previous_effective_light_state = effective_light_state;
             has_previous_effective_light_state = true;
@@ -858,119 +691,273 @@ namespace crossroads {
         }
 
         effective_light_state = base_state;
+        applyApproachLightRules();
+        updateMovementWaitTimers(dt_seconds);
+        updateRouteDemand();
+        updateConflictClearance();
 
+        // Ranking only moves when a vehicle event or a scoring threshold happens; gates still run every tick.
+        if (schedulerSelectionStale(prev_route_green_active)) {
+            selectSchedulerRoutes(prev_route_green_active);
+        }
+        scheduler_score_time = current_time;
+        applySchedulerSelection();
+
+        applyTransitionDiscipline(prev_effective);
+        updateRouteSignalTracking(prev_route_green_active);
+
+        previous_effective_light_state = effective_light_state;
+        has_previous_effective_light_state = true;
+    }
+
+    void SimulatorEngine::rebuildRouteConflictMatrix() {
+        if (default_layout_fast_path) {
+            loadLayoutRouteTables<DefaultIntersectionLayout>();
+            return;
+        }
+
+        RouteTables tables;
+        if (!findCachedRouteTables(config_fingerprint, intersection_config, tables)) {
+            tables = computeRouteTables(intersection_config);
+            cacheRouteTables(config_fingerprint, intersection_config, tables);
+        }
+        route_configured = tables.configured;
+        route_conflict_masks = tables.conflicts;
+
+        approach_lane_classes = {};
         for (const auto& approach_cfg : intersection_config.approaches) {
-            const Direction dir = directionFromApproach(approach_cfg.id);
-            const auto& queue = traffic.getQueueByDirection(dir);
-            if (queue.empty()) {
-                setApproachMainLight(effective_light_state, approach_cfg.id, LightState::Red);
+            auto& lanes = approach_lane_classes[approachIndex(approach_cfg.id)];
+            for (const auto& lane_cfg : approach_cfg.lanes) {
+                if (isDedicatedRightTurnLane(lane_cfg)) {
+                    lanes.dedicated_right.push_back(lane_cfg.id);
+                    if (hasExclusiveLaneConnection(
+                            intersection_config, approach_cfg.id, lane_cfg.id, MovementType::Right)) {
+                        lanes.exclusive_right.push_back(lane_cfg.id);
+                    }
+                }
+                if (isDedicatedLeftTurnLane(lane_cfg)) {
+                    lanes.dedicated_left.push_back(lane_cfg.id);
+                }
             }
         }
 
+        route_conflict_matrix_ready = true;
+    }
+
+    template <typename Layout>
+    void SimulatorEngine::loadLayoutRouteTables() {
+        static_assert(Layout::kRouteCount == kRouteCount, "layout route tables must match the scheduler routes");
+        route_configured = Layout::kRouteConfigured;
+        route_conflict_masks = Layout::kRouteConflictMasks;
+
+        approach_lane_classes = {};
         for (const auto& approach_cfg : intersection_config.approaches) {
-            const ApproachId approach = approach_cfg.id;
-            const Direction dir = directionFromApproach(approach);
-            const auto& queue = traffic.getQueueByDirection(dir);
+            const LaneId right_lane = laneIdFor(approach_cfg.id, Layout::kRightTurnLaneIndex);
+            auto& lanes = approach_lane_classes[approachIndex(approach_cfg.id)];
+            lanes.dedicated_right.push_back(right_lane);
+            lanes.exclusive_right.push_back(right_lane);
+        }
 
-            std::vector<LaneId> dedicated_right_lane_ids;
-            std::vector<LaneId> exclusive_right_lane_ids;
-            dedicated_right_lane_ids.reserve(approach_cfg.lanes.size());
-            exclusive_right_lane_ids.reserve(approach_cfg.lanes.size());
-            for (const auto& lane_cfg : approach_cfg.lanes) {
-                if (isDedicatedRightTurnLane(lane_cfg)) {
-                    dedicated_right_lane_ids.push_back(lane_cfg.id);
-                    if (hasExclusiveLaneConnection(intersection_config, approach, lane_cfg.id, MovementType::Right)) {
-                        exclusive_right_lane_ids.push_back(lane_cfg.id);
+        route_conflict_matrix_ready = true;
+    }
+
+    const LaneConfig* SimulatorEngine::laneConfigFor(Direction dir, LaneId lane_id) const {
+        if (!default_layout_fast_path) {
+            return findLaneConfigForVehicle(intersection_config, dir, lane_id);
+        }
+
+        const ApproachId approach = approachFromDirection(dir);
+        const int lane_index = static_cast<int>(lane_id) - static_cast<int>(laneIdFor(approach, 0));
+        if (lane_index < 0 || lane_index >= static_cast<int>(DefaultIntersectionLayout::kLanesPerApproach)) {
+            return nullptr;
+        }
+        return &intersection_config.approaches[approachIndex(approach)].lanes[static_cast<std::size_t>(lane_index)];
+    }
+
+    void SimulatorEngine::refreshMovementPermissions() {
+        const IntersectionState& state = effective_light_state;
+        const IntersectionState& last = movement_permissions_state;
+        if (!movement_permissions_stale && state.north == last.north && state.east == last.east &&
+            state.south == last.south && state.west == last.west && state.turnSouthEast == last.turnSouthEast &&
+            state.turnNorthWest == last.turnNorthWest && state.turnWestSouth == last.turnWestSouth &&
+            state.turnEastNorth == last.turnEastNorth && state.turnNorthEast == last.turnNorthEast &&
+            state.turnSouthWest == last.turnSouthWest && state.turnEastSouth == last.turnEastSouth &&
+            state.turnWestNorth == last.turnWestNorth) {
+            return;
+        }
+        movement_permissions_state = state;
+        movement_permissions_stale = false;
+
+        // Same rules as the per-vehicle check, asked once for every movement and destination a lane can see
+        Vehicle probe(0, Direction::North, 0.0);
+        auto lane_permissions = [&](Direction dir, const LaneConfig* lane_cfg) {
+            uint16_t mask = 0;
+            if (lane_cfg && !lane_cfg->connected_to_intersection) {
+                return mask;
+            }
+            for (MovementType movement : {MovementType::Straight, MovementType::Left, MovementType::Right}) {
+                for (std::size_t destination_index = 0; destination_index < 4; ++destination_index) {
+                    const ApproachId destination = static_cast<ApproachId>(destination_index);
+                    probe.movement = movement;
+                    probe.destination_approach = destination;
+                    if (signalAllowsVehicle(dir, probe, lane_cfg, state)) {
+                        mask |= TrafficGenerator::MovementPermissions::bit(movement, destination);
                     }
                 }
             }
+            return mask;
+        };
 
-            if (dedicated_right_lane_ids.empty()) {
-                setRightTurnLight(effective_light_state, approach, LightState::Red);
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            const std::size_t dir_index = static_cast<std::size_t>(dir);
+            movement_permissions.unconfigured[dir_index] = lane_permissions(dir, nullptr);
+            const ApproachId approach = approachFromDirection(dir);
+            const std::size_t approach_index = approachIndex(approach);
+            auto& lanes = movement_permissions.lanes[dir_index];
+            if (approach_index >= intersection_config.approaches.size()) {
+                lanes.clear();
                 continue;
             }
+            const ApproachConfig& approach_cfg = intersection_config.approaches[approach_index];
+            lanes.resize(approach_cfg.lanes.size());
+            for (std::size_t lane = 0; lane < approach_cfg.lanes.size(); ++lane) {
+                lanes[lane] = lane_permissions(dir, &approach_cfg.lanes[lane]);
+            }
+        }
+    }
 
-            const bool has_demand = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                if (std::find(dedicated_right_lane_ids.begin(), dedicated_right_lane_ids.end(), vehicle.lane_id) ==
-                    dedicated_right_lane_ids.end()) {
-                    return false;
+    void SimulatorEngine::refreshApproachDemand() {
+        const uint64_t version = traffic.getDemandVersion();
+        if (approach_demand_version == version) {
+            return;
+        }
+        approach_demand_version = version;
+        approach_demand = {};
+
+        for (const auto& approach_cfg : intersection_config.approaches) {
+            const ApproachId approach = approach_cfg.id;
+            const Direction dir = directionFromApproach(approach);
+            const auto& lanes = approach_lane_classes[approachIndex(approach)];
+            ApproachDemand& demand = approach_demand[approachIndex(approach)];
+            demand.queue_empty = traffic.getQueueLength(dir) == 0;
+
+            // Counts a group of vehicles that share lane and movement: one vehicle in microscopic mode, a lane's
+            // point-queue counters in mesoscopic mode.
+            auto add_vehicles = [&](const Vehicle& vehicle, int waiting, int crossing, int stopped) {
+                if (waiting == 0 && crossing == 0) {
+                    return;
                 }
-                return vehicle.isWaiting() || vehicle.isCrossing();
-            });
 
-            const bool has_non_right_or_mixed_lane_demand =
-                std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                    if (!vehicle.isWaiting() && !vehicle.isCrossing()) {
-                        return false;
+                const bool left = isEffectiveLeftTurn(dir, vehicle);
+                const std::array<bool, 3> movement_matches = {
+                    vehicle.movement == MovementType::Straight, left, vehicle.movement == MovementType::Right};
+                for (std::size_t movement_idx = 0; movement_idx < movement_matches.size(); ++movement_idx) {
+                    if (!movement_matches[movement_idx]) {
+                        continue;
                     }
-                    if (vehicle.movement != MovementType::Right) {
-                        return true;
+                    demand.waiting[movement_idx] += waiting;
+                    demand.crossing[movement_idx] += crossing;
+                    demand.stopped[movement_idx] += stopped;
+                }
+
+                const bool in_right_lane = containsLane(lanes.dedicated_right, vehicle.lane_id);
+                const bool in_left_lane = containsLane(lanes.dedicated_left, vehicle.lane_id);
+                demand.right_lane_demand = demand.right_lane_demand || in_right_lane;
+                demand.right_exclusive_demand =
+                    demand.right_exclusive_demand || containsLane(lanes.exclusive_right, vehicle.lane_id);
+                demand.main_light_demand =
+                    demand.main_light_demand || vehicle.movement != MovementType::Right || !in_right_lane;
+                demand.left_lane_demand = demand.left_lane_demand || in_left_lane;
+                demand.left_lane_crossing = demand.left_lane_crossing || (crossing > 0 && in_left_lane && left);
+                demand.unprotected_left_demand = demand.unprotected_left_demand || (left && !in_left_lane);
+            };
+
+            if (traffic.isMesoscopic()) {
+                const MesoscopicQueues& meso = traffic.getMesoscopicQueues();
+                const auto& meso_lanes = meso.approach(approach).lanes;
+                for (std::size_t lane_index = 0; lane_index < meso_lanes.size(); ++lane_index) {
+                    const MesoscopicLane& lane = meso_lanes[lane_index];
+                    for (MovementType movement : {MovementType::Straight, MovementType::Left, MovementType::Right}) {
+                        const std::size_t m = movementIndex(movement);
+                        add_vehicles(meso.proxyVehicle(approach, lane_index, movement),
+                                     static_cast<int>(lane.queued[m]),
+                                     static_cast<int>(lane.crossing[m]),
+                                     static_cast<int>(lane.stopped[m]));
                     }
-                    return std::find(dedicated_right_lane_ids.begin(),
-                                     dedicated_right_lane_ids.end(),
-                                     vehicle.lane_id) == dedicated_right_lane_ids.end();
-                });
-            if (!has_non_right_or_mixed_lane_demand) {
-                setApproachMainLight(effective_light_state, approach, LightState::Red);
+                }
+                continue;
             }
 
-            const bool has_exclusive_demand = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                if (std::find(exclusive_right_lane_ids.begin(), exclusive_right_lane_ids.end(), vehicle.lane_id) ==
-                    exclusive_right_lane_ids.end()) {
-                    return false;
+            for (const auto& vehicle : traffic.getQueueByDirection(dir)) {
+                const bool stopped = vehicle.current_speed <= STOPPED_SPEED_THRESHOLD;
+                add_vehicles(vehicle, 1, 0, stopped ? 1 : 0);
+            }
+            for (const auto& crossing : traffic.getCrossingQueues(dir)) {
+                for (const auto& vehicle : crossing) {
+                    add_vehicles(vehicle, 0, 1, 0);
                 }
-                return vehicle.isWaiting() || vehicle.isCrossing();
-            });
+            }
+        }
+    }
+
+    void SimulatorEngine::applyApproachLightRules() {
+        const std::size_t straight = movementIndex(MovementType::Straight);
+        const std::size_t left = movementIndex(MovementType::Left);
+
+        for (const auto& approach_cfg : intersection_config.approaches) {
+            if (approach_demand[approachIndex(approach_cfg.id)].queue_empty) {
+                setApproachMainLight(effective_light_state, approach_cfg.id, LightState::Red);
+            }
+        }
+
+        for (const auto& approach_cfg : intersection_config.approaches) {
+            const ApproachId approach = approach_cfg.id;
+            const std::size_t approach_idx = approachIndex(approach);
+            const ApproachDemand& demand = approach_demand[approach_idx];
+
+            if (approach_lane_classes[approach_idx].dedicated_right.empty()) {
+                setRightTurnLight(effective_light_state, approach, LightState::Red);
+                continue;
+            }
+
+            if (!demand.main_light_demand) {
+                setApproachMainLight(effective_light_state, approach, LightState::Red);
+            }
 
             const ApproachId opposing = opposingApproachForRightTurn(approach);
             const bool opposing_red = isApproachMainRed(opposing, effective_light_state);
-            const std::size_t approach_idx = approachIndex(approach);
 
-            if (has_demand && opposing_red) {
+            if (demand.right_lane_demand && opposing_red) {
                 right_turn_green_hold_until[approach_idx] =
                     std::max(right_turn_green_hold_until[approach_idx], current_time + right_turn_min_green_seconds);
             }
 
             const bool hold_active = right_turn_green_hold_until[approach_idx] > current_time;
-            const ApproachId conflicting_left_approach = opposingApproachForLeftTurn(approach);
+            const std::size_t conflicting_left_idx = approachIndex(opposingApproachForLeftTurn(approach));
             const bool starved_conflicting_left =
-                left_wait_seconds[approachIndex(conflicting_left_approach)] >= left_starvation_threshold_seconds;
+                left_wait_seconds[conflicting_left_idx] >= left_starvation_threshold_seconds;
             const bool fairness_blocks_right =
-                starved_conflicting_left && has_left_waiting_demand[approachIndex(conflicting_left_approach)];
+                starved_conflicting_left && approach_demand[conflicting_left_idx].waiting[left] > 0;
 
-            const bool right_candidate_green =
-                has_exclusive_demand ? (has_demand || hold_active) : (opposing_red && (has_demand || hold_active));
+            const bool right_candidate_green = demand.right_exclusive_demand
+                                                   ? (demand.right_lane_demand || hold_active)
+                                                   : (opposing_red && (demand.right_lane_demand || hold_active));
             const bool turn_green = right_candidate_green && !fairness_blocks_right;
             setRightTurnLight(effective_light_state, approach, turn_green ? LightState::Green : LightState::Red);
         }
 
         for (const auto& approach_cfg : intersection_config.approaches) {
             const ApproachId approach = approach_cfg.id;
-            const Direction dir = directionFromApproach(approach);
-            const auto& queue = traffic.getQueueByDirection(dir);
-
-            std::vector<LaneId> dedicated_left_lane_ids;
-            dedicated_left_lane_ids.reserve(approach_cfg.lanes.size());
-            for (const auto& lane_cfg : approach_cfg.lanes) {
-                if (isDedicatedLeftTurnLane(lane_cfg)) {
-                    dedicated_left_lane_ids.push_back(lane_cfg.id);
-                }
-            }
+            const std::size_t approach_idx = approachIndex(approach);
+            const ApproachDemand& demand = approach_demand[approach_idx];
 
-            if (dedicated_left_lane_ids.empty()) {
+            if (approach_lane_classes[approach_idx].dedicated_left.empty()) {
                 setLeftTurnLight(effective_light_state, approach, LightState::Red);
                 continue;
             }
 
-            const bool has_demand = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                if (std::find(dedicated_left_lane_ids.begin(), dedicated_left_lane_ids.end(), vehicle.lane_id) ==
-                    dedicated_left_lane_ids.end()) {
-                    return false;
-                }
-                return vehicle.isWaiting() || vehicle.isCrossing();
-            });
-
             const ApproachId opposing = opposingApproachForLeftTurn(approach);
+            const std::size_t opposing_idx = approachIndex(opposing);
             const bool opposing_red = isApproachMainRed(opposing, effective_light_state);
             const bool opposing_right_red =
                 rightTurnLightFor(directionFromApproach(opposing), effective_light_state) == LightState::Red;
@@ -984,337 +971,189 @@ namespace crossroads {
             }
 
             const bool opposing_straight_starved =
-                straight_wait_seconds[approachIndex(opposing)] >= straight_starvation_threshold_seconds;
-            const bool opposing_has_straight_waiting = has_straight_waiting_demand[approachIndex(opposing)];
+                straight_wait_seconds[opposing_idx] >= straight_starvation_threshold_seconds;
+            const bool opposing_has_straight_waiting = approach_demand[opposing_idx].waiting[straight] > 0;
             const bool fairness_blocks_left = opposing_straight_starved && opposing_has_straight_waiting;
 
-            const bool left_green =
-                has_demand && opposing_red && opposing_right_red && cross_traffic_main_red && !fairness_blocks_left;
+            const bool left_green = demand.left_lane_demand && opposing_red && opposing_right_red &&
+                                    cross_traffic_main_red && !fairness_blocks_left;
             setLeftTurnLight(effective_light_state, approach, left_green ? LightState::Green : LightState::Red);
 
-            const bool has_dedicated_left_crossing =
-                std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                    if (!vehicle.isCrossing()) {
-                        return false;
-                    }
-                    if (std::find(dedicated_left_lane_ids.begin(), dedicated_left_lane_ids.end(), vehicle.lane_id) ==
-                        dedicated_left_lane_ids.end()) {
-                        return false;
-                    }
-                    return isEffectiveLeftTurn(dir, vehicle);
-                });
-            if (has_dedicated_left_crossing) {
+            if (demand.left_lane_crossing) {
                 setApproachMainLight(effective_light_state, opposing, LightState::Red);
             }
 
-            const bool unprotected_mixed_left = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                if (!vehicle.isWaiting() && !vehicle.isCrossing()) {
-                    return false;
-                }
-                if (!isEffectiveLeftTurn(dir, vehicle)) {
-                    return false;
-                }
-                return std::find(dedicated_left_lane_ids.begin(), dedicated_left_lane_ids.end(), vehicle.lane_id) ==
-                       dedicated_left_lane_ids.end();
-            });
-
-            if (unprotected_mixed_left && !(opposing_red && opposing_right_red)) {
+            if (demand.unprotected_left_demand && !(opposing_red && opposing_right_red)) {
                 setApproachMainLight(effective_light_state, approach, LightState::Red);
             }
 
-            const bool has_any_left_demand = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                if (!vehicle.isWaiting() && !vehicle.isCrossing()) {
-                    return false;
-                }
-                return isEffectiveLeftTurn(dir, vehicle);
-            });
+            const bool has_any_left_demand = demand.waiting[left] > 0 || demand.crossing[left] > 0;
             if (has_any_left_demand) {
                 const LightState approach_main = approachMainLight(approach, effective_light_state);
-                if (approach_main == LightState::Green) {
-                    const bool opposing_straight_starved =
-                        straight_wait_seconds[approachIndex(opposing)] >= straight_starvation_threshold_seconds;
-                    const bool opposing_has_straight_waiting = has_straight_waiting_demand[approachIndex(opposing)];
-                    if (!(opposing_straight_starved && opposing_has_straight_waiting)) {
-                        setApproachMainLight(effective_light_state, opposing, LightState::Red);
-                    }
+                if (approach_main == LightState::Green && !fairness_blocks_left) {
+                    setApproachMainLight(effective_light_state, opposing, LightState::Red);
                 }
             }
         }
+    }
 
-        for (const auto& approach_cfg : intersection_config.approaches) {
-            const ApproachId approach = approach_cfg.id;
-            const Direction dir = directionFromApproach(approach);
-            const auto& queue = traffic.getQueueByDirection(dir);
-            const std::size_t idx = approachIndex(approach);
-
-            bool left_is_being_served = false;
-            bool straight_is_being_served = false;
-            bool right_is_being_served = false;
-
-            for (const auto& vehicle : queue) {
-                if (vehicle.isCrossing()) {
-                    if (isEffectiveLeftTurn(dir, vehicle)) {
-                        left_is_being_served = true;
-                    }
-                    if (vehicle.movement == MovementType::Straight) {
-                        straight_is_being_served = true;
-                    }
-                    if (vehicle.movement == MovementType::Right) {
-                        right_is_being_served = true;
-                    }
-                }
-            }
-
-            if (has_left_waiting_demand[idx] && !left_is_being_served) {
-                left_wait_seconds[idx] += std::max(0.0, dt_seconds);
-            } else {
-                left_wait_seconds[idx] = 0.0;
-            }
-
-            if (has_straight_waiting_demand[idx] && !straight_is_being_served) {
-                straight_wait_seconds[idx] += std::max(0.0, dt_seconds);
-            } else {
-                straight_wait_seconds[idx] = 0.0;
-            }
-
-            if (has_right_waiting_demand[idx] && !right_is_being_served) {
-                right_wait_seconds[idx] += std::max(0.0, dt_seconds);
+    void SimulatorEngine::updateMovementWaitTimers(double dt_seconds) {
+        const double step = std::max(0.0, dt_seconds);
+        auto update_timer = [&](double& timer, const ApproachDemand& demand, MovementType movement) {
+            const std::size_t movement_idx = movementIndex(movement);
+            if (demand.waiting[movement_idx] > 0 && demand.crossing[movement_idx] == 0) {
+                timer += step;
             } else {
-                right_wait_seconds[idx] = 0.0;
+                timer = 0.0;
             }
-        }
-
-        struct RouteCandidate {
-            ApproachId approach;
-            MovementType movement;
-            bool waiting_demand;
-            std::size_t demand_count;
-            double wait_seconds;
         };
 
-        std::array<RouteCandidate, kRouteCount> routes{};
-        for (int approach_int = 0; approach_int < 4; ++approach_int) {
-            ApproachId approach = static_cast<ApproachId>(approach_int);
-            for (int movement_int = 0; movement_int < 3; ++movement_int) {
-                MovementType movement = static_cast<MovementType>(movement_int);
-                const std::size_t idx = routeIndex(approach, movement);
-                routes[idx] = {approach, movement, false, 0u, 0.0};
-            }
-        }
-
         for (const auto& approach_cfg : intersection_config.approaches) {
-            const ApproachId approach = approach_cfg.id;
-            const std::size_t idx = approachIndex(approach);
-
-            auto count_waiting = [&](MovementType movement) {
-                const Direction dir = directionFromApproach(approach);
-                const auto& queue = traffic.getQueueByDirection(dir);
-                return static_cast<std::size_t>(std::count_if(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                    if (!vehicle.isWaiting()) {
-                        return false;
-                    }
-                    switch (movement) {
-                        case MovementType::Straight:
-                            return vehicle.movement == MovementType::Straight;
-                        case MovementType::Left:
-                            return isEffectiveLeftTurn(dir, vehicle);
-                        case MovementType::Right:
-                            return vehicle.movement == MovementType::Right;
-                    }
-                    return false;
-                }));
-            };
+            const std::size_t idx = approachIndex(approach_cfg.id);
+            update_timer(left_wait_seconds[idx], approach_demand[idx], MovementType::Left);
+            update_timer(straight_wait_seconds[idx], approach_demand[idx], MovementType::Straight);
+            update_timer(right_wait_seconds[idx], approach_demand[idx], MovementType::Right);
+        }
+    }
 
-            const std::size_t straight_idx = routeIndex(approach, MovementType::Straight);
-            const std::size_t left_idx = routeIndex(approach, MovementType::Left);
-            const std::size_t right_idx = routeIndex(approach, MovementType::Right);
+    void SimulatorEngine::updateRouteDemand() {
+        route_waiting_demand.fill(false);
+        route_wait_seconds.fill(0.0);
+        route_waiting_count.fill(0);
+        route_crossing_vehicle_count.fill(0);
+        route_stopped_waiting_count.fill(0);
 
-            if (route_configured[straight_idx]) {
-                routes[straight_idx] = {approach,
-                                        MovementType::Straight,
-                                        has_straight_waiting_demand[idx],
-                                        count_waiting(MovementType::Straight),
-                                        straight_wait_seconds[idx]};
-            }
-            if (route_configured[left_idx]) {
-                routes[left_idx] = {approach,
-                                    MovementType::Left,
-                                    has_left_waiting_demand[idx],
-                                    count_waiting(MovementType::Left),
-                                    left_wait_seconds[idx]};
-            }
-            if (route_configured[right_idx]) {
-                routes[right_idx] = {approach,
-                                     MovementType::Right,
-                                     has_right_waiting_demand[idx],
-                                     count_waiting(MovementType::Right),
-                                     right_wait_seconds[idx]};
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx]) {
+                continue;
             }
+            const std::size_t approach_idx = route_idx / 3;
+            const std::size_t movement_idx = route_idx % 3;
+            const ApproachDemand& demand = approach_demand[approach_idx];
+            route_waiting_count[route_idx] = demand.waiting[movement_idx];
+            route_crossing_vehicle_count[route_idx] = demand.crossing[movement_idx];
+            route_stopped_waiting_count[route_idx] = demand.stopped[movement_idx];
+            route_waiting_demand[route_idx] = demand.waiting[movement_idx] > 0;
 
-            route_waiting_demand[straight_idx] = routes[straight_idx].waiting_demand;
-            route_waiting_demand[left_idx] = routes[left_idx].waiting_demand;
-            route_waiting_demand[right_idx] = routes[right_idx].waiting_demand;
-            route_wait_seconds[straight_idx] = routes[straight_idx].wait_seconds;
-            route_wait_seconds[left_idx] = routes[left_idx].wait_seconds;
-            route_wait_seconds[right_idx] = routes[right_idx].wait_seconds;
+            switch (static_cast<MovementType>(movement_idx)) {
+                case MovementType::Straight:
+                    route_wait_seconds[route_idx] = straight_wait_seconds[approach_idx];
+                    break;
+                case MovementType::Left:
+                    route_wait_seconds[route_idx] = left_wait_seconds[approach_idx];
+                    break;
+                case MovementType::Right:
+                    route_wait_seconds[route_idx] = right_wait_seconds[approach_idx];
+                    break;
+            }
         }
 
         bool any_waiting_routes = false;
         bool all_waiting_served = true;
-        for (const auto& route : routes) {
-            if (!route.waiting_demand) {
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_waiting_demand[route_idx]) {
                 continue;
             }
             any_waiting_routes = true;
-            const std::size_t idx = routeIndex(route.approach, route.movement);
-            if (!scheduler_served_this_cycle[idx]) {
+            if (!scheduler_served_this_cycle[route_idx]) {
                 all_waiting_served = false;
             }
         }
 
         if (any_waiting_routes && all_waiting_served) {
             scheduler_served_this_cycle.fill(false);
+            scheduler_selection_version = 0;
         }
+    }
 
-        // Count crossing vehicles per route (vehicles that started crossing but haven't exited)
-        route_crossing_vehicle_count.fill(0);
-        route_stopped_waiting_count.fill(0);
-        constexpr double kStoppedSpeedThreshold = 0.2;  // m/s
-        for (int approach_int = 0; approach_int < 4; ++approach_int) {
-            ApproachId approach = static_cast<ApproachId>(approach_int);
-            const Direction dir = directionFromApproach(approach);
-            const auto& queue = traffic.getQueueByDirection(dir);
-
-            auto count_crossing = [&](MovementType movement) {
-                return static_cast<int>(std::count_if(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                    if (!vehicle.isCrossing()) {
-                        return false;
-                    }
-                    switch (movement) {
-                        case MovementType::Straight:
-                            return vehicle.movement == MovementType::Straight;
-                        case MovementType::Left:
-                            return isEffectiveLeftTurn(dir, vehicle);
-                        case MovementType::Right:
-                            return vehicle.movement == MovementType::Right;
-                    }
-                    return false;
-                }));
-            };
-
-            auto count_stopped_waiting = [&](MovementType movement) {
-                return static_cast<int>(std::count_if(queue.begin(), queue.end(), [&](const Vehicle& vehicle) {
-                    if (!vehicle.isWaiting() || vehicle.isCrossing()) {
-                        return false;
-                    }
-                    if (vehicle.current_speed > kStoppedSpeedThreshold) {
-                        return false;
-                    }
-                    switch (movement) {
-                        case MovementType::Straight:
-                            return vehicle.movement == MovementType::Straight;
-                        case MovementType::Left:
-                            return isEffectiveLeftTurn(dir, vehicle);
-                        case MovementType::Right:
-                            return vehicle.movement == MovementType::Right;
-                    }
-                    return false;
-                }));
-            };
+    void SimulatorEngine::updateConflictClearance() {
+        // Track when conflicts first became clear per route; activation waits kClearanceBufferSeconds after that.
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx]) {
+                continue;
+            }
 
-            const std::size_t s_idx = routeIndex(approach, MovementType::Straight);
-            const std::size_t l_idx = routeIndex(approach, MovementType::Left);
-            const std::size_t r_idx = routeIndex(approach, MovementType::Right);
-            if (route_configured[s_idx])
-                route_crossing_vehicle_count[s_idx] = count_crossing(MovementType::Straight);
-            if (route_configured[l_idx])
-                route_crossing_vehicle_count[l_idx] = count_crossing(MovementType::Left);
-            if (route_configured[r_idx])
-                route_crossing_vehicle_count[r_idx] = count_crossing(MovementType::Right);
-
-            if (route_configured[s_idx])
-                route_stopped_waiting_count[s_idx] = count_stopped_waiting(MovementType::Straight);
-            if (route_configured[l_idx])
-                route_stopped_waiting_count[l_idx] = count_stopped_waiting(MovementType::Left);
-            if (route_configured[r_idx])
-                route_stopped_waiting_count[r_idx] = count_stopped_waiting(MovementType::Right);
-        }
-
-        // Helper: check whether all conflicting routes have no crossing vehicles remaining
-        auto areConflictsClear = [&](std::size_t route_idx) -> bool {
+            bool conflicts_clear = true;
             for (std::size_t other = 0; other < kRouteCount; ++other) {
-                if (other == route_idx)
-                    continue;
-                if (!route_configured[other])
-                    continue;
-                if (!route_conflict_matrix[route_idx][other])
-                    continue;
-                if (route_crossing_vehicle_count[other] > 0)
-                    return false;
+                if (other != route_idx && route_configured[other] && routesConflict(route_idx, other) &&
+                    route_crossing_vehicle_count[other] > 0) {
+                    conflicts_clear = false;
+                    break;
+                }
             }
-            return true;
-        };
 
-        // Track when conflicts first became clear per route,
-        // and require an extra 2-second buffer before activation.
-        constexpr double kClearanceBufferSeconds = 2.0;
-        constexpr double kRedHoldSeconds = 2.0;
-        for (std::size_t ri = 0; ri < kRouteCount; ++ri) {
-            if (!route_configured[ri])
-                continue;
-            if (areConflictsClear(ri)) {
-                if (route_conflicts_cleared_at[ri] < 0.0) {
-                    route_conflicts_cleared_at[ri] = current_time;
+            if (conflicts_clear) {
+                if (route_conflicts_cleared_at[route_idx] < 0.0) {
+                    route_conflicts_cleared_at[route_idx] = current_time;
                 }
             } else {
-                route_conflicts_cleared_at[ri] = -1.0;
+                route_conflicts_cleared_at[route_idx] = -1.0;
             }
         }
+    }
 
-        auto areConflictsClearWithBuffer = [&](std::size_t route_idx) -> bool {
-            if (route_conflicts_cleared_at[route_idx] < 0.0)
-                return false;
-            return (current_time - route_conflicts_cleared_at[route_idx]) >= kClearanceBufferSeconds;
-        };
+    bool SimulatorEngine::schedulerSelectionStale(const std::array<bool, 12>& prev_route_green_active) const {
+        if (!incremental_scheduling || scheduler_selection_version != traffic.getDemandVersion()) {
+            return true;
+        }
+        if (scheduler_selection_forced_anchor != scheduler_forced_anchor_route) {
+            return true;
+        }
+        if (scheduler_selection_green != prev_route_green_active) {
+            return true;
+        }
+        return current_time + kSchedulerTimeEpsilon >= scheduler_next_selection_time;
+    }
 
-        auto routeIsRed = [&](const IntersectionState& state, ApproachId approach, MovementType movement) -> bool {
-            switch (movement) {
-                case MovementType::Straight:
-                    return approachMainLight(approach, state) == LightState::Red;
-                case MovementType::Left:
-                    return leftTurnLightFor(directionFromApproach(approach), state) == LightState::Red;
-                case MovementType::Right:
-                    return rightTurnLightFor(directionFromApproach(approach), state) == LightState::Red;
+    void SimulatorEngine::selectSchedulerRoutes(const std::array<bool, 12>& prev_route_green_active) {
+        ++scheduler_selection_count;
+        scheduler_selection_version = traffic.getDemandVersion();
+        scheduler_selection_forced_anchor = scheduler_forced_anchor_route;
+        scheduler_selection_green = prev_route_green_active;
+        scheduler_selection_time = current_time;
+        route_priority_score.fill(0.0);
+        route_priority_score_slope.fill(0.0);
+        route_priority_score_curvature.fill(0.0);
+
+        // Until the next vehicle event a score only drifts with wait and aging time, so re-rank when a starvation
+        // or green-time threshold is reached or when two routes can swap places, whichever comes first.
+        double next_selection_time = std::numeric_limits<double>::infinity();
+        // Takes the time left rather than a deadline: a threshold a rounding error away would vanish in current_time.
+        auto note_threshold = [&](double seconds_left) {
+            if (seconds_left > 0.0) {
+                next_selection_time =
+                    std::min(next_selection_time, current_time + seconds_left - kSchedulerRankMarginSeconds);
             }
-            return false;
         };
 
-        std::size_t max_waiting_demand = 0;
-        for (const auto& route : routes) {
-            if (route.waiting_demand) {
-                max_waiting_demand = std::max(max_waiting_demand, route.demand_count);
+        int max_waiting_demand = 0;
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (route_waiting_demand[route_idx]) {
+                max_waiting_demand = std::max(max_waiting_demand, route_waiting_count[route_idx]);
             }
         }
 
         constexpr double kCycleUnservedBonus = 15'000.0;
         constexpr int kStoppedPriorityThreshold = 5;
         constexpr double kStoppedPriorityBonus = 120'000.0;
+        constexpr double kMinimumGreenLockBonus = 1'000'000.0;
+        constexpr double kStarvationBonus = 200'000.0;
+        constexpr double kInitialWaitersLockBonus = 500'000.0;
 
         int anchor_route_index = -1;
         double anchor_score = -1.0;
-        for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
-            if (!route_configured[route_idx]) {
-                continue;
-            }
-            const auto& route = routes[route_idx];
-            if (!route.waiting_demand) {
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx] || !route_waiting_demand[route_idx]) {
                 continue;
             }
 
+            const double wait_seconds = route_wait_seconds[route_idx];
+            note_threshold(movement_starvation_max_wait_seconds - wait_seconds);
+
             const double aging_seconds = route_last_served_time[route_idx] >= 0.0
                                              ? std::max(0.0, current_time - route_last_served_time[route_idx])
                                              : movement_starvation_max_wait_seconds;
-            const double demand_pressure = static_cast<double>(route.demand_count);
+            const double demand_pressure = static_cast<double>(route_waiting_count[route_idx]);
             const double stopped_pressure = static_cast<double>(route_stopped_waiting_count[route_idx]);
 
             // Emphasize longer queues: aggressive weighting up to ~4x at the longest queue.
@@ -1324,9 +1163,9 @@ namespace crossroads {
                 route_priority_queue_weight * (1.0 + 2.0 * queue_ratio + queue_ratio * queue_ratio);
             const double stopped_bonus = queue_weight * 1.2 * stopped_pressure;
 
-            double score = route_priority_wait_weight * route.wait_seconds + queue_weight * demand_pressure +
-                           route_priority_aging_weight * aging_seconds + (0.75 * route.wait_seconds * demand_pressure) +
-                           stopped_bonus + 0.5 * route.wait_seconds * route.wait_seconds;
+            double score = route_priority_wait_weight * wait_seconds + queue_weight * demand_pressure +
+                           route_priority_aging_weight * aging_seconds + (0.75 * wait_seconds * demand_pressure) +
+                           stopped_bonus + 0.5 * wait_seconds * wait_seconds;
 
             if (stopped_pressure > static_cast<double>(kStoppedPriorityThreshold)) {
                 score += kStoppedPriorityBonus;
@@ -1336,20 +1175,18 @@ namespace crossroads {
                 score += kCycleUnservedBonus;
             }
 
-            constexpr double kMinimumGreenLockBonus = 1'000'000.0;
-            constexpr double kServiceContinuationBonus = 25'000.0;
-            constexpr double kStarvationBonus = 200'000.0;
-
             int conflicting_waiting_routes = 0;
-            for (std::size_t other_idx = 0; other_idx < routes.size(); ++other_idx) {
-                if (other_idx == route_idx) {
+            bool conflicting_route_starving = false;
+            for (std::size_t other_idx = 0; other_idx < kRouteCount; ++other_idx) {
+                if (other_idx == route_idx || !route_configured[other_idx] || !route_waiting_demand[other_idx]) {
                     continue;
                 }
-                if (!route_configured[other_idx] || !routes[other_idx].waiting_demand) {
+                if (!routesConflict(route_idx, other_idx)) {
                     continue;
                 }
-                if (route_conflict_matrix[route_idx][other_idx]) {
-                    ++conflicting_waiting_routes;
+                ++conflicting_waiting_routes;
+                if (route_wait_seconds[other_idx] >= movement_starvation_max_wait_seconds) {
+                    conflicting_route_starving = true;
                 }
             }
 
@@ -1357,6 +1194,10 @@ namespace crossroads {
                 const double green_started_at =
                     route_green_started_at[route_idx] >= 0.0 ? route_green_started_at[route_idx] : current_time;
                 const double green_elapsed = std::max(0.0, current_time - green_started_at);
+                note_threshold(minimum_green_seconds - green_elapsed);
+                note_threshold(route_max_green_seconds - green_elapsed);
+                note_threshold(1.5 * route_max_green_seconds - green_elapsed);
+
                 if (green_elapsed < minimum_green_seconds) {
                     score += kMinimumGreenLockBonus;
                 } else {
@@ -1375,180 +1216,187 @@ namespace crossroads {
                 // Initial-waiters lock: keep green long enough so all vehicles that were
                 // waiting when this route turned green have started crossing.
                 // However, break this lock if any conflicting route is starving.
-                bool conflicting_route_starving = false;
-                for (std::size_t other_idx = 0; other_idx < routes.size(); ++other_idx) {
-                    if (other_idx == route_idx || !route_configured[other_idx]) {
-                        continue;
-                    }
-                    if (!route_conflict_matrix[route_idx][other_idx]) {
-                        continue;
-                    }
-                    if (routes[other_idx].waiting_demand &&
-                        routes[other_idx].wait_seconds >= movement_starvation_max_wait_seconds) {
-                        conflicting_route_starving = true;
-                        break;
-                    }
-                }
                 if (!conflicting_route_starving && route_initial_waiting_count[route_idx] > 0 &&
                     route_vehicles_started_this_green[route_idx] < route_initial_waiting_count[route_idx] &&
                     green_elapsed < 1.5 * route_max_green_seconds) {
-                    constexpr double kInitialWaitersLockBonus = 500'000.0;
                     score += kInitialWaitersLockBonus;
                 }
             }
 
-            if (route.wait_seconds >= movement_starvation_max_wait_seconds) {
-                score += kStarvationBonus;
-            }
+            if (wait_seconds >= movement_starvation_max_wait_seconds) {
+                score += kStarvationBonus;
+            }
+
+            route_priority_score[route_idx] = score;
+            // The wait timer runs while the movement has no vehicle crossing; aging runs once the route was served.
+            const double wait_rate = route_crossing_vehicle_count[route_idx] == 0 ? 1.0 : 0.0;
+            const double aging_rate = route_last_served_time[route_idx] >= 0.0 ? 1.0 : 0.0;
+            route_priority_score_slope[route_idx] =
+                wait_rate * (route_priority_wait_weight + 0.75 * demand_pressure + wait_seconds) +
+                aging_rate * route_priority_aging_weight;
+            route_priority_score_curvature[route_idx] = 0.5 * wait_rate;
+
+            if (score > anchor_score) {
+                anchor_score = score;
+                anchor_route_index = static_cast<int>(route_idx);
+            }
+        }
+
+        // Predictive mode: a rollout-backed choice replaces the greedy anchor while that route still has demand.
+        if (scheduler_forced_anchor_route >= 0) {
+            const std::size_t forced_idx = static_cast<std::size_t>(scheduler_forced_anchor_route);
+            if (forced_idx < kRouteCount && route_configured[forced_idx] && route_waiting_demand[forced_idx]) {
+                anchor_route_index = scheduler_forced_anchor_route;
+            }
+        }
+
+        scheduler_anchor_route_index = anchor_route_index;
+        scheduler_parallel_order_count = 0;
+        if (anchor_route_index >= 0) {
+            const std::size_t anchor_idx = static_cast<std::size_t>(anchor_route_index);
+            for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+                if (!route_configured[route_idx] || route_idx == anchor_idx || !route_waiting_demand[route_idx]) {
+                    continue;
+                }
+                if (routesConflict(anchor_idx, route_idx)) {
+                    continue;
+                }
+                scheduler_parallel_order[scheduler_parallel_order_count++] = route_idx;
+            }
+
+            std::sort(scheduler_parallel_order.begin(),
+                      scheduler_parallel_order.begin() + static_cast<std::ptrdiff_t>(scheduler_parallel_order_count),
+                      [&](std::size_t lhs, std::size_t rhs) { return route_priority_score[lhs] > route_priority_score[rhs]; });
+        }
+
+        // Every pair, not just the anchor against the rest: the predictive planner ranks its candidates by score too.
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx] || !route_waiting_demand[route_idx]) {
+                continue;
+            }
+            for (std::size_t other_idx = route_idx + 1; other_idx < kRouteCount; ++other_idx) {
+                if (!route_configured[other_idx] || !route_waiting_demand[other_idx]) {
+                    continue;
+                }
+                const double delay = rankFlipDelay(route_priority_score[route_idx] - route_priority_score[other_idx],
+                                                   route_priority_score_slope[route_idx] -
+                                                       route_priority_score_slope[other_idx],
+                                                   route_priority_score_curvature[route_idx] -
+                                                       route_priority_score_curvature[other_idx]);
+                note_threshold(std::max(delay, kSchedulerRankMarginSeconds));
+            }
+        }
+
+        scheduler_next_selection_time = next_selection_time;
+    }
+
+    double SimulatorEngine::currentPriorityScore(std::size_t route_idx) const {
+        const double elapsed = scheduler_score_time - scheduler_selection_time;
+        return route_priority_score[route_idx] + route_priority_score_slope[route_idx] * elapsed +
+               route_priority_score_curvature[route_idx] * elapsed * elapsed;
+    }
+
+    bool SimulatorEngine::routeConflictsHeld(std::size_t route_idx, const IntersectionState& state) const {
+        // Clearance gate: a route can only go green when all conflicting routes are red for at least
+        // kRedHoldSeconds AND have had no crossing vehicles for kClearanceBufferSeconds. No bypass for
+        // already-green routes — every green activation must satisfy the gate.
+        if (route_conflicts_cleared_at[route_idx] < 0.0 ||
+            (current_time - route_conflicts_cleared_at[route_idx]) < kClearanceBufferSeconds) {
+            return false;
+        }
+
+        for (std::size_t other_idx = 0; other_idx < kRouteCount; ++other_idx) {
+            if (!route_configured[other_idx] || !routesConflict(route_idx, other_idx)) {
+                continue;
+            }
+            if (!routeIsRed(state, static_cast<ApproachId>(other_idx / 3), static_cast<MovementType>(other_idx % 3))) {
+                return false;
+            }
+            if (route_red_since[other_idx] < 0.0 || (current_time - route_red_since[other_idx]) < kRedHoldSeconds) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void SimulatorEngine::applySchedulerSelection() {
+        if (scheduler_anchor_route_index < 0) {
+            return;
+        }
 
-            route_priority_score[route_idx] = score;
+        const std::size_t anchor_idx = static_cast<std::size_t>(scheduler_anchor_route_index);
+        IntersectionState override_state = effective_light_state;
 
-            if (score > anchor_score) {
-                anchor_score = score;
-                anchor_route_index = static_cast<int>(route_idx);
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx] || !routesConflict(anchor_idx, route_idx)) {
+                continue;
             }
+            scheduler_blocked_routes[route_idx] = true;
+            setRouteLight(override_state,
+                          static_cast<ApproachId>(route_idx / 3),
+                          static_cast<MovementType>(route_idx % 3),
+                          LightState::Red);
         }
 
-        if (anchor_route_index >= 0) {
-            scheduler_anchor_route_index = anchor_route_index;
-
-            IntersectionState override_state = effective_light_state;
+        const bool can_activate_anchor = routeConflictsHeld(anchor_idx, override_state);
+        scheduler_clearance_blocked_routes[anchor_idx] = !can_activate_anchor;
 
-            for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
-                if (!route_configured[route_idx]) {
-                    continue;
-                }
-                if (!route_conflict_matrix[static_cast<std::size_t>(anchor_route_index)][route_idx]) {
-                    continue;
-                }
-                scheduler_blocked_routes[route_idx] = true;
-                setRouteLight(override_state, routes[route_idx].approach, routes[route_idx].movement, LightState::Red);
-            }
-
-            // Clearance gate: anchor can only go green when all conflicting
-            // routes are red for at least kRedHoldSeconds AND have no crossing
-            // vehicles remaining in the intersection.  No bypass for already-green
-            // anchors — every green activation must satisfy the gate.
-            const bool conflicts_clear = areConflictsClearWithBuffer(static_cast<std::size_t>(anchor_route_index));
-            bool conflicts_all_red_held = true;
-            for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
-                if (!route_configured[route_idx]) {
-                    continue;
-                }
-                if (!route_conflict_matrix[static_cast<std::size_t>(anchor_route_index)][route_idx]) {
-                    continue;
-                }
-                if (!routeIsRed(override_state, routes[route_idx].approach, routes[route_idx].movement)) {
-                    conflicts_all_red_held = false;
-                    break;
-                }
-                if (route_red_since[route_idx] < 0.0 || (current_time - route_red_since[route_idx]) < kRedHoldSeconds) {
-                    conflicts_all_red_held = false;
-                    break;
-                }
+        if (!can_activate_anchor) {
+            // Conflicts not yet cleared: apply Red states to help drain crossing vehicles
+            if (checker.isSafe(override_state)) {
+                effective_light_state = override_state;
             }
-            const bool can_activate_anchor = conflicts_clear && conflicts_all_red_held;
-            scheduler_clearance_blocked_routes[static_cast<std::size_t>(anchor_route_index)] = !can_activate_anchor;
+            return;
+        }
 
-            if (can_activate_anchor) {
-                setRouteLight(override_state,
-                              routes[static_cast<std::size_t>(anchor_route_index)].approach,
-                              routes[static_cast<std::size_t>(anchor_route_index)].movement,
-                              LightState::Green);
+        setRouteLight(override_state,
+                      static_cast<ApproachId>(anchor_idx / 3),
+                      static_cast<MovementType>(anchor_idx % 3),
+                      LightState::Green);
 
-                if (!checker.isSafe(override_state)) {
-                    scheduler_safety_blocked_routes[static_cast<std::size_t>(anchor_route_index)] = true;
-                } else {
-                    effective_light_state = override_state;
-                }
+        if (!checker.isSafe(override_state)) {
+            scheduler_safety_blocked_routes[anchor_idx] = true;
+        } else {
+            effective_light_state = override_state;
+        }
 
-                std::vector<std::size_t> parallel_candidates;
-                parallel_candidates.reserve(routes.size());
-                for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
-                    if (!route_configured[route_idx]) {
-                        continue;
-                    }
-                    if (static_cast<int>(route_idx) == anchor_route_index) {
-                        continue;
-                    }
-                    if (!routes[route_idx].waiting_demand) {
-                        continue;
-                    }
-                    if (route_conflict_matrix[static_cast<std::size_t>(anchor_route_index)][route_idx]) {
-                        continue;
-                    }
-                    parallel_candidates.push_back(route_idx);
+        std::array<std::size_t, kRouteCount> selected_parallel{};
+        std::size_t selected_count = 0;
+        for (std::size_t order_idx = 0; order_idx < scheduler_parallel_order_count; ++order_idx) {
+            const std::size_t candidate_idx = scheduler_parallel_order[order_idx];
+            bool conflicts = false;
+            for (std::size_t accepted = 0; accepted < selected_count; ++accepted) {
+                if (routesConflict(candidate_idx, selected_parallel[accepted])) {
+                    conflicts = true;
+                    break;
                 }
+            }
+            if (conflicts || !routeConflictsHeld(candidate_idx, override_state)) {
+                continue;
+            }
 
-                std::sort(
-                    parallel_candidates.begin(), parallel_candidates.end(), [&](std::size_t lhs, std::size_t rhs) {
-                        const double lhs_score = route_priority_score[lhs];
-                        const double rhs_score = route_priority_score[rhs];
-                        return lhs_score > rhs_score;
-                    });
-
-                std::vector<std::size_t> selected_parallel;
-                for (std::size_t candidate_idx : parallel_candidates) {
-                    bool conflicts = false;
-                    for (std::size_t accepted_idx : selected_parallel) {
-                        if (route_conflict_matrix[candidate_idx][accepted_idx]) {
-                            conflicts = true;
-                            break;
-                        }
-                    }
-                    if (conflicts) {
-                        continue;
-                    }
-
-                    const bool candidate_conflicts_clear = areConflictsClearWithBuffer(candidate_idx);
-                    bool candidate_conflicts_all_red_held = true;
-                    for (std::size_t other_idx = 0; other_idx < routes.size(); ++other_idx) {
-                        if (!route_configured[other_idx]) {
-                            continue;
-                        }
-                        if (!route_conflict_matrix[candidate_idx][other_idx]) {
-                            continue;
-                        }
-                        if (!routeIsRed(override_state, routes[other_idx].approach, routes[other_idx].movement)) {
-                            candidate_conflicts_all_red_held = false;
-                            break;
-                        }
-                        if (route_red_since[other_idx] < 0.0 ||
-                            (current_time - route_red_since[other_idx]) < kRedHoldSeconds) {
-                            candidate_conflicts_all_red_held = false;
-                            break;
-                        }
-                    }
-
-                    if (!(candidate_conflicts_clear && candidate_conflicts_all_red_held)) {
-                        continue;
-                    }
-
-                    IntersectionState trial_state = override_state;
-                    setRouteLight(
-                        trial_state, routes[candidate_idx].approach, routes[candidate_idx].movement, LightState::Green);
+            IntersectionState trial_state = override_state;
+            setRouteLight(trial_state,
+                          static_cast<ApproachId>(candidate_idx / 3),
+                          static_cast<MovementType>(candidate_idx % 3),
+                          LightState::Green);
 
-                    if (!checker.isSafe(trial_state)) {
-                        scheduler_safety_blocked_routes[candidate_idx] = true;
-                        continue;
-                    }
+            if (!checker.isSafe(trial_state)) {
+                scheduler_safety_blocked_routes[candidate_idx] = true;
+                continue;
+            }
 
-                    override_state = trial_state;
-                    selected_parallel.push_back(candidate_idx);
-                    scheduler_parallel_routes[candidate_idx] = true;
-                }
+            override_state = trial_state;
+            selected_parallel[selected_count++] = candidate_idx;
+            scheduler_parallel_routes[candidate_idx] = true;
+        }
 
-                if (checker.isSafe(override_state)) {
-                    effective_light_state = override_state;
-                }
-            } else {
-                // Conflicts not yet cleared: apply Red states to help drain crossing vehicles
-                if (checker.isSafe(override_state)) {
-                    effective_light_state = override_state;
-                }
-            }
+        if (checker.isSafe(override_state)) {
+            effective_light_state = override_state;
         }
+    }
 
+    void SimulatorEngine::applyTransitionDiscipline(const IntersectionState& prev_effective) {
         auto apply_minimum_green_hold = [&](std::size_t index, LightState& current_light, LightState previous_light) {
             const bool was_green = previous_light == LightState::Green;
             const bool is_green = current_light == LightState::Green;
@@ -1620,40 +1468,36 @@ namespace crossroads {
         apply_minimum_green_hold(9, effective_light_state.turnSouthWest, prev_effective.turnSouthWest);
         apply_minimum_green_hold(10, effective_light_state.turnEastSouth, prev_effective.turnEastSouth);
         apply_minimum_green_hold(11, effective_light_state.turnWestNorth, prev_effective.turnWestNorth);
+    }
 
-        // Track how long each route has been red (post-discipline state).
-        for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
+    void SimulatorEngine::updateRouteSignalTracking(const std::array<bool, 12>& prev_route_green_active) {
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
             if (!route_configured[route_idx]) {
                 route_red_since[route_idx] = -1.0;
+                route_green_active[route_idx] = false;
                 continue;
             }
 
-            const bool is_red =
-                routeIsRed(effective_light_state, routes[route_idx].approach, routes[route_idx].movement);
-            if (is_red) {
+            const ApproachId approach = static_cast<ApproachId>(route_idx / 3);
+            const MovementType movement = static_cast<MovementType>(route_idx % 3);
+
+            // Track how long each route has been red (post-discipline state).
+            if (routeIsRed(effective_light_state, approach, movement)) {
                 if (route_red_since[route_idx] < 0.0) {
                     route_red_since[route_idx] = current_time;
                 }
             } else {
                 route_red_since[route_idx] = -1.0;
             }
-        }
-
-        for (std::size_t route_idx = 0; route_idx < routes.size(); ++route_idx) {
-            if (!route_configured[route_idx]) {
-                route_green_active[route_idx] = false;
-                continue;
-            }
 
-            const bool is_green =
-                routeIsGreen(effective_light_state, routes[route_idx].approach, routes[route_idx].movement);
+            const bool is_green = routeIsGreen(effective_light_state, approach, movement);
             const bool was_green = prev_route_green_active[route_idx];
             route_green_active[route_idx] = is_green;
 
             if (!was_green && is_green) {
                 route_green_started_at[route_idx] = current_time;
                 route_vehicles_started_this_green[route_idx] = 0;
-                route_initial_waiting_count[route_idx] = static_cast<int>(routes[route_idx].demand_count);
+                route_initial_waiting_count[route_idx] = route_waiting_count[route_idx];
                 scheduler_served_this_cycle[route_idx] = true;
             } else if (was_green && !is_green) {
                 route_last_served_time[route_idx] = current_time;
@@ -1662,9 +1506,6 @@ namespace crossroads {
                 route_initial_waiting_count[route_idx] = 0;
             }
         }
-
-        previous_effective_light_state = effective_light_state;
-        has_previous_effective_light_state = true;
     }
 
     void SimulatorEngine::generateTraffic(double dt) {
@@ -1674,43 +1515,40 @@ namespace crossroads {
     void SimulatorEngine::processVehicleCrossings() {
         // Start crossing when vehicle has reached stopzone.
         // Multiple vehicles in the same lane are allowed, but only with safe headway.
-        const double STOP_TARGET = 69.5;
         const double MIN_SAME_LANE_HEADWAY_SECONDS = 0.7;
 
         for (int dir = 0; dir < 4; ++dir) {
             Direction lane = static_cast<Direction>(dir);
             auto& queue = traffic.getQueueByDirection(lane);
+            const double STOP_TARGET =
+                stopTargetPosition(intersection_config.approaches[approachIndex(approachFromDirection(lane))]);
+            // A started vehicle leaves the queue, so i only advances past the vehicles that stay.
             for (size_t i = 0; i < queue.size(); ++i) {
                 auto& vehicle = queue[i];
-                if (!vehicle.isWaiting() || vehicle.position_in_lane < STOP_TARGET) {
+                if (vehicle.position_in_lane < STOP_TARGET) {
                     continue;
                 }
 
                 bool blocked_by_same_lane_front = false;
-                for (size_t j = 0; j < i; ++j) {
-                    const auto& ahead = queue[j];
-                    if (ahead.lane_id != vehicle.lane_id) {
-                        continue;
-                    }
-
-                    if (ahead.isWaiting()) {
-                        blocked_by_same_lane_front = true;
-                        break;
-                    }
-
-                    if (ahead.isCrossing()) {
-                        const double elapsed = std::max(0.0, current_time - ahead.crossing_time);
-                        if (elapsed < MIN_SAME_LANE_HEADWAY_SECONDS) {
-                            blocked_by_same_lane_front = true;
+                for (size_t j = 0; j < i && !blocked_by_same_lane_front; ++j) {
+                    blocked_by_same_lane_front = queue[j].lane_id == vehicle.lane_id;
+                }
+                // The crossing lists are in start order, so only their most recent starts can be within the headway.
+                for (const auto& crossing : traffic.getCrossingQueues(lane)) {
+                    for (auto it = crossing.end(); it != crossing.begin() && !blocked_by_same_lane_front;) {
+                        --it;
+                        const double elapsed = std::max(0.0, current_time - it->crossing_time);
+                        if (elapsed >= MIN_SAME_LANE_HEADWAY_SECONDS) {
                             break;
                         }
+                        blocked_by_same_lane_front = it->lane_id == vehicle.lane_id;
                     }
                 }
                 if (blocked_by_same_lane_front) {
                     continue;
                 }
 
-                const LaneConfig* lane_cfg = findLaneConfigForVehicle(intersection_config, lane, vehicle.lane_id);
+                const LaneConfig* lane_cfg = laneConfigFor(lane, vehicle.lane_id);
                 bool connected = lane_cfg ? lane_cfg->connected_to_intersection : true;
                 bool has_traffic_light = lane_cfg ? lane_cfg->has_traffic_light : true;
 
@@ -1720,49 +1558,46 @@ namespace crossroads {
 
                 bool can_cross = signalAllowsVehicle(lane, vehicle, lane_cfg, effective_light_state);
                 if (can_cross) {
-                    const ApproachId approach = approachFromDirection(lane);
-                    MovementType route_movement = vehicle.movement;
-                    if (isEffectiveLeftTurn(lane, vehicle)) {
-                        route_movement = MovementType::Left;
-                    }
-                    const std::size_t route_idx = routeIndex(approach, route_movement);
-                    if (route_idx < route_vehicles_started_this_green.size() && route_configured[route_idx] &&
-                        route_green_active[route_idx]) {
-                        route_vehicles_started_this_green[route_idx] += 1;
-                    }
-                    vehicle.crossing_time = current_time;
+                    countRouteStart(lane, vehicle);
+                    traffic.startCrossingAt(lane, i, current_time);
+                    --i;
                 }
             }
         }
     }
 
+    void SimulatorEngine::countRouteStart(Direction lane, const Vehicle& vehicle) {
+        const ApproachId approach = approachFromDirection(lane);
+        MovementType route_movement = vehicle.movement;
+        if (isEffectiveLeftTurn(lane, vehicle)) {
+            route_movement = MovementType::Left;
+        }
+        const std::size_t route_idx = routeIndex(approach, route_movement);
+        if (route_idx < route_vehicles_started_this_green.size() && route_configured[route_idx] &&
+            route_green_active[route_idx]) {
+            route_vehicles_started_this_green[route_idx] += 1;
+        }
+    }
+
     void SimulatorEngine::completeVehicleCrossings() {
         // Complete all vehicles that have finished crossing, regardless of queue position.
         for (int dir = 0; dir < 4; ++dir) {
-            Direction lane = static_cast<Direction>(dir);
-            const auto& queue = traffic.getQueueByDirection(lane);
-            std::vector<uint32_t> finished_ids;
-            finished_ids.reserve(queue.size());
-
-            for (const auto& vehicle : queue) {
-                if (!vehicle.isCrossing()) {
-                    continue;
-                }
-
-                const double crossing_time = vehicle.getCrossingDuration(queue.size());
-                if (current_time - vehicle.crossing_time >= crossing_time) {
-                    finished_ids.push_back(vehicle.id);
-                }
-            }
-
-            for (uint32_t id : finished_ids) {
-                traffic.completeCrossing(id, current_time);
-            }
+            traffic.completeFinishedCrossings(static_cast<Direction>(dir), current_time);
         }
     }
 
     void SimulatorEngine::advanceController(double dt) {
         controller->tick(dt);
+        if (auto* handover = dynamic_cast<HandoverController*>(controller.get()); handover && handover->finished()) {
+            controller = handover->releaseNext();
+        }
+    }
+
+    std::unique_ptr<ITrafficLightController> SimulatorEngine::makeConfiguredController() const {
+        if (intersection_config.signal_groups.empty()) {
+            return std::make_unique<BasicControllerAdapter>(ns_duration, ew_duration);
+        }
+        return std::make_unique<ConfigurableSignalGroupController>(intersection_config);
     }
 
     IntersectionState SimulatorEngine::getCurrentLightState() const {
@@ -1781,6 +1616,7 @@ namespace crossroads {
                                  traffic.getQueueLength(Direction::West)};
         metrics.total_queue_length =
             metrics.queue_lengths[0] + metrics.queue_lengths[1] + metrics.queue_lengths[2] + metrics.queue_lengths[3];
+        metrics.queued_delay_seconds = traffic.getQueuedDelaySeconds(current_time);
         metrics.safety_violations = safety_violations;
         return metrics;
     }
@@ -1819,6 +1655,32 @@ namespace crossroads {
             return "straight";
         }
 
+        const char* toString(VehicleClass vehicle_class) {
+            switch (vehicle_class) {
+                case VehicleClass::Car:
+                    return "car";
+                case VehicleClass::Truck:
+                    return "truck";
+                case VehicleClass::Bus:
+                    return "bus";
+                case VehicleClass::Bicycle:
+                    return "bicycle";
+            }
+            return "car";
+        }
+
+        const char* toString(SimulatorEngine::SchedulerMode mode) {
+            switch (mode) {
+                case SimulatorEngine::SchedulerMode::Adaptive:
+                    return "adaptive";
+                case SimulatorEngine::SchedulerMode::FixedTime:
+                    return "fixed_time";
+                case SimulatorEngine::SchedulerMode::Predictive:
+                    return "predictive";
+            }
+            return "adaptive";
+        }
+
         const char* toString(ApproachId approach) {
             switch (approach) {
                 case ApproachId::North:
@@ -1861,7 +1723,8 @@ namespace crossroads {
                 out << "\"destination_approach\":\"" << toString(v.destination_approach) << "\",";
                 out << "\"destination_lane_index\":" << v.destination_lane_index << ",";
                 out << "\"destination_lane_id\":" << v.destination_lane_id << ",";
-                out << "\"lane_change_allowed\":" << (v.lane_change_allowed ? "true" : "false");
+                out << "\"lane_change_allowed\":" << (v.lane_change_allowed ? "true" : "false") << ",";
+                out << "\"vehicle_class\":\"" << toString(v.vehicle_class) << "\"";
                 out << "}";
             }
             out << "]";
@@ -1905,6 +1768,7 @@ namespace crossroads {
         out << "},";
         out << "\"scheduler\":{";
         out << "\"wmax_seconds\":" << movement_starvation_max_wait_seconds << ",";
+        out << "\"mode\":\"" << toString(scheduler_mode) << "\",";
         out << "\"anchor_route\":";
         if (scheduler_anchor_route_index >= 0 &&
             route_configured[static_cast<std::size_t>(scheduler_anchor_route_index)]) {
@@ -1939,7 +1803,7 @@ namespace crossroads {
                 if (other_idx == idx || !route_configured[other_idx]) {
                     continue;
                 }
-                if (route_conflict_matrix[idx][other_idx] && route_green_active[other_idx]) {
+                if (routesConflict(idx, other_idx) && route_green_active[other_idx]) {
                     conflicting_green_active = true;
                     break;
                 }
@@ -1982,7 +1846,7 @@ namespace crossroads {
                 out << "\"movement\":\"" << toString(movement) << "\",";
                 out << "\"waiting_demand\":" << (route_waiting_demand[idx] ? "true" : "false") << ",";
                 out << "\"wait_seconds\":" << route_wait_seconds[idx] << ",";
-                out << "\"priority_score\":" << route_priority_score[idx] << ",";
+                out << "\"priority_score\":" << currentPriorityScore(idx) << ",";
                 out << "\"green_active\":" << (route_green_active[idx] ? "true" : "false") << ",";
                 const bool selected = (scheduler_anchor_route_index >= 0 &&
                                        static_cast<std::size_t>(scheduler_anchor_route_index) == idx) ||
@@ -2009,7 +1873,7 @@ namespace crossroads {
                         if (!route_configured[other_idx]) {
                             continue;
                         }
-                        if (!route_conflict_matrix[idx][other_idx]) {
+                        if (!routesConflict(idx, other_idx)) {
                             continue;
                         }
                         if (!first_conflict) {
@@ -2065,11 +1929,14 @@ namespace crossroads {
         route_waiting_demand.fill(false);
         route_wait_seconds.fill(0.0);
         route_priority_score.fill(0.0);
+        route_priority_score_slope.fill(0.0);
+        route_priority_score_curvature.fill(0.0);
         route_green_active.fill(false);
         route_last_served_time.fill(-1.0);
         route_green_started_at.fill(-1.0);
         route_vehicles_started_this_green.fill(0);
         route_initial_waiting_count.fill(0);
+        route_waiting_count.fill(0);
         route_crossing_vehicle_count.fill(0);
         route_stopped_waiting_count.fill(0);
         route_conflicts_cleared_at.fill(-1.0);
@@ -2082,6 +1949,18 @@ namespace crossroads {
         scheduler_served_this_cycle.fill(false);
         minimum_green_hold_until_seconds.fill(0.0);
         minimum_orange_hold_until_seconds.fill(0.0);
+        scheduler_forced_anchor_route = -1;
+        scheduler_parallel_order_count = 0;
+        scheduler_selection_version = 0;
+        scheduler_next_selection_time = 0.0;
+        scheduler_selection_time = 0.0;
+        scheduler_score_time = 0.0;
+        scheduler_selection_green.fill(false);
+        scheduler_selection_forced_anchor = -1;
+        scheduler_selection_count = 0;
+        approach_demand_version = 0;
+        predictive_next_decision_time = 0.0;
+        predictive_last_decision = PredictiveDecision{};
         previous_effective_light_state = IntersectionState{};
         has_previous_effective_light_state = false;
         refreshEffectiveSignalState(0.0);
@@ -2128,11 +2007,7 @@ namespace crossroads {
         control_mode = mode;
 
         if (control_mode == ControlMode::Basic) {
-            if (intersection_config.signal_groups.empty()) {
-                controller = std::make_unique<BasicControllerAdapter>(ns_duration, ew_duration);
-            } else {
-                controller = std::make_unique<ConfigurableSignalGroupController>(intersection_config);
-            }
+            controller = makeConfiguredController();
         } else {
             controller = std::make_unique<NullControlController>();
         }
@@ -2156,6 +2031,84 @@ namespace crossroads {
         has_previous_controller_state = true;
     }
 
+    bool SimulatorEngine::applyConfigLive(const IntersectionConfig& config,
+                                          ConfigSwapReport* report,
+                                          std::string* error) {
+        SafetyChecker new_checker(config);
+        if (!new_checker.isConfigValid()) {
+            setStateError(error, "config failed safety validation rules");
+            return false;
+        }
+
+        ConfigSwapReport swap;
+        swap.layout_changed = !sameLaneLayout(intersection_config, config);
+        const bool same_plan = sameSignalPlan(intersection_config, config);
+        swap.signal_plan_changed = !same_plan;
+        swap.timing_changed = same_plan && signalTimingDiffers(intersection_config, config);
+
+        // A finished handover is only unwrapped on the next tick, so do that now; while one runs, the swap goes to
+        // the controller it hands over to.
+        auto* handover = dynamic_cast<HandoverController*>(controller.get());
+        if (handover && handover->finished()) {
+            controller = handover->releaseNext();
+            handover = nullptr;
+        }
+        ITrafficLightController* active = handover ? &handover->nextController() : controller.get();
+
+        // Decide what happens to the controller before anything changes, so a refusal leaves the engine as is.
+        auto* configured = dynamic_cast<ConfigurableSignalGroupController*>(active);
+        const bool standard_controller =
+            control_mode == ControlMode::NullControl
+                ? dynamic_cast<NullControlController*>(active) != nullptr
+                : (configured != nullptr || dynamic_cast<BasicControllerAdapter*>(active) != nullptr);
+        if (!same_plan && !standard_controller) {
+            setStateError(error, "a custom traffic light controller cannot take a new signal plan");
+            return false;
+        }
+
+        checker = new_checker;
+        intersection_config = config;
+        config_fingerprint = intersectionConfigFingerprint(intersection_config);
+        config_hash = intersectionConfigHash(config_fingerprint);
+
+        swap.vehicles_removed = traffic.reconfigure(intersection_config);
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            swap.vehicles_kept += traffic.getQueueLength(dir);
+        }
+
+        if (swap.layout_changed) {
+            default_layout_fast_path = matchesDefaultIntersectionLayout(intersection_config);
+            rebuildRouteConflictMatrix();
+        }
+
+        if (control_mode == ControlMode::Basic && standard_controller) {
+            if (same_plan) {
+                if (configured != nullptr) {
+                    configured->retime(intersection_config);
+                }
+            } else if (handover) {
+                handover->replaceNext(makeConfiguredController());
+            } else {
+                controller = std::make_unique<HandoverController>(controller->getCurrentState(),
+                                                                  makeConfiguredController(),
+                                                                  SafetyChecker::ORANGE_DURATION,
+                                                                  kClearanceBufferSeconds);
+            }
+        }
+
+        // Rollout engines were built from the old config. Demand and the scheduler ranking are recomputed on the
+        // next tick.
+        rollout_engines.clear();
+        approach_demand_version = 0;
+        scheduler_selection_version = 0;
+        movement_permissions_stale = true;
+
+        if (report) {
+            *report = swap;
+        }
+        return true;
+    }
+
     const IntersectionConfig& SimulatorEngine::getIntersectionConfig() const {
         return intersection_config;
     }
@@ -2176,6 +2129,488 @@ namespace crossroads {
         return traffic.getArrivalRate();
     }
 
+    void SimulatorEngine::setApproachArrivalRates(const std::optional<std::array<double, 4>>& rates) {
+        traffic.setApproachArrivalRates(rates);
+    }
+
+    void SimulatorEngine::setSchedulerMode(SchedulerMode mode) {
+        scheduler_mode = mode;
+        refreshEffectiveSignalState(0.0);
+    }
+
+    SimulatorEngine::SchedulerMode SimulatorEngine::getSchedulerMode() const {
+        return scheduler_mode;
+    }
+
+    void SimulatorEngine::setFidelity(Fidelity fidelity, const MesoscopicSettings& settings) {
+        traffic.setMesoscopic(fidelity == Fidelity::Mesoscopic, settings);
+        refreshEffectiveSignalState(0.0);
+    }
+
+    SimulatorEngine::Fidelity SimulatorEngine::getFidelity() const {
+        return traffic.isMesoscopic() ? Fidelity::Mesoscopic : Fidelity::Microscopic;
+    }
+
+    void SimulatorEngine::setPredictiveRolloutBudget(std::size_t max_rollout_ticks) {
+        predictive_rollout_tick_budget = max_rollout_ticks;
+    }
+
+    std::size_t SimulatorEngine::getLastPredictiveRolloutTicks() const {
+        return predictive_last_decision.rollout_ticks;
+    }
+
+    PredictiveDecision SimulatorEngine::getLastPredictiveDecision() const {
+        return predictive_last_decision;
+    }
+
+    void SimulatorEngine::getRouteObservation(RouteObservation& observation) const {
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            const ApproachId approach = static_cast<ApproachId>(route_idx / 3);
+            const MovementType movement = static_cast<MovementType>(route_idx % 3);
+            observation.configured[route_idx] = route_configured[route_idx];
+            observation.waiting[route_idx] = route_waiting_count[route_idx];
+            observation.stopped[route_idx] = route_stopped_waiting_count[route_idx];
+            observation.wait_seconds[route_idx] = route_wait_seconds[route_idx];
+            observation.lights[route_idx] = routeLight(effective_light_state, approach, movement);
+        }
+    }
+
+    void SimulatorEngine::setLayoutFastPathEnabled(bool enabled) {
+        default_layout_fast_path = enabled && matchesDefaultIntersectionLayout(intersection_config);
+        rebuildRouteConflictMatrix();
+        approach_demand_version = 0;
+        scheduler_selection_version = 0;
+    }
+
+    void SimulatorEngine::setIncrementalSchedulingEnabled(bool enabled) {
+        incremental_scheduling = enabled;
+        scheduler_selection_version = 0;
+    }
+
+    bool SimulatorEngine::usesLayoutFastPath() const {
+        return default_layout_fast_path;
+    }
+
+    std::size_t SimulatorEngine::getSchedulerSelectionCount() const {
+        return scheduler_selection_count;
+    }
+
+    void SimulatorEngine::planPredictiveAnchor(double dt) {
+        if (current_time + 1e-9 < predictive_next_decision_time) {
+            return;
+        }
+        predictive_next_decision_time = current_time + predictive_decision_interval_seconds;
+        predictive_last_decision = PredictiveDecision{};
+        scheduler_forced_anchor_route = -1;
+
+        // The budget is counted in simulated ticks rather than wall-clock time so replays stay deterministic.
+        const double step = dt > 0.0 ? dt : 0.1;
+        const std::size_t horizon_ticks =
+            std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(predictive_horizon_seconds / step)));
+        const std::size_t max_rollouts = predictive_rollout_tick_budget / horizon_ticks;
+        if (max_rollouts < 2) {
+            return;
+        }
+
+        std::array<std::size_t, kRouteCount> candidates{};
+        std::size_t candidate_count = 0;
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!route_configured[route_idx] || !route_waiting_demand[route_idx] ||
+                static_cast<int>(route_idx) == scheduler_anchor_route_index) {
+                continue;
+            }
+            candidates[candidate_count++] = route_idx;
+        }
+        std::sort(candidates.begin(), candidates.begin() + candidate_count, [&](std::size_t lhs, std::size_t rhs) {
+            return currentPriorityScore(lhs) > currentPriorityScore(rhs);
+        });
+        candidate_count = std::min({candidate_count, predictive_candidate_count, max_rollouts - 1});
+        if (candidate_count == 0) {
+            return;
+        }
+
+        while (rollout_engines.size() < candidate_count + 1) {
+            rollout_engines.push_back(std::make_unique<SimulatorEngine>(
+                intersection_config, traffic.getArrivalRate(), ns_duration, ew_duration));
+        }
+
+        // Slot 0 keeps the greedy choice; an alternative has to beat it to be forced.
+        double best_cost = std::numeric_limits<double>::infinity();
+        int best_route = -1;
+        for (std::size_t slot = 0; slot <= candidate_count; ++slot) {
+            SimulatorEngine& rollout = *rollout_engines[slot];
+            if (!syncRolloutEngine(rollout)) {
+                return;
+            }
+
+            const int forced_route = slot == 0 ? -1 : static_cast<int>(candidates[slot - 1]);
+            rollout.scheduler_forced_anchor_route = forced_route;
+
+            double cost = 0.0;
+            for (std::size_t i = 0; i < horizon_ticks; ++i) {
+                rollout.tick(step);
+                if (rollout.safety_violations > safety_violations) {
+                    cost = std::numeric_limits<double>::infinity();
+                    break;
+                }
+                cost += static_cast<double>(rollout.countWaitingVehicles()) * step;
+            }
+            predictive_last_decision.rollout_ticks += horizon_ticks;
+            if (slot == 0) {
+                predictive_last_decision.greedy_cost = cost;
+            }
+
+            if (cost + 1e-9 < best_cost) {
+                best_cost = cost;
+                best_route = forced_route;
+            }
+        }
+
+        scheduler_forced_anchor_route = best_route;
+        predictive_last_decision.forced_route = best_route;
+        predictive_last_decision.chosen_cost = best_cost;
+    }
+
+    bool SimulatorEngine::syncRolloutEngine(SimulatorEngine& rollout) const {
+        if (!rollout.copyStateFrom(*this)) {
+            return false;
+        }
+        rollout.scheduler_mode = SchedulerMode::Adaptive;
+        rollout.scheduler_forced_anchor_route = -1;
+        return true;
+    }
+
+    bool SimulatorEngine::copyStateFrom(const SimulatorEngine& other) {
+        if (!other.controller) {
+            return false;
+        }
+        if (!controller || !controller->copyStateFrom(*other.controller)) {
+            std::unique_ptr<ITrafficLightController> copy = other.controller->clone();
+            if (!copy) {
+                return false;
+            }
+            controller = std::move(copy);
+        }
+
+        copyDynamicStateFrom(other);
+        return true;
+    }
+
+    void SimulatorEngine::copyDynamicStateFrom(const SimulatorEngine& other) {
+        control_mode = other.control_mode;
+        scheduler_mode = other.scheduler_mode;
+        traffic.copyDynamicStateFrom(other.traffic);
+        current_time = other.current_time;
+        running = other.running;
+        safety_violations = other.safety_violations;
+        effective_light_state = other.effective_light_state;
+        previous_effective_light_state = other.previous_effective_light_state;
+        previous_controller_state = other.previous_controller_state;
+        has_previous_effective_light_state = other.has_previous_effective_light_state;
+        has_previous_controller_state = other.has_previous_controller_state;
+        minimum_green_hold_until_seconds = other.minimum_green_hold_until_seconds;
+        minimum_orange_hold_until_seconds = other.minimum_orange_hold_until_seconds;
+        right_turn_green_hold_until = other.right_turn_green_hold_until;
+        straight_wait_seconds = other.straight_wait_seconds;
+        left_wait_seconds = other.left_wait_seconds;
+        right_wait_seconds = other.right_wait_seconds;
+        route_waiting_demand = other.route_waiting_demand;
+        route_wait_seconds = other.route_wait_seconds;
+        route_priority_score = other.route_priority_score;
+        route_priority_score_slope = other.route_priority_score_slope;
+        route_priority_score_curvature = other.route_priority_score_curvature;
+        route_green_active = other.route_green_active;
+        route_configured = other.route_configured;
+        route_last_served_time = other.route_last_served_time;
+        route_green_started_at = other.route_green_started_at;
+        route_vehicles_started_this_green = other.route_vehicles_started_this_green;
+        route_initial_waiting_count = other.route_initial_waiting_count;
+        route_crossing_vehicle_count = other.route_crossing_vehicle_count;
+        route_stopped_waiting_count = other.route_stopped_waiting_count;
+        route_conflicts_cleared_at = other.route_conflicts_cleared_at;
+        route_red_since = other.route_red_since;
+        route_conflict_masks = other.route_conflict_masks;
+        route_conflict_matrix_ready = other.route_conflict_matrix_ready;
+        scheduler_anchor_route_index = other.scheduler_anchor_route_index;
+        scheduler_parallel_routes = other.scheduler_parallel_routes;
+        scheduler_blocked_routes = other.scheduler_blocked_routes;
+        scheduler_safety_blocked_routes = other.scheduler_safety_blocked_routes;
+        scheduler_clearance_blocked_routes = other.scheduler_clearance_blocked_routes;
+        scheduler_served_this_cycle = other.scheduler_served_this_cycle;
+        scheduler_forced_anchor_route = other.scheduler_forced_anchor_route;
+        approach_demand = other.approach_demand;
+        approach_demand_version = other.approach_demand_version;
+        route_waiting_count = other.route_waiting_count;
+        scheduler_parallel_order = other.scheduler_parallel_order;
+        scheduler_parallel_order_count = other.scheduler_parallel_order_count;
+        scheduler_selection_version = other.scheduler_selection_version;
+        scheduler_next_selection_time = other.scheduler_next_selection_time;
+        scheduler_selection_time = other.scheduler_selection_time;
+        scheduler_score_time = other.scheduler_score_time;
+        scheduler_selection_green = other.scheduler_selection_green;
+        scheduler_selection_forced_anchor = other.scheduler_selection_forced_anchor;
+        scheduler_selection_count = other.scheduler_selection_count;
+        predictive_next_decision_time = other.predictive_next_decision_time;
+        predictive_last_decision = other.predictive_last_decision;
+    }
+
+    bool SimulatorEngine::saveState(std::string& out, std::string* error) const {
+        out.clear();
+        StateWriter writer(out);
+        for (char c : kStateMagic) {
+            writer.u8(static_cast<uint8_t>(c));
+        }
+        writer.u16(kStateVersion);
+        writer.bytes(config_hash);
+
+        writer.u8(static_cast<uint8_t>(control_mode));
+        writer.u8(static_cast<uint8_t>(scheduler_mode));
+        writer.f64(current_time);
+        writer.boolean(running);
+        writer.u64(safety_violations);
+        writer.lights(effective_light_state);
+        writer.lights(previous_effective_light_state);
+        writer.lights(previous_controller_state);
+        writer.boolean(has_previous_effective_light_state);
+        writer.boolean(has_previous_controller_state);
+        writer.f64Array(minimum_green_hold_until_seconds);
+        writer.f64Array(minimum_orange_hold_until_seconds);
+        writer.f64Array(right_turn_green_hold_until);
+        writer.f64Array(straight_wait_seconds);
+        writer.f64Array(left_wait_seconds);
+        writer.f64Array(right_wait_seconds);
+        writer.boolArray(route_waiting_demand);
+        writer.f64Array(route_wait_seconds);
+        writer.f64Array(route_priority_score);
+        writer.f64Array(route_priority_score_slope);
+        writer.f64Array(route_priority_score_curvature);
+        writer.boolArray(route_green_active);
+        writer.f64Array(route_last_served_time);
+        writer.f64Array(route_green_started_at);
+        writer.i32Array(route_vehicles_started_this_green);
+        writer.i32Array(route_initial_waiting_count);
+        writer.i32Array(route_crossing_vehicle_count);
+        writer.i32Array(route_stopped_waiting_count);
+        writer.f64Array(route_conflicts_cleared_at);
+        writer.f64Array(route_red_since);
+        for (const ApproachDemand& demand : approach_demand) {
+            writer.i32Array(demand.waiting);
+            writer.i32Array(demand.crossing);
+            writer.i32Array(demand.stopped);
+            writer.boolArray(std::array<bool, 7>{demand.queue_empty,
+                                                 demand.right_lane_demand,
+                                                 demand.right_exclusive_demand,
+                                                 demand.main_light_demand,
+                                                 demand.left_lane_demand,
+                                                 demand.left_lane_crossing,
+                                                 demand.unprotected_left_demand});
+        }
+        writer.i32Array(route_waiting_count);
+        writer.u64(approach_demand_version);
+        writer.i32(scheduler_anchor_route_index);
+        writer.boolArray(scheduler_parallel_routes);
+        writer.boolArray(scheduler_blocked_routes);
+        writer.boolArray(scheduler_safety_blocked_routes);
+        writer.boolArray(scheduler_clearance_blocked_routes);
+        writer.boolArray(scheduler_served_this_cycle);
+        writer.i32(scheduler_forced_anchor_route);
+        writer.i32Array(scheduler_parallel_order);
+        writer.u32(static_cast<uint32_t>(scheduler_parallel_order_count));
+        writer.u64(scheduler_selection_version);
+        writer.f64(scheduler_next_selection_time);
+        writer.f64(scheduler_selection_time);
+        writer.f64(scheduler_score_time);
+        writer.boolArray(scheduler_selection_green);
+        writer.i32(scheduler_selection_forced_anchor);
+        writer.u64(scheduler_selection_count);
+        writer.f64(predictive_next_decision_time);
+        writer.u64(predictive_last_decision.rollout_ticks);
+        writer.i32(predictive_last_decision.forced_route);
+        writer.f64(predictive_last_decision.greedy_cost);
+        writer.f64(predictive_last_decision.chosen_cost);
+
+        traffic.saveState(writer);
+        if (!controller || !controller->saveState(writer)) {
+            out.clear();
+            setStateError(error, "traffic light controller does not support checkpoints");
+            return false;
+        }
+        return true;
+    }
+
+    bool SimulatorEngine::loadState(const std::string& bytes, std::string* error) {
+        StateReader reader(bytes);
+        if (!readStateHeader(reader, error)) {
+            return false;
+        }
+
+        // The body is read in place, so keep the current state to fall back to when it turns out to be bad.
+        std::string previous_state;
+        const bool has_previous_state = saveState(previous_state);
+        if (readStateBody(reader, error)) {
+            return true;
+        }
+        StateReader previous_reader(previous_state);
+        if (!has_previous_state || !readStateHeader(previous_reader, nullptr) ||
+            !readStateBody(previous_reader, nullptr)) {
+            reset();
+        }
+        return false;
+    }
+
+    bool SimulatorEngine::readStateHeader(StateReader& reader, std::string* error) const {
+        bool magic_ok = true;
+        for (char c : kStateMagic) {
+            magic_ok = reader.u8() == static_cast<uint8_t>(c) && magic_ok;
+        }
+        if (!reader.ok() || !magic_ok) {
+            setStateError(error, "not an engine checkpoint");
+            return false;
+        }
+        const uint16_t version = reader.u16();
+        if (!reader.ok() || version != kStateVersion) {
+            setStateError(error, "unsupported engine checkpoint version " + std::to_string(version));
+            return false;
+        }
+        if (reader.bytes() != config_hash || !reader.ok()) {
+            setStateError(error, "checkpoint was saved from a different intersection config");
+            return false;
+        }
+        return true;
+    }
+
+    bool SimulatorEngine::readStateBody(StateReader& reader, std::string* error) {
+        const uint8_t saved_control_mode = reader.u8();
+        const uint8_t saved_scheduler_mode = reader.u8();
+        if (!reader.ok() || saved_control_mode > static_cast<uint8_t>(ControlMode::NullControl) ||
+            saved_scheduler_mode > static_cast<uint8_t>(SchedulerMode::Predictive)) {
+            setStateError(error, "corrupt engine checkpoint");
+            return false;
+        }
+        scheduler_mode = static_cast<SchedulerMode>(saved_scheduler_mode);
+        current_time = reader.f64();
+        running = reader.boolean();
+        safety_violations = static_cast<size_t>(reader.u64());
+        effective_light_state = reader.lights();
+        previous_effective_light_state = reader.lights();
+        previous_controller_state = reader.lights();
+        has_previous_effective_light_state = reader.boolean();
+        has_previous_controller_state = reader.boolean();
+        reader.f64Array(minimum_green_hold_until_seconds);
+        reader.f64Array(minimum_orange_hold_until_seconds);
+        reader.f64Array(right_turn_green_hold_until);
+        reader.f64Array(straight_wait_seconds);
+        reader.f64Array(left_wait_seconds);
+        reader.f64Array(right_wait_seconds);
+        reader.boolArray(route_waiting_demand);
+        reader.f64Array(route_wait_seconds);
+        reader.f64Array(route_priority_score);
+        reader.f64Array(route_priority_score_slope);
+        reader.f64Array(route_priority_score_curvature);
+        reader.boolArray(route_green_active);
+        reader.f64Array(route_last_served_time);
+        reader.f64Array(route_green_started_at);
+        reader.i32Array(route_vehicles_started_this_green);
+        reader.i32Array(route_initial_waiting_count);
+        reader.i32Array(route_crossing_vehicle_count);
+        reader.i32Array(route_stopped_waiting_count);
+        reader.f64Array(route_conflicts_cleared_at);
+        reader.f64Array(route_red_since);
+        for (ApproachDemand& demand : approach_demand) {
+            reader.i32Array(demand.waiting);
+            reader.i32Array(demand.crossing);
+            reader.i32Array(demand.stopped);
+            std::array<bool, 7> flags{};
+            reader.boolArray(flags);
+            demand.queue_empty = flags[0];
+            demand.right_lane_demand = flags[1];
+            demand.right_exclusive_demand = flags[2];
+            demand.main_light_demand = flags[3];
+            demand.left_lane_demand = flags[4];
+            demand.left_lane_crossing = flags[5];
+            demand.unprotected_left_demand = flags[6];
+        }
+        reader.i32Array(route_waiting_count);
+        approach_demand_version = reader.u64();
+        scheduler_anchor_route_index = reader.i32();
+        reader.boolArray(scheduler_parallel_routes);
+        reader.boolArray(scheduler_blocked_routes);
+        reader.boolArray(scheduler_safety_blocked_routes);
+        reader.boolArray(scheduler_clearance_blocked_routes);
+        reader.boolArray(scheduler_served_this_cycle);
+        scheduler_forced_anchor_route = reader.i32();
+        reader.i32Array(scheduler_parallel_order);
+        scheduler_parallel_order_count = reader.u32();
+        scheduler_selection_version = reader.u64();
+        scheduler_next_selection_time = reader.f64();
+        scheduler_selection_time = reader.f64();
+        scheduler_score_time = reader.f64();
+        reader.boolArray(scheduler_selection_green);
+        scheduler_selection_forced_anchor = reader.i32();
+        scheduler_selection_count = static_cast<std::size_t>(reader.u64());
+        predictive_next_decision_time = reader.f64();
+        predictive_last_decision.rollout_ticks = static_cast<std::size_t>(reader.u64());
+        predictive_last_decision.forced_route = reader.i32();
+        predictive_last_decision.greedy_cost = reader.f64();
+        predictive_last_decision.chosen_cost = reader.f64();
+
+        auto valid_route = [](int route_idx) { return route_idx >= -1 && route_idx < static_cast<int>(kRouteCount); };
+        bool indices_valid = valid_route(scheduler_anchor_route_index) && valid_route(scheduler_forced_anchor_route) &&
+                             valid_route(scheduler_selection_forced_anchor) &&
+                             scheduler_parallel_order_count <= kRouteCount;
+        for (std::size_t route_idx : scheduler_parallel_order) {
+            indices_valid = indices_valid && route_idx < kRouteCount;
+        }
+        if (!reader.ok() || !indices_valid || !traffic.loadState(reader)) {
+            setStateError(error, "corrupt engine checkpoint");
+            return false;
+        }
+
+        const ControlMode mode = static_cast<ControlMode>(saved_control_mode);
+        if (mode != control_mode || !controller) {
+            const IntersectionState loaded_previous_controller_state = previous_controller_state;
+            setControlMode(mode);
+            previous_controller_state = loaded_previous_controller_state;
+        }
+        // A checkpoint taken during a live swap holds a handover around the configured controller.
+        auto* handover = dynamic_cast<HandoverController*>(controller.get());
+        if (HandoverController::startsState(reader) && !handover) {
+            controller = std::make_unique<HandoverController>(
+                IntersectionState{}, std::move(controller), SafetyChecker::ORANGE_DURATION, kClearanceBufferSeconds);
+        } else if (!HandoverController::startsState(reader) && handover) {
+            controller = handover->releaseNext();
+        }
+        const bool controller_loaded = controller->loadState(reader);
+        if (!controller_loaded && reader.ok()) {
+            setStateError(error, "checkpoint does not match the engine's traffic light controller");
+            return false;
+        }
+        if (!controller_loaded || !reader.ok() || !reader.atEnd()) {
+            setStateError(error, "corrupt engine checkpoint");
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t SimulatorEngine::countWaitingVehicles() const {
+        if (traffic.isMesoscopic()) {
+            return traffic.getMesoscopicQueues().queued();
+        }
+        std::size_t waiting = 0;
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            waiting += traffic.getQueueByDirection(dir).size();
+        }
+        return waiting;
+    }
+
+    double SimulatorEngine::getSimTime() const {
+        return current_time;
+    }
+
+    void SimulatorEngine::getLaneVehicleStates(Direction dir, std::vector<LaneVehicleState>& states) const {
+        traffic.getLaneVehicleStates(dir, states);
+    }
+
     bool SimulatorEngine::isLightGreen(Direction dir) const {
         auto state = getCurrentLightState();
         switch (dir) {
@@ -2252,7 +2687,8 @@ namespace crossroads {
         return false;
     }
 
-    std::vector<SignalGroupId> SimulatorEngine::resolveActiveSignalGroups(const IntersectionState& state) const {
+    void SimulatorEngine::resolveActiveSignalGroups(const IntersectionState& state,
+                                                    std::vector<SignalGroupId>& active_ids) const {
         auto is_active = [](LightState value) { return value == LightState::Green || value == LightState::Orange; };
 
         auto is_movement_active = [&](ApproachId approach, MovementType movement) {
@@ -2300,8 +2736,7 @@ namespace crossroads {
             return false;
         };
 
-        std::unordered_set<SignalGroupId> active_ids;
-
+        active_ids.clear();
         for (const auto& group : intersection_config.signal_groups) {
             bool group_active = false;
             for (LaneId lane_id : group.controlled_lanes) {
@@ -2322,12 +2757,10 @@ namespace crossroads {
                 }
             }
 
-            if (group_active) {
-                active_ids.insert(group.id);
+            if (group_active && std::find(active_ids.begin(), active_ids.end(), group.id) == active_ids.end()) {
+                active_ids.push_back(group.id);
             }
         }
-
-        return std::vector<SignalGroupId>(active_ids.begin(), active_ids.end());
     }
 
     bool SimulatorEngine::isConfigSignalStateSafe(const IntersectionState& state) const {
@@ -2339,12 +2772,12 @@ namespace crossroads {
             return false;
         }
 
-        std::vector<SignalGroupId> active_groups = resolveActiveSignalGroups(state);
-        if (active_groups.empty()) {
+        resolveActiveSignalGroups(state, active_signal_groups);
+        if (active_signal_groups.empty()) {
             return true;
         }
 
-        return checker.areSignalGroupsConflictFree(active_groups);
+        return checker.areSignalGroupsConflictFree(active_signal_groups);
     }
 
 }  // namespace crossroads
\ No newline at end of file
@@ -1,16 +1,37 @@
 #include "TrafficGenerator.hpp"
 
 #include <algorithm>
+#include <iterator>
 
 namespace crossroads {
     namespace {
-        constexpr double CAR_LENGTH_METERS = 4.0;
-        constexpr double STOPLINE_TARGET_METERS = 69.5;  // 0.5m vóór de streep (streep op 70m)
-        constexpr double STOPPED_GAP_METERS = 2.0;       // 2m bumper-bumper bij stilstand
-        constexpr double MIN_FRONT_DISTANCE_METERS = CAR_LENGTH_METERS + STOPPED_GAP_METERS;  // 6m front-to-front
-        constexpr double FOLLOWING_TIME_SECONDS = 1.5;  // 1.5s following bij rijden
-        constexpr size_t MAX_QUEUE_SIZE_PER_DIRECTION = 60;
-        constexpr size_t MAX_QUEUE_SIZE_PER_LANE = 12;
+        constexpr double LANE_CHANGE_CUTOFF_METERS = 15.0;  // Geen rijstrookwissel meer vlak voor de streep
+
+        // Front-to-front distance behind a stopped vehicle of this class (6m achter een auto)
+        double standstillSpacing(VehicleClass ahead) {
+            return vehicleClassParams(ahead).length_m + kStoppedGapMeters;
+        }
+
+        std::size_t crossingListIndex(bool turning, VehicleClass vehicle_class) {
+            return static_cast<std::size_t>(vehicle_class) * 2 + (turning ? 1 : 0);
+        }
+
+        // A multiplicative hash spreads consecutive ids over [0, 1), independent of the id % 10 movement roll.
+        VehicleClass chooseVehicleClass(const std::array<double, kVehicleClassCount>& mix, uint32_t vehicle_id) {
+            double total = 0.0;
+            for (double share : mix) {
+                total += std::max(0.0, share);
+            }
+            const double roll = static_cast<double>((vehicle_id * 2654435761u) >> 8) / static_cast<double>(1u << 24);
+            double cumulative = 0.0;
+            for (std::size_t i = 0; i < mix.size(); ++i) {
+                cumulative += std::max(0.0, mix[i]);
+                if (roll * total < cumulative) {
+                    return static_cast<VehicleClass>(i);
+                }
+            }
+            return VehicleClass::Car;
+        }
 
         ApproachId approachFromDirection(Direction dir) {
             switch (dir) {
@@ -39,6 +60,19 @@ namespace crossroads {
             }
             return 0;
         }
+
+        // Index of a lane within its approach, or lanes.size(). Lane ids are normally laneIdFor(approach, index),
+        // so that slot is tried first.
+        size_t laneIndexOf(const ApproachConfig& approach, LaneId lane_id) {
+            const size_t guess = lane_id % 100;
+            if (guess < approach.lanes.size() && approach.lanes[guess].id == lane_id) {
+                return guess;
+            }
+            const auto found = std::find_if(approach.lanes.begin(), approach.lanes.end(), [&](const LaneConfig& lane) {
+                return lane.id == lane_id;
+            });
+            return static_cast<size_t>(std::distance(approach.lanes.begin(), found));
+        }
     }  // namespace
 
     const ApproachConfig* TrafficGenerator::getApproachConfig(Direction dir) const {
@@ -152,62 +186,53 @@ namespace crossroads {
     size_t TrafficGenerator::choosePreferredLaneIndex(const ApproachConfig& approach,
                                                       MovementType movement,
                                                       size_t current_index) const {
-        std::vector<size_t> candidates;
+        // One pass over the candidate lanes in ascending order: the first, the last and the nearest one.
+        const size_t none = approach.lanes.size();
+        size_t first = none;
+        size_t last = none;
+        size_t best = none;
+        size_t best_dist = 0;
         for (size_t idx = 0; idx < approach.lanes.size(); ++idx) {
-            if (!approach.lanes[idx].connected_to_intersection) {
+            if (!approach.lanes[idx].connected_to_intersection || !laneAllowsMovement(approach.lanes[idx], movement)) {
                 continue;
             }
 
-            if (laneAllowsMovement(approach.lanes[idx], movement)) {
-                candidates.push_back(idx);
+            first = first == none ? idx : first;
+            last = idx;
+            size_t dist = (idx > current_index) ? (idx - current_index) : (current_index - idx);
+            if (best == none || dist < best_dist) {
+                best = idx;
+                best_dist = dist;
             }
         }
 
-        if (candidates.empty()) {
+        if (best == none) {
             return current_index;
         }
-
         if (movement == MovementType::Right) {
-            return *std::max_element(candidates.begin(), candidates.end());
+            return last;
         }
         if (movement == MovementType::Left) {
-            return *std::min_element(candidates.begin(), candidates.end());
-        }
-
-        size_t best = candidates.front();
-        size_t best_dist = (best > current_index) ? (best - current_index) : (current_index - best);
-        for (size_t idx : candidates) {
-            size_t dist = (idx > current_index) ? (idx - current_index) : (current_index - idx);
-            if (dist < best_dist) {
-                best = idx;
-                best_dist = dist;
-            }
+            return first;
         }
         return best;
     }
 
-    bool TrafficGenerator::hasSafeGapForLaneChange(const std::deque<Vehicle>& queue,
-                                                   size_t vehicle_index,
-                                                   LaneId target_lane_id) const {
-        const Vehicle& vehicle = queue[vehicle_index];
-        for (size_t j = 0; j < queue.size(); ++j) {
-            if (j == vehicle_index) {
-                continue;
-            }
-            const Vehicle& other = queue[j];
-            if (other.isCrossing() || other.lane_id != target_lane_id) {
-                continue;
-            }
-
-            double distance = std::abs(other.position_in_lane - vehicle.position_in_lane);
-            if (distance < MIN_FRONT_DISTANCE_METERS) {
-                return false;
-            }
+    bool TrafficGenerator::hasSafeGapForLaneChange(const std::vector<LaneOccupant>& target_lane,
+                                                   double position,
+                                                   VehicleClass vehicle_class) {
+        // Only the nearest vehicle on either side in the target lane can be too close.
+        const auto next = std::lower_bound(target_lane.begin(), target_lane.end(), position, occupantBefore);
+        if (next != target_lane.end() && next->position - position < standstillSpacing(next->vehicle_class)) {
+            return false;
+        }
+        if (next != target_lane.begin() && position - std::prev(next)->position < standstillSpacing(vehicle_class)) {
+            return false;
         }
         return true;
     }
 
-    void TrafficGenerator::maybeApplyLaneChanges(Direction dir, std::deque<Vehicle>& queue) {
+    void TrafficGenerator::maybeApplyLaneChanges(Direction dir, VehicleQueue& queue) {
         if (!use_configured_spawns || queue.empty()) {
             return;
         }
@@ -217,41 +242,56 @@ namespace crossroads {
             return;
         }
 
-        for (size_t i = 0; i < queue.size(); ++i) {
-            Vehicle& vehicle = queue[i];
-            if (vehicle.isCrossing()) {
-                continue;
+        // A vehicle whose lane allows its movement already has its route resolved (at spawn, after its last lane
+        // change, or by reconfigure), so only vehicles in the wrong lane need work. The lane buckets are built on
+        // the first such vehicle.
+        bool buckets_ready = false;
+        auto buildBuckets = [&]() {
+            lane_change_positions.resize(std::max(lane_change_positions.size(), approach->lanes.size()));
+            for (std::size_t lane = 0; lane < approach->lanes.size(); ++lane) {
+                lane_change_positions[lane].clear();
             }
+            for (const Vehicle& other : queue) {
+                const std::size_t lane = laneIndexOf(*approach, other.lane_id);
+                if (lane < approach->lanes.size()) {
+                    lane_change_positions[lane].push_back({other.position_in_lane, other.vehicle_class});
+                }
+            }
+            for (std::size_t lane = 0; lane < approach->lanes.size(); ++lane) {
+                std::sort(lane_change_positions[lane].begin(),
+                          lane_change_positions[lane].end(),
+                          [](const LaneOccupant& lhs, const LaneOccupant& rhs) { return lhs.position < rhs.position; });
+            }
+            buckets_ready = true;
+        };
 
-            auto current_it = std::find_if(approach->lanes.begin(), approach->lanes.end(), [&](const LaneConfig& lane) {
-                return lane.id == vehicle.lane_id;
-            });
-            if (current_it == approach->lanes.end()) {
+        for (Vehicle& vehicle : queue) {
+            const std::size_t current_index = laneIndexOf(*approach, vehicle.lane_id);
+            if (current_index >= approach->lanes.size() ||
+                laneAllowsMovement(approach->lanes[current_index], vehicle.movement)) {
                 continue;
             }
 
-            size_t current_index = static_cast<size_t>(std::distance(approach->lanes.begin(), current_it));
-            bool movement_allowed = laneAllowsMovement(*current_it, vehicle.movement);
+            const LaneId previous_lane_id = vehicle.lane_id;
+            const MovementType previous_movement = vehicle.movement;
+            const ApproachId previous_destination = vehicle.destination_approach;
+            auto noteRouteChange = [&]() {
+                if (vehicle.lane_id != previous_lane_id || vehicle.movement != previous_movement ||
+                    vehicle.destination_approach != previous_destination) {
+                    ++demand_version;
+                }
+            };
 
             auto fallbackToCurrentLaneMovement = [&]() {
                 vehicle.movement = MovementType::Straight;
                 vehicle.turning = false;
             };
 
-            if (movement_allowed) {
-                resolveVehicleRoute(vehicle, approach->id, static_cast<uint16_t>(current_index), vehicle.movement);
-                continue;
-            }
-
-            if (!vehicle.lane_change_allowed) {
-                fallbackToCurrentLaneMovement();
-                resolveVehicleRoute(vehicle, approach->id, static_cast<uint16_t>(current_index), vehicle.movement);
-                continue;
-            }
-
-            if (vehicle.position_in_lane > 55.0) {
+            if (!vehicle.lane_change_allowed ||
+                vehicle.position_in_lane > approach->length_m - LANE_CHANGE_CUTOFF_METERS) {
                 fallbackToCurrentLaneMovement();
                 resolveVehicleRoute(vehicle, approach->id, static_cast<uint16_t>(current_index), vehicle.movement);
+                noteRouteChange();
                 continue;
             }
 
@@ -260,17 +300,35 @@ namespace crossroads {
                 continue;
             }
 
-            LaneId target_lane = approach->lanes[target_index].id;
-            if (target_lane == vehicle.lane_id) {
+            if (target_index == current_index) {
                 resolveVehicleRoute(vehicle, approach->id, static_cast<uint16_t>(current_index), vehicle.movement);
+                noteRouteChange();
                 continue;
             }
 
-            if (hasSafeGapForLaneChange(queue, i, target_lane)) {
-                vehicle.lane_id = target_lane;
+            if (!buckets_ready) {
+                buildBuckets();
+            }
+            std::vector<LaneOccupant>& target_lane = lane_change_positions[target_index];
+            if (hasSafeGapForLaneChange(target_lane, vehicle.position_in_lane, vehicle.vehicle_class)) {
+                std::vector<LaneOccupant>& current_lane = lane_change_positions[current_index];
+                const auto own = std::lower_bound(
+                    current_lane.begin(), current_lane.end(), vehicle.position_in_lane, occupantBefore);
+                if (own != current_lane.end()) {
+                    current_lane.erase(own);
+                }
+                const auto slot = std::upper_bound(
+                    target_lane.begin(),
+                    target_lane.end(),
+                    vehicle.position_in_lane,
+                    [](double position, const LaneOccupant& occupant) { return position < occupant.position; });
+                target_lane.insert(slot, {vehicle.position_in_lane, vehicle.vehicle_class});
+
+                vehicle.lane_id = approach->lanes[target_index].id;
                 vehicle.queue_index = static_cast<uint8_t>(target_index % 3);
                 vehicle.lane_change_allowed = approach->lanes[target_index].supports_lane_change;
                 resolveVehicleRoute(vehicle, approach->id, static_cast<uint16_t>(target_index), vehicle.movement);
+                noteRouteChange();
             }
         }
     }
@@ -291,7 +349,7 @@ namespace crossroads {
         , next_vehicle_id(1) {
     }
 
-    std::deque<Vehicle>& TrafficGenerator::getQueueByDirection(Direction dir) {
+    VehicleQueue& TrafficGenerator::getQueueByDirection(Direction dir) {
         switch (dir) {
             case Direction::North:
                 return north_queue;
@@ -305,7 +363,17 @@ namespace crossroads {
         return north_queue;
     }
 
-    const std::deque<Vehicle>& TrafficGenerator::getQueueByDirection(Direction dir) const {
+    const VehicleQueue& TrafficGenerator::getCrossingQueue(Direction dir,
+                                                          bool turning,
+                                                          VehicleClass vehicle_class) const {
+        return crossing_queues[static_cast<std::size_t>(dir)][crossingListIndex(turning, vehicle_class)];
+    }
+
+    VehicleQueue& TrafficGenerator::crossingQueue(Direction dir, bool turning, VehicleClass vehicle_class) {
+        return crossing_queues[static_cast<std::size_t>(dir)][crossingListIndex(turning, vehicle_class)];
+    }
+
+    const VehicleQueue& TrafficGenerator::getQueueByDirection(Direction dir) const {
         switch (dir) {
             case Direction::North:
                 return north_queue;
@@ -328,185 +396,248 @@ namespace crossroads {
     void TrafficGenerator::generateTraffic(double dt_seconds, double current_time) {
         enforceSpawnLaneFilterOnExistingQueues();
 
-        time_accumulated += dt_seconds;
-        double spawn_interval = getNextSpawnInterval();
-
-        while (time_accumulated >= spawn_interval) {
-            time_accumulated -= spawn_interval;
-
-            Direction directions[] = {Direction::North, Direction::South, Direction::East, Direction::West};
+        Direction directions[] = {Direction::North, Direction::South, Direction::East, Direction::West};
 
+        if (approach_arrival_rates.has_value()) {
             for (Direction dir : directions) {
-                const uint32_t candidate_id = next_vehicle_id;
-                Vehicle v(candidate_id, dir, current_time);
-                ApproachId approach = approachFromDirection(dir);
-
-                if (spawn_lane_filter.has_value() && spawn_lane_filter->approach != approach) {
+                const size_t approach_idx = approachArrayIndex(approachFromDirection(dir));
+                const double rate = (*approach_arrival_rates)[approach_idx];
+                approach_time_accumulated[approach_idx] += dt_seconds;
+                if (rate <= 0.0) {
+                    approach_time_accumulated[approach_idx] = 0.0;
                     continue;
                 }
 
-                if (use_configured_spawns) {
-                    size_t approach_idx = approachArrayIndex(approach);
-                    const auto& approach_cfg = intersection_config.approaches[approach_idx];
-
-                    if (!approach_cfg.lanes.empty()) {
-                        std::vector<size_t> connected_lane_indices;
-                        connected_lane_indices.reserve(approach_cfg.lanes.size());
-                        for (size_t lane_idx = 0; lane_idx < approach_cfg.lanes.size(); ++lane_idx) {
-                            if (approach_cfg.lanes[lane_idx].connected_to_intersection) {
-                                connected_lane_indices.push_back(lane_idx);
-                            }
-                        }
+                const double spawn_interval = 1.0 / rate;
+                while (approach_time_accumulated[approach_idx] >= spawn_interval) {
+                    approach_time_accumulated[approach_idx] -= spawn_interval;
+                    trySpawnVehicle(dir, current_time);
+                }
+            }
+            return;
+        }
 
-                        if (spawn_lane_filter.has_value() && spawn_lane_filter->approach == approach) {
-                            connected_lane_indices.erase(
-                                std::remove_if(
-                                    connected_lane_indices.begin(),
-                                    connected_lane_indices.end(),
-                                    [&](size_t lane_idx) { return lane_idx != spawn_lane_filter->lane_index; }),
-                                connected_lane_indices.end());
-                        }
+        time_accumulated += dt_seconds;
+        double spawn_interval = getNextSpawnInterval();
 
-                        if (connected_lane_indices.empty()) {
-                            continue;
-                        }
+        while (time_accumulated >= spawn_interval) {
+            time_accumulated -= spawn_interval;
 
-                        size_t cursor_slot = spawn_lane_cursor[approach_idx] % connected_lane_indices.size();
-                        size_t cursor = connected_lane_indices[cursor_slot];
-                        const auto& lane_cfg = approach_cfg.lanes[cursor];
-                        spawn_lane_cursor[approach_idx] = (cursor_slot + 1) % connected_lane_indices.size();
-
-                        std::vector<MovementType> available_movements;
-                        for (size_t lane_idx : connected_lane_indices) {
-                            const auto& lane = approach_cfg.lanes[lane_idx];
-                            for (MovementType movement : lane.allowed_movements) {
-                                if (std::find(available_movements.begin(), available_movements.end(), movement) ==
-                                    available_movements.end()) {
-                                    available_movements.push_back(movement);
-                                }
-                            }
-                        }
+            for (Direction dir : directions) {
+                trySpawnVehicle(dir, current_time);
+            }
+        }
+    }
 
-                        if (!available_movements.empty()) {
-                            size_t movement_idx = chooseSpawnMovementIndex(available_movements, v.id);
-                            v.movement = available_movements[movement_idx];
-                        } else {
-                            v.movement = MovementType::Straight;
-                        }
+    void TrafficGenerator::trySpawnVehicle(Direction dir, double current_time) {
+        const uint32_t candidate_id = next_vehicle_id;
+        Vehicle v(candidate_id, dir, current_time);
+        ApproachId approach = approachFromDirection(dir);
 
-                        size_t preferred_lane_idx = choosePreferredLaneIndex(approach_cfg, v.movement, cursor);
-                        const auto& preferred_lane_cfg = approach_cfg.lanes[preferred_lane_idx];
-
-                        v.queue_index = static_cast<uint8_t>(preferred_lane_idx % 3);
-                        v.lane_id = preferred_lane_cfg.id;
-                        v.lane_change_allowed = preferred_lane_cfg.supports_lane_change;
-
-                        if (!resolveVehicleRoute(v, approach, static_cast<uint16_t>(preferred_lane_idx), v.movement)) {
-                            bool resolved = false;
-                            if (!preferred_lane_cfg.allowed_movements.empty()) {
-                                resolved = resolveVehicleRoute(v,
-                                                               approach,
-                                                               static_cast<uint16_t>(preferred_lane_idx),
-                                                               preferred_lane_cfg.allowed_movements.front());
-                            } else {
-                                resolved = resolveVehicleRoute(
-                                    v, approach, static_cast<uint16_t>(preferred_lane_idx), MovementType::Straight);
-                            }
-
-                            if (!resolved) {
-                                continue;
-                            }
-                        }
-                    } else {
-                        use_configured_spawns = false;
+        if (spawn_lane_filter.has_value() && spawn_lane_filter->approach != approach) {
+            return;
+        }
+        if (const ApproachConfig* mix_approach = getApproachConfig(dir)) {
+            v.vehicle_class = chooseVehicleClass(mix_approach->vehicle_mix, v.id);
+        }
+
+        if (use_configured_spawns) {
+            size_t approach_idx = approachArrayIndex(approach);
+            const auto& approach_cfg = intersection_config.approaches[approach_idx];
+
+            if (!approach_cfg.lanes.empty()) {
+                std::vector<size_t>& connected_lane_indices = spawn_lane_indices;
+                connected_lane_indices.clear();
+                for (size_t lane_idx = 0; lane_idx < approach_cfg.lanes.size(); ++lane_idx) {
+                    if (approach_cfg.lanes[lane_idx].connected_to_intersection) {
+                        connected_lane_indices.push_back(lane_idx);
                     }
                 }
 
-                if (!use_configured_spawns) {
-                    if (spawn_lane_filter.has_value() && spawn_lane_filter->approach == approach) {
-                        const uint16_t focused_lane = spawn_lane_filter->lane_index;
-                        if (focused_lane > 2) {
-                            continue;
-                        }
+                if (spawn_lane_filter.has_value() && spawn_lane_filter->approach == approach) {
+                    connected_lane_indices.erase(
+                        std::remove_if(
+                            connected_lane_indices.begin(),
+                            connected_lane_indices.end(),
+                            [&](size_t lane_idx) { return lane_idx != spawn_lane_filter->lane_index; }),
+                        connected_lane_indices.end());
+                }
 
-                        v.queue_index = static_cast<uint8_t>(focused_lane);
-                        v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + focused_lane);
-                        v.turning = (focused_lane == 2);
-                        v.movement = v.turning ? MovementType::Right : MovementType::Straight;
-                    } else {
-                        v.turning = (v.id % 5 == 0);
-
-                        if (v.turning) {
-                            v.queue_index = 2;
-                            v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + 2);
-                            v.movement = MovementType::Right;
-                        } else {
-                            auto& queue = getQueueByDirection(dir);
-                            size_t straight_count = 0;
-                            for (const auto& veh : queue) {
-                                if (!veh.turning)
-                                    straight_count++;
-                            }
-                            v.queue_index = straight_count % 2;
-                            v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + v.queue_index);
-                            v.movement = MovementType::Straight;
+                if (connected_lane_indices.empty()) {
+                    return;
+                }
+
+                size_t cursor_slot = spawn_lane_cursor[approach_idx] % connected_lane_indices.size();
+                size_t cursor = connected_lane_indices[cursor_slot];
+                const auto& lane_cfg = approach_cfg.lanes[cursor];
+                spawn_lane_cursor[approach_idx] = (cursor_slot + 1) % connected_lane_indices.size();
+
+                std::vector<MovementType>& available_movements = spawn_movements;
+                available_movements.clear();
+                for (size_t lane_idx : connected_lane_indices) {
+                    const auto& lane = approach_cfg.lanes[lane_idx];
+                    for (MovementType movement : lane.allowed_movements) {
+                        if (std::find(available_movements.begin(), available_movements.end(), movement) ==
+                            available_movements.end()) {
+                            available_movements.push_back(movement);
                         }
                     }
+                }
 
-                    v.destination_approach = destinationApproachFor(approach, v.movement);
-                    v.destination_lane_index = v.queue_index;
-                    v.destination_lane_id = laneIdFor(v.destination_approach, v.destination_lane_index);
+                if (!available_movements.empty()) {
+                    size_t movement_idx = chooseSpawnMovementIndex(available_movements, v.id);
+                    v.movement = available_movements[movement_idx];
+                } else {
+                    v.movement = MovementType::Straight;
                 }
 
-                auto& queue = getQueueByDirection(dir);
+                size_t preferred_lane_idx = choosePreferredLaneIndex(approach_cfg, v.movement, cursor);
+                const auto& preferred_lane_cfg = approach_cfg.lanes[preferred_lane_idx];
 
-                if (spawn_lane_filter.has_value()) {
-                    const auto& filter = *spawn_lane_filter;
-                    if (filter.approach != approach) {
-                        continue;
-                    }
+                v.queue_index = static_cast<uint8_t>(preferred_lane_idx % 3);
+                v.lane_id = preferred_lane_cfg.id;
+                v.lane_change_allowed = preferred_lane_cfg.supports_lane_change;
 
-                    size_t spawned_lane_index = static_cast<size_t>(v.queue_index);
-                    if (use_configured_spawns) {
-                        size_t approach_idx = approachArrayIndex(approach);
-                        const auto& approach_cfg = intersection_config.approaches[approach_idx];
-                        auto lane_it = std::find_if(approach_cfg.lanes.begin(),
-                                                    approach_cfg.lanes.end(),
-                                                    [&](const LaneConfig& lane) { return lane.id == v.lane_id; });
-                        if (lane_it == approach_cfg.lanes.end()) {
-                            continue;
-                        }
-                        spawned_lane_index = static_cast<size_t>(std::distance(approach_cfg.lanes.begin(), lane_it));
+                if (!resolveVehicleRoute(v, approach, static_cast<uint16_t>(preferred_lane_idx), v.movement)) {
+                    bool resolved = false;
+                    if (!preferred_lane_cfg.allowed_movements.empty()) {
+                        resolved = resolveVehicleRoute(v,
+                                                       approach,
+                                                       static_cast<uint16_t>(preferred_lane_idx),
+                                                       preferred_lane_cfg.allowed_movements.front());
+                    } else {
+                        resolved = resolveVehicleRoute(
+                            v, approach, static_cast<uint16_t>(preferred_lane_idx), MovementType::Straight);
                     }
 
-                    if (spawned_lane_index != static_cast<size_t>(filter.lane_index)) {
-                        continue;
+                    if (!resolved) {
+                        return;
                     }
                 }
+            } else {
+                return;  // An absent arm (e.g. the missing leg of a T-junction) has no traffic
+            }
+        }
 
-                if (queue.size() >= MAX_QUEUE_SIZE_PER_DIRECTION) {
-                    continue;
+        if (!use_configured_spawns) {
+            if (spawn_lane_filter.has_value() && spawn_lane_filter->approach == approach) {
+                const uint16_t focused_lane = spawn_lane_filter->lane_index;
+                if (focused_lane > 2) {
+                    return;
                 }
 
-                const size_t same_lane_count = static_cast<size_t>(std::count_if(
-                    queue.begin(), queue.end(), [&](const Vehicle& other) { return other.lane_id == v.lane_id; }));
-                if (same_lane_count >= MAX_QUEUE_SIZE_PER_LANE) {
-                    continue;
+                v.queue_index = static_cast<uint8_t>(focused_lane);
+                v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + focused_lane);
+                v.turning = (focused_lane == 2);
+                v.movement = v.turning ? MovementType::Right : MovementType::Straight;
+            } else {
+                v.turning = (v.id % 5 == 0);
+
+                if (v.turning) {
+                    v.queue_index = 2;
+                    v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + 2);
+                    v.movement = MovementType::Right;
+                } else {
+                    auto& queue = getQueueByDirection(dir);
+                    size_t straight_count = 0;
+                    for (std::size_t c = 0; c < kVehicleClassCount; ++c) {
+                        straight_count += crossingQueue(dir, false, static_cast<VehicleClass>(c)).size();
+                    }
+                    for (const auto& veh : queue) {
+                        if (!veh.turning)
+                            straight_count++;
+                    }
+                    v.queue_index = straight_count % 2;
+                    v.lane_id = static_cast<LaneId>(static_cast<int>(dir) * 100 + v.queue_index);
+                    v.movement = MovementType::Straight;
                 }
+            }
 
-                const bool lane_entry_blocked = std::any_of(queue.begin(), queue.end(), [&](const Vehicle& other) {
-                    return other.lane_id == v.lane_id && other.position_in_lane < MIN_FRONT_DISTANCE_METERS;
-                });
-                if (lane_entry_blocked) {
-                    continue;
+            v.destination_approach = destinationApproachFor(approach, v.movement);
+            v.destination_lane_index = v.queue_index;
+            v.destination_lane_id = laneIdFor(v.destination_approach, v.destination_lane_index);
+        }
+
+        if (spawn_lane_filter.has_value()) {
+            const auto& filter = *spawn_lane_filter;
+            if (filter.approach != approach) {
+                return;
+            }
+
+            size_t spawned_lane_index = static_cast<size_t>(v.queue_index);
+            if (use_configured_spawns) {
+                size_t approach_idx = approachArrayIndex(approach);
+                const auto& approach_cfg = intersection_config.approaches[approach_idx];
+                auto lane_it = std::find_if(approach_cfg.lanes.begin(),
+                                            approach_cfg.lanes.end(),
+                                            [&](const LaneConfig& lane) { return lane.id == v.lane_id; });
+                if (lane_it == approach_cfg.lanes.end()) {
+                    return;
                 }
+                spawned_lane_index = static_cast<size_t>(std::distance(approach_cfg.lanes.begin(), lane_it));
+            }
+
+            if (spawned_lane_index != static_cast<size_t>(filter.lane_index)) {
+                return;
+            }
+        }
+
+        const ApproachConfig* spawn_approach = getApproachConfig(dir);
+        if (mesoscopic) {
+            if (!use_configured_spawns || !spawn_approach) {
+                return;
+            }
+            const size_t lane_index = laneIndexOf(*spawn_approach, v.lane_id);
+            if (lane_index >= spawn_approach->lanes.size() ||
+                meso_queues.queuedOnLane(approach, lane_index) >= effectiveLaneCapacity(*spawn_approach)) {
+                return;
+            }
+            // Zelfde instroomregel als microscopisch: het vorige voertuig moet zijn lengte plus 2m vrijgemaakt hebben.
+            const auto& lane_vehicles = meso_queues.approach(approach).lanes[lane_index].vehicles;
+            const double free_flow_speed = std::max(mesoscopic_settings.free_flow_speed, 0.1);
+            if (!lane_vehicles.empty() && current_time - lane_vehicles.back().spawn_time <
+                                              standstillSpacing(lane_vehicles.back().vehicle_class) / free_flow_speed) {
+                return;
+            }
+
+            v.id = next_vehicle_id++;
+            total_generated++;
+            meso_queues.admit(approach,
+                              lane_index,
+                              v.id,
+                              v.movement,
+                              v.vehicle_class,
+                              {v.destination_approach, v.destination_lane_index, v.destination_lane_id},
+                              current_time,
+                              current_time + spawn_approach->length_m / free_flow_speed);
+            ++demand_version;
+            return;
+        }
 
-                v.id = next_vehicle_id++;
-                total_generated++;
-                v.position_in_lane = 0.0;
-                queue.push_back(v);
+        auto& queue = getQueueByDirection(dir);
+        size_t same_lane_count = 0;
+        bool lane_entry_blocked = false;
+        for (const Vehicle& other : queue) {
+            if (other.lane_id == v.lane_id) {
+                ++same_lane_count;
+                lane_entry_blocked =
+                    lane_entry_blocked || other.position_in_lane < standstillSpacing(other.vehicle_class);
+            }
+        }
+        for (const VehicleQueue& crossing : crossing_queues[static_cast<std::size_t>(dir)]) {
+            for (const Vehicle& other : crossing) {
+                same_lane_count += other.lane_id == v.lane_id ? 1 : 0;
             }
         }
+        if (lane_entry_blocked || (spawn_approach && same_lane_count >= effectiveLaneCapacity(*spawn_approach))) {
+            return;
+        }
+
+        v.id = next_vehicle_id++;
+        total_generated++;
+        v.position_in_lane = 0.0;
+        queue.push_back(v);
+        ++demand_version;
     }
 
     bool TrafficGenerator::startCrossing(Direction lane, uint32_t vehicle_id, double current_time) {
@@ -519,44 +650,73 @@ namespace crossroads {
         if (front.id != vehicle_id)
             return false;
 
-        front.crossing_time = current_time;
+        startCrossingAt(lane, 0, current_time);
         return true;
     }
 
-    bool TrafficGenerator::completeCrossing(uint32_t vehicle_id, double current_time) {
-        for (auto dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
-            auto& queue = getQueueByDirection(dir);
+    void TrafficGenerator::startCrossingAt(Direction lane, std::size_t queue_index, double current_time) {
+        auto& queue = getQueueByDirection(lane);
+        Vehicle& vehicle = queue[queue_index];
+        vehicle.crossing_time = current_time;
+        crossingQueue(lane, vehicle.turning, vehicle.vehicle_class).push_back(vehicle);
+        queue.erase(queue.begin() + static_cast<std::ptrdiff_t>(queue_index));
+        ++demand_version;
+    }
 
-            auto it = std::find_if(
-                queue.begin(), queue.end(), [vehicle_id](const Vehicle& vehicle) { return vehicle.id == vehicle_id; });
-            if (it != queue.end()) {
-                Vehicle crossed = *it;
-                queue.erase(it);
-                crossed.exit_time = current_time;
-                crossed_vehicles.push_back(crossed);
-                return true;
+    bool TrafficGenerator::completeCrossing(uint32_t vehicle_id) {
+        // Only the short crossing lists are searched; the engine completes through completeFinishedCrossings.
+        for (auto& approach_crossing : crossing_queues) {
+            for (auto& crossing : approach_crossing) {
+                auto it = std::find_if(crossing.begin(), crossing.end(), [vehicle_id](const Vehicle& vehicle) {
+                    return vehicle.id == vehicle_id;
+                });
+                if (it != crossing.end()) {
+                    total_crossed++;
+                    total_crossed_wait_seconds += it->waitTime();
+                    crossing.erase(it);
+                    ++demand_version;
+                    return true;
+                }
             }
         }
 
         return false;
     }
 
+    std::size_t TrafficGenerator::completeFinishedCrossings(Direction lane, double current_time) {
+        const std::size_t approach_vehicles = getQueueLength(lane);
+        std::size_t completed = 0;
+        for (VehicleQueue& crossing : crossing_queues[static_cast<std::size_t>(lane)]) {
+            while (!crossing.empty() &&
+                   current_time - crossing.front().crossing_time >=
+                       crossing.front().getCrossingDuration(approach_vehicles)) {
+                total_crossed++;
+                total_crossed_wait_seconds += crossing.front().waitTime();
+                crossing.pop_front();
+                ++completed;
+            }
+        }
+        demand_version += completed;
+        return completed;
+    }
+
     size_t TrafficGenerator::getQueueLength(Direction lane) const {
-        switch (lane) {
-            case Direction::North:
-                return north_queue.size();
-            case Direction::South:
-                return south_queue.size();
-            case Direction::East:
-                return east_queue.size();
-            case Direction::West:
-                return west_queue.size();
+        if (mesoscopic) {
+            return meso_queues.vehicleCount(approachFromDirection(lane));
         }
-        return 0;
+        std::size_t count = getQueueByDirection(lane).size();
+        for (const VehicleQueue& crossing : crossing_queues[static_cast<std::size_t>(lane)]) {
+            count += crossing.size();
+        }
+        return count;
     }
 
     size_t TrafficGenerator::getTotalWaiting() const {
-        return north_queue.size() + south_queue.size() + east_queue.size() + west_queue.size();
+        std::size_t total = 0;
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            total += getQueueLength(dir);
+        }
+        return total;
     }
 
     Vehicle* TrafficGenerator::peekNextVehicle(Direction lane) {
@@ -565,15 +725,10 @@ namespace crossroads {
     }
 
     double TrafficGenerator::getAverageWaitTime() const {
-        if (crossed_vehicles.empty())
+        if (total_crossed == 0)
             return 0.0;
 
-        double total_wait = 0.0;
-        for (const auto& v : crossed_vehicles) {
-            total_wait += v.waitTime();
-        }
-
-        return total_wait / crossed_vehicles.size();
+        return total_crossed_wait_seconds / total_crossed;
     }
 
     void TrafficGenerator::reset() {
@@ -581,163 +736,413 @@ namespace crossroads {
         south_queue.clear();
         east_queue.clear();
         west_queue.clear();
-        crossed_vehicles.clear();
+        for (auto& approach_crossing : crossing_queues) {
+            for (auto& crossing : approach_crossing) {
+                crossing.clear();
+            }
+        }
+        meso_queues.clear();
+        total_crossed = 0;
+        total_crossed_wait_seconds = 0.0;
         time_accumulated = 0.0;
+        approach_time_accumulated = {0.0, 0.0, 0.0, 0.0};
         next_vehicle_id = 1;
         total_generated = 0;
+        ++demand_version;
     }
 
-    void TrafficGenerator::updateVehicleSpeeds(
-        double dt_seconds,
-        const std::array<bool, 4>& lane_can_move,
-        const std::function<bool(Direction, const Vehicle&)>& can_vehicle_move_override) {
-        const double STOP_LINE_POSITION = 70.0;
-        const double STOP_TARGET = STOPLINE_TARGET_METERS;  // 0.5m voor de streep
-        const double MAX_SPEED = 10.0;                      // m/s
-        const double BRAKE_DECEL = 4.5;                     // m/s^2
-
-        for (int dir = 0; dir < 4; ++dir) {
-            Direction d = static_cast<Direction>(dir);
-            auto& queue = getQueueByDirection(d);
+    void TrafficGenerator::copyDynamicStateFrom(const TrafficGenerator& other) {
+        use_configured_spawns = other.use_configured_spawns;
+        spawn_lane_cursor = other.spawn_lane_cursor;
+        spawn_lane_filter = other.spawn_lane_filter;
+        arrival_rate = other.arrival_rate;
+        time_accumulated = other.time_accumulated;
+        approach_arrival_rates = other.approach_arrival_rates;
+        approach_time_accumulated = other.approach_time_accumulated;
+        next_vehicle_id = other.next_vehicle_id;
+        total_generated = other.total_generated;
+        north_queue = other.north_queue;
+        east_queue = other.east_queue;
+        south_queue = other.south_queue;
+        west_queue = other.west_queue;
+        crossing_queues = other.crossing_queues;
+        mesoscopic = other.mesoscopic;
+        mesoscopic_settings = other.mesoscopic_settings;
+        meso_queues = other.meso_queues;
+        total_crossed = other.total_crossed;
+        total_crossed_wait_seconds = other.total_crossed_wait_seconds;
+        demand_version = other.demand_version;
+    }
 
-            maybeApplyLaneChanges(d, queue);
+    bool TrafficGenerator::migrateWaitingVehicle(const ApproachConfig& approach, Vehicle& vehicle) const {
+        for (std::size_t lane_index = 0; lane_index < approach.lanes.size(); ++lane_index) {
+            const LaneConfig& lane = approach.lanes[lane_index];
+            if (lane.id != vehicle.lane_id) {
+                continue;
+            }
+            if (!lane.connected_to_intersection) {
+                return false;
+            }
 
-            for (size_t i = 0; i < queue.size(); ++i) {
-                Vehicle& vehicle = queue[i];
+            vehicle.lane_change_allowed = lane.supports_lane_change;
+            const auto index = static_cast<uint16_t>(lane_index);
+            if (laneAllowsMovement(lane, vehicle.movement) &&
+                resolveVehicleRoute(vehicle, approach.id, index, vehicle.movement)) {
+                return true;
+            }
+            for (MovementType movement : lane.allowed_movements) {
+                if (resolveVehicleRoute(vehicle, approach.id, index, movement)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return false;
+    }
 
-                if (vehicle.isCrossing())
-                    continue;  // Already crossing, skip speed updates
+    std::size_t TrafficGenerator::reconfigure(const IntersectionConfig& config) {
+        std::array<double, 4> previous_lengths{};
+        for (std::size_t i = 0; i < previous_lengths.size(); ++i) {
+            previous_lengths[i] = intersection_config.approaches[i].length_m;
+        }
+        intersection_config = config;
+        use_configured_spawns = true;
 
-                bool can_move = lane_can_move[dir];
-                if (can_vehicle_move_override) {
-                    can_move = can_vehicle_move_override(d, vehicle);
+        std::size_t removed = mesoscopic ? meso_queues.configure(intersection_config) : 0;
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            const ApproachConfig* approach = getApproachConfig(dir);
+            auto& queue = getQueueByDirection(dir);
+            // A longer or shorter approach keeps each waiting vehicle's distance to the stop line.
+            const double shift = approach ? approach->length_m - previous_lengths[approachIndex(approach->id)] : 0.0;
+            for (auto it = queue.begin(); it != queue.end();) {
+                if (approach && migrateWaitingVehicle(*approach, *it)) {
+                    if (shift != 0.0) {
+                        it->position_in_lane =
+                            std::clamp(it->position_in_lane + shift, 0.0, stopTargetPosition(*approach));
+                    }
+                    ++it;
+                    continue;
                 }
+                it = queue.erase(it);
+                ++removed;
+            }
+        }
+        ++demand_version;
+        return removed;
+    }
 
-                double target_speed = MAX_SPEED;
+    namespace {
+        void saveVehicle(StateWriter& writer, const Vehicle& vehicle) {
+            writer.u32(vehicle.id);
+            writer.u8(static_cast<uint8_t>(vehicle.entry_lane));
+            writer.f64(vehicle.arrival_time);
+            writer.f64(vehicle.crossing_time);
+            writer.f64(vehicle.exit_time);
+            writer.f64(vehicle.current_speed);
+            writer.f64(vehicle.position_in_lane);
+            writer.boolean(vehicle.turning);
+            writer.u8(vehicle.queue_index);
+            writer.u16(vehicle.lane_id);
+            writer.u8(static_cast<uint8_t>(vehicle.movement));
+            writer.u8(static_cast<uint8_t>(vehicle.destination_approach));
+            writer.u16(vehicle.destination_lane_index);
+            writer.u16(vehicle.destination_lane_id);
+            writer.boolean(vehicle.lane_change_allowed);
+            writer.u8(static_cast<uint8_t>(vehicle.vehicle_class));
+        }
 
-                // Nearest non-crossing vehicle ahead in the SAME lane (queue_index)
-                int ahead_idx = static_cast<int>(i) - 1;
-                while (ahead_idx >= 0) {
-                    const Vehicle& ahead = queue[static_cast<size_t>(ahead_idx)];
-                    if (!ahead.isCrossing() && ahead.lane_id == vehicle.lane_id)
-                        break;
-                    --ahead_idx;
-                }
-                const bool has_ahead = ahead_idx >= 0;
+        Vehicle loadVehicle(StateReader& reader) {
+            const uint32_t id = reader.u32();
+            const uint8_t entry_lane = reader.u8();
+            Vehicle vehicle(id, static_cast<Direction>(entry_lane & 3), reader.f64());
+            vehicle.crossing_time = reader.f64();
+            vehicle.exit_time = reader.f64();
+            vehicle.current_speed = reader.f64();
+            vehicle.position_in_lane = reader.f64();
+            vehicle.turning = reader.boolean();
+            vehicle.queue_index = reader.u8();
+            vehicle.lane_id = reader.u16();
+            const uint8_t movement = reader.u8();
+            const uint8_t destination_approach = reader.u8();
+            vehicle.destination_lane_index = reader.u16();
+            vehicle.destination_lane_id = reader.u16();
+            vehicle.lane_change_allowed = reader.boolean();
+            const uint8_t vehicle_class = reader.u8();
+            if (entry_lane > 3 || movement > 2 || destination_approach > 3 || vehicle_class >= kVehicleClassCount) {
+                reader.fail();
+            }
+            vehicle.vehicle_class = static_cast<VehicleClass>(vehicle_class % kVehicleClassCount);
+            vehicle.movement = static_cast<MovementType>(movement % 3);
+            vehicle.destination_approach = static_cast<ApproachId>(destination_approach & 3);
+            return vehicle;
+        }
+    }  // namespace
 
-                // Desired following distance: stopped 2m gap; moving time-gap
-                auto getDesiredGap = [](double speed) {
-                    if (speed < 0.5) {
-                        return MIN_FRONT_DISTANCE_METERS;  // 6m front-to-front (4m car + 2m gap)
-                    }
-                    return CAR_LENGTH_METERS + FOLLOWING_TIME_SECONDS * speed;
-                };
-
-                // Compute target position respecting stop target and front vehicle in same lane
-                double target_position = STOP_TARGET;
-                if (has_ahead) {
-                    const Vehicle& ahead = queue[static_cast<size_t>(ahead_idx)];
-                    target_position = std::min(target_position, ahead.position_in_lane - MIN_FRONT_DISTANCE_METERS);
+    void TrafficGenerator::saveState(StateWriter& writer) const {
+        for (std::size_t cursor : spawn_lane_cursor) {
+            writer.u32(static_cast<uint32_t>(cursor));
+        }
+        writer.boolean(spawn_lane_filter.has_value());
+        if (spawn_lane_filter.has_value()) {
+            writer.u8(static_cast<uint8_t>(spawn_lane_filter->approach));
+            writer.u16(spawn_lane_filter->lane_index);
+        }
+        writer.f64(arrival_rate);
+        writer.f64(time_accumulated);
+        writer.boolean(approach_arrival_rates.has_value());
+        if (approach_arrival_rates.has_value()) {
+            writer.f64Array(*approach_arrival_rates);
+        }
+        writer.f64Array(approach_time_accumulated);
+        writer.u32(next_vehicle_id);
+        writer.u32(total_generated);
+        writer.u64(demand_version);
+        writer.u32(total_crossed);
+        writer.f64(total_crossed_wait_seconds);
+        for (const auto* queue : {&north_queue, &east_queue, &south_queue, &west_queue}) {
+            writer.u32(static_cast<uint32_t>(queue->size()));
+            for (const Vehicle& vehicle : *queue) {
+                saveVehicle(writer, vehicle);
+            }
+        }
+        for (const auto& approach_crossing : crossing_queues) {
+            for (const auto& crossing : approach_crossing) {
+                writer.u32(static_cast<uint32_t>(crossing.size()));
+                for (const Vehicle& vehicle : crossing) {
+                    saveVehicle(writer, vehicle);
                 }
+            }
+        }
+        writer.boolean(mesoscopic);
+        writer.f64(mesoscopic_settings.saturation_flow_per_hour);
+        writer.f64(mesoscopic_settings.free_flow_speed);
+        meso_queues.saveState(writer);
+    }
 
-                if (has_ahead) {
-                    const Vehicle& ahead = queue[static_cast<size_t>(ahead_idx)];
-                    double spacing = ahead.position_in_lane - vehicle.position_in_lane;
-                    double desired_gap = getDesiredGap(vehicle.current_speed);
-
-                    if (can_move) {
-                        // Time-gap following
-                        if (spacing < desired_gap) {
-                            double ratio = spacing / desired_gap;
-                            target_speed =
-                                std::min(target_speed, ahead.current_speed + (MAX_SPEED - ahead.current_speed) * ratio);
-                        }
-                        if (spacing < MIN_FRONT_DISTANCE_METERS) {
-                            target_speed = 0.0;
-                        }
-                    } else {
-                        // Red/orange: brake to stop target (or behind front car)
-                        double dist_to_target = target_position - vehicle.position_in_lane;
-                        if (dist_to_target <= 0.0) {
-                            target_speed = 0.0;
-                        } else {
-                            double safe_speed = std::sqrt(2.0 * BRAKE_DECEL * dist_to_target);
-                            target_speed = std::min(target_speed, safe_speed);
-                        }
-                    }
-                } else {
-                    // No vehicle ahead
-                    if (!can_move && vehicle.position_in_lane < STOP_LINE_POSITION) {
-                        double dist_to_stop = STOP_TARGET - vehicle.position_in_lane;
-                        if (dist_to_stop <= 0.0) {
-                            target_speed = 0.0;
-                        } else {
-                            double safe_speed = std::sqrt(2.0 * BRAKE_DECEL * dist_to_stop);
-                            target_speed = std::min(target_speed, safe_speed);
-                        }
+    bool TrafficGenerator::loadState(StateReader& reader) {
+        std::array<size_t, 4> saved_cursor{};
+        for (std::size_t& cursor : saved_cursor) {
+            cursor = reader.u32();
+        }
+        std::optional<SpawnLaneFilter> saved_filter;
+        if (reader.boolean()) {
+            SpawnLaneFilter filter;
+            const uint8_t approach = reader.u8();
+            filter.approach = static_cast<ApproachId>(approach & 3);
+            filter.lane_index = reader.u16();
+            if (approach > 3) {
+                reader.fail();
+            }
+            saved_filter = filter;
+        }
+        const double saved_arrival_rate = reader.f64();
+        const double saved_time_accumulated = reader.f64();
+        std::optional<std::array<double, 4>> saved_approach_rates;
+        if (reader.boolean()) {
+            std::array<double, 4> rates{};
+            reader.f64Array(rates);
+            saved_approach_rates = rates;
+        }
+        std::array<double, 4> saved_approach_time{};
+        reader.f64Array(saved_approach_time);
+        const uint32_t saved_next_vehicle_id = reader.u32();
+        const uint32_t saved_total_generated = reader.u32();
+        const uint64_t saved_demand_version = reader.u64();
+        const uint32_t saved_total_crossed = reader.u32();
+        const double saved_crossed_wait = reader.f64();
+
+        std::array<VehicleQueue, 4> saved_queues;
+        for (auto& queue : saved_queues) {
+            const uint32_t count = reader.u32();
+            for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+                queue.push_back(loadVehicle(reader));
+            }
+        }
+        std::array<std::array<VehicleQueue, kCrossingListCount>, 4> saved_crossing;
+        for (std::size_t dir = 0; dir < saved_crossing.size(); ++dir) {
+            for (std::size_t list = 0; list < kCrossingListCount; ++list) {
+                const uint32_t count = reader.u32();
+                for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+                    const Vehicle vehicle = loadVehicle(reader);
+                    if (static_cast<std::size_t>(vehicle.entry_lane) != dir ||
+                        crossingListIndex(vehicle.turning, vehicle.vehicle_class) != list || !vehicle.isCrossing()) {
+                        reader.fail();
                     }
+                    saved_crossing[dir][list].push_back(vehicle);
                 }
+            }
+        }
+        const bool saved_mesoscopic = reader.boolean();
+        MesoscopicSettings saved_settings;
+        saved_settings.saturation_flow_per_hour = reader.f64();
+        saved_settings.free_flow_speed = reader.f64();
+        MesoscopicQueues saved_meso = meso_queues;
+        if (!reader.ok() || !saved_meso.loadState(reader)) {
+            return false;
+        }
 
-                vehicle.updateSpeed(target_speed, dt_seconds);
+        spawn_lane_cursor = saved_cursor;
+        spawn_lane_filter = saved_filter;
+        arrival_rate = saved_arrival_rate;
+        time_accumulated = saved_time_accumulated;
+        approach_arrival_rates = saved_approach_rates;
+        approach_time_accumulated = saved_approach_time;
+        next_vehicle_id = saved_next_vehicle_id;
+        total_generated = saved_total_generated;
+        demand_version = saved_demand_version;
+        total_crossed = saved_total_crossed;
+        total_crossed_wait_seconds = saved_crossed_wait;
+        north_queue = std::move(saved_queues[0]);
+        east_queue = std::move(saved_queues[1]);
+        south_queue = std::move(saved_queues[2]);
+        west_queue = std::move(saved_queues[3]);
+        crossing_queues = std::move(saved_crossing);
+        mesoscopic = saved_mesoscopic;
+        mesoscopic_settings = saved_settings;
+        meso_queues = std::move(saved_meso);
+        return true;
+    }
 
-                // Update position
-                if (!vehicle.isCrossing()) {
-                    vehicle.position_in_lane += vehicle.current_speed * dt_seconds;
+    void TrafficGenerator::updateVehicleSpeeds(
+        double dt_seconds,
+        const std::array<bool, 4>& lane_can_move,
+        const MovementPermissions* permissions) {
+        // Vehicles only interact with the vehicle ahead in the same lane, so each lane is one contiguous run of
+        // queue indices in queue order and the vehicle ahead is the previous entry. The lanes of all approaches go
+        // into one batch for the car-following kernel.
+        std::size_t lane_total = 0;
+        for (int dir = 0; dir < 4; ++dir) {
+            Direction d = static_cast<Direction>(dir);
+            auto& queue = getQueueByDirection(d);
+            maybeApplyLaneChanges(d, queue);
+            lane_order_begin[dir] = lane_total;
+            lane_total = buildLaneOrder(queue, lane_total);
+        }
+        lane_order_begin[4] = lane_total;
 
-                    // Clamp to stop target if red/orange
-                    if (!can_move) {
-                        if (vehicle.position_in_lane > target_position) {
-                            vehicle.position_in_lane = target_position;
-                            vehicle.current_speed = 0.0;
-                        }
-                    }
+        std::size_t ranks = 0;
+        for (std::size_t lane = 0; lane < lane_total; ++lane) {
+            ranks = std::max(ranks, lane_order[lane].size());
+        }
+        car_following.reset(lane_total, ranks);
 
-                    // Maintain minimum distance behind vehicle ahead
-                    if (has_ahead) {
-                        const Vehicle& ahead = queue[static_cast<size_t>(ahead_idx)];
-                        double max_pos = ahead.position_in_lane - MIN_FRONT_DISTANCE_METERS;
-                        if (vehicle.position_in_lane > max_pos) {
-                            vehicle.position_in_lane = max_pos;
-                            vehicle.current_speed = std::min(vehicle.current_speed, ahead.current_speed);
-                        }
+        for (int dir = 0; dir < 4; ++dir) {
+            Direction d = static_cast<Direction>(dir);
+            const auto& queue = getQueueByDirection(d);
+            const ApproachConfig* approach = getApproachConfig(d);
+            const double STOP_LINE_POSITION = approach ? approach->length_m : kDefaultApproachLengthMeters;
+            const double STOP_TARGET = STOP_LINE_POSITION - kStopTargetOffsetMeters;
+
+            for (std::size_t lane = lane_order_begin[dir]; lane < lane_order_begin[dir + 1]; ++lane) {
+                car_following.setLane(lane, STOP_LINE_POSITION, STOP_TARGET, lane_order[lane].size());
+                uint16_t lane_permissions = 0;
+                if (permissions) {
+                    const auto& configured = permissions->lanes[dir];
+                    const std::size_t lane_index =
+                        approach ? laneIndexOf(*approach, lane_order_ids[lane]) : configured.size();
+                    lane_permissions =
+                        lane_index < configured.size() ? configured[lane_index] : permissions->unconfigured[dir];
+                }
+                for (std::size_t rank = 0; rank < lane_order[lane].size(); ++rank) {
+                    const Vehicle& vehicle = queue[lane_order[lane][rank]];
+                    const bool can_move =
+                        permissions
+                            ? (lane_permissions & MovementPermissions::bit(vehicle.movement,
+                                                                           vehicle.destination_approach)) != 0
+                            : lane_can_move[dir];
+                    car_following.setVehicle(rank, lane, vehicle, can_move);
+                }
+            }
+        }
+
+        advanceCarFollowing(car_following, dt_seconds);
+
+        for (int dir = 0; dir < 4; ++dir) {
+            auto& queue = getQueueByDirection(static_cast<Direction>(dir));
+            for (std::size_t lane = lane_order_begin[dir]; lane < lane_order_begin[dir + 1]; ++lane) {
+                for (std::size_t rank = 0; rank < lane_order[lane].size(); ++rank) {
+                    Vehicle& vehicle = queue[lane_order[lane][rank]];
+                    const std::size_t slot = car_following.slot(rank, lane);
+                    const bool was_stopped = vehicle.current_speed <= STOPPED_SPEED_THRESHOLD;
+                    vehicle.position_in_lane = car_following.position[slot];
+                    vehicle.current_speed = car_following.speed[slot];
+                    if (was_stopped != (vehicle.current_speed <= STOPPED_SPEED_THRESHOLD)) {
+                        ++demand_version;
                     }
                 }
             }
         }
     }
 
+    std::size_t TrafficGenerator::buildLaneOrder(const VehicleQueue& queue, std::size_t first_lane) {
+        std::size_t lane_count = first_lane;
+        for (std::size_t i = 0; i < queue.size(); ++i) {
+            const Vehicle& vehicle = queue[i];
+            // An approach has a handful of lanes, so a linear search beats hashing.
+            std::size_t lane = first_lane;
+            while (lane < lane_count && lane_order_ids[lane] != vehicle.lane_id) {
+                ++lane;
+            }
+            if (lane == lane_count) {
+                if (lane_count == lane_order.size()) {
+                    lane_order.emplace_back();
+                    lane_order_ids.push_back(vehicle.lane_id);
+                }
+                lane_order_ids[lane_count] = vehicle.lane_id;
+                lane_order[lane_count].clear();
+                ++lane_count;
+            }
+            lane_order[lane].push_back(static_cast<uint32_t>(i));
+        }
+        return lane_count;
+    }
+
     double TrafficGenerator::getAverageQueueDensity(Direction dir) const {
-        return std::min(1.0, static_cast<double>(getQueueByDirection(dir).size()) / LANE_CAPACITY);
+        const ApproachConfig* approach = getApproachConfig(dir);
+        const std::size_t capacity =
+            approach ? std::max<std::size_t>(approach->lanes.size(), 1) * effectiveLaneCapacity(*approach) : 1;
+        return std::min(1.0, static_cast<double>(getQueueLength(dir)) / static_cast<double>(capacity));
     }
 
     std::vector<LaneVehicleState> TrafficGenerator::getLaneVehicleStates(Direction dir) const {
         std::vector<LaneVehicleState> states;
-        const auto& queue = getQueueByDirection(dir);
-        states.reserve(queue.size());
-        const size_t queue_len = queue.size();
-
-        for (const auto& vehicle : queue) {
-            LaneVehicleState state;
-            state.id = vehicle.id;
-            state.position_in_lane = vehicle.position_in_lane;
-            state.speed = vehicle.current_speed;
-            state.crossing = vehicle.isCrossing();
-            state.turning = vehicle.turning;
-            state.crossing_time = vehicle.crossing_time;
-            state.crossing_duration = vehicle.getCrossingDuration(queue_len);
-            state.queue_index = vehicle.queue_index;
-            state.lane_id = vehicle.lane_id;
-            state.movement = vehicle.movement;
-            state.destination_approach = vehicle.destination_approach;
-            state.destination_lane_index = vehicle.destination_lane_index;
-            state.destination_lane_id = vehicle.destination_lane_id;
-            state.lane_change_allowed = vehicle.lane_change_allowed;
-            states.push_back(state);
-        }
-
+        getLaneVehicleStates(dir, states);
         return states;
     }
 
+    void TrafficGenerator::getLaneVehicleStates(Direction dir, std::vector<LaneVehicleState>& states) const {
+        states.clear();
+        const size_t queue_len = getQueueLength(dir);
+        states.reserve(queue_len);
+
+        // Waiting vehicles first, then the crossing ones
+        auto appendStates = [&](const VehicleQueue& queue) {
+            for (const auto& vehicle : queue) {
+                LaneVehicleState state;
+                state.id = vehicle.id;
+                state.position_in_lane = vehicle.position_in_lane;
+                state.speed = vehicle.current_speed;
+                state.crossing = vehicle.isCrossing();
+                state.turning = vehicle.turning;
+                state.crossing_time = vehicle.crossing_time;
+                state.crossing_duration = vehicle.getCrossingDuration(queue_len);
+                state.queue_index = vehicle.queue_index;
+                state.lane_id = vehicle.lane_id;
+                state.movement = vehicle.movement;
+                state.destination_approach = vehicle.destination_approach;
+                state.destination_lane_index = vehicle.destination_lane_index;
+                state.destination_lane_id = vehicle.destination_lane_id;
+                state.lane_change_allowed = vehicle.lane_change_allowed;
+                state.vehicle_class = vehicle.vehicle_class;
+                states.push_back(state);
+            }
+        };
+        appendStates(getQueueByDirection(dir));
+        for (const VehicleQueue& crossing : crossing_queues[static_cast<std::size_t>(dir)]) {
+            appendStates(crossing);
+        }
+    }
+
     void TrafficGenerator::setSpawnLaneFilter(const std::optional<SpawnLaneFilter>& filter) {
         spawn_lane_filter = filter;
         spawn_lane_cursor = {0, 0, 0, 0};
@@ -756,6 +1161,62 @@ namespace crossroads {
         return arrival_rate;
     }
 
+    void TrafficGenerator::setApproachArrivalRates(const std::optional<std::array<double, 4>>& rates) {
+        approach_arrival_rates = rates;
+        if (approach_arrival_rates.has_value()) {
+            for (double& rate : *approach_arrival_rates) {
+                rate = std::max(0.0, rate);
+            }
+        }
+        approach_time_accumulated = {0.0, 0.0, 0.0, 0.0};
+    }
+
+    std::optional<std::array<double, 4>> TrafficGenerator::getApproachArrivalRates() const {
+        return approach_arrival_rates;
+    }
+
+    double TrafficGenerator::getQueuedDelaySeconds(double current_time) const {
+        if (mesoscopic) {
+            return meso_queues.queuedDelaySeconds(current_time);
+        }
+        double total = 0.0;
+        for (const auto* queue : {&north_queue, &east_queue, &south_queue, &west_queue}) {
+            for (const auto& vehicle : *queue) {
+                total += std::max(0.0, current_time - vehicle.arrival_time);
+            }
+        }
+        return total;
+    }
+
+    void TrafficGenerator::setMesoscopic(bool enabled, const MesoscopicSettings& settings) {
+        mesoscopic_settings = settings;
+        if (enabled == mesoscopic) {
+            return;
+        }
+        mesoscopic = enabled;
+        north_queue.clear();
+        east_queue.clear();
+        south_queue.clear();
+        west_queue.clear();
+        meso_queues.clear();
+        if (mesoscopic) {
+            meso_queues.configure(intersection_config);
+        }
+        ++demand_version;
+    }
+
+    void TrafficGenerator::advanceMesoscopic(double dt_seconds,
+                                             double current_time,
+                                             const std::function<bool(Direction, const Vehicle&)>& may_go) {
+        const MesoscopicQueues::StepResult step = meso_queues.advance(
+            dt_seconds, current_time, mesoscopic_settings.saturation_flow_per_hour / 3600.0, may_go);
+        total_crossed += step.crossed;
+        total_crossed_wait_seconds += step.crossed_wait_seconds;
+        if (step.changed) {
+            ++demand_version;
+        }
+    }
+
     void TrafficGenerator::enforceSpawnLaneFilterOnExistingQueues() {
         if (!spawn_lane_filter.has_value()) {
             return;
@@ -781,16 +1242,25 @@ namespace crossroads {
             focused_lane_id = static_cast<LaneId>(static_cast<int>(target_direction) * 100 + target.lane_index);
         }
 
-        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
-            auto& queue = getQueueByDirection(dir);
+        const size_t vehicles_before = getTotalWaiting();
+        auto keepFocusedLane = [&](Direction dir, VehicleQueue& queue) {
             if (dir != target_direction) {
                 queue.clear();
-                continue;
+                return;
             }
 
             queue.erase(std::remove_if(
                             queue.begin(), queue.end(), [&](const Vehicle& v) { return v.lane_id != focused_lane_id; }),
                         queue.end());
+        };
+        for (Direction dir : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+            keepFocusedLane(dir, getQueueByDirection(dir));
+            for (VehicleQueue& crossing : crossing_queues[static_cast<std::size_t>(dir)]) {
+                keepFocusedLane(dir, crossing);
+            }
+        }
+        if (getTotalWaiting() != vehicles_before) {
+            ++demand_version;
         }
     }
 
@@ -0,0 +1,225 @@
+#include "TrainingEnvironment.hpp"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <utility>
+
+#include "ParallelFor.hpp"
+#include "SafetyChecker.hpp"
+
+namespace crossroads {
+    namespace {
+        constexpr std::size_t kFeaturesPerRoute = 4;
+
+        float lightValue(LightState light) {
+            switch (light) {
+                case LightState::Red:
+                    return 0.0f;
+                case LightState::Orange:
+                    return 0.5f;
+                case LightState::Green:
+                    return 1.0f;
+            }
+            return 0.0f;
+        }
+    }  // namespace
+
+    TrainingEnvironment::TrainingEnvironment(const IntersectionConfig& config, TrainingEnvironmentOptions options)
+        : options(options), engine(config, options.traffic_rate, 10.0, 10.0) {
+        action_count = ActionSignalController(config).phaseCount();
+        reset(0, nullptr);
+    }
+
+    std::size_t TrainingEnvironment::actionCount() const {
+        return action_count;
+    }
+
+    void TrainingEnvironment::reset(uint64_t seed, float* observation) {
+        engine.reset();
+
+        std::mt19937_64 rng(seed);
+        const double jitter = std::clamp(options.rate_jitter, 0.0, 1.0);
+        std::uniform_real_distribution<double> spread(1.0 - jitter, 1.0 + jitter);
+        std::array<double, 4> rates{};
+        for (double& rate : rates) {
+            rate = std::max(0.0, options.traffic_rate) * spread(rng);
+        }
+        engine.setApproachArrivalRates(rates);
+
+        auto controller = std::make_unique<ActionSignalController>(engine.getIntersectionConfig(),
+                                                                   options.min_green_seconds,
+                                                                   SafetyChecker::ORANGE_DURATION,
+                                                                   options.clearance_seconds);
+        action_controller = controller.get();
+        engine.setController(std::move(controller), SimulatorEngine::ControlMode::Basic);
+        engine.setSchedulerMode(SimulatorEngine::SchedulerMode::FixedTime);
+        engine.start();
+        // A zero-length tick publishes the controller's first phase as the effective light state.
+        engine.tick(0.0);
+        elapsed_seconds = 0.0;
+
+        if (observation) {
+            writeObservation(observation);
+        }
+    }
+
+    TrainingStepResult TrainingEnvironment::step(std::size_t action, float* observation) {
+        TrainingStepResult result;
+        // A safety fallback swaps the action controller out; the episode is over at that point.
+        if (engine.getControlMode() == SimulatorEngine::ControlMode::NullControl) {
+            result.done = true;
+        } else {
+            action_controller->setRequestedPhase(action);
+            const double dt = options.time_step_seconds > 0.0 ? options.time_step_seconds : 0.1;
+            for (std::size_t tick = 0; tick < std::max<std::size_t>(1, options.ticks_per_step); ++tick) {
+                engine.tick(dt);
+                elapsed_seconds += dt;
+                if (engine.getControlMode() == SimulatorEngine::ControlMode::NullControl) {
+                    result.reward -= options.safety_violation_penalty;
+                    result.done = true;
+                    break;
+                }
+                result.reward -= static_cast<double>(engine.countWaitingVehicles()) * dt;
+            }
+            result.done = result.done || elapsed_seconds >= options.episode_seconds;
+        }
+
+        if (observation) {
+            writeObservation(observation);
+        }
+        return result;
+    }
+
+    double TrainingEnvironment::simTime() const {
+        return elapsed_seconds;
+    }
+
+    const SimulatorEngine& TrainingEnvironment::getEngine() const {
+        return engine;
+    }
+
+    void TrainingEnvironment::writeObservation(float* observation) const {
+        engine.getRouteObservation(route_observation);
+        for (std::size_t route_idx = 0; route_idx < route_observation.waiting.size(); ++route_idx) {
+            float* features = observation + route_idx * kFeaturesPerRoute;
+            features[0] = static_cast<float>(route_observation.waiting[route_idx]);
+            features[1] = static_cast<float>(route_observation.stopped[route_idx]);
+            features[2] = static_cast<float>(route_observation.wait_seconds[route_idx]);
+            features[3] = lightValue(route_observation.lights[route_idx]);
+        }
+    }
+
+    VectorTrainingEnvironment::VectorTrainingEnvironment(const IntersectionConfig& config,
+                                                         std::size_t env_count,
+                                                         TrainingEnvironmentOptions options,
+                                                         std::size_t worker_count) {
+        environments.reserve(env_count);
+        for (std::size_t i = 0; i < env_count; ++i) {
+            environments.push_back(std::make_unique<TrainingEnvironment>(config, options));
+        }
+        next_seeds.assign(env_count, 0);
+
+        slice_count = std::max<std::size_t>(1, std::min(resolveWorkerCount(worker_count), env_count));
+        workers.reserve(slice_count - 1);
+        for (std::size_t i = 1; i < slice_count; ++i) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    VectorTrainingEnvironment::~VectorTrainingEnvironment() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        work_ready.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    std::size_t VectorTrainingEnvironment::size() const {
+        return environments.size();
+    }
+
+    std::size_t VectorTrainingEnvironment::actionCount() const {
+        return environments.empty() ? 0 : environments.front()->actionCount();
+    }
+
+    void VectorTrainingEnvironment::reset(uint64_t seed, float* observations) {
+        for (std::size_t i = 0; i < environments.size(); ++i) {
+            next_seeds[i] = seed + i;
+            float* observation = observations ? observations + i * TrainingEnvironment::kObservationSize : nullptr;
+            environments[i]->reset(next_seeds[i], observation);
+        }
+    }
+
+    void VectorTrainingEnvironment::step(const int32_t* actions,
+                                         float* observations,
+                                         float* rewards,
+                                         uint8_t* dones) {
+        step_actions = actions;
+        step_observations = observations;
+        step_rewards = rewards;
+        step_dones = dones;
+        runOnWorkers();
+    }
+
+    void VectorTrainingEnvironment::runSlice(std::size_t worker_index) {
+        const std::size_t count = environments.size();
+        const std::size_t begin = worker_index * count / slice_count;
+        const std::size_t end = (worker_index + 1) * count / slice_count;
+        for (std::size_t i = begin; i < end; ++i) {
+            float* observation =
+                step_observations ? step_observations + i * TrainingEnvironment::kObservationSize : nullptr;
+            const std::size_t action = step_actions[i] < 0 ? 0 : static_cast<std::size_t>(step_actions[i]);
+            const TrainingStepResult result = environments[i]->step(action, observation);
+            if (result.done) {
+                next_seeds[i] += count;
+                environments[i]->reset(next_seeds[i], observation);
+            }
+            if (step_rewards) {
+                step_rewards[i] = static_cast<float>(result.reward);
+            }
+            if (step_dones) {
+                step_dones[i] = result.done ? 1 : 0;
+            }
+        }
+    }
+
+    void VectorTrainingEnvironment::workerLoop(std::size_t worker_index) {
+        uint64_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                work_ready.wait(lock, [&]() { return stopping || generation != seen_generation; });
+                if (stopping) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+
+            runSlice(worker_index);
+
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                --pending_workers;
+            }
+            work_done.notify_one();
+        }
+    }
+
+    void VectorTrainingEnvironment::runOnWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            pending_workers = workers.size();
+            ++generation;
+        }
+        work_ready.notify_all();
+
+        runSlice(0);
+
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        work_done.wait(lock, [&]() { return pending_workers == 0; });
+    }
+}  // namespace crossroads
@@ -0,0 +1,95 @@
+#include <memory>
+#include <string>
+
+#include "IntersectionConfigJson.hpp"
+#include "SafetyChecker.hpp"
+#include "TrainingEnvironment.hpp"
+#include "crossroads_env.h"
+
+struct crossroads_env {
+    std::unique_ptr<crossroads::VectorTrainingEnvironment> environments;
+};
+
+// No exception may cross the C boundary: every entry point catches everything and reports it as NULL or 0.
+extern "C" {
+
+crossroads_env* crossroads_env_create(const char* config_json,
+                                      size_t env_count,
+                                      size_t worker_count,
+                                      double traffic_rate,
+                                      double episode_seconds) {
+    try {
+        crossroads::IntersectionConfig config = crossroads::makeDefaultIntersectionConfig();
+        if (config_json) {
+            crossroads::ConfigParseResult parsed = crossroads::intersectionConfigFromJson(config_json);
+            if (!parsed.ok) {
+                return nullptr;
+            }
+            config = parsed.config;
+        }
+        if (!crossroads::SafetyChecker(config).isConfigValid()) {
+            return nullptr;
+        }
+
+        crossroads::TrainingEnvironmentOptions options;
+        options.traffic_rate = traffic_rate;
+        options.episode_seconds = episode_seconds;
+
+        auto env = std::make_unique<crossroads_env>();
+        env->environments =
+            std::make_unique<crossroads::VectorTrainingEnvironment>(config, env_count, options, worker_count);
+        return env.release();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void crossroads_env_destroy(crossroads_env* env) {
+    try {
+        delete env;
+    } catch (...) {
+    }
+}
+
+size_t crossroads_env_size(const crossroads_env* env) {
+    try {
+        return env ? env->environments->size() : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+size_t crossroads_env_action_count(const crossroads_env* env) {
+    try {
+        return env ? env->environments->actionCount() : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+size_t crossroads_env_observation_size(void) {
+    return crossroads::TrainingEnvironment::kObservationSize;
+}
+
+void crossroads_env_reset(crossroads_env* env, uint64_t seed, float* observations) {
+    try {
+        if (env) {
+            env->environments->reset(seed, observations);
+        }
+    } catch (...) {
+    }
+}
+
+void crossroads_env_step(crossroads_env* env,
+                         const int32_t* actions,
+                         float* observations,
+                         float* rewards,
+                         uint8_t* dones) {
+    try {
+        if (env && actions) {
+            env->environments->step(actions, observations, rewards, dones);
+        }
+    } catch (...) {
+    }
+}
+}
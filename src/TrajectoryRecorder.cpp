@@ -0,0 +1,487 @@
+#include "TrajectoryRecorder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#ifdef CROSSROADS_USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace crossroads {
+    namespace {
+        constexpr char kTrajectoryMagic[4] = {'X', 'R', 'T', 'J'};
+        constexpr uint16_t kTrajectoryVersion = 1;
+        constexpr uint8_t kCodecRaw = 0;
+        constexpr uint8_t kCodecDeflate = 1;
+        constexpr std::size_t kChunkHeaderBytes = 4 + 1 + 4 + 4;
+        constexpr uint32_t kMaxChunkBytes = 256u * 1024u * 1024u;
+        constexpr std::size_t kColumnCount = 9;
+        constexpr std::size_t kMaxVarintBytes = 10;
+
+        ApproachId approachFromDirection(Direction dir) {
+            switch (dir) {
+                case Direction::North:
+                    return ApproachId::North;
+                case Direction::East:
+                    return ApproachId::East;
+                case Direction::South:
+                    return ApproachId::South;
+                case Direction::West:
+                    return ApproachId::West;
+            }
+            return ApproachId::North;
+        }
+
+        void setError(std::string* error, const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+        }
+
+        void appendU32(std::string& out, uint32_t value) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                out.push_back(static_cast<char>((value >> shift) & 0xff));
+            }
+        }
+
+        uint32_t readU32(const char* bytes) {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        // Writes the zigzag varint of value at out (at most kMaxVarintBytes) and returns the end.
+        char* putZigzagVarint(char* out, int64_t value) {
+            uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+            while (zigzag >= 0x80) {
+                *out++ = static_cast<char>(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *out++ = static_cast<char>(zigzag);
+            return out;
+        }
+
+        bool readZigzagVarint(const std::string& bytes, std::size_t& pos, int64_t& value) {
+            uint64_t zigzag = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (pos >= bytes.size()) {
+                    return false;
+                }
+                const uint8_t byte = static_cast<uint8_t>(bytes[pos++]);
+                zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Decodes one delta column and hands each value to assign; false on a short column or when assign
+        // rejects a value.
+        template <typename Assign>
+        bool decodeColumn(const std::string& bytes, std::size_t& pos, std::size_t count, Assign assign) {
+            int64_t value = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                int64_t delta = 0;
+                if (!readZigzagVarint(bytes, pos, delta)) {
+                    return false;
+                }
+                value += delta;
+                if (!assign(value)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        int64_t toMillis(double seconds) {
+            return static_cast<int64_t>(std::llround(seconds * 1000.0));
+        }
+
+        int64_t toCentis(double value) {
+            return static_cast<int64_t>(std::llround(value * 100.0));
+        }
+    }  // namespace
+
+    void TrajectoryColumns::clear() {
+        vehicle_id.clear();
+        time_seconds.clear();
+        approach.clear();
+        lane_id.clear();
+        movement.clear();
+        crossing.clear();
+        turning.clear();
+        position.clear();
+        speed.clear();
+        crossing_start.clear();
+    }
+
+    TrajectoryRecorder::~TrajectoryRecorder() {
+        close();
+    }
+
+    bool TrajectoryRecorder::open(const std::string& path, std::string* error, std::size_t chunk_rows) {
+        close();
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            setError(error, "cannot open " + path + " for writing");
+            return false;
+        }
+        out.write(kTrajectoryMagic, sizeof(kTrajectoryMagic));
+        const char version[2] = {static_cast<char>(kTrajectoryVersion & 0xff),
+                                 static_cast<char>(kTrajectoryVersion >> 8)};
+        out.write(version, sizeof(version));
+        if (!out) {
+            setError(error, "cannot write " + path);
+            out.close();
+            return false;
+        }
+
+        this->chunk_rows = std::max<std::size_t>(1, chunk_rows);
+        pending.clear();
+        pending.reserve(this->chunk_rows);
+        rows_recorded = 0;
+        stopping = false;
+        write_failed = false;
+        bytes_written = sizeof(kTrajectoryMagic) + sizeof(version);
+        recording = true;
+        worker = std::thread(&TrajectoryRecorder::writerLoop, this);
+        return true;
+    }
+
+    bool TrajectoryRecorder::isOpen() const {
+        return recording;
+    }
+
+    void TrajectoryRecorder::record(const SimulatorEngine& engine) {
+        if (!recording) {
+            return;
+        }
+
+        const std::size_t rows_before = pending.size();
+        const int64_t time_ms = toMillis(engine.getSimTime());
+        for (Direction dir : {Direction::North, Direction::East, Direction::South, Direction::West}) {
+            engine.getLaneVehicleStates(dir, lane_scratch);
+            const uint8_t approach = static_cast<uint8_t>(approachFromDirection(dir));
+            for (const LaneVehicleState& vehicle : lane_scratch) {
+                Row row;
+                row.vehicle_id = vehicle.id;
+                row.time_ms = time_ms;
+                row.approach = approach;
+                row.lane_id = vehicle.lane_id;
+                row.movement = static_cast<uint8_t>(vehicle.movement);
+                row.flags = static_cast<uint8_t>((vehicle.crossing ? 1 : 0) | (vehicle.turning ? 2 : 0));
+                row.position_cm = toCentis(vehicle.position_in_lane);
+                row.speed_cm_s = toCentis(vehicle.speed);
+                row.crossing_start_ms = vehicle.crossing_time < 0.0 ? -1 : toMillis(vehicle.crossing_time);
+                pending.push_back(row);
+            }
+        }
+        rows_recorded += pending.size() - rows_before;
+
+        if (pending.size() >= chunk_rows) {
+            handOffChunk();
+        }
+    }
+
+    void TrajectoryRecorder::close() {
+        if (!recording) {
+            return;
+        }
+        if (!pending.empty()) {
+            handOffChunk();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        out.close();
+        recording = false;
+    }
+
+    uint64_t TrajectoryRecorder::rowsRecorded() const {
+        return rows_recorded;
+    }
+
+    uint64_t TrajectoryRecorder::bytesWritten() const {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return bytes_written;
+    }
+
+    bool TrajectoryRecorder::failed() const {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return write_failed;
+    }
+
+    void TrajectoryRecorder::handOffChunk() {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_changed.wait(lock, [&]() { return queued_chunks.size() < kMaxQueuedChunks; });
+        queued_chunks.push_back(std::move(pending));
+        if (!spare_chunks.empty()) {
+            pending = std::move(spare_chunks.back());
+            spare_chunks.pop_back();
+        } else {
+            pending = std::vector<Row>();
+            pending.reserve(chunk_rows);
+        }
+        lock.unlock();
+        queue_changed.notify_all();
+    }
+
+    void TrajectoryRecorder::writerLoop() {
+        while (true) {
+            std::vector<Row> chunk;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_changed.wait(lock, [&]() { return stopping || !queued_chunks.empty(); });
+                if (queued_chunks.empty()) {
+                    return;
+                }
+                chunk = std::move(queued_chunks.front());
+                queued_chunks.pop_front();
+            }
+
+            writeChunk(chunk);
+
+            chunk.clear();
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                spare_chunks.push_back(std::move(chunk));
+            }
+            queue_changed.notify_all();
+        }
+    }
+
+    void TrajectoryRecorder::writeChunk(const std::vector<Row>& rows) {
+        // Rows arrive in time order and vehicle ids in a chunk span a narrow range, so a counting sort on the id
+        // orders them by vehicle and then time in linear time.
+        uint32_t min_id = UINT32_MAX;
+        uint32_t max_id = 0;
+        for (const Row& row : rows) {
+            min_id = std::min(min_id, row.vehicle_id);
+            max_id = std::max(max_id, row.vehicle_id);
+        }
+        sorted_rows.resize(rows.size());
+        if (!rows.empty() && max_id - min_id < rows.size() * 4) {
+            id_offsets.assign(static_cast<std::size_t>(max_id - min_id) + 2, 0);
+            for (const Row& row : rows) {
+                ++id_offsets[row.vehicle_id - min_id + 1];
+            }
+            for (std::size_t i = 1; i < id_offsets.size(); ++i) {
+                id_offsets[i] += id_offsets[i - 1];
+            }
+            for (const Row& row : rows) {
+                sorted_rows[id_offsets[row.vehicle_id - min_id]++] = row;
+            }
+        } else {
+            std::copy(rows.begin(), rows.end(), sorted_rows.begin());
+            std::stable_sort(sorted_rows.begin(), sorted_rows.end(), [](const Row& lhs, const Row& rhs) {
+                return lhs.vehicle_id < rhs.vehicle_id;
+            });
+        }
+
+        encode_buffer.resize(sorted_rows.size() * kColumnCount * kMaxVarintBytes);
+        char* cursor = &encode_buffer[0];
+        auto column = [&](auto field) {
+            int64_t previous = 0;
+            for (const Row& row : sorted_rows) {
+                const int64_t value = static_cast<int64_t>(field(row));
+                cursor = putZigzagVarint(cursor, value - previous);
+                previous = value;
+            }
+        };
+        column([](const Row& row) { return row.vehicle_id; });
+        column([](const Row& row) { return row.time_ms; });
+        column([](const Row& row) { return row.approach; });
+        column([](const Row& row) { return row.lane_id; });
+        column([](const Row& row) { return row.movement; });
+        column([](const Row& row) { return row.flags; });
+        column([](const Row& row) { return row.position_cm; });
+        column([](const Row& row) { return row.speed_cm_s; });
+        column([](const Row& row) { return row.crossing_start_ms; });
+        encode_buffer.resize(static_cast<std::size_t>(cursor - encode_buffer.data()));
+
+        uint8_t codec = kCodecRaw;
+        const std::string* body = &encode_buffer;
+#ifdef CROSSROADS_USE_ZLIB
+        uLongf compressed_size = compressBound(static_cast<uLong>(encode_buffer.size()));
+        compress_buffer.resize(compressed_size);
+        if (compress2(reinterpret_cast<Bytef*>(&compress_buffer[0]),
+                      &compressed_size,
+                      reinterpret_cast<const Bytef*>(encode_buffer.data()),
+                      static_cast<uLong>(encode_buffer.size()),
+                      Z_BEST_SPEED) == Z_OK &&
+            compressed_size < encode_buffer.size()) {
+            compress_buffer.resize(compressed_size);
+            codec = kCodecDeflate;
+            body = &compress_buffer;
+        }
+#endif
+
+        std::string header;
+        appendU32(header, static_cast<uint32_t>(rows.size()));
+        header.push_back(static_cast<char>(codec));
+        appendU32(header, static_cast<uint32_t>(encode_buffer.size()));
+        appendU32(header, static_cast<uint32_t>(body->size()));
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(body->data(), static_cast<std::streamsize>(body->size()));
+        out.flush();
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (out) {
+            bytes_written += header.size() + body->size();
+        } else {
+            write_failed = true;
+        }
+    }
+
+    bool TrajectoryReader::open(const std::string& path, std::string* error) {
+        in.close();
+        in.open(path, std::ios::binary);
+        char header[6] = {};
+        if (!in || !in.read(header, sizeof(header))) {
+            setError(error, "cannot read " + path);
+            return false;
+        }
+        const uint16_t version = static_cast<uint16_t>(static_cast<uint8_t>(header[4]) |
+                                                       (static_cast<uint8_t>(header[5]) << 8));
+        if (std::memcmp(header, kTrajectoryMagic, sizeof(kTrajectoryMagic)) != 0 || version != kTrajectoryVersion) {
+            setError(error, path + " is not a trajectory file of version " + std::to_string(kTrajectoryVersion));
+            return false;
+        }
+        return true;
+    }
+
+    bool TrajectoryReader::readChunk(TrajectoryColumns& columns, std::string* error) {
+        columns.clear();
+        char header[kChunkHeaderBytes];
+        if (!in.read(header, sizeof(header))) {
+            if (in.gcount() != 0) {
+                setError(error, "truncated chunk header");
+            }
+            return false;
+        }
+        const uint32_t row_count = readU32(header);
+        const uint8_t codec = static_cast<uint8_t>(header[4]);
+        const uint32_t raw_size = readU32(header + 5);
+        const uint32_t stored_size = readU32(header + 9);
+        if (raw_size > kMaxChunkBytes || stored_size > kMaxChunkBytes || row_count > raw_size) {
+            setError(error, "corrupt chunk header");
+            return false;
+        }
+
+        stored.resize(stored_size);
+        if (stored_size > 0 && !in.read(&stored[0], stored_size)) {
+            setError(error, "truncated chunk");
+            return false;
+        }
+
+        const std::string* body = &stored;
+        if (codec == kCodecDeflate) {
+#ifdef CROSSROADS_USE_ZLIB
+            raw.resize(raw_size);
+            uLongf raw_length = raw_size;
+            if (uncompress(reinterpret_cast<Bytef*>(&raw[0]),
+                           &raw_length,
+                           reinterpret_cast<const Bytef*>(stored.data()),
+                           stored_size) != Z_OK ||
+                raw_length != raw_size) {
+                setError(error, "chunk does not inflate");
+                return false;
+            }
+            body = &raw;
+#else
+            setError(error, "chunk is deflate-compressed but zlib support is not built in");
+            return false;
+#endif
+        } else if (codec != kCodecRaw || stored_size != raw_size) {
+            setError(error, "unknown chunk codec");
+            return false;
+        }
+
+        std::size_t pos = 0;
+        const std::size_t count = row_count;
+        auto in_range = [](int64_t value, int64_t low, int64_t high) { return value >= low && value <= high; };
+        const bool decoded =
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.vehicle_id.push_back(static_cast<uint32_t>(value));
+                return in_range(value, 0, UINT32_MAX);
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.time_seconds.push_back(static_cast<double>(value) / 1000.0);
+                return true;
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.approach.push_back(static_cast<ApproachId>(value & 3));
+                return in_range(value, 0, 3);
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.lane_id.push_back(static_cast<LaneId>(value));
+                return in_range(value, 0, UINT16_MAX);
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.movement.push_back(static_cast<MovementType>(value % 3));
+                return in_range(value, 0, 2);
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.crossing.push_back(static_cast<uint8_t>(value & 1));
+                columns.turning.push_back(static_cast<uint8_t>((value >> 1) & 1));
+                return in_range(value, 0, 3);
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.position.push_back(static_cast<double>(value) / 100.0);
+                return true;
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.speed.push_back(static_cast<double>(value) / 100.0);
+                return true;
+            }) &&
+            decodeColumn(*body, pos, count, [&](int64_t value) {
+                columns.crossing_start.push_back(value < 0 ? -1.0 : static_cast<double>(value) / 1000.0);
+                return true;
+            });
+        if (!decoded || pos != body->size()) {
+            columns.clear();
+            setError(error, "corrupt chunk body");
+            return false;
+        }
+        return true;
+    }
+
+    bool readTrajectoryFile(const std::string& path, TrajectoryColumns& columns, std::string* error) {
+        TrajectoryReader reader;
+        if (!reader.open(path, error)) {
+            return false;
+        }
+
+        TrajectoryColumns chunk;
+        std::string chunk_error;
+        while (reader.readChunk(chunk, &chunk_error)) {
+            auto append = [](auto& into, const auto& from) { into.insert(into.end(), from.begin(), from.end()); };
+            append(columns.vehicle_id, chunk.vehicle_id);
+            append(columns.time_seconds, chunk.time_seconds);
+            append(columns.approach, chunk.approach);
+            append(columns.lane_id, chunk.lane_id);
+            append(columns.movement, chunk.movement);
+            append(columns.crossing, chunk.crossing);
+            append(columns.turning, chunk.turning);
+            append(columns.position, chunk.position);
+            append(columns.speed, chunk.speed);
+            append(columns.crossing_start, chunk.crossing_start);
+        }
+        if (!chunk_error.empty()) {
+            setError(error, chunk_error);
+            return false;
+        }
+        return true;
+    }
+}  // namespace crossroads
@@ -8,12 +8,226 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <ctime>
+#include <initializer_list>
 #include <utility>
 #include <vector>
 
 namespace crossroads::db {
-#ifndef CROSSROADS_USE_SQLITE
+#ifdef CROSSROADS_USE_SQLITE
+    namespace {
+        enum class StatementId : std::size_t {
+            SaveActiveConfig,
+            LoadActiveConfig,
+            SaveNamedConfig,
+            LoadNamedConfig,
+            ListNamedConfigs,
+            ListNamedConfigPage,
+            ListNamedConfigPageOpen,
+            ExportNamedConfigPage,
+            DeleteNamedConfig,
+            TouchNamedConfig,
+            LoadMostRecentNamedConfig,
+            LoadMaxRunId,
+            InsertRun,
+            InsertRunMetric,
+            FinishRun,
+            ListRuns,
+            ListRunsByConfig,
+            LoadRun,
+            LoadRunMetrics,
+            CompareRunsByConfig,
+            Count,
+        };
+
+        constexpr std::size_t kStatementCount = static_cast<std::size_t>(StatementId::Count);
+        constexpr int kBusyTimeoutMs = 5000;
+        constexpr std::size_t kExportPageSize = 64;  // Rows read per connection lock while exporting
+
+        constexpr std::array<const char*, kStatementCount> kStatementSql = {
+            "INSERT INTO app_config(key, value) VALUES('active_intersection_config', ?) "
+            "ON CONFLICT(key) DO UPDATE SET value = excluded.value;",
+            "SELECT value FROM app_config WHERE key = 'active_intersection_config' LIMIT 1;",
+            "INSERT INTO named_intersection_configs(name, config_json, updated_at) VALUES(?, ?, datetime('now')) "
+            "ON CONFLICT(name) DO UPDATE SET "
+            "config_json = excluded.config_json, "
+            "updated_at = datetime('now');",
+            "SELECT config_json FROM named_intersection_configs WHERE name = ? LIMIT 1;",
+            "SELECT name, updated_at, COALESCE(last_used_at, '') "
+            "FROM named_intersection_configs "
+            "ORDER BY COALESCE(last_used_at, updated_at) DESC, name ASC;",
+            "SELECT name, updated_at, COALESCE(last_used_at, '') "
+            "FROM named_intersection_configs "
+            "WHERE name >= ?1 AND name < ?2 AND name <> ?3 ORDER BY name LIMIT ?4;",
+            "SELECT name, updated_at, COALESCE(last_used_at, '') "
+            "FROM named_intersection_configs "
+            "WHERE name >= ?1 AND name <> ?3 ORDER BY name LIMIT ?4;",
+            "SELECT name, config_json FROM named_intersection_configs "
+            "WHERE ?1 IS NULL OR name > ?1 ORDER BY name LIMIT ?2;",
+            "DELETE FROM named_intersection_configs WHERE name = ?;",
+            "UPDATE named_intersection_configs SET last_used_at = datetime('now') WHERE name = ?;",
+            "SELECT name "
+            "FROM named_intersection_configs "
+            "ORDER BY COALESCE(last_used_at, updated_at) DESC, name ASC "
+            "LIMIT 1;",
+            "SELECT COALESCE(MAX(id), 0) FROM runs;",
+            "INSERT INTO runs(id, started_at, config_hash, parameters_json) VALUES(?, datetime('now'), ?, ?);",
+            "INSERT OR REPLACE INTO run_metrics(run_id, scope, scope_index, interval_start, interval_seconds, "
+            "queue_avg, queue_max, stopped_avg, max_wait_seconds, green_fraction, vehicles_crossed) "
+            "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+            "UPDATE runs SET ended_at = datetime('now'), sim_seconds = ?, vehicles_generated = ?, "
+            "vehicles_crossed = ?, average_wait_seconds = ?, safety_violations = ? WHERE id = ?;",
+            "SELECT id, started_at, COALESCE(ended_at, ''), config_hash, parameters_json, sim_seconds, "
+            "vehicles_generated, vehicles_crossed, average_wait_seconds, safety_violations "
+            "FROM runs ORDER BY id DESC LIMIT ?;",
+            "SELECT id, started_at, COALESCE(ended_at, ''), config_hash, parameters_json, sim_seconds, "
+            "vehicles_generated, vehicles_crossed, average_wait_seconds, safety_violations "
+            "FROM runs WHERE config_hash = ? ORDER BY id DESC LIMIT ?;",
+            "SELECT id, started_at, COALESCE(ended_at, ''), config_hash, parameters_json, sim_seconds, "
+            "vehicles_generated, vehicles_crossed, average_wait_seconds, safety_violations "
+            "FROM runs WHERE id = ?;",
+            "SELECT scope, scope_index, interval_start, interval_seconds, queue_avg, queue_max, stopped_avg, "
+            "max_wait_seconds, green_fraction, vehicles_crossed "
+            "FROM run_metrics WHERE run_id = ?1 AND (?2 < 0 OR scope = ?2) "
+            "ORDER BY scope, scope_index, interval_start;",
+            "SELECT config_hash, COUNT(*), AVG(average_wait_seconds), "
+            "COALESCE(SUM(vehicles_crossed) * 3600.0 / NULLIF(SUM(sim_seconds), 0), 0), SUM(safety_violations) "
+            "FROM runs WHERE ended_at IS NOT NULL "
+            "GROUP BY config_hash ORDER BY 3 ASC, config_hash ASC;",
+        };
+
+        // Hands a cached statement back unbound and rewound, whichever way the call leaves.
+        class StatementLease {
+           public:
+            explicit StatementLease(sqlite3_stmt* stmt) : stmt(stmt) {
+            }
+            ~StatementLease() {
+                if (stmt) {
+                    sqlite3_reset(stmt);
+                    sqlite3_clear_bindings(stmt);
+                }
+            }
+
+            StatementLease(const StatementLease&) = delete;
+            StatementLease& operator=(const StatementLease&) = delete;
+
+            sqlite3_stmt* get() const {
+                return stmt;
+            }
+            explicit operator bool() const {
+                return stmt != nullptr;
+            }
+
+           private:
+            sqlite3_stmt* stmt;
+        };
+
+        std::string columnText(sqlite3_stmt* stmt, int column) {
+            const unsigned char* text = sqlite3_column_text(stmt, column);
+            return text ? reinterpret_cast<const char*>(text) : "";
+        }
+
+        RunRecord readRunRow(sqlite3_stmt* stmt) {
+            RunRecord run;
+            run.id = sqlite3_column_int64(stmt, 0);
+            run.started_at = columnText(stmt, 1);
+            run.ended_at = columnText(stmt, 2);
+            run.config_hash = columnText(stmt, 3);
+            run.parameters_json = columnText(stmt, 4);
+            run.sim_seconds = sqlite3_column_double(stmt, 5);
+            run.vehicles_generated = static_cast<std::size_t>(sqlite3_column_int64(stmt, 6));
+            run.vehicles_crossed = static_cast<std::size_t>(sqlite3_column_int64(stmt, 7));
+            run.average_wait_seconds = sqlite3_column_double(stmt, 8);
+            run.safety_violations = static_cast<std::size_t>(sqlite3_column_int64(stmt, 9));
+            return run;
+        }
+
+        bool execSql(sqlite3* handle, const char* sql, const char* fallback_error, std::string* error) {
+            char* errmsg = nullptr;
+            if (sqlite3_exec(handle, sql, nullptr, nullptr, &errmsg) != SQLITE_OK) {
+                if (error) {
+                    *error = errmsg ? errmsg : fallback_error;
+                }
+                sqlite3_free(errmsg);
+                return false;
+            }
+            return true;
+        }
+    }  // namespace
+
+    struct Database::Connection {
+        sqlite3* handle = nullptr;
+        std::array<sqlite3_stmt*, kStatementCount> statements{};
+
+        Connection() = default;
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        ~Connection() {
+            for (sqlite3_stmt* stmt : statements) {
+                sqlite3_finalize(stmt);
+            }
+            sqlite3_close(handle);
+        }
+
+        void setError(std::string* error) const {
+            if (error) {
+                *error = sqlite3_errmsg(handle);
+            }
+        }
+
+        // Prepared on first use; a failed prepare (e.g. schema not created yet) is retried next time.
+        sqlite3_stmt* statement(StatementId id, std::string* error) {
+            sqlite3_stmt*& slot = statements[static_cast<std::size_t>(id)];
+            if (!slot && sqlite3_prepare_v2(handle, kStatementSql[static_cast<std::size_t>(id)], -1, &slot, nullptr) !=
+                             SQLITE_OK) {
+                setError(error);
+                sqlite3_finalize(slot);
+                slot = nullptr;
+            }
+            return slot;
+        }
+
+        bool execute(StatementId id, std::initializer_list<const std::string*> params, std::string* error) {
+            StatementLease stmt(statement(id, error));
+            if (!stmt) {
+                return false;
+            }
+            bindAll(stmt.get(), params);
+            if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+                setError(error);
+                return false;
+            }
+            return true;
+        }
+
+        std::optional<std::string> queryText(StatementId id,
+                                             std::initializer_list<const std::string*> params,
+                                             std::string* error) {
+            StatementLease stmt(statement(id, error));
+            if (!stmt) {
+                return std::nullopt;
+            }
+            bindAll(stmt.get(), params);
+            const int step_rc = sqlite3_step(stmt.get());
+            if (step_rc == SQLITE_ROW) {
+                return columnText(stmt.get(), 0);
+            }
+            if (step_rc != SQLITE_DONE) {
+                setError(error);
+            }
+            return std::nullopt;
+        }
+
+        static void bindAll(sqlite3_stmt* stmt, std::initializer_list<const std::string*> params) {
+            int index = 1;
+            for (const std::string* param : params) {
+                sqlite3_bind_text(stmt, index++, param->c_str(), static_cast<int>(param->size()), SQLITE_TRANSIENT);
+            }
+        }
+    };
+#else
     namespace {
         using nlohmann::json;
 
@@ -103,19 +317,47 @@ namespace crossroads::db {
             return out.good();
         }
     }  // namespace
+
+    struct Database::Connection {};
 #endif
 
     Database::Database(std::string file_path) : file_path(std::move(file_path)) {
     }
 
+    Database::~Database() = default;
+
+    Database::Connection* Database::acquireConnection(std::string* error) const {
+#ifdef CROSSROADS_USE_SQLITE
+        if (connection) {
+            return connection.get();
+        }
+
+        auto opened = std::make_unique<Connection>();
+        if (sqlite3_open(file_path.c_str(), &opened->handle) != SQLITE_OK) {
+            opened->setError(error);
+            return nullptr;
+        }
+
+        sqlite3_busy_timeout(opened->handle, kBusyTimeoutMs);
+        // WAL keeps readers (e.g. a second process inspecting the file) from blocking a save and vice versa.
+        if (!execSql(opened->handle, "PRAGMA journal_mode=WAL;", "failed to enable WAL journal", error) ||
+            !execSql(opened->handle, "PRAGMA synchronous=NORMAL;", "failed to set synchronous mode", error)) {
+            return nullptr;
+        }
+
+        connection = std::move(opened);
+        return connection.get();
+#else
+        (void)error;
+        return nullptr;
+#endif
+    }
+
     bool Database::initialize(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
             return false;
         }
 
@@ -131,46 +373,49 @@ namespace crossroads::db {
             "config_json TEXT NOT NULL,"
             "updated_at TEXT NOT NULL DEFAULT (datetime('now')),"
             "last_used_at TEXT"
-            ");";
-
-        char* errmsg = nullptr;
-        const int exec_rc = sqlite3_exec(handle, create_sql, nullptr, nullptr, &errmsg);
-        if (exec_rc != SQLITE_OK) {
-            if (error) {
-                *error = errmsg ? errmsg : "failed to initialize schema";
-            }
-            sqlite3_free(errmsg);
-            sqlite3_close(handle);
-            return false;
-        }
-
-        const int exec_named_rc = sqlite3_exec(handle, create_named_sql, nullptr, nullptr, &errmsg);
-        if (exec_named_rc != SQLITE_OK) {
-            if (error) {
-                *error = errmsg ? errmsg : "failed to initialize named config schema";
-            }
-            sqlite3_free(errmsg);
-            sqlite3_close(handle);
-            return false;
-        }
+            ");"
+            "CREATE INDEX IF NOT EXISTS named_configs_by_recent "
+            "ON named_intersection_configs(COALESCE(last_used_at, updated_at) DESC, name);";
 
         const char* seed_sql =
             "INSERT INTO named_intersection_configs(name, config_json, updated_at, last_used_at) "
             "SELECT 'Standaard', value, datetime('now'), datetime('now') FROM app_config "
             "WHERE key='active_intersection_config' "
             "AND NOT EXISTS (SELECT 1 FROM named_intersection_configs);";
-        const int seed_rc = sqlite3_exec(handle, seed_sql, nullptr, nullptr, &errmsg);
-        if (seed_rc != SQLITE_OK) {
-            if (error) {
-                *error = errmsg ? errmsg : "failed to seed named configs";
-            }
-            sqlite3_free(errmsg);
-            sqlite3_close(handle);
-            return false;
-        }
 
-        sqlite3_close(handle);
-        return true;
+        const char* create_runs_sql =
+            "CREATE TABLE IF NOT EXISTS runs ("
+            "id INTEGER PRIMARY KEY,"
+            "started_at TEXT NOT NULL,"
+            "ended_at TEXT,"
+            "config_hash TEXT NOT NULL,"
+            "parameters_json TEXT NOT NULL DEFAULT '{}',"
+            "sim_seconds REAL NOT NULL DEFAULT 0,"
+            "vehicles_generated INTEGER NOT NULL DEFAULT 0,"
+            "vehicles_crossed INTEGER NOT NULL DEFAULT 0,"
+            "average_wait_seconds REAL NOT NULL DEFAULT 0,"
+            "safety_violations INTEGER NOT NULL DEFAULT 0"
+            ");"
+            "CREATE INDEX IF NOT EXISTS runs_by_config ON runs(config_hash, id);"
+            "CREATE TABLE IF NOT EXISTS run_metrics ("
+            "run_id INTEGER NOT NULL,"
+            "scope INTEGER NOT NULL,"
+            "scope_index INTEGER NOT NULL,"
+            "interval_start REAL NOT NULL,"
+            "interval_seconds REAL NOT NULL,"
+            "queue_avg REAL NOT NULL,"
+            "queue_max REAL NOT NULL,"
+            "stopped_avg REAL NOT NULL,"
+            "max_wait_seconds REAL NOT NULL,"
+            "green_fraction REAL NOT NULL,"
+            "vehicles_crossed INTEGER NOT NULL,"
+            "PRIMARY KEY (run_id, scope, scope_index, interval_start)"
+            ") WITHOUT ROWID;";
+
+        return execSql(db->handle, create_sql, "failed to initialize schema", error) &&
+               execSql(db->handle, create_named_sql, "failed to initialize named config schema", error) &&
+               execSql(db->handle, seed_sql, "failed to seed named configs", error) &&
+               execSql(db->handle, create_runs_sql, "failed to initialize run history schema", error);
 #else
         std::ofstream out(file_path, std::ios::app);
         if (!out.good()) {
@@ -192,43 +437,10 @@ namespace crossroads::db {
     }
 
     bool Database::saveActiveIntersectionConfigJson(const std::string& config_json, std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        const char* upsert_sql =
-            "INSERT INTO app_config(key, value) VALUES('active_intersection_config', ?) "
-            "ON CONFLICT(key) DO UPDATE SET value = excluded.value;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, upsert_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_bind_text(stmt, 1, config_json.c_str(), static_cast<int>(config_json.size()), SQLITE_TRANSIENT);
-
-        const int step_rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        if (step_rc != SQLITE_DONE) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_close(handle);
-        return true;
+        Connection* db = acquireConnection(error);
+        return db && db->execute(StatementId::SaveActiveConfig, {&config_json}, error);
 #else
         std::ofstream out(file_path, std::ios::trunc);
         if (!out.good()) {
@@ -243,43 +455,13 @@ namespace crossroads::db {
     }
 
     std::optional<std::string> Database::loadActiveIntersectionConfigJson(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return std::nullopt;
-        }
-
-        const char* select_sql = "SELECT value FROM app_config WHERE key = 'active_intersection_config' LIMIT 1;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
             return std::nullopt;
         }
-
-        const int step_rc = sqlite3_step(stmt);
-        if (step_rc == SQLITE_ROW) {
-            const unsigned char* text = sqlite3_column_text(stmt, 0);
-            std::string value = text ? reinterpret_cast<const char*>(text) : "";
-            sqlite3_finalize(stmt);
-            sqlite3_close(handle);
-            return value;
-        }
-
-        if (step_rc != SQLITE_DONE && error) {
-            *error = sqlite3_errmsg(handle);
-        }
-
-        sqlite3_finalize(stmt);
-        sqlite3_close(handle);
-        return std::nullopt;
+        return db->queryText(StatementId::LoadActiveConfig, {}, error);
 #else
         std::ifstream in(file_path);
         if (!in.good()) {
@@ -297,46 +479,10 @@ namespace crossroads::db {
     bool Database::saveNamedIntersectionConfigJson(const std::string& name,
                                                    const std::string& config_json,
                                                    std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        const char* upsert_sql =
-            "INSERT INTO named_intersection_configs(name, config_json, updated_at) VALUES(?, ?, datetime('now')) "
-            "ON CONFLICT(name) DO UPDATE SET "
-            "config_json = excluded.config_json, "
-            "updated_at = datetime('now');";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, upsert_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_bind_text(stmt, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, config_json.c_str(), static_cast<int>(config_json.size()), SQLITE_TRANSIENT);
-
-        const int step_rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        if (step_rc != SQLITE_DONE) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_close(handle);
-        return true;
+        Connection* db = acquireConnection(error);
+        return db && db->execute(StatementId::SaveNamedConfig, {&name, &config_json}, error);
 #else
         std::vector<FallbackNamedConfigRow> rows;
         if (!readFallbackNamedConfigRows(file_path, rows, error)) {
@@ -359,44 +505,13 @@ namespace crossroads::db {
 
     std::optional<std::string> Database::loadNamedIntersectionConfigJson(const std::string& name,
                                                                          std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return std::nullopt;
-        }
-
-        const char* select_sql = "SELECT config_json FROM named_intersection_configs WHERE name = ? LIMIT 1;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
             return std::nullopt;
         }
-
-        sqlite3_bind_text(stmt, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
-        const int step_rc = sqlite3_step(stmt);
-        if (step_rc == SQLITE_ROW) {
-            const unsigned char* text = sqlite3_column_text(stmt, 0);
-            std::string value = text ? reinterpret_cast<const char*>(text) : "";
-            sqlite3_finalize(stmt);
-            sqlite3_close(handle);
-            return value;
-        }
-
-        if (step_rc != SQLITE_DONE && error) {
-            *error = sqlite3_errmsg(handle);
-        }
-
-        sqlite3_finalize(stmt);
-        sqlite3_close(handle);
-        return std::nullopt;
+        return db->queryText(StatementId::LoadNamedConfig, {&name}, error);
 #else
         std::vector<FallbackNamedConfigRow> rows;
         if (!readFallbackNamedConfigRows(file_path, rows, error)) {
@@ -414,53 +529,32 @@ namespace crossroads::db {
     }
 
     std::vector<NamedConfigEntry> Database::listNamedIntersectionConfigs(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
         std::vector<NamedConfigEntry> rows;
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
             return rows;
         }
 
-        const char* select_sql =
-            "SELECT name, updated_at, COALESCE(last_used_at, '') "
-            "FROM named_intersection_configs "
-            "ORDER BY COALESCE(last_used_at, updated_at) DESC, name ASC;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        StatementLease stmt(db->statement(StatementId::ListNamedConfigs, error));
+        if (!stmt) {
             return rows;
         }
 
         while (true) {
-            const int step_rc = sqlite3_step(stmt);
+            const int step_rc = sqlite3_step(stmt.get());
             if (step_rc == SQLITE_DONE) {
                 break;
             }
             if (step_rc != SQLITE_ROW) {
-                if (error) {
-                    *error = sqlite3_errmsg(handle);
-                }
+                db->setError(error);
                 break;
             }
 
-            const unsigned char* name_text = sqlite3_column_text(stmt, 0);
-            const unsigned char* updated_text = sqlite3_column_text(stmt, 1);
-            const unsigned char* last_used_text = sqlite3_column_text(stmt, 2);
-            rows.push_back(NamedConfigEntry{name_text ? reinterpret_cast<const char*>(name_text) : "",
-                                            updated_text ? reinterpret_cast<const char*>(updated_text) : "",
-                                            last_used_text ? reinterpret_cast<const char*>(last_used_text) : ""});
+            rows.push_back(NamedConfigEntry{
+                columnText(stmt.get(), 0), columnText(stmt.get(), 1), columnText(stmt.get(), 2)});
         }
-
-        sqlite3_finalize(stmt);
-        sqlite3_close(handle);
 #else
         std::vector<FallbackNamedConfigRow> fallback_rows;
         if (!readFallbackNamedConfigRows(file_path, fallback_rows, error)) {
@@ -483,42 +577,203 @@ namespace crossroads::db {
         return rows;
     }
 
-    bool Database::deleteNamedIntersectionConfig(const std::string& name, std::string* error) const {
+    namespace {
+        // Smallest string greater than every string starting with prefix, or empty when there is none.
+        std::string prefixUpperBound(std::string prefix) {
+            while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xFF) {
+                prefix.pop_back();
+            }
+            if (!prefix.empty()) {
+                prefix.back() = static_cast<char>(static_cast<unsigned char>(prefix.back()) + 1);
+            }
+            return prefix;
+        }
+    }  // namespace
+
+    NamedConfigPage Database::listNamedIntersectionConfigPage(const std::string& prefix,
+                                                              const std::string& after,
+                                                              std::size_t limit,
+                                                              std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+        NamedConfigPage page;
+        if (limit == 0) {
+            return page;
+        }
+
+        // Range scan from the later of the prefix and the cursor; the cursor row itself is excluded.
+        const std::string& lower = after > prefix ? after : prefix;
+        const std::string upper = prefixUpperBound(prefix);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return page;
+        }
+
+        StatementLease stmt(db->statement(
+            upper.empty() ? StatementId::ListNamedConfigPageOpen : StatementId::ListNamedConfigPage, error));
+        if (!stmt) {
+            return page;
+        }
+        sqlite3_bind_text(stmt.get(), 1, lower.c_str(), static_cast<int>(lower.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt.get(), 2, upper.c_str(), static_cast<int>(upper.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt.get(), 3, after.c_str(), static_cast<int>(after.size()), SQLITE_TRANSIENT);
+        // One row more than asked tells whether another page follows.
+        sqlite3_bind_int64(stmt.get(), 4, static_cast<sqlite3_int64>(limit) + 1);
+
+        while (true) {
+            const int step_rc = sqlite3_step(stmt.get());
+            if (step_rc == SQLITE_DONE) {
+                break;
+            }
+            if (step_rc != SQLITE_ROW) {
+                db->setError(error);
+                break;
+            }
+            page.items.push_back(NamedConfigEntry{
+                columnText(stmt.get(), 0), columnText(stmt.get(), 1), columnText(stmt.get(), 2)});
+        }
+#else
+        std::vector<FallbackNamedConfigRow> rows;
+        if (!readFallbackNamedConfigRows(file_path, rows, error)) {
+            return page;
+        }
+
+        std::sort(rows.begin(), rows.end(), [](const FallbackNamedConfigRow& lhs, const FallbackNamedConfigRow& rhs) {
+            return lhs.name < rhs.name;
+        });
+        for (const auto& row : rows) {
+            if (row.name < lower || row.name == after || (!upper.empty() && row.name >= upper)) {
+                continue;
+            }
+            page.items.push_back(NamedConfigEntry{row.name, row.updated_at, row.last_used_at});
+            if (page.items.size() > limit) {
+                break;
             }
-            sqlite3_close(handle);
-            return false;
         }
+#endif
+        if (page.items.size() > limit) {
+            page.items.resize(limit);
+            page.next_after = page.items.back().name;
+        }
+        return page;
+    }
 
-        const char* delete_sql = "DELETE FROM named_intersection_configs WHERE name = ?;";
+    bool Database::importNamedIntersectionConfigs(const std::vector<NamedConfigRecord>& records,
+                                                  std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return false;
+        }
+        if (!execSql(db->handle, "BEGIN IMMEDIATE;", "failed to begin named config import", error)) {
+            return false;
+        }
 
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, delete_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
+        for (const NamedConfigRecord& record : records) {
+            if (!db->execute(StatementId::SaveNamedConfig, {&record.name, &record.config_json}, error)) {
+                execSql(db->handle, "ROLLBACK;", "failed to roll back named config import", nullptr);
+                return false;
             }
-            sqlite3_close(handle);
+        }
+        return execSql(db->handle, "COMMIT;", "failed to commit named config import", error);
+#else
+        std::vector<FallbackNamedConfigRow> rows;
+        if (!readFallbackNamedConfigRows(file_path, rows, error)) {
             return false;
         }
 
-        sqlite3_bind_text(stmt, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
+        const std::string now = nowUtcTimestamp();
+        for (const NamedConfigRecord& record : records) {
+            auto it = std::find_if(
+                rows.begin(), rows.end(), [&](const FallbackNamedConfigRow& row) { return row.name == record.name; });
+            if (it == rows.end()) {
+                rows.push_back(FallbackNamedConfigRow{record.name, record.config_json, now, ""});
+            } else {
+                it->config_json = record.config_json;
+                it->updated_at = now;
+            }
+        }
+        return writeFallbackNamedConfigRows(file_path, rows, error);
+#endif
+    }
 
-        const int step_rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        if (step_rc != SQLITE_DONE) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
+    bool Database::exportNamedIntersectionConfigs(const std::function<bool(const NamedConfigRecord&)>& row_sink,
+                                                  std::string* error) const {
+#ifdef CROSSROADS_USE_SQLITE
+        // A page at a time, and the connection lock is released while row_sink runs, so a slow reader does not
+        // hold up other requests. The cursor is the last name handed out.
+        std::vector<NamedConfigRecord> page;
+        std::optional<std::string> after;
+        while (true) {
+            page.clear();
+            {
+                std::lock_guard<std::mutex> lock(connection_mutex);
+                Connection* db = acquireConnection(error);
+                if (!db) {
+                    return false;
+                }
+
+                StatementLease stmt(db->statement(StatementId::ExportNamedConfigPage, error));
+                if (!stmt) {
+                    return false;
+                }
+                if (after) {
+                    sqlite3_bind_text(stmt.get(), 1, after->c_str(), static_cast<int>(after->size()), SQLITE_TRANSIENT);
+                } else {
+                    sqlite3_bind_null(stmt.get(), 1);
+                }
+                sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(kExportPageSize));
+
+                while (true) {
+                    const int step_rc = sqlite3_step(stmt.get());
+                    if (step_rc == SQLITE_DONE) {
+                        break;
+                    }
+                    if (step_rc != SQLITE_ROW) {
+                        db->setError(error);
+                        return false;
+                    }
+                    page.push_back(NamedConfigRecord{columnText(stmt.get(), 0), columnText(stmt.get(), 1)});
+                }
+            }
+
+            for (const NamedConfigRecord& record : page) {
+                if (!row_sink(record)) {
+                    return true;
+                }
+            }
+            if (page.size() < kExportPageSize) {
+                return true;
+            }
+            after = page.back().name;
+        }
+#else
+        std::vector<FallbackNamedConfigRow> rows;
+        {
+            std::lock_guard<std::mutex> lock(connection_mutex);
+            if (!readFallbackNamedConfigRows(file_path, rows, error)) {
+                return false;
             }
-            sqlite3_close(handle);
-            return false;
         }
 
-        sqlite3_close(handle);
+        std::sort(rows.begin(), rows.end(), [](const FallbackNamedConfigRow& lhs, const FallbackNamedConfigRow& rhs) {
+            return lhs.name < rhs.name;
+        });
+        for (const auto& row : rows) {
+            if (!row_sink(NamedConfigRecord{row.name, row.config_json})) {
+                break;
+            }
+        }
         return true;
+#endif
+    }
+
+    bool Database::deleteNamedIntersectionConfig(const std::string& name, std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        return db && db->execute(StatementId::DeleteNamedConfig, {&name}, error);
 #else
         std::vector<FallbackNamedConfigRow> rows;
         if (!readFallbackNamedConfigRows(file_path, rows, error)) {
@@ -539,41 +794,10 @@ namespace crossroads::db {
     }
 
     bool Database::touchNamedIntersectionConfig(const std::string& name, std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        const char* update_sql = "UPDATE named_intersection_configs SET last_used_at = datetime('now') WHERE name = ?;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, update_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_bind_text(stmt, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
-
-        const int step_rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        if (step_rc != SQLITE_DONE) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return false;
-        }
-
-        sqlite3_close(handle);
-        return true;
+        Connection* db = acquireConnection(error);
+        return db && db->execute(StatementId::TouchNamedConfig, {&name}, error);
 #else
         std::vector<FallbackNamedConfigRow> rows;
         if (!readFallbackNamedConfigRows(file_path, rows, error)) {
@@ -591,47 +815,13 @@ namespace crossroads::db {
     }
 
     std::optional<std::string> Database::loadMostRecentNamedConfigName(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
 #ifdef CROSSROADS_USE_SQLITE
-        sqlite3* handle = nullptr;
-        if (sqlite3_open(file_path.c_str(), &handle) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
-            return std::nullopt;
-        }
-
-        const char* select_sql =
-            "SELECT name "
-            "FROM named_intersection_configs "
-            "ORDER BY COALESCE(last_used_at, updated_at) DESC, name ASC "
-            "LIMIT 1;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(handle, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            if (error) {
-                *error = sqlite3_errmsg(handle);
-            }
-            sqlite3_close(handle);
+        Connection* db = acquireConnection(error);
+        if (!db) {
             return std::nullopt;
         }
-
-        const int step_rc = sqlite3_step(stmt);
-        if (step_rc == SQLITE_ROW) {
-            const unsigned char* text = sqlite3_column_text(stmt, 0);
-            std::string value = text ? reinterpret_cast<const char*>(text) : "";
-            sqlite3_finalize(stmt);
-            sqlite3_close(handle);
-            return value;
-        }
-
-        if (step_rc != SQLITE_DONE && error) {
-            *error = sqlite3_errmsg(handle);
-        }
-
-        sqlite3_finalize(stmt);
-        sqlite3_close(handle);
-        return std::nullopt;
+        return db->queryText(StatementId::LoadMostRecentNamedConfig, {}, error);
 #else
         std::vector<FallbackNamedConfigRow> rows;
         if (!readFallbackNamedConfigRows(file_path, rows, error)) {
@@ -653,4 +843,282 @@ namespace crossroads::db {
         return std::nullopt;
 #endif
     }
+
+#ifndef CROSSROADS_USE_SQLITE
+    namespace {
+        void setRunHistoryUnavailable(std::string* error) {
+            if (error) {
+                *error = "run history requires SQLite";
+            }
+        }
+    }  // namespace
+#endif
+
+    std::optional<int64_t> Database::loadMaxRunId(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return std::nullopt;
+        }
+
+        StatementLease stmt(db->statement(StatementId::LoadMaxRunId, error));
+        if (!stmt) {
+            return std::nullopt;
+        }
+        if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+            db->setError(error);
+            return std::nullopt;
+        }
+        return sqlite3_column_int64(stmt.get(), 0);
+#else
+        setRunHistoryUnavailable(error);
+        return std::nullopt;
+#endif
+    }
+
+    bool Database::writeRunHistoryBatch(const RunHistoryBatch& batch, std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return false;
+        }
+        if (!execSql(db->handle, "BEGIN IMMEDIATE;", "failed to begin run history transaction", error)) {
+            return false;
+        }
+
+        auto write_all = [&]() {
+            for (const RunRecord& run : batch.started) {
+                StatementLease stmt(db->statement(StatementId::InsertRun, error));
+                if (!stmt) {
+                    return false;
+                }
+                sqlite3_bind_int64(stmt.get(), 1, run.id);
+                sqlite3_bind_text(stmt.get(),
+                                  2,
+                                  run.config_hash.c_str(),
+                                  static_cast<int>(run.config_hash.size()),
+                                  SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt.get(),
+                                  3,
+                                  run.parameters_json.c_str(),
+                                  static_cast<int>(run.parameters_json.size()),
+                                  SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+                    db->setError(error);
+                    return false;
+                }
+            }
+
+            for (const RunMetricSample& sample : batch.samples) {
+                StatementLease stmt(db->statement(StatementId::InsertRunMetric, error));
+                if (!stmt) {
+                    return false;
+                }
+                sqlite3_bind_int64(stmt.get(), 1, sample.run_id);
+                sqlite3_bind_int(stmt.get(), 2, static_cast<int>(sample.scope));
+                sqlite3_bind_int(stmt.get(), 3, sample.scope_index);
+                sqlite3_bind_double(stmt.get(), 4, sample.interval_start);
+                sqlite3_bind_double(stmt.get(), 5, sample.interval_seconds);
+                sqlite3_bind_double(stmt.get(), 6, sample.queue_avg);
+                sqlite3_bind_double(stmt.get(), 7, sample.queue_max);
+                sqlite3_bind_double(stmt.get(), 8, sample.stopped_avg);
+                sqlite3_bind_double(stmt.get(), 9, sample.max_wait_seconds);
+                sqlite3_bind_double(stmt.get(), 10, sample.green_fraction);
+                sqlite3_bind_int64(stmt.get(), 11, sample.vehicles_crossed);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+                    db->setError(error);
+                    return false;
+                }
+            }
+
+            for (const RunRecord& run : batch.finished) {
+                StatementLease stmt(db->statement(StatementId::FinishRun, error));
+                if (!stmt) {
+                    return false;
+                }
+                sqlite3_bind_double(stmt.get(), 1, run.sim_seconds);
+                sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(run.vehicles_generated));
+                sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(run.vehicles_crossed));
+                sqlite3_bind_double(stmt.get(), 4, run.average_wait_seconds);
+                sqlite3_bind_int64(stmt.get(), 5, static_cast<sqlite3_int64>(run.safety_violations));
+                sqlite3_bind_int64(stmt.get(), 6, run.id);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+                    db->setError(error);
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        if (!write_all()) {
+            execSql(db->handle, "ROLLBACK;", "failed to roll back run history transaction", nullptr);
+            return false;
+        }
+        return execSql(db->handle, "COMMIT;", "failed to commit run history transaction", error);
+#else
+        (void)batch;
+        setRunHistoryUnavailable(error);
+        return false;
+#endif
+    }
+
+    std::vector<RunRecord> Database::listRuns(const std::string& config_hash,
+                                              std::size_t limit,
+                                              std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+        std::vector<RunRecord> runs;
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return runs;
+        }
+
+        const bool by_config = !config_hash.empty();
+        StatementLease stmt(db->statement(by_config ? StatementId::ListRunsByConfig : StatementId::ListRuns, error));
+        if (!stmt) {
+            return runs;
+        }
+        int param = 1;
+        if (by_config) {
+            sqlite3_bind_text(
+                stmt.get(), param++, config_hash.c_str(), static_cast<int>(config_hash.size()), SQLITE_TRANSIENT);
+        }
+        sqlite3_bind_int64(stmt.get(), param, static_cast<sqlite3_int64>(limit));
+
+        while (true) {
+            const int step_rc = sqlite3_step(stmt.get());
+            if (step_rc == SQLITE_DONE) {
+                break;
+            }
+            if (step_rc != SQLITE_ROW) {
+                db->setError(error);
+                break;
+            }
+            runs.push_back(readRunRow(stmt.get()));
+        }
+#else
+        (void)config_hash;
+        (void)limit;
+        setRunHistoryUnavailable(error);
+#endif
+        return runs;
+    }
+
+    std::optional<RunRecord> Database::loadRun(int64_t run_id, std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return std::nullopt;
+        }
+
+        StatementLease stmt(db->statement(StatementId::LoadRun, error));
+        if (!stmt) {
+            return std::nullopt;
+        }
+        sqlite3_bind_int64(stmt.get(), 1, run_id);
+        const int step_rc = sqlite3_step(stmt.get());
+        if (step_rc == SQLITE_ROW) {
+            return readRunRow(stmt.get());
+        }
+        if (step_rc != SQLITE_DONE) {
+            db->setError(error);
+        }
+        return std::nullopt;
+#else
+        (void)run_id;
+        setRunHistoryUnavailable(error);
+        return std::nullopt;
+#endif
+    }
+
+    std::vector<RunMetricSample> Database::loadRunMetrics(int64_t run_id,
+                                                          std::optional<RunMetricScope> scope,
+                                                          std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+        std::vector<RunMetricSample> samples;
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return samples;
+        }
+
+        StatementLease stmt(db->statement(StatementId::LoadRunMetrics, error));
+        if (!stmt) {
+            return samples;
+        }
+        sqlite3_bind_int64(stmt.get(), 1, run_id);
+        sqlite3_bind_int(stmt.get(), 2, scope.has_value() ? static_cast<int>(*scope) : -1);
+
+        while (true) {
+            const int step_rc = sqlite3_step(stmt.get());
+            if (step_rc == SQLITE_DONE) {
+                break;
+            }
+            if (step_rc != SQLITE_ROW) {
+                db->setError(error);
+                break;
+            }
+
+            RunMetricSample sample;
+            sample.run_id = run_id;
+            sample.scope = static_cast<RunMetricScope>(sqlite3_column_int(stmt.get(), 0));
+            sample.scope_index = sqlite3_column_int(stmt.get(), 1);
+            sample.interval_start = sqlite3_column_double(stmt.get(), 2);
+            sample.interval_seconds = sqlite3_column_double(stmt.get(), 3);
+            sample.queue_avg = sqlite3_column_double(stmt.get(), 4);
+            sample.queue_max = sqlite3_column_double(stmt.get(), 5);
+            sample.stopped_avg = sqlite3_column_double(stmt.get(), 6);
+            sample.max_wait_seconds = sqlite3_column_double(stmt.get(), 7);
+            sample.green_fraction = sqlite3_column_double(stmt.get(), 8);
+            sample.vehicles_crossed = sqlite3_column_int64(stmt.get(), 9);
+            samples.push_back(sample);
+        }
+#else
+        (void)run_id;
+        (void)scope;
+        setRunHistoryUnavailable(error);
+#endif
+        return samples;
+    }
+
+    std::vector<RunConfigSummary> Database::compareRunsByConfig(std::string* error) const {
+        std::lock_guard<std::mutex> lock(connection_mutex);
+        std::vector<RunConfigSummary> summaries;
+#ifdef CROSSROADS_USE_SQLITE
+        Connection* db = acquireConnection(error);
+        if (!db) {
+            return summaries;
+        }
+
+        StatementLease stmt(db->statement(StatementId::CompareRunsByConfig, error));
+        if (!stmt) {
+            return summaries;
+        }
+
+        while (true) {
+            const int step_rc = sqlite3_step(stmt.get());
+            if (step_rc == SQLITE_DONE) {
+                break;
+            }
+            if (step_rc != SQLITE_ROW) {
+                db->setError(error);
+                break;
+            }
+
+            RunConfigSummary summary;
+            summary.config_hash = columnText(stmt.get(), 0);
+            summary.run_count = static_cast<std::size_t>(sqlite3_column_int64(stmt.get(), 1));
+            summary.average_wait_seconds = sqlite3_column_double(stmt.get(), 2);
+            summary.throughput_per_hour = sqlite3_column_double(stmt.get(), 3);
+            summary.safety_violations = static_cast<std::size_t>(sqlite3_column_int64(stmt.get(), 4));
+            summaries.push_back(summary);
+        }
+#else
+        setRunHistoryUnavailable(error);
+#endif
+        return summaries;
+    }
 }  // namespace crossroads::db
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
@@ -12,9 +17,77 @@ namespace crossroads::db {
         std::string last_used_at;
     };
 
+    // One page of the named-config library in name order. next_after is the cursor for the following page and
+    // empty on the last one.
+    struct NamedConfigPage {
+        std::vector<NamedConfigEntry> items;
+        std::string next_after;
+    };
+
+    struct NamedConfigRecord {
+        std::string name;
+        std::string config_json;
+    };
+
+    enum class RunMetricScope { Total = 0, Approach = 1, Route = 2 };
+
+    // One simulation run. Summary fields are filled in when the run is finished; ended_at stays empty until then.
+    struct RunRecord {
+        int64_t id = 0;
+        std::string started_at;
+        std::string ended_at;
+        std::string config_hash;
+        std::string parameters_json;
+        double sim_seconds = 0.0;
+        std::size_t vehicles_generated = 0;
+        std::size_t vehicles_crossed = 0;
+        double average_wait_seconds = 0.0;
+        std::size_t safety_violations = 0;
+    };
+
+    // Aggregate over one interval for the whole intersection, one approach (ApproachId order) or one route
+    // (approach * 3 + movement). Averages are time-weighted over the interval.
+    struct RunMetricSample {
+        int64_t run_id = 0;
+        RunMetricScope scope = RunMetricScope::Total;
+        int scope_index = 0;
+        double interval_start = 0.0;
+        double interval_seconds = 0.0;
+        double queue_avg = 0.0;
+        double queue_max = 0.0;
+        double stopped_avg = 0.0;
+        double max_wait_seconds = 0.0;
+        double green_fraction = 0.0;
+        int64_t vehicles_crossed = 0;  // Total scope only
+    };
+
+    struct RunConfigSummary {
+        std::string config_hash;
+        std::size_t run_count = 0;
+        double average_wait_seconds = 0.0;
+        double throughput_per_hour = 0.0;
+        std::size_t safety_violations = 0;
+    };
+
+    struct RunHistoryBatch {
+        std::vector<RunRecord> started;
+        std::vector<RunMetricSample> samples;
+        std::vector<RunRecord> finished;
+
+        bool empty() const {
+            return started.empty() && samples.empty() && finished.empty();
+        }
+    };
+
+    // One long-lived connection per Database (WAL journal, statements prepared once and reused). Every call
+    // takes the connection lock, so a single instance can be shared by all HTTP handler threads.
     class Database {
        public:
         explicit Database(std::string file_path);
+        ~Database();
+
+        Database(const Database&) = delete;
+        Database& operator=(const Database&) = delete;
 
         bool initialize(std::string* error = nullptr) const;
         bool saveActiveIntersectionConfigJson(const std::string& config_json, std::string* error = nullptr) const;
@@ -25,12 +98,46 @@ namespace crossroads::db {
         std::optional<std::string> loadNamedIntersectionConfigJson(const std::string& name,
                                                                    std::string* error = nullptr) const;
         std::vector<NamedConfigEntry> listNamedIntersectionConfigs(std::string* error = nullptr) const;
+        // Names starting with prefix (case-sensitive, empty for all) that sort after `after`, read from the name
+        // index so a page costs the same however large the library is.
+        NamedConfigPage listNamedIntersectionConfigPage(const std::string& prefix,
+                                                        const std::string& after,
+                                                        std::size_t limit,
+                                                        std::string* error = nullptr) const;
+        // Saves every record or none of them, in one transaction.
+        bool importNamedIntersectionConfigs(const std::vector<NamedConfigRecord>& records,
+                                            std::string* error = nullptr) const;
+        // Hands each stored config to row_sink in name order, reading a page at a time and releasing the connection
+        // between pages; a config saved meanwhile shows up if its name sorts after the current page. row_sink
+        // returns false to stop early, which is not an error.
+        bool exportNamedIntersectionConfigs(const std::function<bool(const NamedConfigRecord&)>& row_sink,
+                                            std::string* error = nullptr) const;
         bool deleteNamedIntersectionConfig(const std::string& name, std::string* error = nullptr) const;
         bool touchNamedIntersectionConfig(const std::string& name, std::string* error = nullptr) const;
         std::optional<std::string> loadMostRecentNamedConfigName(std::string* error = nullptr) const;
 
+        // Run history (SQLite only). Writes arrive in batches from RunHistoryWriter, one transaction per batch.
+        std::optional<int64_t> loadMaxRunId(std::string* error = nullptr) const;
+        bool writeRunHistoryBatch(const RunHistoryBatch& batch, std::string* error = nullptr) const;
+        // Newest first; an empty config_hash lists runs of every config.
+        std::vector<RunRecord> listRuns(const std::string& config_hash,
+                                        std::size_t limit,
+                                        std::string* error = nullptr) const;
+        std::optional<RunRecord> loadRun(int64_t run_id, std::string* error = nullptr) const;
+        std::vector<RunMetricSample> loadRunMetrics(int64_t run_id,
+                                                    std::optional<RunMetricScope> scope,
+                                                    std::string* error = nullptr) const;
+        // Finished runs grouped per config hash, lowest average wait first.
+        std::vector<RunConfigSummary> compareRunsByConfig(std::string* error = nullptr) const;
+
        private:
+        struct Connection;
+
+        Connection* acquireConnection(std::string* error) const;
+
         std::string file_path;
+        mutable std::mutex connection_mutex;
+        mutable std::unique_ptr<Connection> connection;
     };
 
 }  // namespace crossroads::db
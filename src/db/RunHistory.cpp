@@ -0,0 +1,274 @@
+#include "RunHistory.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace crossroads::db {
+    namespace {
+        constexpr std::size_t kRouteCount = 12;
+        constexpr std::size_t kApproachCount = 4;
+    }  // namespace
+
+    RunHistoryWriter::RunHistoryWriter(const Database& database, std::chrono::milliseconds flush_interval)
+        : database(database), flush_interval(flush_interval) {
+        next_run_id = database.loadMaxRunId().value_or(0) + 1;
+        worker = std::thread(&RunHistoryWriter::writerLoop, this);
+    }
+
+    RunHistoryWriter::~RunHistoryWriter() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    int64_t RunHistoryWriter::beginRun(const std::string& config_hash, const std::string& parameters_json) {
+        const int64_t run_id = next_run_id.fetch_add(1);
+        RunRecord run;
+        run.id = run_id;
+        run.config_hash = config_hash;
+        run.parameters_json = parameters_json;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            pending.started.push_back(std::move(run));
+            ++queued_generation;
+        }
+        return run_id;
+    }
+
+    void RunHistoryWriter::recordSamples(const std::vector<RunMetricSample>& samples) {
+        if (samples.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        pending.samples.insert(pending.samples.end(), samples.begin(), samples.end());
+        ++queued_generation;
+    }
+
+    void RunHistoryWriter::finishRun(const RunRecord& summary) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        pending.finished.push_back(summary);
+        ++queued_generation;
+    }
+
+    void RunHistoryWriter::flush() {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        const uint64_t target = queued_generation;
+        if (written_generation >= target) {
+            return;
+        }
+        flush_requested = true;
+        queue_changed.notify_all();
+        batch_written.wait(lock, [&]() { return written_generation >= target; });
+    }
+
+    std::size_t RunHistoryWriter::failedBatchCount() const {
+        return failed_batches.load();
+    }
+
+    void RunHistoryWriter::writerLoop() {
+        while (true) {
+            RunHistoryBatch batch;
+            uint64_t batch_generation = 0;
+            bool exit_after_write = false;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_changed.wait_for(lock, flush_interval, [&]() { return stopping || flush_requested; });
+                flush_requested = false;
+                exit_after_write = stopping;
+                std::swap(batch, pending);
+                batch_generation = queued_generation;
+            }
+
+            if (!batch.empty()) {
+                std::string error;
+                if (!database.writeRunHistoryBatch(batch, &error)) {
+                    ++failed_batches;
+                    std::cerr << "Warning: failed to write run history: " << error << std::endl;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                written_generation = batch_generation;
+            }
+            batch_written.notify_all();
+
+            if (exit_after_write) {
+                return;
+            }
+        }
+    }
+
+    RunMetricsSampler::RunMetricsSampler(double interval_seconds)
+        : interval_seconds(interval_seconds > 0.0 ? interval_seconds : 5.0) {
+    }
+
+    void RunMetricsSampler::begin(int64_t run_id, const SimulatorEngine& engine) {
+        const SimulatorMetrics metrics = engine.getMetrics();
+        this->run_id = run_id;
+        running = true;
+        interval_start = metrics.total_time;
+        crossed_at_interval_start = metrics.vehicles_crossed;
+        closed.clear();
+        clearAccumulators();
+    }
+
+    void RunMetricsSampler::end() {
+        running = false;
+    }
+
+    bool RunMetricsSampler::active() const {
+        return running;
+    }
+
+    int64_t RunMetricsSampler::runId() const {
+        return run_id;
+    }
+
+    bool RunMetricsSampler::observe(const SimulatorEngine& engine, double dt) {
+        if (!running || dt <= 0.0) {
+            return false;
+        }
+
+        engine.getRouteObservation(observation);
+        const SimulatorMetrics metrics = engine.getMetrics();
+
+        std::array<double, kApproachCount> approach_stopped{};
+        std::array<bool, kApproachCount> approach_green{};
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            const std::size_t approach_idx = route_idx / 3;
+            const double waiting = observation.waiting[route_idx];
+            const double stopped = observation.stopped[route_idx];
+            const double wait_seconds = observation.wait_seconds[route_idx];
+            route_waiting_area[route_idx] += waiting * dt;
+            route_waiting_max[route_idx] = std::max(route_waiting_max[route_idx], waiting);
+            route_stopped_area[route_idx] += stopped * dt;
+            route_max_wait[route_idx] = std::max(route_max_wait[route_idx], wait_seconds);
+            approach_max_wait[approach_idx] = std::max(approach_max_wait[approach_idx], wait_seconds);
+            total_max_wait = std::max(total_max_wait, wait_seconds);
+            approach_stopped[approach_idx] += stopped;
+            if (observation.lights[route_idx] == LightState::Green) {
+                route_green_seconds[route_idx] += dt;
+                approach_green[approach_idx] = true;
+            }
+        }
+
+        for (std::size_t approach_idx = 0; approach_idx < kApproachCount; ++approach_idx) {
+            const double queue = static_cast<double>(metrics.queue_lengths[approach_idx]);
+            approach_queue_area[approach_idx] += queue * dt;
+            approach_queue_max[approach_idx] = std::max(approach_queue_max[approach_idx], queue);
+            approach_stopped_area[approach_idx] += approach_stopped[approach_idx] * dt;
+            total_stopped_area += approach_stopped[approach_idx] * dt;
+            if (approach_green[approach_idx]) {
+                approach_green_seconds[approach_idx] += dt;
+            }
+        }
+        total_queue_area += static_cast<double>(metrics.total_queue_length) * dt;
+        total_queue_max = std::max(total_queue_max, static_cast<double>(metrics.total_queue_length));
+
+        elapsed += dt;
+        if (elapsed + 1e-9 < interval_seconds) {
+            return false;
+        }
+        closeInterval(engine);
+        return true;
+    }
+
+    bool RunMetricsSampler::closePartialInterval(const SimulatorEngine& engine) {
+        if (!running || elapsed <= 0.0) {
+            return false;
+        }
+        closeInterval(engine);
+        return true;
+    }
+
+    const std::vector<RunMetricSample>& RunMetricsSampler::samples() const {
+        return closed;
+    }
+
+    RunRecord RunMetricsSampler::summary(const SimulatorEngine& engine) const {
+        const SimulatorMetrics metrics = engine.getMetrics();
+        RunRecord run;
+        run.id = run_id;
+        run.sim_seconds = metrics.total_time;
+        run.vehicles_generated = metrics.vehicles_generated;
+        run.vehicles_crossed = metrics.vehicles_crossed;
+        run.average_wait_seconds = metrics.average_wait_time;
+        run.safety_violations = metrics.safety_violations;
+        return run;
+    }
+
+    void RunMetricsSampler::closeInterval(const SimulatorEngine& engine) {
+        const std::size_t crossed = engine.getMetrics().vehicles_crossed;
+        closed.clear();
+
+        auto make_sample = [&](RunMetricScope scope, int scope_index) {
+            RunMetricSample sample;
+            sample.run_id = run_id;
+            sample.scope = scope;
+            sample.scope_index = scope_index;
+            sample.interval_start = interval_start;
+            sample.interval_seconds = elapsed;
+            return sample;
+        };
+
+        RunMetricSample total = make_sample(RunMetricScope::Total, 0);
+        total.queue_avg = total_queue_area / elapsed;
+        total.queue_max = total_queue_max;
+        total.stopped_avg = total_stopped_area / elapsed;
+        total.max_wait_seconds = total_max_wait;
+        total.vehicles_crossed = static_cast<int64_t>(crossed - crossed_at_interval_start);
+        closed.push_back(total);
+
+        for (std::size_t approach_idx = 0; approach_idx < kApproachCount; ++approach_idx) {
+            RunMetricSample sample = make_sample(RunMetricScope::Approach, static_cast<int>(approach_idx));
+            sample.queue_avg = approach_queue_area[approach_idx] / elapsed;
+            sample.queue_max = approach_queue_max[approach_idx];
+            sample.stopped_avg = approach_stopped_area[approach_idx] / elapsed;
+            sample.max_wait_seconds = approach_max_wait[approach_idx];
+            sample.green_fraction = approach_green_seconds[approach_idx] / elapsed;
+            closed.push_back(sample);
+        }
+
+        for (std::size_t route_idx = 0; route_idx < kRouteCount; ++route_idx) {
+            if (!observation.configured[route_idx]) {
+                continue;
+            }
+            RunMetricSample sample = make_sample(RunMetricScope::Route, static_cast<int>(route_idx));
+            sample.queue_avg = route_waiting_area[route_idx] / elapsed;
+            sample.queue_max = route_waiting_max[route_idx];
+            sample.stopped_avg = route_stopped_area[route_idx] / elapsed;
+            sample.max_wait_seconds = route_max_wait[route_idx];
+            sample.green_fraction = route_green_seconds[route_idx] / elapsed;
+            closed.push_back(sample);
+        }
+
+        interval_start += elapsed;
+        crossed_at_interval_start = crossed;
+        clearAccumulators();
+    }
+
+    void RunMetricsSampler::clearAccumulators() {
+        elapsed = 0.0;
+        route_waiting_area = {};
+        route_waiting_max = {};
+        route_stopped_area = {};
+        route_max_wait = {};
+        route_green_seconds = {};
+        approach_queue_area = {};
+        approach_queue_max = {};
+        approach_stopped_area = {};
+        approach_max_wait = {};
+        approach_green_seconds = {};
+        total_queue_area = 0.0;
+        total_queue_max = 0.0;
+        total_stopped_area = 0.0;
+        total_max_wait = 0.0;
+    }
+}  // namespace crossroads::db
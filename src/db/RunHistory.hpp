@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Database.hpp"
+#include "SimulatorEngine.hpp"
+
+namespace crossroads::db {
+
+    // Queues run history and commits it from its own thread, one transaction per batch, so the simulation loop
+    // only ever takes a short in-memory lock. Run ids are handed out up front and do not wait for the insert.
+    class RunHistoryWriter {
+       public:
+        explicit RunHistoryWriter(const Database& database,
+                                  std::chrono::milliseconds flush_interval = std::chrono::milliseconds(500));
+        ~RunHistoryWriter();
+
+        RunHistoryWriter(const RunHistoryWriter&) = delete;
+        RunHistoryWriter& operator=(const RunHistoryWriter&) = delete;
+
+        int64_t beginRun(const std::string& config_hash, const std::string& parameters_json);
+        void recordSamples(const std::vector<RunMetricSample>& samples);
+        void finishRun(const RunRecord& summary);
+        // Blocks until everything queued before the call is committed (or failed).
+        void flush();
+        std::size_t failedBatchCount() const;
+
+       private:
+        void writerLoop();
+
+        const Database& database;
+        std::chrono::milliseconds flush_interval;
+        std::atomic<int64_t> next_run_id{1};
+        std::atomic<std::size_t> failed_batches{0};
+
+        std::mutex queue_mutex;
+        std::condition_variable queue_changed;
+        std::condition_variable batch_written;
+        RunHistoryBatch pending;
+        uint64_t queued_generation = 0;
+        uint64_t written_generation = 0;
+        bool flush_requested = false;
+        bool stopping = false;
+        std::thread worker;
+    };
+
+    // Folds per-tick engine state into fixed sim-time intervals: one Total row, one row per approach and one per
+    // configured route.
+    class RunMetricsSampler {
+       public:
+        explicit RunMetricsSampler(double interval_seconds = 5.0);
+
+        void begin(int64_t run_id, const SimulatorEngine& engine);
+        void end();
+        bool active() const;
+        int64_t runId() const;
+
+        // Call after every engine tick. Returns true when an interval closed; its rows are in samples().
+        bool observe(const SimulatorEngine& engine, double dt);
+        // Closes a partly filled interval, e.g. when the run ends. Returns false if nothing was accumulated.
+        bool closePartialInterval(const SimulatorEngine& engine);
+        const std::vector<RunMetricSample>& samples() const;
+        RunRecord summary(const SimulatorEngine& engine) const;
+
+       private:
+        void closeInterval(const SimulatorEngine& engine);
+        void clearAccumulators();
+
+        double interval_seconds;
+        int64_t run_id = 0;
+        bool running = false;
+        double interval_start = 0.0;
+        double elapsed = 0.0;
+        std::size_t crossed_at_interval_start = 0;
+
+        std::array<double, 12> route_waiting_area{};
+        std::array<double, 12> route_waiting_max{};
+        std::array<double, 12> route_stopped_area{};
+        std::array<double, 12> route_max_wait{};
+        std::array<double, 12> route_green_seconds{};
+        std::array<double, 4> approach_queue_area{};
+        std::array<double, 4> approach_queue_max{};
+        std::array<double, 4> approach_stopped_area{};
+        std::array<double, 4> approach_max_wait{};
+        std::array<double, 4> approach_green_seconds{};
+        double total_queue_area = 0.0;
+        double total_queue_max = 0.0;
+        double total_stopped_area = 0.0;
+        double total_max_wait = 0.0;
+
+        RouteObservation observation;
+        std::vector<RunMetricSample> closed;
+    };
+
+}  // namespace crossroads::db
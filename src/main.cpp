@@ -2,8 +2,11 @@
 #include <atomic>
 #include <cctype>
 #include <chrono>
+#include <cmath>
 #include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -11,11 +14,17 @@
 #include <thread>
 #include <vector>
 
+#include "ConfigBundle.hpp"
 #include "IntersectionConfigJson.hpp"
 #include "SafetyChecker.hpp"
+#include "SessionJournal.hpp"
+#include "SignalPlanOptimizer.hpp"
 #include "SimpleHttpUiServer.hpp"
+#include "SimulationSessions.hpp"
 #include "SimulatorEngine.hpp"
+#include "TrajectoryRecorder.hpp"
 #include "db/Database.hpp"
+#include "db/RunHistory.hpp"
 
 namespace {
     std::atomic<bool> g_keep_running{true};
@@ -29,6 +38,87 @@ namespace {
         return value;
     }
 
+    std::string percentDecode(const std::string& text) {
+        auto hexValue = [](char c) -> int {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return 10 + (c - 'a');
+            if (c >= 'A' && c <= 'F')
+                return 10 + (c - 'A');
+            return -1;
+        };
+
+        std::string out;
+        out.reserve(text.size());
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '+') {
+                out += ' ';
+            } else if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 &&
+                       hexValue(text[i + 2]) >= 0) {
+                out += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+                i += 2;
+            } else {
+                out += text[i];
+            }
+        }
+        return out;
+    }
+
+    std::optional<std::string> queryParameter(const std::string& path, const std::string& key) {
+        const std::size_t qmark = path.find('?');
+        if (qmark == std::string::npos) {
+            return std::nullopt;
+        }
+        std::istringstream query(path.substr(qmark + 1));
+        std::string pair;
+        while (std::getline(query, pair, '&')) {
+            const std::size_t eq = pair.find('=');
+            if (pair.substr(0, eq) == key) {
+                return eq == std::string::npos ? std::string() : percentDecode(pair.substr(eq + 1));
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<crossroads::ApproachId> approachFromName(const std::string& name) {
+        if (name == "north")
+            return crossroads::ApproachId::North;
+        if (name == "east")
+            return crossroads::ApproachId::East;
+        if (name == "south")
+            return crossroads::ApproachId::South;
+        if (name == "west")
+            return crossroads::ApproachId::West;
+        return std::nullopt;
+    }
+
+    const char* schedulerModeName(crossroads::SimulatorEngine::SchedulerMode mode) {
+        switch (mode) {
+            case crossroads::SimulatorEngine::SchedulerMode::Adaptive:
+                return "adaptive";
+            case crossroads::SimulatorEngine::SchedulerMode::FixedTime:
+                return "fixed_time";
+            case crossroads::SimulatorEngine::SchedulerMode::Predictive:
+                return "predictive";
+        }
+        return "adaptive";
+    }
+
+    nlohmann::json runToJson(const crossroads::db::RunRecord& run) {
+        nlohmann::json parameters = nlohmann::json::parse(run.parameters_json, nullptr, false);
+        return {{"id", run.id},
+                {"started_at", run.started_at},
+                {"ended_at", run.ended_at},
+                {"config_hash", run.config_hash},
+                {"parameters", parameters.is_discarded() ? nlohmann::json::object() : parameters},
+                {"sim_seconds", run.sim_seconds},
+                {"vehicles_generated", run.vehicles_generated},
+                {"vehicles_crossed", run.vehicles_crossed},
+                {"average_wait_seconds", run.average_wait_seconds},
+                {"safety_violations", run.safety_violations}};
+    }
+
     void handleSignal(int) {
         g_keep_running = false;
     }
@@ -44,7 +134,9 @@ int main() {
     constexpr double kDefaultTrafficRate = 0.8;
     constexpr double kNorthSouthDuration = 10.0;
     constexpr double kEastWestDuration = 10.0;
-    double traffic_rate = kDefaultTrafficRate;
+    constexpr double kTickSeconds = 0.1;
+    constexpr std::chrono::milliseconds kTickInterval(100);
+    const std::string kDefaultSessionId = "default";
 
     crossroads::db::Database database("crossroads.db");
     std::string db_error;
@@ -77,51 +169,154 @@ int main() {
         }
     }
 
-    crossroads::SimulatorEngine engine(initial_config, traffic_rate, kNorthSouthDuration, kEastWestDuration);
-    std::mutex engine_mutex;
-    std::atomic<bool> app_running{true};
-    std::optional<crossroads::IntersectionConfig> pending_config;
-    std::optional<crossroads::TrafficGenerator::SpawnLaneFilter> active_spawn_filter;
+    // Every engine lives in a session, ticked by the session workers. The default session is the one the UI
+    // drives, journals and keeps run history for; POST /sessions adds sandboxes with their own config and inputs.
+    crossroads::SimulationSessions sessions;
+    const std::shared_ptr<crossroads::SimulationSession> default_session =
+        sessions.createPinned(kDefaultSessionId,
+                              initial_config,
+                              {kDefaultTrafficRate, kNorthSouthDuration, kEastWestDuration, {}},
+                              kTickSeconds,
+                              kTickInterval);
+    crossroads::SimulatorEngine& engine = default_session->engine;
+    std::mutex& engine_mutex = default_session->mutex;
+    crossroads::SessionInputs& session_inputs = default_session->inputs;
+    double& traffic_rate = session_inputs.traffic_rate;
+    std::optional<crossroads::TrafficGenerator::SpawnLaneFilter>& active_spawn_filter = session_inputs.spawn_filter;
+    std::optional<crossroads::IntersectionConfig>& pending_config = default_session->pending_config;
+
+    // Every engine input goes through the session journal so a field session can be replayed tick for tick.
+    // CROSSROADS_SESSION_JOURNAL picks the file; an empty value turns recording off.
+    crossroads::SessionRecorder session_recorder;
+    const char* journal_env = std::getenv("CROSSROADS_SESSION_JOURNAL");
+    const std::string journal_path = journal_env ? journal_env : "crossroads-session.journal";
+    if (!journal_path.empty()) {
+        std::string journal_error;
+        if (!session_recorder.open(journal_path, initial_config, session_inputs, kTickSeconds, &journal_error)) {
+            std::cerr << "Warning: session recording disabled: " << journal_error << std::endl;
+        }
+    }
+
+    // Per-vehicle trajectories for calibration, recorded only when CROSSROADS_TRAJECTORY_FILE names a file.
+    crossroads::TrajectoryRecorder trajectory_recorder;
+    if (const char* trajectory_env = std::getenv("CROSSROADS_TRAJECTORY_FILE"); trajectory_env && *trajectory_env) {
+        std::string trajectory_error;
+        if (!trajectory_recorder.open(trajectory_env, &trajectory_error)) {
+            std::cerr << "Warning: trajectory recording disabled: " << trajectory_error << std::endl;
+        }
+    }
+
+    // Only the default session is journaled; the journal replays one engine.
+    auto applyInput = [&](crossroads::SimulationSession& session, crossroads::SessionEvent event) {
+        if (&session == default_session.get()) {
+            event.tick = session_recorder.tick();
+            session_recorder.record(event);
+        }
+        crossroads::applySessionEvent(session.engine, session.inputs, event);
+    };
+    auto applyCommand = [&](crossroads::SimulationSession& session, crossroads::SimulatorEngine::UICommand command) {
+        applyInput(session, crossroads::SessionEvent::makeCommand(command, session.tick_seconds));
+    };
+
+    // Run history is sampled under the engine lock and written by the writer thread.
+    crossroads::db::RunHistoryWriter run_history(database);
+    crossroads::db::RunMetricsSampler run_sampler;
+
+    auto beginRun = [&]() {
+        nlohmann::json parameters;
+        parameters["traffic_rate"] = traffic_rate;
+        parameters["scheduler_mode"] = schedulerModeName(engine.getSchedulerMode());
+        if (active_spawn_filter.has_value()) {
+            parameters["spawn_filter"] = {{"approach", crossroads::approachIndex(active_spawn_filter->approach)},
+                                          {"lane_index", active_spawn_filter->lane_index}};
+        }
+        const std::string config_hash = crossroads::intersectionConfigHash(engine.getIntersectionConfig());
+        run_sampler.begin(run_history.beginRun(config_hash, parameters.dump()), engine);
+    };
+
+    auto finishRun = [&]() {
+        if (!run_sampler.active()) {
+            return;
+        }
+        if (run_sampler.closePartialInterval(engine)) {
+            run_history.recordSamples(run_sampler.samples());
+        }
+        run_history.finishRun(run_sampler.summary(engine));
+        run_sampler.end();
+    };
+
+    // ?session=<id> picks the session a request is for; without it the request goes to the default session.
+    auto sessionForPath = [&](const std::string& path) {
+        return sessions.find(queryParameter(path, "session").value_or(kDefaultSessionId));
+    };
+    auto sessionNotFound = []() {
+        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+            404, crossroads::validationErrorsToJson({"session not found"})};
+    };
 
     crossroads::SimpleHttpUiServer server(
         8080,
-        [&]() {
-            std::lock_guard<std::mutex> lock(engine_mutex);
-            return engine.getSnapshotJson();
+        [&](const std::string& path) {
+            const std::shared_ptr<crossroads::SimulationSession> session = sessionForPath(path);
+            if (!session) {
+                return sessionNotFound();
+            }
+            std::lock_guard<std::mutex> lock(session->mutex);
+            return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, session->engine.getSnapshotJson()};
         },
-        [&](const std::string& cmd) {
-            std::lock_guard<std::mutex> lock(engine_mutex);
+        [&](const std::string& cmd, const std::string& path) {
+            const std::shared_ptr<crossroads::SimulationSession> session = sessionForPath(path);
+            if (!session) {
+                return sessionNotFound();
+            }
+            std::lock_guard<std::mutex> lock(session->mutex);
+
+            // Run history follows the default session only
+            const bool has_run_history = session == default_session;
+            auto finishSessionRun = [&]() {
+                if (has_run_history) {
+                    finishRun();
+                }
+            };
+            auto beginSessionRun = [&]() {
+                if (has_run_history && !run_sampler.active()) {
+                    beginRun();
+                }
+            };
 
             auto applyPendingConfigIfNeeded = [&]() {
-                if (!pending_config.has_value()) {
+                if (!session->pending_config.has_value()) {
                     return;
                 }
-                engine =
-                    crossroads::SimulatorEngine(*pending_config, traffic_rate, kNorthSouthDuration, kEastWestDuration);
-                engine.setTrafficRate(traffic_rate);
-                engine.setSpawnLaneFilter(active_spawn_filter);
-                pending_config.reset();
+                applyInput(*session, crossroads::SessionEvent::makeApplyConfig(*session->pending_config));
+                session->pending_config.reset();
             };
 
             if (cmd == "start") {
-                if (!engine.isRunning()) {
+                if (!session->engine.isRunning()) {
+                    if (session->pending_config.has_value()) {
+                        finishSessionRun();
+                    }
                     applyPendingConfigIfNeeded();
                 }
-                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Start);
+                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Start);
+                beginSessionRun();
             } else if (cmd == "stop")
-                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Stop);
+                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Stop);
             else if (cmd == "reset") {
+                finishSessionRun();
                 applyPendingConfigIfNeeded();
-                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Reset);
+                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Reset);
             } else if (cmd == "step")
-                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Step, 0.1);
+                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Step);
             else if (cmd == "spawn_focus:all") {
-                const bool was_running = engine.isRunning();
-                active_spawn_filter.reset();
-                engine.setSpawnLaneFilter(active_spawn_filter);
-                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Reset);
+                const bool was_running = session->engine.isRunning();
+                finishSessionRun();
+                applyInput(*session, crossroads::SessionEvent::makeSpawnFilter(std::nullopt));
+                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Reset);
                 if (was_running) {
-                    engine.handleCommand(crossroads::SimulatorEngine::UICommand::Start);
+                    applyCommand(*session, crossroads::SimulatorEngine::UICommand::Start);
+                    beginSessionRun();
                 }
             } else if (cmd.rfind("spawn_focus:", 0) == 0) {
                 const std::string payload = cmd.substr(std::string("spawn_focus:").size());
@@ -158,15 +353,16 @@ int main() {
                     try {
                         int lane_index_raw = std::stoi(lane_text);
                         if (lane_index_raw >= 0) {
-                            const bool was_running = engine.isRunning();
+                            const bool was_running = session->engine.isRunning();
                             crossroads::TrafficGenerator::SpawnLaneFilter filter;
                             filter.approach = approach;
                             filter.lane_index = static_cast<uint16_t>(lane_index_raw);
-                            active_spawn_filter = filter;
-                            engine.setSpawnLaneFilter(active_spawn_filter);
-                            engine.handleCommand(crossroads::SimulatorEngine::UICommand::Reset);
+                            finishSessionRun();
+                            applyInput(*session, crossroads::SessionEvent::makeSpawnFilter(filter));
+                            applyCommand(*session, crossroads::SimulatorEngine::UICommand::Reset);
                             if (was_running) {
-                                engine.handleCommand(crossroads::SimulatorEngine::UICommand::Start);
+                                applyCommand(*session, crossroads::SimulatorEngine::UICommand::Start);
+                                beginSessionRun();
                             }
                         }
                     } catch (...) {
@@ -176,11 +372,11 @@ int main() {
                 const std::string rate_text = cmd.substr(std::string("spawn_rate:").size());
                 try {
                     const double parsed = std::stod(rate_text);
-                    traffic_rate = std::max(0.0, parsed);
-                    engine.setTrafficRate(traffic_rate);
+                    applyInput(*session, crossroads::SessionEvent::makeTrafficRate(std::max(0.0, parsed)));
                 } catch (...) {
                 }
             }
+            return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, "ok", "text/plain"};
         },
         [&]() {
             std::lock_guard<std::mutex> lock(engine_mutex);
@@ -190,9 +386,73 @@ int main() {
             return crossroads::intersectionConfigToJson(engine.getIntersectionConfig());
         },
         [&](const std::string& body) {
+            nlohmann::json request = nlohmann::json::parse(body, nullptr, false);
+
+            // Plan optimization runs many headless simulations, so it must not hold the engine lock.
+            if (request.is_object() && request.contains("action") && request["action"].is_string() &&
+                request["action"].get<std::string>() == "optimize_plan") {
+                crossroads::IntersectionConfig base_config;
+                if (request.contains("config")) {
+                    const std::string config_json =
+                        request["config"].is_string() ? request["config"].get<std::string>() : request["config"].dump();
+                    crossroads::ConfigParseResult parsed = crossroads::intersectionConfigFromJson(config_json);
+                    if (!parsed.ok) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson(parsed.errors)};
+                    }
+                    base_config = parsed.config;
+                } else {
+                    std::lock_guard<std::mutex> lock(engine_mutex);
+                    base_config = pending_config.has_value() ? *pending_config : engine.getIntersectionConfig();
+                }
+
+                if (!request.contains("demand") || !request["demand"].is_array()) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        400, crossroads::validationErrorsToJson({"demand must be an array"})};
+                }
+
+                std::vector<crossroads::LaneDemand> demand;
+                for (const auto& entry : request["demand"]) {
+                    if (!entry.is_object() || !entry.contains("lane_id") || !entry["lane_id"].is_number_unsigned() ||
+                        !entry.contains("vehicles_per_hour") || !entry["vehicles_per_hour"].is_number()) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400,
+                            crossroads::validationErrorsToJson(
+                                {"demand entries need lane_id and vehicles_per_hour"})};
+                    }
+                    demand.push_back({entry["lane_id"].get<crossroads::LaneId>(),
+                                      entry["vehicles_per_hour"].get<double>()});
+                }
+
+                crossroads::SignalPlanOptimizer optimizer;
+                const crossroads::SignalPlanResult result = optimizer.optimize(base_config, demand);
+                if (!result.ok) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        400, crossroads::validationErrorsToJson(result.errors)};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["cycle_seconds"] = result.cycle_seconds;
+                resp["average_delay_seconds"] = result.average_delay_seconds;
+                resp["initial_average_delay_seconds"] = result.initial_average_delay_seconds;
+                resp["evaluations"] = result.evaluations;
+                resp["config"] = nlohmann::json::parse(result.config_json);
+
+                if (request.contains("save_as") && request["save_as"].is_string()) {
+                    const std::string name = trimCopy(request["save_as"].get<std::string>());
+                    std::string error;
+                    if (!name.empty() && !database.saveNamedIntersectionConfigJson(name, result.config_json, &error)) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            500, crossroads::validationErrorsToJson({"database error: " + error})};
+                    }
+                    resp["name"] = name;
+                }
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
             std::lock_guard<std::mutex> lock(engine_mutex);
 
-            nlohmann::json request = nlohmann::json::parse(body, nullptr, false);
             if (request.is_object() && request.contains("action") && request["action"].is_string()) {
                 const std::string action = request["action"].get<std::string>();
                 std::string error;
@@ -340,6 +600,55 @@ int main() {
                     return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
                 }
 
+                if (action == "apply_live") {
+                    if (!request.contains("config")) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson({"config is required"})};
+                    }
+
+                    const std::string config_json =
+                        request["config"].is_string() ? request["config"].get<std::string>() : request["config"].dump();
+                    crossroads::ConfigParseResult parsed = crossroads::intersectionConfigFromJson(config_json);
+                    if (!parsed.ok) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson(parsed.errors)};
+                    }
+
+                    crossroads::SafetyChecker checker(parsed.config);
+                    if (!checker.isConfigValid()) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson({"config failed safety validation rules"})};
+                    }
+                    const std::string normalized_json = crossroads::intersectionConfigToJson(parsed.config);
+                    if (!database.saveActiveIntersectionConfigJson(normalized_json, &error)) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            500, crossroads::validationErrorsToJson({"database error: " + error})};
+                    }
+
+                    // The run history is keyed by config hash, so the swap closes the current run.
+                    const bool was_sampling = run_sampler.active();
+                    finishRun();
+                    crossroads::SessionEvent event = crossroads::SessionEvent::makeSwapConfig(parsed.config);
+                    event.tick = session_recorder.tick();
+                    session_recorder.record(event);
+                    crossroads::ConfigSwapReport report;
+                    crossroads::applySessionEvent(engine, session_inputs, event, &report);
+                    pending_config.reset();
+                    if (was_sampling && engine.isRunning()) {
+                        beginRun();
+                    }
+
+                    nlohmann::json resp;
+                    resp["ok"] = true;
+                    resp["state"] = "applied";
+                    resp["layout_changed"] = report.layout_changed;
+                    resp["timing_changed"] = report.timing_changed;
+                    resp["signal_plan_changed"] = report.signal_plan_changed;
+                    resp["vehicles_kept"] = report.vehicles_kept;
+                    resp["vehicles_removed"] = report.vehicles_removed;
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+                }
+
                 return crossroads::SimpleHttpUiServer::ConfigMutationResult{
                     400, crossroads::validationErrorsToJson({"unknown action"})};
             }
@@ -366,6 +675,339 @@ int main() {
             pending_config = parsed.config;
             return crossroads::SimpleHttpUiServer::ConfigMutationResult{
                 200, "{\"ok\":true,\"state\":\"pending\",\"apply_on\":\"start_or_reset\"}"};
+        },
+        [&](const std::string& method, const std::string& path) {
+            if (method != "GET") {
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    405, crossroads::validationErrorsToJson({"method not allowed"})};
+            }
+
+            // Answer from committed rows, including whatever the running simulation queued so far.
+            run_history.flush();
+
+            const std::size_t qmark = path.find('?');
+            const std::string clean_path = qmark == std::string::npos ? path : path.substr(0, qmark);
+            std::string error;
+
+            if (clean_path == "/runs" || clean_path == "/runs/") {
+                std::size_t limit = 50;
+                if (auto limit_text = queryParameter(path, "limit"); limit_text.has_value()) {
+                    try {
+                        limit = static_cast<std::size_t>(std::max(1, std::stoi(*limit_text)));
+                    } catch (...) {
+                    }
+                }
+                const auto runs = database.listRuns(queryParameter(path, "config_hash").value_or(""), limit, &error);
+                if (!error.empty()) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        500, crossroads::validationErrorsToJson({"database error: " + error})};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["items"] = nlohmann::json::array();
+                for (const auto& run : runs) {
+                    resp["items"].push_back(runToJson(run));
+                }
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
+            if (clean_path == "/runs/compare") {
+                const auto summaries = database.compareRunsByConfig(&error);
+                if (!error.empty()) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        500, crossroads::validationErrorsToJson({"database error: " + error})};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["items"] = nlohmann::json::array();
+                for (const auto& summary : summaries) {
+                    resp["items"].push_back({{"config_hash", summary.config_hash},
+                                             {"run_count", summary.run_count},
+                                             {"average_wait_seconds", summary.average_wait_seconds},
+                                             {"throughput_per_hour", summary.throughput_per_hour},
+                                             {"safety_violations", summary.safety_violations}});
+                }
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
+            int64_t run_id = 0;
+            try {
+                std::size_t consumed = 0;
+                const std::string id_text = clean_path.substr(std::string("/runs/").size());
+                run_id = std::stoll(id_text, &consumed);
+                if (consumed != id_text.size()) {
+                    run_id = 0;
+                }
+            } catch (...) {
+            }
+            if (run_id <= 0) {
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    404, crossroads::validationErrorsToJson({"unknown runs endpoint"})};
+            }
+
+            std::optional<crossroads::db::RunMetricScope> scope;
+            const std::string scope_text = queryParameter(path, "scope").value_or("");
+            if (scope_text == "total") {
+                scope = crossroads::db::RunMetricScope::Total;
+            } else if (scope_text == "approach") {
+                scope = crossroads::db::RunMetricScope::Approach;
+            } else if (scope_text == "route") {
+                scope = crossroads::db::RunMetricScope::Route;
+            } else if (!scope_text.empty()) {
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    400, crossroads::validationErrorsToJson({"scope must be total, approach or route"})};
+            }
+
+            const auto run = database.loadRun(run_id, &error);
+            if (!run.has_value()) {
+                const std::string msg = !error.empty() ? ("database error: " + error) : "run not found";
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    404, crossroads::validationErrorsToJson({msg})};
+            }
+
+            static const char* const kScopeNames[] = {"total", "approach", "route"};
+            nlohmann::json resp;
+            resp["ok"] = true;
+            resp["run"] = runToJson(*run);
+            resp["metrics"] = nlohmann::json::array();
+            for (const auto& sample : database.loadRunMetrics(run_id, scope, &error)) {
+                resp["metrics"].push_back({{"scope", kScopeNames[static_cast<int>(sample.scope)]},
+                                           {"index", sample.scope_index},
+                                           {"interval_start", sample.interval_start},
+                                           {"interval_seconds", sample.interval_seconds},
+                                           {"queue_avg", sample.queue_avg},
+                                           {"queue_max", sample.queue_max},
+                                           {"stopped_avg", sample.stopped_avg},
+                                           {"max_wait_seconds", sample.max_wait_seconds},
+                                           {"green_fraction", sample.green_fraction},
+                                           {"vehicles_crossed", sample.vehicles_crossed}});
+            }
+            return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+        },
+        [&](const std::string& method, const std::string& path, const std::string& body) {
+            const std::size_t qmark = path.find('?');
+            const std::string clean_path = qmark == std::string::npos ? path : path.substr(0, qmark);
+            std::string error;
+
+            if (method == "GET" && (clean_path == "/config/library" || clean_path == "/config/library/")) {
+                std::size_t limit = 50;
+                if (auto limit_text = queryParameter(path, "limit"); limit_text.has_value()) {
+                    try {
+                        limit = static_cast<std::size_t>(std::clamp(std::stoi(*limit_text), 1, 500));
+                    } catch (...) {
+                    }
+                }
+                const auto page = database.listNamedIntersectionConfigPage(queryParameter(path, "prefix").value_or(""),
+                                                                           queryParameter(path, "after").value_or(""),
+                                                                           limit,
+                                                                           &error);
+                if (!error.empty()) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        500, crossroads::validationErrorsToJson({"database error: " + error})};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["items"] = nlohmann::json::array();
+                for (const auto& entry : page.items) {
+                    resp["items"].push_back({{"name", entry.name},
+                                             {"updated_at", entry.updated_at},
+                                             {"last_used_at", entry.last_used_at}});
+                }
+                resp["next_after"] = page.next_after;
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
+            if (method == "GET" && clean_path == "/config/library/export") {
+                // Sent a line at a time as the pages are read, so the library is never held in memory as a whole
+                crossroads::SimpleHttpUiServer::ConfigMutationResult result{200, "", "application/x-ndjson"};
+                result.stream = [&database](const crossroads::SimpleHttpUiServer::BodyWriter& write) {
+                    std::string line;
+                    std::string export_error;
+                    if (!database.exportNamedIntersectionConfigs(
+                            [&](const crossroads::db::NamedConfigRecord& record) {
+                                line.clear();
+                                crossroads::appendConfigBundleLine(line, record.name, record.config_json);
+                                return write(line);
+                            },
+                            &export_error)) {
+                        std::cerr << "Warning: config library export failed: " << export_error << std::endl;
+                        return false;
+                    }
+                    return true;
+                };
+                return result;
+            }
+
+            if (method == "POST" && clean_path == "/config/library/import") {
+                const crossroads::ConfigBundleParseResult bundle = crossroads::parseConfigBundle(body);
+                if (!bundle.ok) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        400, crossroads::validationErrorsToJson(bundle.errors)};
+                }
+
+                std::vector<crossroads::db::NamedConfigRecord> records;
+                records.reserve(bundle.entries.size());
+                for (const auto& entry : bundle.entries) {
+                    records.push_back({entry.name, entry.config_json});
+                }
+                if (!database.importNamedIntersectionConfigs(records, &error)) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        500, crossroads::validationErrorsToJson({"database error: " + error})};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["imported"] = records.size();
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
+            return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                404, crossroads::validationErrorsToJson({"unknown config library endpoint"})};
+        },
+        [&](const std::string& method, const std::string& path, const std::string& body) {
+            const std::size_t qmark = path.find('?');
+            const std::string clean_path = qmark == std::string::npos ? path : path.substr(0, qmark);
+            std::string error;
+
+            if (clean_path == "/sessions" || clean_path == "/sessions/") {
+                if (method == "GET") {
+                    nlohmann::json resp;
+                    resp["ok"] = true;
+                    resp["items"] = nlohmann::json::array();
+                    for (const auto& info : sessions.list()) {
+                        resp["items"].push_back({{"id", info.id},
+                                                 {"pinned", info.pinned},
+                                                 {"running", info.running},
+                                                 {"sim_time", info.sim_time},
+                                                 {"traffic_rate", info.traffic_rate},
+                                                 {"tick_seconds", info.tick_seconds},
+                                                 {"tick_interval_ms", info.tick_interval_ms},
+                                                 {"idle_seconds", info.idle_seconds},
+                                                 {"home_worker", info.home_worker}});
+                    }
+                    resp["workers"] = nlohmann::json::array();
+                    for (const auto& stats : sessions.workerStats()) {
+                        resp["workers"].push_back({{"worker", stats.worker},
+                                                   {"home_sessions", stats.home_sessions},
+                                                   {"ticks", stats.ticks},
+                                                   {"stolen_ticks", stats.stolen_ticks},
+                                                   {"busy_seconds", stats.busy_seconds},
+                                                   {"utilization", stats.utilization}});
+                    }
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+                }
+                if (method != "POST") {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        405, crossroads::validationErrorsToJson({"method not allowed"})};
+                }
+
+                nlohmann::json request =
+                    trimCopy(body).empty() ? nlohmann::json::object() : nlohmann::json::parse(body, nullptr, false);
+                if (!request.is_object()) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        400, crossroads::validationErrorsToJson({"body must be a JSON object"})};
+                }
+
+                // A new session starts from the default session's config unless the request brings its own.
+                crossroads::IntersectionConfig config;
+                if (request.contains("config")) {
+                    const std::string config_json =
+                        request["config"].is_string() ? request["config"].get<std::string>() : request["config"].dump();
+                    crossroads::ConfigParseResult parsed = crossroads::intersectionConfigFromJson(config_json);
+                    if (!parsed.ok) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson(parsed.errors)};
+                    }
+                    crossroads::SafetyChecker checker(parsed.config);
+                    if (!checker.isConfigValid()) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson({"config failed safety validation rules"})};
+                    }
+                    config = parsed.config;
+                } else {
+                    std::lock_guard<std::mutex> lock(engine_mutex);
+                    config = pending_config.has_value() ? *pending_config : engine.getIntersectionConfig();
+                }
+
+                crossroads::SessionInputs inputs{kDefaultTrafficRate,
+                                                 kNorthSouthDuration,
+                                                 kEastWestDuration,
+                                                 {},
+                                                 crossroads::SimulatorEngine::SchedulerMode::Adaptive};
+                if (request.contains("traffic_rate")) {
+                    if (!request["traffic_rate"].is_number() || request["traffic_rate"].get<double>() < 0.0) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson({"traffic_rate must be a number >= 0"})};
+                    }
+                    inputs.traffic_rate = request["traffic_rate"].get<double>();
+                }
+                if (request.contains("spawn_filter") && !request["spawn_filter"].is_null()) {
+                    const nlohmann::json& filter_json = request["spawn_filter"];
+                    std::optional<crossroads::ApproachId> approach;
+                    if (filter_json.is_object() && filter_json.contains("approach") &&
+                        filter_json["approach"].is_string()) {
+                        approach = approachFromName(filter_json["approach"].get<std::string>());
+                    }
+                    if (!approach.has_value() || !filter_json.contains("lane_index") ||
+                        !filter_json["lane_index"].is_number_unsigned()) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400,
+                            crossroads::validationErrorsToJson(
+                                {"spawn_filter needs approach (north, east, south or west) and lane_index"})};
+                    }
+                    crossroads::TrafficGenerator::SpawnLaneFilter filter;
+                    filter.approach = *approach;
+                    filter.lane_index = filter_json["lane_index"].get<uint16_t>();
+                    inputs.spawn_filter = filter;
+                }
+
+                // speed is simulated seconds per wall second; every session ticks kTickSeconds at a time.
+                double speed = 1.0;
+                if (request.contains("speed")) {
+                    if (!request["speed"].is_number() || request["speed"].get<double>() < 0.1 ||
+                        request["speed"].get<double>() > 10.0) {
+                        return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                            400, crossroads::validationErrorsToJson({"speed must be between 0.1 and 10"})};
+                    }
+                    speed = request["speed"].get<double>();
+                }
+                const std::chrono::milliseconds interval(
+                    std::max<int64_t>(1, static_cast<int64_t>(std::llround(kTickInterval.count() / speed))));
+
+                const std::shared_ptr<crossroads::SimulationSession> session =
+                    sessions.create(config, inputs, kTickSeconds, interval, &error);
+                if (!session) {
+                    return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                        503, crossroads::validationErrorsToJson({error})};
+                }
+
+                nlohmann::json resp;
+                resp["ok"] = true;
+                resp["id"] = session->id;
+                resp["tick_interval_ms"] = interval.count();
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
+            }
+
+            const std::string id = clean_path.substr(std::string("/sessions/").size());
+            if (method != "DELETE") {
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    405, crossroads::validationErrorsToJson({"method not allowed"})};
+            }
+            if (!sessions.find(id)) {
+                return sessionNotFound();
+            }
+            if (!sessions.destroy(id, &error)) {
+                return crossroads::SimpleHttpUiServer::ConfigMutationResult{
+                    400, crossroads::validationErrorsToJson({error})};
+            }
+
+            nlohmann::json resp;
+            resp["ok"] = true;
+            resp["id"] = id;
+            return crossroads::SimpleHttpUiServer::ConfigMutationResult{200, resp.dump()};
         });
 
     if (!server.start()) {
@@ -373,15 +1015,17 @@ int main() {
         return 1;
     }
 
-    std::thread sim_thread([&]() {
-        while (app_running) {
-            {
-                std::lock_guard<std::mutex> lock(engine_mutex);
-                engine.tick(0.1);
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Runs under the default session's lock, right after each of its ticks
+    default_session->after_tick = [&](crossroads::SimulationSession& session) {
+        session_recorder.advanceTick();
+        if (session.engine.isRunning() && run_sampler.observe(session.engine, session.tick_seconds)) {
+            run_history.recordSamples(run_sampler.samples());
+        }
+        if (session.engine.isRunning()) {
+            trajectory_recorder.record(session.engine);
         }
-    });
+    };
+    sessions.start();
 
     std::cout << "Open UI at: http://localhost:8080" << std::endl;
     std::cout << "Press Ctrl+C to stop server..." << std::endl;
@@ -390,10 +1034,13 @@ int main() {
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
 
-    app_running = false;
-    if (sim_thread.joinable()) {
-        sim_thread.join();
+    sessions.stop();
+    {
+        std::lock_guard<std::mutex> lock(engine_mutex);
+        finishRun();
+        session_recorder.close();
     }
+    trajectory_recorder.close();
     server.stop();
 
     std::cout << "UI server stopped." << std::endl;
@@ -0,0 +1,57 @@
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "SessionJournal.hpp"
+
+namespace {
+    void printUsage() {
+        std::cerr << "Usage: crossroads_replay <journal> [--seek TICK] [--until-violation]" << std::endl;
+    }
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printUsage();
+        return 2;
+    }
+
+    std::optional<uint64_t> seek_tick;
+    bool until_violation = false;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--seek" && i + 1 < argc) {
+            seek_tick = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--until-violation") {
+            until_violation = true;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    crossroads::SessionJournal journal;
+    std::string error;
+    if (!crossroads::readSessionJournal(argv[1], journal, &error)) {
+        std::cerr << "Failed to read journal: " << error << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Journal: " << journal.events.size() << " inputs over " << journal.end_tick << " ticks"
+              << (journal.truncated ? " (truncated tail)" : "") << std::endl;
+
+    crossroads::SessionReplayer replayer(std::move(journal));
+    if (until_violation) {
+        if (auto tick = replayer.runToNextSafetyViolation(); tick.has_value()) {
+            std::cerr << "Safety violation during tick " << (*tick - 1) << std::endl;
+        } else {
+            std::cerr << "No safety violation in the journal" << std::endl;
+        }
+    } else {
+        replayer.seek(seek_tick.value_or(replayer.endTick()));
+    }
+
+    std::cout << replayer.engine().getSnapshotJson() << std::endl;
+    return 0;
+}
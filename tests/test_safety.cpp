@@ -1,14 +1,71 @@
 #define CATCH_CONFIG_MAIN
+#include <algorithm>
+#include <atomic>
 #include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <map>
 #include <memory>
+#include <new>
 #include <nlohmann/json.hpp>
+#include <thread>
 
 #include "BasicLightController.hpp"
+#include "ConfigBundle.hpp"
 #include "IntersectionConfigJson.hpp"
+#include "IntersectionTopology.hpp"
+#include "ParallelFor.hpp"
 #include "SafetyChecker.hpp"
+#include "SessionJournal.hpp"
+#include "SignalPlanOptimizer.hpp"
+#include "SimulationSessions.hpp"
 #include "SimulatorEngine.hpp"
 #include "TrafficGenerator.hpp"
 #include "TrafficLightControllers.hpp"
+#include "TrajectoryRecorder.hpp"
+#include "TrainingEnvironment.hpp"
+#include "crossroads_env.h"
+#include "db/Database.hpp"
+#include "db/RunHistory.hpp"
+
+// Counting allocator for the allocation-free tick test: while counting, every global operator new is tallied.
+namespace {
+    std::atomic<bool> count_allocations{false};
+    std::atomic<std::size_t> counted_allocations{0};
+}  // namespace
+
+void* operator new(std::size_t size) {
+    if (count_allocations.load(std::memory_order_relaxed)) {
+        counted_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
 
 using namespace crossroads;
 
@@ -380,7 +437,7 @@ TEST_CASE("TrafficGenerator vehicle crossing simulation", "traffic") {
     REQUIRE(started == true);
 
     // Complete crossing after 2 seconds (typical crossing time)
-    bool completed = gen.completeCrossing(vid, 2.6);
+    bool completed = gen.completeCrossing(vid);
     REQUIRE(completed == true);
 
     // Should have one less vehicle waiting
@@ -1164,6 +1221,60 @@ TEST_CASE("IntersectionConfig JSON parser rejects malformed structure", "[config
     REQUIRE_FALSE(parsed.errors.empty());
 }
 
+TEST_CASE("IntersectionConfig JSON writer matches the DOM serialization and hash", "[config][json]") {
+    IntersectionConfig config = makeDefaultIntersectionConfig();
+    config.approaches[1].name = "East \"Main\"\t\x01 stra\xc3\x9f" "e\\";
+    config.signal_groups = {{3, "NS", {laneIdFor(ApproachId::North, 0)}, {MovementType::Straight}, 7.25, 1e-5},
+                            {4, "EW", {laneIdFor(ApproachId::East, 0)}, {MovementType::Straight}, 123456789.0, 0.1}};
+
+    const std::string json_text = intersectionConfigToJson(config);
+    REQUIRE(json_text == nlohmann::json::parse(json_text).dump());
+    REQUIRE(intersectionConfigToJson(makeDefaultIntersectionConfig()) ==
+            nlohmann::json::parse(intersectionConfigToJson(makeDefaultIntersectionConfig())).dump());
+
+    uint64_t expected = 1469598103934665603ULL;
+    for (unsigned char ch : json_text) {
+        expected ^= ch;
+        expected *= 1099511628211ULL;
+    }
+    REQUIRE(intersectionConfigFingerprint(config) == expected);
+
+    const ConfigParseResult parsed = intersectionConfigFromJson(json_text);
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.config.approaches[1].name == config.approaches[1].name);
+    REQUIRE(intersectionConfigHash(parsed.config) == intersectionConfigHash(config));
+}
+
+TEST_CASE("IntersectionConfig JSON parser resolves lane ids and reports wrong field types", "[config][json]") {
+    const nlohmann::json defaults = nlohmann::json::parse(intersectionConfigToJson(makeDefaultIntersectionConfig()));
+    const std::string approaches = defaults["approaches"].dump();
+
+    const ConfigParseResult by_id = intersectionConfigFromJson(
+        R"({"lane_connections":[{"from_lane_id":0,"movement":"straight","to_lane_id":200}],"extra":{"a":[1,{"b":[]}]},)"
+        R"("approaches":)" +
+        approaches + "}");
+    REQUIRE(by_id.ok);
+    REQUIRE(by_id.config.lane_connections.size() == 1);
+    REQUIRE(by_id.config.lane_connections[0].from_approach == ApproachId::North);
+    REQUIRE(by_id.config.lane_connections[0].to_approach == ApproachId::South);
+    REQUIRE(by_id.config.lane_connections[0].to_lane_index == 0);
+
+    nlohmann::json wrong_types = defaults;
+    wrong_types["approaches"][0]["name"] = 5;
+    wrong_types["approaches"][1]["lanes"][0]["has_traffic_light"] = "yes";
+    ConfigParseResult rejected;
+    REQUIRE_NOTHROW(rejected = intersectionConfigFromJson(wrong_types.dump()));
+    REQUIRE_FALSE(rejected.ok);
+    REQUIRE(rejected.errors.size() == 2);
+    REQUIRE(rejected.errors[0] == "approach north name must be a string");
+    REQUIRE(rejected.errors[1] == "lane 100 has_traffic_light must be a boolean");
+
+    const ConfigParseResult truncated = intersectionConfigFromJson(R"({"approaches":[)");
+    REQUIRE_FALSE(truncated.ok);
+    REQUIRE(truncated.errors.size() == 1);
+    REQUIRE(truncated.errors[0].rfind("invalid JSON: ", 0) == 0);
+}
+
 TEST_CASE("SafetyChecker rejects invalid lane configuration", "[safety][config]") {
     IntersectionConfig invalid = makeDefaultIntersectionConfig();
     invalid.approaches[0].lanes[0].allowed_movements.clear();
@@ -1866,6 +1977,37 @@ TEST_CASE("TrafficGenerator changes to preferred right lane early", "[traffic][l
     REQUIRE(north.front().turning == true);
 }
 
+TEST_CASE("TrafficGenerator lane changes respect the gap to vehicles that already moved over", "[traffic][lane-change]") {
+    IntersectionConfig config = makeDefaultIntersectionConfig();
+    config.approaches[0].lanes = {{300, "N-left", {MovementType::Left}, true},
+                                  {301, "N-straight", {MovementType::Straight}, true},
+                                  {302, "N-right", {MovementType::Right}, true}};
+
+    TrafficGenerator gen(config, 1.0);
+    auto& north = gen.getQueueByDirection(Direction::North);
+    auto push = [&](uint32_t id, LaneId lane, MovementType movement, double position) {
+        Vehicle vehicle(id, Direction::North, 0.0);
+        vehicle.lane_id = lane;
+        vehicle.movement = movement;
+        vehicle.turning = movement != MovementType::Straight;
+        vehicle.position_in_lane = position;
+        north.push_back(vehicle);
+    };
+    push(1, 300, MovementType::Right, 30.0);
+    push(2, 302, MovementType::Right, 20.0);
+    push(3, 301, MovementType::Right, 12.0);
+    push(4, 300, MovementType::Right, 10.0);  // 2 m behind vehicle 3 once that one has moved over
+    push(5, 301, MovementType::Straight, 11.0);
+
+    std::array<bool, 4> can_move = {false, false, false, false};
+    gen.updateVehicleSpeeds(0.1, can_move);
+
+    REQUIRE(north[0].lane_id == 302);
+    REQUIRE(north[2].lane_id == 302);
+    REQUIRE(north[3].lane_id == 300);
+    REQUIRE(north[4].lane_id == 301);
+}
+
 TEST_CASE("TrafficGenerator falls back to straight when lane change unavailable", "[traffic][lane-change]") {
     IntersectionConfig config = makeDefaultIntersectionConfig();
     config.approaches[0].lanes = {{400, "N-left", {MovementType::Left}, false},
@@ -1890,6 +2032,55 @@ TEST_CASE("TrafficGenerator falls back to straight when lane change unavailable"
     REQUIRE(north.front().turning == false);
 }
 
+TEST_CASE("Approach length and lane capacity come from the config", "[traffic][config]") {
+    IntersectionConfig config = makeDefaultIntersectionConfig();
+    REQUIRE(effectiveLaneCapacity(config.approaches[0]) == 12);
+    REQUIRE(intersectionConfigToJson(config).find("length_m") == std::string::npos);
+
+    config.approaches[0].length_m = 400.0;
+    config.approaches[1].lane_capacity = 5;
+    const auto parsed = intersectionConfigFromJson(intersectionConfigToJson(config));
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.config.approaches[0].length_m == 400.0);
+    REQUIRE(parsed.config.approaches[1].lane_capacity == 5);
+    REQUIRE(SafetyChecker(parsed.config).isConfigValid());
+
+    IntersectionConfig too_short = config;
+    too_short.approaches[2].length_m = 5.0;
+    REQUIRE_FALSE(SafetyChecker(too_short).isConfigValid());
+    REQUIRE_FALSE(intersectionConfigFromJson(intersectionConfigToJson(too_short)).ok);
+
+    TrafficGenerator gen(config, 1.0);
+    std::array<bool, 4> can_move = {false, false, false, false};
+    double time = 0.0;
+    for (int i = 0; i < 6000; ++i) {
+        gen.generateTraffic(0.1, time);
+        gen.updateVehicleSpeeds(0.1, can_move);
+        time += 0.1;
+    }
+
+    // The long north approach queues far more than the 70 m default would hold, all behind the stop line.
+    const auto& north = gen.getQueueByDirection(Direction::North);
+    REQUIRE(north.size() > 100);
+    std::map<LaneId, double> last_position;
+    for (const auto& vehicle : north) {
+        REQUIRE(vehicle.position_in_lane <= 399.5);
+        const auto previous = last_position.find(vehicle.lane_id);
+        if (previous != last_position.end()) {
+            REQUIRE(previous->second - vehicle.position_in_lane >= 6.0 - 1e-9);
+        }
+        last_position[vehicle.lane_id] = vehicle.position_in_lane;
+    }
+
+    std::map<LaneId, std::size_t> east_per_lane;
+    for (const auto& vehicle : gen.getQueueByDirection(Direction::East)) {
+        ++east_per_lane[vehicle.lane_id];
+    }
+    for (const auto& [lane, count] : east_per_lane) {
+        REQUIRE(count <= 5);
+    }
+}
+
 TEST_CASE("TrafficGenerator resolves vehicle destination from lane connections", "[traffic][config][routing]") {
     IntersectionConfig config = makeDefaultIntersectionConfig();
     config.approaches[0].lanes = {{500, "N-only-right", {MovementType::Right}, true}};
@@ -1937,10 +2128,1661 @@ TEST_CASE("Mixed north lane 0 keeps straight+left intents from config", "[traffi
 
             const uint32_t id = next->id;
             REQUIRE(gen.startCrossing(Direction::North, id, current_time));
-            REQUIRE(gen.completeCrossing(id, current_time + 1.0));
+            REQUIRE(gen.completeCrossing(id));
         }
     }
 
     REQUIRE(seen_straight);
     REQUIRE(seen_left);
-}
\ No newline at end of file
+}
+
+namespace {
+    IntersectionConfig makeTwoPhaseStraightConfig() {
+        IntersectionConfig config = makeDefaultIntersectionConfig();
+        config.signal_groups = {{1,
+                                 "NS-straight",
+                                 {laneIdFor(ApproachId::North, 0),
+                                  laneIdFor(ApproachId::North, 1),
+                                  laneIdFor(ApproachId::South, 0),
+                                  laneIdFor(ApproachId::South, 1)},
+                                 {MovementType::Straight},
+                                 10.0,
+                                 2.0},
+                                {2,
+                                 "EW-straight",
+                                 {laneIdFor(ApproachId::East, 0),
+                                  laneIdFor(ApproachId::East, 1),
+                                  laneIdFor(ApproachId::West, 0),
+                                  laneIdFor(ApproachId::West, 1)},
+                                 {MovementType::Straight},
+                                 10.0,
+                                 2.0}};
+        return config;
+    }
+}  // namespace
+
+TEST_CASE("TrafficGenerator honours per-approach arrival rates", "[traffic][demand]") {
+    TrafficGenerator gen(makeDefaultIntersectionConfig(), 0.5);
+    gen.setApproachArrivalRates(std::array<double, 4>{1.0, 0.0, 0.0, 0.0});
+
+    for (int i = 0; i < 30; ++i) {
+        gen.generateTraffic(0.1, static_cast<double>(i) * 0.1);
+    }
+
+    REQUIRE(gen.getQueueLength(Direction::North) >= 2);
+    REQUIRE(gen.getQueueLength(Direction::East) == 0);
+    REQUIRE(gen.getQueueLength(Direction::South) == 0);
+    REQUIRE(gen.getQueueLength(Direction::West) == 0);
+    REQUIRE(gen.getQueuedDelaySeconds(3.0) > 0.0);
+}
+
+TEST_CASE("SignalPlanOptimizer Webster splits follow critical lane demand", "[optimizer][webster]") {
+    const IntersectionConfig config = makeTwoPhaseStraightConfig();
+    const std::vector<LaneDemand> demand = {{laneIdFor(ApproachId::North, 0), 600.0},
+                                            {laneIdFor(ApproachId::South, 1), 500.0},
+                                            {laneIdFor(ApproachId::East, 0), 200.0}};
+
+    SignalPlanOptimizer optimizer;
+    const IntersectionConfig plan = optimizer.websterPlan(config, demand);
+
+    REQUIRE(plan.signal_groups.size() == 2);
+    REQUIRE(plan.signal_groups[0].min_green_seconds > plan.signal_groups[1].min_green_seconds);
+    REQUIRE(plan.signal_groups[1].min_green_seconds >= 3.0);
+    REQUIRE(signalPlanCycleSeconds(plan) >= 20.0);
+}
+
+TEST_CASE("SignalPlanOptimizer returns a safe plan no worse than Webster", "[optimizer]") {
+    const IntersectionConfig config = makeTwoPhaseStraightConfig();
+    const std::vector<LaneDemand> demand = {{laneIdFor(ApproachId::North, 0), 700.0},
+                                            {laneIdFor(ApproachId::South, 0), 700.0},
+                                            {laneIdFor(ApproachId::East, 0), 250.0},
+                                            {laneIdFor(ApproachId::West, 0), 250.0}};
+
+    SignalPlanOptimizerOptions options;
+    options.evaluation_seconds = 120.0;
+    options.max_evaluations = 24;
+    options.worker_count = 4;
+    SignalPlanOptimizer optimizer(options);
+
+    const SignalPlanResult result = optimizer.optimize(config, demand);
+    REQUIRE(result.ok);
+    REQUIRE(result.evaluations <= options.max_evaluations);
+    REQUIRE(result.average_delay_seconds <= result.initial_average_delay_seconds);
+    REQUIRE(result.cycle_seconds == Catch::Approx(signalPlanCycleSeconds(result.config)));
+
+    const ConfigParseResult parsed = intersectionConfigFromJson(result.config_json);
+    REQUIRE(parsed.ok);
+    SafetyChecker checker(parsed.config);
+    REQUIRE(checker.isConfigValid());
+}
+
+TEST_CASE("SignalPlanOptimizer rejects configs without signal groups", "[optimizer]") {
+    SignalPlanOptimizer optimizer;
+    const SignalPlanResult result = optimizer.optimize(makeDefaultIntersectionConfig(), {});
+    REQUIRE_FALSE(result.ok);
+    REQUIRE_FALSE(result.errors.empty());
+}
+
+TEST_CASE("Predictive scheduler stays safe within its rollout budget", "[engine][scheduler][predictive]") {
+    SimulatorEngine engine(0.6, 10.0, 10.0);
+    engine.setSchedulerMode(SimulatorEngine::SchedulerMode::Predictive);
+    engine.setPredictiveRolloutBudget(120);
+    engine.start();
+
+    for (int i = 0; i < 600; ++i) {
+        engine.tick(0.1);
+        REQUIRE(engine.getLastPredictiveRolloutTicks() <= 120);
+    }
+
+    const auto metrics = engine.getMetrics();
+    REQUIRE(metrics.safety_violations == 0);
+    REQUIRE(engine.getControlMode() == SimulatorEngine::ControlMode::Basic);
+    REQUIRE(metrics.vehicles_crossed > 10);
+    REQUIRE(engine.getSnapshotJson().find("\"mode\":\"predictive\"") != std::string::npos);
+}
+
+TEST_CASE("Predictive scheduler without budget matches the greedy scheduler", "[engine][scheduler][predictive]") {
+    SimulatorEngine greedy(0.6, 10.0, 10.0);
+    SimulatorEngine predictive(0.6, 10.0, 10.0);
+    predictive.setSchedulerMode(SimulatorEngine::SchedulerMode::Predictive);
+    predictive.setPredictiveRolloutBudget(0);
+    greedy.start();
+    predictive.start();
+
+    for (int i = 0; i < 400; ++i) {
+        greedy.tick(0.1);
+        predictive.tick(0.1);
+    }
+
+    REQUIRE(predictive.getLastPredictiveRolloutTicks() == 0);
+    REQUIRE(predictive.getMetrics().vehicles_crossed == greedy.getMetrics().vehicles_crossed);
+    REQUIRE(predictive.getMetrics().average_wait_time == Catch::Approx(greedy.getMetrics().average_wait_time));
+}
+
+TEST_CASE("Predictive scheduler overrides the greedy anchor only for a cheaper rollout",
+          "[engine][scheduler][predictive]") {
+    SimulatorEngine predictive(1.0, 10.0, 10.0);
+    predictive.setSchedulerMode(SimulatorEngine::SchedulerMode::Predictive);
+    predictive.start();
+
+    // Same state, same mode, no rollout budget: follows the greedy anchor
+    SimulatorEngine greedy(1.0, 10.0, 10.0);
+    greedy.setSchedulerMode(SimulatorEngine::SchedulerMode::Predictive);
+    greedy.setPredictiveRolloutBudget(0);
+
+    auto anchorOf = [](const SimulatorEngine& engine) {
+        return nlohmann::json::parse(engine.getSnapshotJson())["scheduler"]["anchor_route"];
+    };
+
+    bool overridden = false;
+    for (int i = 0; i < 3000 && !overridden; ++i) {
+        REQUIRE(greedy.copyStateFrom(predictive));
+        predictive.tick(0.1);
+        const PredictiveDecision decision = predictive.getLastPredictiveDecision();
+        if (decision.forced_route < 0) {
+            continue;
+        }
+        overridden = true;
+
+        REQUIRE(decision.rollout_ticks > 0);
+        REQUIRE(decision.chosen_cost < decision.greedy_cost);
+
+        // Replaying the greedy rollout (4 s horizon at this step) gives the cost the decision was measured against
+        double greedy_cost = 0.0;
+        for (int t = 0; t < 40; ++t) {
+            greedy.tick(0.1);
+            if (t == 0) {
+                REQUIRE(anchorOf(greedy) != anchorOf(predictive));
+            }
+            greedy_cost += static_cast<double>(greedy.countWaitingVehicles()) * 0.1;
+        }
+        REQUIRE(greedy_cost == Catch::Approx(decision.greedy_cost));
+    }
+
+    REQUIRE(overridden);
+}
+
+TEST_CASE("Scheduler re-ranks routes only on events and thresholds", "[engine][scheduler][incremental]") {
+    SimulatorEngine engine(0.5, 10.0, 10.0);
+    engine.start();
+
+    constexpr int kTicks = 1200;
+    for (int i = 0; i < kTicks; ++i) {
+        engine.tick(0.1);
+    }
+
+    const auto metrics = engine.getMetrics();
+    REQUIRE(metrics.safety_violations == 0);
+    REQUIRE(metrics.vehicles_crossed > 20);
+    REQUIRE(engine.getSchedulerSelectionCount() > 0);
+    REQUIRE(engine.getSchedulerSelectionCount() < static_cast<std::size_t>(kTicks));
+}
+
+TEST_CASE("Incremental scheduling matches re-ranking every tick", "[engine][scheduler][incremental]") {
+    for (const auto mode : {SimulatorEngine::SchedulerMode::Adaptive, SimulatorEngine::SchedulerMode::Predictive}) {
+        SimulatorEngine incremental(0.7, 10.0, 10.0);
+        SimulatorEngine every_tick(0.7, 10.0, 10.0);
+        incremental.setSchedulerMode(mode);
+        every_tick.setSchedulerMode(mode);
+        every_tick.setIncrementalSchedulingEnabled(false);
+        incremental.start();
+        every_tick.start();
+
+        constexpr int kTicks = 1500;
+        for (int i = 0; i < kTicks; ++i) {
+            incremental.tick(0.1);
+            every_tick.tick(0.1);
+
+            // Lights, vehicles and selected routes match exactly; the extrapolated scores up to rounding
+            nlohmann::json lhs = nlohmann::json::parse(incremental.getSnapshotJson());
+            nlohmann::json rhs = nlohmann::json::parse(every_tick.getSnapshotJson());
+            auto& lhs_routes = lhs["scheduler"]["routes"];
+            auto& rhs_routes = rhs["scheduler"]["routes"];
+            REQUIRE(lhs_routes.size() == rhs_routes.size());
+            for (std::size_t r = 0; r < lhs_routes.size(); ++r) {
+                REQUIRE(lhs_routes[r]["priority_score"].get<double>() ==
+                        Catch::Approx(rhs_routes[r]["priority_score"].get<double>()).epsilon(1e-4));
+                lhs_routes[r].erase("priority_score");
+                rhs_routes[r].erase("priority_score");
+            }
+            REQUIRE(lhs == rhs);
+        }
+
+        REQUIRE(incremental.getMetrics().vehicles_crossed > 20);
+        REQUIRE(incremental.getSchedulerSelectionCount() < every_tick.getSchedulerSelectionCount());
+    }
+}
+
+TEST_CASE("Empty intersection never runs the route selection", "[engine][scheduler][incremental]") {
+    SimulatorEngine engine(0.0, 10.0, 10.0);
+    engine.start();
+
+    for (int i = 0; i < 100; ++i) {
+        engine.tick(0.1);
+    }
+
+    REQUIRE(engine.getSchedulerSelectionCount() == 0);
+    REQUIRE(engine.getSnapshot().lights.north == LightState::Red);
+}
+
+TEST_CASE("ActionSignalController switches phases through orange and all-red", "[controller][training]") {
+    ActionSignalController controller(makeDefaultIntersectionConfig(), 1.0, 2.0, 1.0);
+    REQUIRE(controller.phaseCount() > 1);
+    REQUIRE(controller.getActivePhase() == 0);
+
+    controller.setRequestedPhase(1);
+    controller.tick(1.0);
+    const IntersectionState orange = controller.getCurrentState();
+    REQUIRE((orange.north == LightState::Orange || orange.turnNorthEast == LightState::Orange ||
+             orange.turnNorthWest == LightState::Orange));
+
+    controller.tick(2.0);
+    const IntersectionState all_red = controller.getCurrentState();
+    REQUIRE(all_red.north == LightState::Red);
+    REQUIRE(all_red.turnNorthEast == LightState::Red);
+    REQUIRE(all_red.turnNorthWest == LightState::Red);
+
+    controller.tick(1.0);
+    REQUIRE(controller.getActivePhase() == 1);
+}
+
+TEST_CASE("TrainingEnvironment reset and step are deterministic per seed", "[training]") {
+    TrainingEnvironmentOptions options;
+    options.episode_seconds = 30.0;
+    TrainingEnvironment lhs(makeDefaultIntersectionConfig(), options);
+    TrainingEnvironment rhs(makeDefaultIntersectionConfig(), options);
+    REQUIRE(lhs.actionCount() > 1);
+
+    std::array<float, TrainingEnvironment::kObservationSize> lhs_obs{};
+    std::array<float, TrainingEnvironment::kObservationSize> rhs_obs{};
+    lhs.reset(7, lhs_obs.data());
+    rhs.reset(7, rhs_obs.data());
+
+    bool done = false;
+    double total_reward = 0.0;
+    for (std::size_t step = 0; step < 100 && !done; ++step) {
+        const std::size_t action = (step / 5) % lhs.actionCount();
+        const TrainingStepResult lhs_result = lhs.step(action, lhs_obs.data());
+        const TrainingStepResult rhs_result = rhs.step(action, rhs_obs.data());
+        REQUIRE(lhs_result.reward == rhs_result.reward);
+        REQUIRE(lhs_result.done == rhs_result.done);
+        REQUIRE(lhs_obs == rhs_obs);
+        REQUIRE(lhs_result.reward <= 0.0);
+        total_reward += lhs_result.reward;
+        done = lhs_result.done;
+    }
+
+    REQUIRE(done);
+    REQUIRE(total_reward < 0.0);
+    REQUIRE(lhs.getEngine().getMetrics().safety_violations == 0);
+}
+
+TEST_CASE("VectorTrainingEnvironment steps all engines and auto-resets", "[training]") {
+    TrainingEnvironmentOptions options;
+    options.episode_seconds = 5.0;
+    VectorTrainingEnvironment vec(makeDefaultIntersectionConfig(), 6, options, 3);
+    REQUIRE(vec.size() == 6);
+
+    std::vector<float> observations(vec.size() * TrainingEnvironment::kObservationSize);
+    std::vector<int32_t> actions(vec.size(), 0);
+    std::vector<float> rewards(vec.size());
+    std::vector<uint8_t> dones(vec.size());
+    vec.reset(1, observations.data());
+
+    std::size_t finished = 0;
+    for (int step = 0; step < 12; ++step) {
+        for (std::size_t i = 0; i < actions.size(); ++i) {
+            actions[i] = static_cast<int32_t>((i + static_cast<std::size_t>(step)) % vec.actionCount());
+        }
+        vec.step(actions.data(), observations.data(), rewards.data(), dones.data());
+        for (uint8_t done : dones) {
+            finished += done;
+        }
+    }
+    REQUIRE(finished == vec.size() * 2);
+
+    crossroads_env* env = crossroads_env_create(nullptr, 2, 1, 0.5, 5.0);
+    REQUIRE(env != nullptr);
+    REQUIRE(crossroads_env_size(env) == 2);
+    REQUIRE(crossroads_env_observation_size() == TrainingEnvironment::kObservationSize);
+    std::vector<float> c_obs(2 * crossroads_env_observation_size());
+    const int32_t c_actions[2] = {0, 1};
+    float c_rewards[2] = {0.0f, 0.0f};
+    uint8_t c_dones[2] = {0, 0};
+    crossroads_env_reset(env, 3, c_obs.data());
+    crossroads_env_step(env, c_actions, c_obs.data(), c_rewards, c_dones);
+    REQUIRE(c_rewards[0] <= 0.0f);
+    crossroads_env_destroy(env);
+    REQUIRE(crossroads_env_create("{not json", 1, 1, 0.5, 5.0) == nullptr);
+
+    // Unsafe configs are refused like the HTTP handlers refuse them, and a failure to build returns NULL
+    IntersectionConfig unsafe = makeDefaultIntersectionConfig();
+    unsafe.signal_groups = {{701,
+                             "conflict",
+                             {laneIdFor(ApproachId::North, 0), laneIdFor(ApproachId::East, 0)},
+                             {MovementType::Straight},
+                             5.0,
+                             2.0}};
+    REQUIRE(crossroads_env_create(intersectionConfigToJson(unsafe).c_str(), 1, 1, 0.5, 5.0) == nullptr);
+    REQUIRE(crossroads_env_create(nullptr, std::numeric_limits<size_t>::max(), 1, 0.5, 5.0) == nullptr);
+}
+
+TEST_CASE("Default layout uses the compile-time route tables", "[engine][layout]") {
+    STATIC_REQUIRE(DefaultIntersectionLayout::kRouteConflicts[0][3]);
+    STATIC_REQUIRE(DefaultIntersectionLayout::kRouteConflicts[3][0]);
+    STATIC_REQUIRE_FALSE(DefaultIntersectionLayout::kRouteConflicts[0][6]);
+    STATIC_REQUIRE_FALSE(DefaultIntersectionLayout::kRouteConfigured[1]);
+
+    SimulatorEngine engine(0.5, 10.0, 10.0);
+    REQUIRE(engine.usesLayoutFastPath());
+
+    IntersectionConfig custom = makeDefaultIntersectionConfig();
+    custom.approaches[0].lanes[0].allowed_movements.push_back(MovementType::Left);
+    SimulatorEngine custom_engine(custom, 0.5, 10.0, 10.0);
+    REQUIRE_FALSE(custom_engine.usesLayoutFastPath());
+    custom_engine.setLayoutFastPathEnabled(true);
+    REQUIRE_FALSE(custom_engine.usesLayoutFastPath());
+}
+
+TEST_CASE("Default layout fast path matches the generic path", "[engine][layout]") {
+    SimulatorEngine fast(0.6, 10.0, 10.0);
+    SimulatorEngine generic(0.6, 10.0, 10.0);
+    generic.setLayoutFastPathEnabled(false);
+    REQUIRE(fast.usesLayoutFastPath());
+    REQUIRE_FALSE(generic.usesLayoutFastPath());
+
+    fast.start();
+    generic.start();
+    for (int i = 0; i < 3000; ++i) {
+        fast.tick(0.1);
+        generic.tick(0.1);
+        if (i % 500 == 0) {
+            REQUIRE(fast.getSnapshotJson() == generic.getSnapshotJson());
+        }
+    }
+
+    REQUIRE(fast.getSnapshotJson() == generic.getSnapshotJson());
+    const auto fast_metrics = fast.getMetrics();
+    const auto generic_metrics = generic.getMetrics();
+    REQUIRE(fast_metrics.vehicles_crossed == generic_metrics.vehicles_crossed);
+    REQUIRE(fast_metrics.vehicles_generated == generic_metrics.vehicles_generated);
+    REQUIRE(fast_metrics.average_wait_time == generic_metrics.average_wait_time);
+    REQUIRE(fast_metrics.safety_violations == 0);
+}
+
+TEST_CASE("Route conflict tables from the segment grid match the default layout and any worker count",
+          "[engine][layout]") {
+    const IntersectionTopology tables = topologyFor(makeDefaultIntersectionConfig());
+    REQUIRE(tables.routeCount() == 12);
+    for (std::size_t i = 0; i < 12; ++i) {
+        REQUIRE(tables.routes()[i].configured == DefaultIntersectionLayout::kRouteConfigured[i]);
+        REQUIRE(tables.conflictMask(i) == DefaultIntersectionLayout::kRouteConflictMasks[i]);
+        for (std::size_t j = 0; j < 12; ++j) {
+            REQUIRE(tables.conflicts(i, j) == DefaultIntersectionLayout::kRouteConflicts[i][j]);
+        }
+    }
+
+    // Seven lanes per approach, every lane allowing every movement.
+    IntersectionConfig wide = makeDefaultIntersectionConfig();
+    wide.lane_connections.clear();
+    for (auto& approach : wide.approaches) {
+        approach.lanes.clear();
+        for (uint16_t i = 0; i < 7; ++i) {
+            approach.lanes.push_back({laneIdFor(approach.id, i),
+                                      "lane",
+                                      {MovementType::Straight, MovementType::Left, MovementType::Right},
+                                      true,
+                                      true,
+                                      true});
+        }
+        approach.to_lane_count = 7;
+    }
+    for (const auto& approach : wide.approaches) {
+        for (uint16_t i = 0; i < 7; ++i) {
+            for (MovementType movement : approach.lanes[i].allowed_movements) {
+                wide.lane_connections.push_back(
+                    {approach.id, i, movement, destinationApproachFor(approach.id, movement), i});
+            }
+        }
+    }
+
+    const IntersectionTopology serial = topologyFor(wide, 1);
+    const IntersectionTopology parallel = topologyFor(wide, 4);
+    for (std::size_t i = 0; i < 12; ++i) {
+        REQUIRE(serial.conflictMask(i) == parallel.conflictMask(i));
+        REQUIRE(serial.routes()[i].configured);
+        REQUIRE_FALSE(serial.conflicts(i, i));
+        for (std::size_t j = 0; j < 12; ++j) {
+            REQUIRE(serial.conflicts(i, j) == serial.conflicts(j, i));
+        }
+    }
+    REQUIRE_FALSE(serial.conflicts(0, 6));  // North and south straight run side by side
+    REQUIRE(serial.conflicts(0, 3));        // North straight crosses east straight
+}
+
+TEST_CASE("Topologies with three or four arms classify turns and build symmetric conflicts", "[engine][layout]") {
+    auto fully_connected = [](const std::vector<TopologyArm>& arms) {
+        std::vector<TopologyConnection> connections;
+        for (uint8_t from = 0; from < arms.size(); ++from) {
+            for (uint8_t to = 0; to < arms.size(); ++to) {
+                if (from != to) {
+                    connections.push_back({from, 0, to, 0});
+                }
+            }
+        }
+        return connections;
+    };
+
+    SECTION("T-junction") {
+        const std::vector<TopologyArm> arms = {{"N", 0.0, 1, 1}, {"E", 90.0, 1, 1}, {"S", 180.0, 1, 1}};
+        IntersectionTopology topology;
+        std::string error;
+        REQUIRE(IntersectionTopology::build(arms, fully_connected(arms), topology, &error));
+        REQUIRE(topology.routeCount() == 6);
+        REQUIRE(topology.routeIndex(0, 0) == -1);
+        // Southbound from north: straight on to south, left turn into east.
+        REQUIRE(topology.routes()[topology.routeIndex(0, 2)].movement == MovementType::Straight);
+        REQUIRE(topology.routes()[topology.routeIndex(0, 1)].movement == MovementType::Left);
+        REQUIRE(topology.routes()[topology.routeIndex(2, 1)].movement == MovementType::Right);
+        REQUIRE(topology.configuredRoutes() == (RouteMask{1} << 6) - 1);
+        // The two straights are each other's reverse; the left out of north and the right out of south merge.
+        REQUIRE_FALSE(topology.conflicts(topology.routeIndex(0, 2), topology.routeIndex(2, 0)));
+        REQUIRE(topology.conflicts(topology.routeIndex(0, 1), topology.routeIndex(2, 1)));
+    }
+
+    SECTION("Invalid layouts") {
+        IntersectionTopology topology;
+        std::string error;
+        REQUIRE_FALSE(IntersectionTopology::build({{"N", 0.0, 1, 1}, {"S", 180.0, 1, 1}}, {}, topology, &error));
+        REQUIRE_FALSE(error.empty());
+        error.clear();
+        REQUIRE_FALSE(IntersectionTopology::build(
+            {{"N", 0.0, 1, 1}, {"NE", 72.0, 1, 1}, {"SE", 144.0, 1, 1}, {"SW", 216.0, 1, 1}, {"NW", 288.0, 1, 1}},
+            {},
+            topology,
+            &error));
+        REQUIRE_FALSE(error.empty());
+        error.clear();
+        REQUIRE_FALSE(IntersectionTopology::build(
+            {{"N", 0.0, 1, 1}, {"E", 90.0, 1, 1}, {"N2", 0.5, 1, 1}}, {}, topology, &error));
+        REQUIRE_FALSE(error.empty());
+        error.clear();
+        REQUIRE_FALSE(IntersectionTopology::build(
+            {{"N", 0.0, 1, 1}, {"E", 90.0, 1, 1}, {"S", 180.0, 1, 1}}, {{0, 0, 0, 0}}, topology, &error));
+        REQUIRE_FALSE(error.empty());
+    }
+}
+
+TEST_CASE("A T-junction config with an absent arm validates and simulates safely", "[engine][layout][safety]") {
+    IntersectionConfig config = makeDefaultIntersectionConfig();
+    auto& west = config.approaches[approachIndex(ApproachId::West)];
+    west.lanes.clear();
+    west.to_lane_count = 0;
+    // Nothing may head for the missing west arm: north turns left instead of right, east only turns.
+    config.approaches[approachIndex(ApproachId::North)].lanes[2].allowed_movements = {MovementType::Left};
+    for (auto& lane : config.approaches[approachIndex(ApproachId::East)].lanes) {
+        lane.allowed_movements = {MovementType::Left};
+    }
+    config.approaches[approachIndex(ApproachId::East)].lanes[2].allowed_movements = {MovementType::Right};
+    config.lane_connections.clear();
+    for (const auto& approach : config.approaches) {
+        for (uint16_t i = 0; i < approach.lanes.size(); ++i) {
+            for (MovementType movement : approach.lanes[i].allowed_movements) {
+                config.lane_connections.push_back(
+                    {approach.id, i, movement, destinationApproachFor(approach.id, movement), i});
+            }
+        }
+    }
+
+    SafetyChecker checker(config);
+    REQUIRE(checker.isConfigValid());
+
+    const auto parsed = intersectionConfigFromJson(intersectionConfigToJson(config));
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.config.approaches[approachIndex(ApproachId::West)].to_lane_count == 0);
+    REQUIRE(SafetyChecker(parsed.config).isConfigValid());
+
+    SECTION("Turning into the absent arm is rejected") {
+        config.approaches[approachIndex(ApproachId::North)].lanes[0].allowed_movements = {MovementType::Right};
+        REQUIRE_FALSE(SafetyChecker(config).isConfigValid());
+    }
+
+    SECTION("Two arms are not a junction") {
+        config.approaches[approachIndex(ApproachId::East)].lanes.clear();
+        config.approaches[approachIndex(ApproachId::East)].to_lane_count = 0;
+        REQUIRE_FALSE(SafetyChecker(config).isConfigValid());
+    }
+
+    SECTION("Simulation") {
+        SimulatorEngine engine(config, 0.8, 10.0, 10.0);
+        engine.start();
+        for (int i = 0; i < 3000; ++i) {
+            engine.tick(0.1);
+        }
+        const auto metrics = engine.getMetrics();
+        REQUIRE(metrics.vehicles_crossed > 0);
+        REQUIRE(metrics.safety_violations == 0);
+        REQUIRE(metrics.queue_lengths[approachIndex(ApproachId::West)] == 0);
+    }
+}
+
+namespace {
+    std::string freshDatabasePath(const std::string& name) {
+        const std::string path = (std::filesystem::temp_directory_path() / name).string();
+        for (const char* suffix : {"", "-wal", "-shm", ".named.json"}) {
+            std::remove((path + suffix).c_str());
+        }
+        return path;
+    }
+}  // namespace
+
+TEST_CASE("Database keeps one connection across calls and threads", "[db]") {
+    const std::string path = freshDatabasePath("crossroads_test_connection.db");
+    db::Database database(path);
+    std::string error;
+    REQUIRE(database.initialize(&error));
+
+    REQUIRE(database.saveActiveIntersectionConfigJson("{\"active\":1}", &error));
+    REQUIRE(database.loadActiveIntersectionConfigJson(&error) == std::optional<std::string>("{\"active\":1}"));
+
+    constexpr int kThreads = 4;
+    constexpr int kWritesPerThread = 25;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; ++t) {
+        writers.emplace_back([&database, t]() {
+            for (int i = 0; i < kWritesPerThread; ++i) {
+                const std::string name = "cfg-" + std::to_string(t) + "-" + std::to_string(i % 5);
+                database.saveNamedIntersectionConfigJson(name, "{\"i\":" + std::to_string(i) + "}");
+                database.touchNamedIntersectionConfig(name);
+                database.loadNamedIntersectionConfigJson(name);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    REQUIRE(database.listNamedIntersectionConfigs(&error).size() == kThreads * 5);
+    REQUIRE(database.loadNamedIntersectionConfigJson("cfg-2-4", &error) == std::optional<std::string>("{\"i\":24}"));
+    REQUIRE(database.deleteNamedIntersectionConfig("cfg-2-4", &error));
+    REQUIRE_FALSE(database.loadNamedIntersectionConfigJson("cfg-2-4", &error).has_value());
+    REQUIRE(database.loadMostRecentNamedConfigName(&error).has_value());
+#ifdef CROSSROADS_USE_SQLITE
+    REQUIRE(std::filesystem::exists(path + "-wal"));
+#endif
+}
+
+TEST_CASE("parallelFor calls the body once per index on at most the requested threads", "[parallel]") {
+    REQUIRE(resolveWorkerCount(3) == 3);
+    REQUIRE(resolveWorkerCount(0) >= 1);
+
+    for (const std::size_t worker_count : {std::size_t{0}, std::size_t{1}, std::size_t{4}, std::size_t{64}}) {
+        constexpr std::size_t kCount = 37;
+        std::vector<std::atomic<int>> calls(kCount);
+        std::atomic<std::size_t> max_slot{0};
+        parallelFor(kCount, worker_count, [&](std::size_t i, std::size_t slot) {
+            calls[i].fetch_add(1);
+            std::size_t seen = max_slot.load();
+            while (slot > seen && !max_slot.compare_exchange_weak(seen, slot)) {
+            }
+        });
+        for (const auto& count : calls) {
+            REQUIRE(count.load() == 1);
+        }
+        REQUIRE(max_slot.load() < std::min(resolveWorkerCount(worker_count), kCount));
+    }
+
+    bool called = false;
+    parallelFor(0, 4, [&](std::size_t, std::size_t) { called = true; });
+    REQUIRE_FALSE(called);
+}
+
+TEST_CASE("Named config library pages by prefix and imports bundles whole or not at all", "[db][library]") {
+    const std::string path = freshDatabasePath("crossroads_test_library.db");
+    db::Database database(path);
+    std::string error;
+    REQUIRE(database.initialize(&error));
+
+    const std::string config_json = intersectionConfigToJson(makeDefaultIntersectionConfig());
+    std::string bundle;
+    for (int i = 0; i < 120; ++i) {
+        const std::string site = i < 70 ? "site-a-" : "site-b-";
+        appendConfigBundleLine(bundle, site + std::to_string(1000 + i), config_json);
+        if (i % 40 == 0) {
+            bundle += "\n";
+        }
+    }
+
+    ConfigBundleParseResult parsed = parseConfigBundle(bundle, 4);
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.entries.size() == 120);
+    std::vector<db::NamedConfigRecord> records;
+    for (const auto& entry : parsed.entries) {
+        records.push_back({entry.name, entry.config_json});
+    }
+    REQUIRE(database.importNamedIntersectionConfigs(records, &error));
+
+    std::vector<std::string> names;
+    std::string after;
+    do {
+        const db::NamedConfigPage page = database.listNamedIntersectionConfigPage("site-a-", after, 25, &error);
+        REQUIRE(error.empty());
+        REQUIRE(page.items.size() <= 25);
+        for (const auto& entry : page.items) {
+            names.push_back(entry.name);
+        }
+        after = page.next_after;
+    } while (!after.empty());
+    REQUIRE(names.size() == 70);
+    REQUIRE(std::is_sorted(names.begin(), names.end()));
+    REQUIRE(names.front() == "site-a-1000");
+    REQUIRE(names.back() == "site-a-1069");
+    REQUIRE(database.listNamedIntersectionConfigPage("", "", 500, &error).items.size() == 120);
+    REQUIRE(database.listNamedIntersectionConfigPage("site-c", "", 10, &error).items.empty());
+
+    std::string exported;
+    REQUIRE(database.exportNamedIntersectionConfigs(
+        [&](const db::NamedConfigRecord& record) {
+            appendConfigBundleLine(exported, record.name, record.config_json);
+            return true;
+        },
+        &error));
+    parsed = parseConfigBundle(exported, 2);
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.entries.size() == 120);
+    REQUIRE(parsed.entries.front().config_json == config_json);
+
+    // The connection is free while a row is handed out, and the sink can stop the export part way
+    std::size_t delivered = 0;
+    REQUIRE(database.exportNamedIntersectionConfigs(
+        [&](const db::NamedConfigRecord& record) {
+            REQUIRE(database.loadNamedIntersectionConfigJson(record.name, &error) == record.config_json);
+            return ++delivered < 70;
+        },
+        &error));
+    REQUIRE(delivered == 70);
+
+    IntersectionConfig conflicting = makeDefaultIntersectionConfig();
+    conflicting.signal_groups = {{601,
+                                  "conflict",
+                                  {laneIdFor(ApproachId::North, 0), laneIdFor(ApproachId::East, 0)},
+                                  {MovementType::Straight},
+                                  5.0,
+                                  2.0}};
+    std::string broken;
+    appendConfigBundleLine(broken, "site-c-1", config_json);
+    appendConfigBundleLine(broken, "site-c-2", intersectionConfigToJson(conflicting));
+    broken += "not json\n";
+    appendConfigBundleLine(broken, "site-c-1", config_json);
+    parsed = parseConfigBundle(broken);
+    REQUIRE_FALSE(parsed.ok);
+    REQUIRE(parsed.errors.size() == 3);
+    REQUIRE(parsed.errors[0] == "line 2: config failed safety validation rules");
+    REQUIRE(parsed.errors[1] == "line 3: not a JSON object");
+    REQUIRE(parsed.errors[2] == "line 4: name \"site-c-1\" already used on line 1");
+    REQUIRE(database.listNamedIntersectionConfigPage("site-c", "", 10, &error).items.empty());
+}
+
+TEST_CASE("Run history is sampled per interval and written in batches", "[db][runs]") {
+    const std::string path = freshDatabasePath("crossroads_test_runs.db");
+    db::Database database(path);
+    REQUIRE(database.initialize());
+
+    SimulatorEngine engine(0.5, 10.0, 10.0);
+    const std::string config_hash = intersectionConfigHash(engine.getIntersectionConfig());
+    REQUIRE(config_hash.size() == 16);
+    REQUIRE(config_hash == intersectionConfigHash(makeDefaultIntersectionConfig()));
+
+    int64_t run_id = 0;
+    {
+        db::RunHistoryWriter writer(database, std::chrono::milliseconds(20));
+        db::RunMetricsSampler sampler(5.0);
+        engine.start();
+        run_id = writer.beginRun(config_hash, "{\"traffic_rate\":0.5}");
+        sampler.begin(run_id, engine);
+
+        std::size_t intervals = 0;
+        for (int i = 0; i < 300; ++i) {
+            engine.tick(0.1);
+            if (sampler.observe(engine, 0.1)) {
+                writer.recordSamples(sampler.samples());
+                ++intervals;
+            }
+        }
+        REQUIRE(intervals == 6);
+        REQUIRE_FALSE(sampler.closePartialInterval(engine));
+        writer.finishRun(sampler.summary(engine));
+        writer.flush();
+        REQUIRE(writer.failedBatchCount() == 0);
+    }
+
+#ifdef CROSSROADS_USE_SQLITE
+    const auto run = database.loadRun(run_id);
+    REQUIRE(run.has_value());
+    REQUIRE(run->config_hash == config_hash);
+    REQUIRE_FALSE(run->ended_at.empty());
+    REQUIRE(run->sim_seconds == Approx(30.0));
+    REQUIRE(run->vehicles_crossed == engine.getMetrics().vehicles_crossed);
+
+    const auto totals = database.loadRunMetrics(run_id, db::RunMetricScope::Total);
+    REQUIRE(totals.size() == 6);
+    int64_t crossed = 0;
+    for (const auto& sample : totals) {
+        REQUIRE(sample.interval_seconds == Approx(5.0));
+        crossed += sample.vehicles_crossed;
+    }
+    REQUIRE(crossed == static_cast<int64_t>(run->vehicles_crossed));
+    REQUIRE(database.loadRunMetrics(run_id, db::RunMetricScope::Approach).size() == 6 * 4);
+    // The default layout configures straight and right for every approach.
+    REQUIRE(database.loadRunMetrics(run_id, db::RunMetricScope::Route).size() == 6 * 8);
+
+    REQUIRE(database.listRuns(config_hash, 10).size() == 1);
+    REQUIRE(database.listRuns("0000000000000000", 10).empty());
+    const auto compare = database.compareRunsByConfig();
+    REQUIRE(compare.size() == 1);
+    REQUIRE(compare.front().run_count == 1);
+
+    // Run ids continue after the stored ones when a new writer starts.
+    db::RunHistoryWriter next_writer(database);
+    REQUIRE(next_writer.beginRun(config_hash, "{}") == run_id + 1);
+#endif
+}
+
+TEST_CASE("Session journal replays a live session bit for bit and seeks from checkpoints", "[replay]") {
+    const std::string path = freshDatabasePath("crossroads_test_session.journal");
+    // Predictive decisions are part of the copied engine state, so seeking through checkpoints must keep them
+    for (auto mode : {SimulatorEngine::SchedulerMode::Adaptive, SimulatorEngine::SchedulerMode::Predictive}) {
+        INFO("scheduler mode " << static_cast<int>(mode));
+        const IntersectionConfig config = makeDefaultIntersectionConfig();
+        SessionInputs inputs{0.6, 10.0, 10.0, {}, mode};
+        SimulatorEngine engine(config, inputs.traffic_rate, inputs.ns_duration, inputs.ew_duration);
+        engine.setSchedulerMode(mode);
+
+        SessionRecorder recorder;
+        REQUIRE(recorder.open(path, config, inputs, 0.1));
+        auto apply = [&](SessionEvent event) {
+            event.tick = recorder.tick();
+            recorder.record(event);
+            applySessionEvent(engine, inputs, event);
+        };
+
+        IntersectionConfig swapped = config;
+        swapped.approaches[0].lanes[0].allowed_movements.push_back(MovementType::Left);
+
+        std::map<uint64_t, std::string> live_snapshots;
+        for (uint64_t tick = 0; tick < 2000; ++tick) {
+            if (tick == 5) {
+                apply(SessionEvent::makeCommand(SimulatorEngine::UICommand::Start));
+            } else if (tick == 400) {
+                apply(SessionEvent::makeTrafficRate(1.2));
+            } else if (tick == 700) {
+                apply(SessionEvent::makeSpawnFilter(TrafficGenerator::SpawnLaneFilter{ApproachId::East, 1}));
+                apply(SessionEvent::makeCommand(SimulatorEngine::UICommand::Reset));
+                apply(SessionEvent::makeCommand(SimulatorEngine::UICommand::Start));
+            } else if (tick == 1100) {
+                apply(SessionEvent::makeApplyConfig(swapped));
+                apply(SessionEvent::makeSpawnFilter(std::nullopt));
+                apply(SessionEvent::makeCommand(SimulatorEngine::UICommand::Start));
+            } else if (tick == 1500) {
+                apply(SessionEvent::makeCommand(SimulatorEngine::UICommand::Step));
+            }
+            engine.tick(0.1);
+            recorder.advanceTick();
+            if (tick + 1 == 650 || tick + 1 == 1300 || tick + 1 == 2000) {
+                live_snapshots[tick + 1] = engine.getSnapshotJson();
+            }
+        }
+        recorder.close();
+
+        SessionJournal journal;
+        REQUIRE(readSessionJournal(path, journal));
+        REQUIRE_FALSE(journal.truncated);
+        REQUIRE(journal.end_tick == 2000);
+        REQUIRE(journal.events.size() == 9);
+
+        SessionReplayer replayer(journal, 245);  // Off the one-second predictive decision grid
+        replayer.runTo(2000);
+        REQUIRE(replayer.engine().getSnapshotJson() == live_snapshots[2000]);
+        REQUIRE(replayer.checkpointCount() == 9);
+
+        replayer.seek(1300);
+        REQUIRE(replayer.tick() == 1300);
+        REQUIRE(replayer.engine().getSnapshotJson() == live_snapshots[1300]);
+        replayer.seek(650);
+        REQUIRE(replayer.engine().getSnapshotJson() == live_snapshots[650]);
+        replayer.seek(2000);
+        REQUIRE(replayer.engine().getSnapshotJson() == live_snapshots[2000]);
+        REQUIRE(replayer.engine().getSchedulerSelectionCount() == engine.getSchedulerSelectionCount());
+        const PredictiveDecision replayed = replayer.engine().getLastPredictiveDecision();
+        REQUIRE(replayed.rollout_ticks == engine.getLastPredictiveDecision().rollout_ticks);
+        REQUIRE(replayed.forced_route == engine.getLastPredictiveDecision().forced_route);
+        REQUIRE(replayed.chosen_cost == engine.getLastPredictiveDecision().chosen_cost);
+    }
+}
+
+TEST_CASE("Session journal tolerates a cut-off tail", "[replay]") {
+    const std::string path = freshDatabasePath("crossroads_test_session_cut.journal");
+    SessionInputs inputs;
+    {
+        SessionRecorder recorder;
+        REQUIRE(recorder.open(path, makeDefaultIntersectionConfig(), inputs, 0.1));
+        SessionEvent start = SessionEvent::makeCommand(SimulatorEngine::UICommand::Start);
+        recorder.record(start);
+        for (int i = 0; i < 120; ++i) {
+            recorder.advanceTick();
+        }
+        recorder.record(SessionEvent::makeTrafficRate(2.0));
+    }
+
+    const auto size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, size - 3);
+
+    SessionJournal journal;
+    REQUIRE(readSessionJournal(path, journal));
+    REQUIRE(journal.truncated);
+    REQUIRE(journal.events.size() == 1);
+    REQUIRE(journal.end_tick == 100);
+}
+
+TEST_CASE("Engine checkpoint restores a saturated run bit for bit", "[engine][checkpoint]") {
+    for (auto mode : {SimulatorEngine::SchedulerMode::Adaptive,
+                      SimulatorEngine::SchedulerMode::FixedTime,
+                      SimulatorEngine::SchedulerMode::Predictive}) {
+        SimulatorEngine source(makeDefaultIntersectionConfig(), 1.5, 10.0, 10.0);
+        source.setSchedulerMode(mode);
+        source.setApproachArrivalRates(std::array<double, 4>{0.9, 0.4, 1.3, 0.6});
+        source.start();
+        for (int i = 0; i < 1200; ++i) {
+            source.tick(0.1);
+        }
+        REQUIRE(source.getMetrics().total_queue_length > 0);
+
+        std::string checkpoint;
+        std::string error;
+        REQUIRE(source.saveState(checkpoint, &error));
+
+        SimulatorEngine restored(makeDefaultIntersectionConfig(), 0.5, 10.0, 10.0);
+        REQUIRE(restored.loadState(checkpoint, &error));
+        REQUIRE(restored.getSnapshotJson() == source.getSnapshotJson());
+        REQUIRE(restored.getSchedulerMode() == mode);
+
+        for (int i = 0; i < 1500; ++i) {
+            source.tick(0.1);
+            restored.tick(0.1);
+        }
+        REQUIRE(restored.getSnapshotJson() == source.getSnapshotJson());
+        REQUIRE(restored.getSchedulerSelectionCount() == source.getSchedulerSelectionCount());
+
+        std::string resaved;
+        std::string expected;
+        REQUIRE(restored.saveState(resaved));
+        REQUIRE(source.saveState(expected));
+        REQUIRE(resaved == expected);
+    }
+}
+
+TEST_CASE("Engine checkpoint carries the controller and rejects mismatches", "[engine][checkpoint]") {
+    IntersectionConfig grouped = makeDefaultIntersectionConfig();
+    grouped.signal_groups = {{501,
+                              "NS-straight",
+                              {laneIdFor(ApproachId::North, 1), laneIdFor(ApproachId::South, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0},
+                             {502,
+                              "EW-straight",
+                              {laneIdFor(ApproachId::East, 1), laneIdFor(ApproachId::West, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0}};
+
+    SimulatorEngine source(grouped, 1.0, 10.0, 10.0);
+    source.setSchedulerMode(SimulatorEngine::SchedulerMode::FixedTime);
+    source.start();
+    for (int i = 0; i < 437; ++i) {
+        source.tick(0.1);
+    }
+    std::string checkpoint;
+    REQUIRE(source.saveState(checkpoint));
+
+    SimulatorEngine restored(grouped, 1.0, 10.0, 10.0);
+    REQUIRE(restored.loadState(checkpoint));
+    for (int i = 0; i < 300; ++i) {
+        source.tick(0.1);
+        restored.tick(0.1);
+        REQUIRE(restored.getCurrentLightState().north == source.getCurrentLightState().north);
+        REQUIRE(restored.getCurrentLightState().east == source.getCurrentLightState().east);
+    }
+    REQUIRE(restored.getSnapshotJson() == source.getSnapshotJson());
+
+    SECTION("A null-control checkpoint switches the control mode") {
+        SimulatorEngine flashing(1.0, 10.0, 10.0);
+        flashing.setControlMode(SimulatorEngine::ControlMode::NullControl);
+        flashing.start();
+        for (int i = 0; i < 25; ++i) {
+            flashing.tick(0.1);
+        }
+        REQUIRE(flashing.saveState(checkpoint));
+
+        SimulatorEngine target(1.0, 10.0, 10.0);
+        REQUIRE(target.loadState(checkpoint));
+        REQUIRE(target.getControlMode() == SimulatorEngine::ControlMode::NullControl);
+        for (int i = 0; i < 40; ++i) {
+            flashing.tick(0.1);
+            target.tick(0.1);
+        }
+        REQUIRE(target.getSnapshotJson() == flashing.getSnapshotJson());
+    }
+
+    SECTION("Another config, a cut-off body or a foreign controller leave the engine untouched") {
+        SimulatorEngine other(makeDefaultIntersectionConfig(), 1.0, 10.0, 10.0);
+        other.start();
+        for (int i = 0; i < 100; ++i) {
+            other.tick(0.1);
+        }
+        const std::string before = other.getSnapshotJson();
+
+        std::string error;
+        REQUIRE_FALSE(other.loadState(checkpoint, &error));
+        REQUIRE(error.find("different intersection config") != std::string::npos);
+        REQUIRE_FALSE(other.loadState("not a checkpoint", &error));
+        REQUIRE(other.getSnapshotJson() == before);
+
+        std::string own;
+        REQUIRE(other.saveState(own));
+        REQUIRE_FALSE(other.loadState(own.substr(0, own.size() - 5), &error));
+        REQUIRE(error == "corrupt engine checkpoint");
+        REQUIRE(other.getSnapshotJson() == before);
+
+        SimulatorEngine custom(makeDefaultIntersectionConfig(), 1.0, 10.0, 10.0);
+        custom.setController(std::make_unique<ActionSignalController>(makeDefaultIntersectionConfig()),
+                             SimulatorEngine::ControlMode::Basic);
+        REQUIRE_FALSE(custom.loadState(own, &error));
+        REQUIRE(error.find("controller") != std::string::npos);
+    }
+}
+
+TEST_CASE("Trajectory recorder writes columnar chunks that read back per vehicle", "[trajectory]") {
+    const std::string path = freshDatabasePath("crossroads_test_trajectory.xrtj");
+    SimulatorEngine engine(makeDefaultIntersectionConfig(), 1.5, 10.0, 10.0);
+    engine.start();
+
+    std::vector<TrajectoryColumns> expected_ticks;
+    TrajectoryRecorder recorder;
+    REQUIRE(recorder.open(path, nullptr, 500));
+    std::vector<LaneVehicleState> lane;
+    std::size_t expected_rows = 0;
+    std::map<uint32_t, std::pair<double, double>> last_seen;  // vehicle -> (time, position)
+    for (int i = 0; i < 1500; ++i) {
+        engine.tick(0.1);
+        recorder.record(engine);
+        for (Direction dir : {Direction::North, Direction::East, Direction::South, Direction::West}) {
+            engine.getLaneVehicleStates(dir, lane);
+            expected_rows += lane.size();
+            for (const auto& vehicle : lane) {
+                last_seen[vehicle.id] = {engine.getSimTime(), vehicle.position_in_lane};
+            }
+        }
+    }
+    recorder.close();
+    REQUIRE_FALSE(recorder.failed());
+    REQUIRE(recorder.rowsRecorded() == expected_rows);
+    REQUIRE(recorder.bytesWritten() == std::filesystem::file_size(path));
+    REQUIRE(recorder.bytesWritten() < expected_rows * 12);
+
+    TrajectoryColumns columns;
+    std::string error;
+    REQUIRE(readTrajectoryFile(path, columns, &error));
+    REQUIRE(columns.size() == expected_rows);
+    REQUIRE(columns.position.size() == expected_rows);
+    REQUIRE(columns.crossing_start.size() == expected_rows);
+
+    std::map<uint32_t, std::pair<double, double>> last_read;
+    std::size_t inconsistent_rows = 0;
+    for (std::size_t row = 0; row < columns.size(); ++row) {
+        const bool lane_matches = columns.lane_id[row] / 100 == approachIndex(columns.approach[row]);
+        const bool speed_valid = columns.speed[row] >= 0.0 && columns.speed[row] <= 10.0;
+        const bool crossing_valid = !columns.crossing[row] || (columns.crossing_start[row] >= 0.0 &&
+                                                               columns.crossing_start[row] <= columns.time_seconds[row] + 1e-9);
+        if (!lane_matches || !speed_valid || !crossing_valid) {
+            ++inconsistent_rows;
+        }
+        auto& seen = last_read[columns.vehicle_id[row]];
+        if (columns.time_seconds[row] >= seen.first) {
+            seen = {columns.time_seconds[row], columns.position[row]};
+        }
+    }
+    REQUIRE(inconsistent_rows == 0);
+    REQUIRE(last_read.size() == last_seen.size());
+    for (const auto& [vehicle_id, seen] : last_seen) {
+        REQUIRE(last_read[vehicle_id].first == Approx(seen.first).margin(1e-3));
+        REQUIRE(last_read[vehicle_id].second == Approx(seen.second).margin(0.006));
+    }
+
+    SECTION("A cut-off file reports the bad chunk") {
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 7);
+        TrajectoryColumns partial;
+        REQUIRE_FALSE(readTrajectoryFile(path, partial, &error));
+        REQUIRE(error == "truncated chunk");
+        REQUIRE(partial.size() < expected_rows);
+        REQUIRE(partial.size() > 0);
+    }
+}
+
+TEST_CASE("Live config swap keeps traffic and hands the lights over through orange", "[engine][config]") {
+    IntersectionConfig grouped = makeDefaultIntersectionConfig();
+    grouped.signal_groups = {{501,
+                              "NS-straight",
+                              {laneIdFor(ApproachId::North, 1), laneIdFor(ApproachId::South, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0},
+                             {502,
+                              "EW-straight",
+                              {laneIdFor(ApproachId::East, 1), laneIdFor(ApproachId::West, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0}};
+
+    SimulatorEngine engine(grouped, 1.0, 10.0, 10.0);
+    engine.setSchedulerMode(SimulatorEngine::SchedulerMode::FixedTime);
+    engine.start();
+    for (int i = 0; i < 200; ++i) {
+        engine.tick(0.1);
+    }
+    const double time_before = engine.getSimTime();
+    const std::size_t waiting_before = engine.getMetrics().total_queue_length;
+    REQUIRE(waiting_before > 0);
+
+    SECTION("A timing-only change retimes the running plan and keeps every vehicle") {
+        IntersectionConfig retimed = grouped;
+        retimed.signal_groups[0].min_green_seconds = 4.0;
+        ConfigSwapReport report;
+        REQUIRE(engine.applyConfigLive(retimed, &report));
+        REQUIRE(report.timing_changed);
+        REQUIRE_FALSE(report.layout_changed);
+        REQUIRE_FALSE(report.signal_plan_changed);
+        REQUIRE(report.vehicles_removed == 0);
+        REQUIRE(engine.getSimTime() == time_before);
+        REQUIRE(engine.getMetrics().total_queue_length == waiting_before);
+        REQUIRE(engine.getIntersectionConfig().signal_groups[0].min_green_seconds == 4.0);
+    }
+
+    SECTION("A new signal plan goes through orange and all-red before the new groups take over") {
+        IntersectionConfig replanned = grouped;
+        replanned.signal_groups.pop_back();
+        replanned.signal_groups.push_back({503,
+                                           "EW-all",
+                                           {laneIdFor(ApproachId::East, 0),
+                                            laneIdFor(ApproachId::East, 1),
+                                            laneIdFor(ApproachId::West, 0),
+                                            laneIdFor(ApproachId::West, 1)},
+                                           {MovementType::Straight},
+                                           2.5,
+                                           1.0});
+        const std::size_t crossed_before = engine.getMetrics().vehicles_crossed;
+
+        ConfigSwapReport report;
+        REQUIRE(engine.applyConfigLive(replanned, &report));
+        REQUIRE(report.signal_plan_changed);
+        REQUIRE_FALSE(report.timing_changed);
+        REQUIRE(report.vehicles_removed == 0);
+
+        // Old greens turn orange, then everything stays red for the clearance time before the new plan starts.
+        const std::size_t violations = engine.getMetrics().safety_violations;
+        auto anyGreen = [](const IntersectionState& lights) {
+            return lights.north == LightState::Green || lights.east == LightState::Green ||
+                   lights.south == LightState::Green || lights.west == LightState::Green;
+        };
+        for (int i = 0; i < 35; ++i) {
+            engine.tick(0.1);
+            REQUIRE_FALSE(anyGreen(engine.getCurrentLightState()));
+        }
+        bool saw_green = false;
+        for (int i = 0; i < 300; ++i) {
+            engine.tick(0.1);
+            saw_green = saw_green || anyGreen(engine.getCurrentLightState());
+        }
+        REQUIRE(saw_green);
+        REQUIRE(engine.getMetrics().safety_violations == violations);
+        REQUIRE(engine.getMetrics().vehicles_crossed > crossed_before);
+    }
+
+    SECTION("Swaps and checkpoints during a handover reach the controller it hands over to") {
+        IntersectionConfig replanned = grouped;
+        replanned.signal_groups.pop_back();
+        replanned.signal_groups.push_back({503,
+                                           "EW-all",
+                                           {laneIdFor(ApproachId::East, 0),
+                                            laneIdFor(ApproachId::East, 1),
+                                            laneIdFor(ApproachId::West, 0),
+                                            laneIdFor(ApproachId::West, 1)},
+                                           {MovementType::Straight},
+                                           2.5,
+                                           1.0});
+        IntersectionConfig retimed = replanned;
+        retimed.signal_groups[0].min_green_seconds = 6.0;
+
+        std::string checkpoint;
+        REQUIRE(engine.saveState(checkpoint));
+        SimulatorEngine direct(grouped, 1.0, 10.0, 10.0);
+        REQUIRE(direct.loadState(checkpoint));
+        REQUIRE(direct.applyConfigLive(retimed));
+
+        // A timing-only change in the middle of the handover retimes the plan that follows it
+        REQUIRE(engine.applyConfigLive(replanned));
+        engine.tick(0.1);
+        direct.tick(0.1);
+        ConfigSwapReport report;
+        REQUIRE(engine.applyConfigLive(retimed, &report));
+        REQUIRE(report.timing_changed);
+
+        // A checkpoint taken mid-handover restores into an engine that is not in one
+        REQUIRE(engine.saveState(checkpoint));
+        SimulatorEngine restored(retimed, 1.0, 10.0, 10.0);
+        REQUIRE(restored.loadState(checkpoint));
+        for (int i = 0; i < 400; ++i) {
+            engine.tick(0.1);
+            direct.tick(0.1);
+            restored.tick(0.1);
+            REQUIRE(engine.getCurrentLightState().east == direct.getCurrentLightState().east);
+            REQUIRE(engine.getCurrentLightState().north == direct.getCurrentLightState().north);
+        }
+        REQUIRE(restored.getSnapshotJson() == engine.getSnapshotJson());
+
+        // A second plan swap while the first is still handing over keeps the lights red until it is done
+        REQUIRE(engine.applyConfigLive(replanned));
+        engine.tick(0.1);
+        std::string error;
+        REQUIRE(engine.applyConfigLive(grouped, nullptr, &error));
+        REQUIRE(error.empty());
+        for (int i = 0; i < 30; ++i) {
+            engine.tick(0.1);
+            REQUIRE(engine.getCurrentLightState().north != LightState::Green);
+            REQUIRE(engine.getCurrentLightState().east != LightState::Green);
+        }
+    }
+
+    SECTION("Vehicles waiting on a lane that no longer reaches the intersection are removed") {
+        IntersectionConfig narrowed = grouped;
+        narrowed.approaches[0].lanes[2].connected_to_intersection = false;
+        narrowed.lane_connections.erase(
+            std::remove_if(narrowed.lane_connections.begin(),
+                           narrowed.lane_connections.end(),
+                           [](const LaneConnectionConfig& c) {
+                               return c.from_approach == ApproachId::North && c.from_lane_index == 2;
+                           }),
+            narrowed.lane_connections.end());
+        std::vector<LaneVehicleState> north;
+        engine.getLaneVehicleStates(Direction::North, north);
+        std::size_t on_removed_lane = 0;
+        for (const auto& state : north) {
+            if (!state.crossing && state.lane_id == laneIdFor(ApproachId::North, 2)) {
+                ++on_removed_lane;
+            }
+        }
+
+        ConfigSwapReport report;
+        REQUIRE(engine.applyConfigLive(narrowed, &report));
+        REQUIRE(report.layout_changed);
+        REQUIRE(report.vehicles_removed == on_removed_lane);
+        engine.getLaneVehicleStates(Direction::North, north);
+        for (const auto& state : north) {
+            REQUIRE(state.lane_id != laneIdFor(ApproachId::North, 2));
+        }
+        for (int i = 0; i < 100; ++i) {
+            engine.tick(0.1);
+        }
+        engine.getLaneVehicleStates(Direction::North, north);
+        for (const auto& state : north) {
+            REQUIRE(state.lane_id != laneIdFor(ApproachId::North, 2));
+        }
+    }
+
+    SECTION("An invalid config leaves the engine untouched") {
+        IntersectionConfig broken = grouped;
+        broken.signal_groups.push_back({504,
+                                        "conflicting",
+                                        {laneIdFor(ApproachId::North, 1), laneIdFor(ApproachId::East, 1)},
+                                        {MovementType::Straight},
+                                        2.5,
+                                        1.0});
+        const std::string before = engine.getSnapshotJson();
+        std::string error;
+        REQUIRE_FALSE(engine.applyConfigLive(broken, nullptr, &error));
+        REQUIRE(error == "config failed safety validation rules");
+        REQUIRE(engine.getSnapshotJson() == before);
+    }
+}
+
+TEST_CASE("Mesoscopic fidelity keeps the metrics of the microscopic model at moderate demand", "[engine][mesoscopic]") {
+    SimulatorEngine micro(makeDefaultIntersectionConfig(), 0.3, 10.0, 10.0);
+    SimulatorEngine meso(makeDefaultIntersectionConfig(), 0.3, 10.0, 10.0);
+    meso.setFidelity(SimulatorEngine::Fidelity::Mesoscopic);
+    REQUIRE(meso.getFidelity() == SimulatorEngine::Fidelity::Mesoscopic);
+    REQUIRE(micro.getFidelity() == SimulatorEngine::Fidelity::Microscopic);
+    micro.start();
+    meso.start();
+    for (int i = 0; i < 18000; ++i) {
+        micro.tick(0.1);
+        meso.tick(0.1);
+    }
+
+    const SimulatorMetrics expected = micro.getMetrics();
+    const SimulatorMetrics metrics = meso.getMetrics();
+    REQUIRE(metrics.safety_violations == 0);
+    REQUIRE(metrics.vehicles_generated == expected.vehicles_generated);
+    REQUIRE(metrics.vehicles_crossed + metrics.total_queue_length == metrics.vehicles_generated);
+    REQUIRE(metrics.vehicles_crossed > expected.vehicles_crossed * 95 / 100);
+    REQUIRE(metrics.average_wait_time > expected.average_wait_time * 0.6);
+    REQUIRE(metrics.average_wait_time < expected.average_wait_time * 1.4);
+
+    // No per-vehicle positions, and the point queues survive a checkpoint.
+    std::vector<LaneVehicleState> states;
+    meso.getLaneVehicleStates(Direction::North, states);
+    REQUIRE(states.empty());
+
+    std::string checkpoint;
+    REQUIRE(meso.saveState(checkpoint));
+    SimulatorEngine restored(makeDefaultIntersectionConfig(), 0.3, 10.0, 10.0);
+    REQUIRE(restored.loadState(checkpoint));
+    REQUIRE(restored.getFidelity() == SimulatorEngine::Fidelity::Mesoscopic);
+    for (int i = 0; i < 600; ++i) {
+        meso.tick(0.1);
+        restored.tick(0.1);
+    }
+    REQUIRE(restored.getSnapshotJson() == meso.getSnapshotJson());
+}
+
+TEST_CASE("Crossing vehicles leave the waiting queue and finish in start order", "[traffic][crossing]") {
+    TrafficGenerator gen(makeDefaultIntersectionConfig(), 2.0);
+    double current_time = 0.0;
+    for (int i = 0; i < 200 && gen.getQueueByDirection(Direction::North).size() < 4; ++i) {
+        current_time += 0.1;
+        gen.generateTraffic(0.1, current_time);
+        gen.updateVehicleSpeeds(0.1, {false, false, false, false});
+    }
+    REQUIRE(gen.getQueueByDirection(Direction::North).size() >= 4);
+
+    const std::size_t approach_vehicles = gen.getQueueLength(Direction::North);
+    std::vector<uint32_t> started;
+    for (int i = 0; i < 3; ++i) {
+        const uint32_t id = gen.peekNextVehicle(Direction::North)->id;
+        REQUIRE(gen.startCrossing(Direction::North, id, current_time + 0.5 * i));
+        started.push_back(id);
+    }
+    REQUIRE(gen.getQueueLength(Direction::North) == approach_vehicles);
+    REQUIRE(gen.getQueueByDirection(Direction::North).size() == approach_vehicles - 3);
+
+    std::vector<uint32_t> crossing_ids;
+    for (bool turning : {false, true}) {
+        for (const Vehicle& vehicle : gen.getCrossingQueue(Direction::North, turning)) {
+            REQUIRE(vehicle.turning == turning);
+            REQUIRE(vehicle.isCrossing());
+            crossing_ids.push_back(vehicle.id);
+        }
+    }
+    std::sort(crossing_ids.begin(), crossing_ids.end());
+    REQUIRE(crossing_ids == started);
+
+    REQUIRE(gen.completeFinishedCrossings(Direction::North, current_time + 1.0) == 0);
+    REQUIRE(gen.completeCrossing(started[1]));
+    REQUIRE_FALSE(gen.completeCrossing(started[1]));
+    REQUIRE(gen.completeFinishedCrossings(Direction::North, current_time + 10.0) == 2);
+    REQUIRE(gen.getTotalCrossed() == 3);
+    REQUIRE(gen.getQueueLength(Direction::North) == approach_vehicles - 3);
+
+    // At high demand every generated vehicle is either still on its approach or has crossed.
+    SimulatorEngine engine(makeDefaultIntersectionConfig(), 2.0, 10.0, 10.0);
+    engine.start();
+    for (int i = 0; i < 3000; ++i) {
+        engine.tick(0.1);
+    }
+    const SimulatorMetrics metrics = engine.getMetrics();
+    REQUIRE(metrics.safety_violations == 0);
+    REQUIRE(metrics.vehicles_crossed > 0);
+    REQUIRE(metrics.vehicles_crossed + metrics.total_queue_length == metrics.vehicles_generated);
+}
+
+TEST_CASE("Configs that differ only in vehicle mix fingerprint and validate apart", "[config][vehicle_class]") {
+    const IntersectionConfig plain = makeDefaultIntersectionConfig();
+    IntersectionConfig short_mix = plain;
+    short_mix.approaches[0].vehicle_mix = {0.2, 0.0, 0.0, 0.0};
+    IntersectionConfig negative_mix = plain;
+    negative_mix.approaches[0].vehicle_mix = {1.5, -0.5, 0.0, 0.0};
+    IntersectionConfig truck_mix = plain;
+    truck_mix.approaches[0].vehicle_mix = {0.8, 0.2, 0.0, 0.0};
+
+    const std::vector<uint64_t> fingerprints = {intersectionConfigFingerprint(plain),
+                                                intersectionConfigFingerprint(short_mix),
+                                                intersectionConfigFingerprint(negative_mix),
+                                                intersectionConfigFingerprint(truck_mix)};
+    for (std::size_t i = 0; i < fingerprints.size(); ++i) {
+        for (std::size_t j = i + 1; j < fingerprints.size(); ++j) {
+            REQUIRE(fingerprints[i] != fingerprints[j]);
+        }
+    }
+
+    // The validation cache is shared across checkers, so the order of checks must not matter
+    for (int round = 0; round < 2; ++round) {
+        REQUIRE(SafetyChecker(plain).isConfigValid());
+        REQUIRE_FALSE(SafetyChecker(short_mix).isConfigValid());
+        REQUIRE_FALSE(SafetyChecker(negative_mix).isConfigValid());
+        REQUIRE(SafetyChecker(truck_mix).isConfigValid());
+    }
+    REQUIRE_FALSE(SafetyChecker(negative_mix).isConfigValid());
+
+    // A written mix reads back exactly, including one that does not add up
+    const ConfigParseResult reread = intersectionConfigFromJson(intersectionConfigToJson(short_mix));
+    REQUIRE(reread.ok);
+    REQUIRE(reread.config.approaches[0].vehicle_mix == short_mix.approaches[0].vehicle_mix);
+    REQUIRE(intersectionConfigFingerprint(reread.config) == intersectionConfigFingerprint(short_mix));
+}
+
+TEST_CASE("Config caches confirm a fingerprint hit on every field", "[config][safety]") {
+    const IntersectionConfig base = makeDefaultIntersectionConfig();
+    REQUIRE(sameIntersectionConfig(base, base));
+
+    std::vector<IntersectionConfig> variants(9, base);
+    variants[0].approaches[1].name = "Oost";
+    variants[1].approaches[1].length_m = 120.0;
+    variants[2].approaches[1].lane_capacity = 4;
+    variants[3].approaches[1].vehicle_mix = {0.9, 0.1, 0.0, 0.0};
+    variants[4].approaches[1].lanes[0].name = "E-zero";
+    variants[5].approaches[1].lanes[0].has_traffic_light = false;
+    variants[6].lane_connections.pop_back();
+    variants[7].signal_groups.push_back({1, "NS", {laneIdFor(ApproachId::North, 0)}, {MovementType::Straight}});
+    variants[8] = variants[7];
+    variants[8].signal_groups[0].orange_seconds = 3.0;
+
+    for (const IntersectionConfig& variant : variants) {
+        REQUIRE_FALSE(sameIntersectionConfig(base, variant));
+        REQUIRE_FALSE(sameIntersectionConfig(variant, base));
+    }
+    REQUIRE_FALSE(sameIntersectionConfig(variants[7], variants[8]));
+}
+
+TEST_CASE("Vehicle classes follow the approach mix and keep their own spacing", "[traffic][vehicle_class]") {
+    IntersectionConfig config = makeDefaultIntersectionConfig();
+    config.approaches[0].vehicle_mix = {0.25, 0.5, 0.0, 0.25};
+    REQUIRE(SafetyChecker(config).isConfigValid());
+
+    const ConfigParseResult parsed = intersectionConfigFromJson(intersectionConfigToJson(config));
+    REQUIRE(parsed.ok);
+    REQUIRE(parsed.config.approaches[0].vehicle_mix == config.approaches[0].vehicle_mix);
+    REQUIRE(intersectionConfigToJson(makeDefaultIntersectionConfig()).find("_share") == std::string::npos);
+    const ConfigParseResult too_many =
+        intersectionConfigFromJson(R"({"approaches":[{"id":"north","truck_share":0.8,"bus_share":0.5,"lanes":[]}]})");
+    REQUIRE_FALSE(too_many.ok);
+
+    SimulatorEngine engine(config, 0.5, 10.0, 10.0);
+    engine.start();
+    std::map<uint32_t, VehicleClass> north_classes;
+    std::vector<LaneVehicleState> states;
+    for (int i = 0; i < 6000; ++i) {
+        engine.tick(0.1);
+        engine.getLaneVehicleStates(Direction::North, states);
+        for (const LaneVehicleState& vehicle : states) {
+            north_classes[vehicle.id] = vehicle.vehicle_class;
+            REQUIRE(vehicle.speed <= vehicleClassParams(vehicle.vehicle_class).desired_speed + 1e-9);
+        }
+        // Waiting vehicles keep at least the length of the vehicle ahead plus 2 m to it.
+        for (const LaneVehicleState& ahead : states) {
+            for (const LaneVehicleState& behind : states) {
+                if (ahead.crossing || behind.crossing || ahead.lane_id != behind.lane_id ||
+                    ahead.position_in_lane <= behind.position_in_lane) {
+                    continue;
+                }
+                REQUIRE(ahead.position_in_lane - behind.position_in_lane >=
+                        vehicleClassParams(ahead.vehicle_class).length_m + 2.0 - 1e-6);
+            }
+        }
+        engine.getLaneVehicleStates(Direction::South, states);
+        for (const LaneVehicleState& vehicle : states) {
+            REQUIRE(vehicle.vehicle_class == VehicleClass::Car);
+        }
+    }
+    REQUIRE(engine.getMetrics().safety_violations == 0);
+
+    std::array<std::size_t, kVehicleClassCount> counts{};
+    for (const auto& entry : north_classes) {
+        ++counts[static_cast<std::size_t>(entry.second)];
+    }
+    const double total = static_cast<double>(north_classes.size());
+    REQUIRE(total > 100);
+    REQUIRE(counts[static_cast<std::size_t>(VehicleClass::Bus)] == 0);
+    REQUIRE(counts[static_cast<std::size_t>(VehicleClass::Truck)] / total == Catch::Approx(0.5).margin(0.1));
+    REQUIRE(counts[static_cast<std::size_t>(VehicleClass::Bicycle)] / total == Catch::Approx(0.25).margin(0.1));
+
+    std::string checkpoint;
+    REQUIRE(engine.saveState(checkpoint));
+    SimulatorEngine restored(config, 0.5, 10.0, 10.0);
+    REQUIRE(restored.loadState(checkpoint));
+    for (int i = 0; i < 300; ++i) {
+        engine.tick(0.1);
+        restored.tick(0.1);
+    }
+    REQUIRE(restored.getSnapshotJson() == engine.getSnapshotJson());
+}
+
+TEST_CASE("Movement permissions decide per lane, movement and destination who may go", "[traffic][permissions]") {
+    const IntersectionConfig config = makeDefaultIntersectionConfig();
+    TrafficGenerator::MovementPermissions none;
+    TrafficGenerator::MovementPermissions all;
+    TrafficGenerator::MovementPermissions straight_only;
+    for (std::size_t dir = 0; dir < 4; ++dir) {
+        const std::size_t lanes = config.approaches[dir].lanes.size();
+        none.lanes[dir].assign(lanes, 0);
+        all.lanes[dir].assign(lanes, 0xFFF);
+        straight_only.lanes[dir].assign(lanes, 0);
+        for (std::size_t destination = 0; destination < 4; ++destination) {
+            for (auto& mask : straight_only.lanes[dir]) {
+                mask |= TrafficGenerator::MovementPermissions::bit(MovementType::Straight,
+                                                                   static_cast<ApproachId>(destination));
+            }
+        }
+    }
+
+    // A full or empty table behaves like the per-approach flags
+    TrafficGenerator by_flag(config, 1.5);
+    TrafficGenerator by_table(config, 1.5);
+    std::vector<LaneVehicleState> flag_states;
+    std::vector<LaneVehicleState> table_states;
+    double current_time = 0.0;
+    for (int i = 0; i < 600; ++i) {
+        current_time += 0.1;
+        const bool go = (i / 150) % 2 == 1;
+        by_flag.generateTraffic(0.1, current_time);
+        by_table.generateTraffic(0.1, current_time);
+        by_flag.updateVehicleSpeeds(0.1, {go, go, go, go});
+        by_table.updateVehicleSpeeds(0.1, {!go, !go, !go, !go}, go ? &all : &none);
+    }
+    for (int dir = 0; dir < 4; ++dir) {
+        by_flag.getLaneVehicleStates(static_cast<Direction>(dir), flag_states);
+        by_table.getLaneVehicleStates(static_cast<Direction>(dir), table_states);
+        REQUIRE(table_states.size() == flag_states.size());
+        for (std::size_t v = 0; v < flag_states.size(); ++v) {
+            REQUIRE(table_states[v].position_in_lane == flag_states[v].position_in_lane);
+            REQUIRE(table_states[v].speed == flag_states[v].speed);
+        }
+    }
+
+    // Only straight-on vehicles pull up past the stop target
+    TrafficGenerator gen(config, 1.5);
+    bool straight_passed = false;
+    for (int i = 0; i < 900; ++i) {
+        current_time += 0.1;
+        gen.generateTraffic(0.1, current_time);
+        gen.updateVehicleSpeeds(0.1, {false, false, false, false}, &straight_only);
+        for (const Vehicle& vehicle : gen.getQueueByDirection(Direction::North)) {
+            const double stop_target = config.approaches[0].length_m - kStopTargetOffsetMeters;
+            if (vehicle.movement != MovementType::Straight) {
+                REQUIRE(vehicle.position_in_lane <= stop_target + 1e-9);
+            } else if (vehicle.position_in_lane > stop_target) {
+                straight_passed = true;
+            }
+        }
+    }
+    REQUIRE(straight_passed);
+}
+
+TEST_CASE("Steady-state ticks do not allocate", "[engine][alloc]") {
+    IntersectionConfig grouped = makeDefaultIntersectionConfig();
+    grouped.signal_groups = {{501,
+                              "NS-straight",
+                              {laneIdFor(ApproachId::North, 1), laneIdFor(ApproachId::South, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0},
+                             {502,
+                              "EW-straight",
+                              {laneIdFor(ApproachId::East, 1), laneIdFor(ApproachId::West, 1)},
+                              {MovementType::Straight},
+                              2.5,
+                              1.0}};
+
+    auto allocationsPerRun = [](SimulatorEngine& engine) {
+        engine.start();
+        // Warm up until queues, scratch buffers and rollout engines have seen their peak load.
+        for (int i = 0; i < 6000; ++i) {
+            engine.tick(0.1);
+        }
+        counted_allocations = 0;
+        count_allocations = true;
+        for (int i = 0; i < 3000; ++i) {
+            engine.tick(0.1);
+        }
+        count_allocations = false;
+        return counted_allocations.load();
+    };
+
+    SECTION("Adaptive scheduler, default layout") {
+        SimulatorEngine engine(makeDefaultIntersectionConfig(), 0.5, 10.0, 10.0);
+        REQUIRE(allocationsPerRun(engine) == 0);
+        REQUIRE(engine.getMetrics().vehicles_crossed > 0);
+    }
+
+    SECTION("Fixed-time signal groups") {
+        SimulatorEngine engine(grouped, 0.5, 10.0, 10.0);
+        engine.setSchedulerMode(SimulatorEngine::SchedulerMode::FixedTime);
+        REQUIRE(allocationsPerRun(engine) == 0);
+    }
+
+    SECTION("Predictive scheduler") {
+        SimulatorEngine engine(makeDefaultIntersectionConfig(), 0.5, 10.0, 10.0);
+        engine.setSchedulerMode(SimulatorEngine::SchedulerMode::Predictive);
+        REQUIRE(allocationsPerRun(engine) == 0);
+    }
+
+    SECTION("Mesoscopic fidelity") {
+        SimulatorEngine engine(grouped, 0.5, 10.0, 10.0);
+        engine.setFidelity(SimulatorEngine::Fidelity::Mesoscopic);
+        REQUIRE(allocationsPerRun(engine) == 0);
+    }
+}
+
+TEST_CASE("Simulation sessions tick at their own pace and idle ones are evicted", "[sessions]") {
+    using Clock = SimulationSessions::Clock;
+    SimulationSessions::Limits limits;
+    limits.max_sessions = 3;
+    limits.idle_timeout = std::chrono::seconds(10);
+    SimulationSessions sessions(limits);
+
+    const SessionInputs inputs{0.5, 10.0, 10.0, {}, SimulatorEngine::SchedulerMode::Adaptive};
+    auto pinned = sessions.createPinned("default", makeDefaultIntersectionConfig(), inputs, 0.1,
+                                        std::chrono::milliseconds(100));
+    auto fast = sessions.create(makeDefaultIntersectionConfig(), inputs, 0.1, std::chrono::milliseconds(50));
+    REQUIRE(pinned);
+    REQUIRE(fast);
+    REQUIRE(sessions.createPinned("default", makeDefaultIntersectionConfig(), inputs, 0.1,
+                                  std::chrono::milliseconds(100)) == nullptr);
+    REQUIRE(sessions.find(fast->id) == fast);
+    pinned->engine.start();
+    fast->engine.start();
+
+    // Two seconds of wall time in 50 ms steps: the 50 ms session ticks twice as often as the 100 ms one.
+    const Clock::time_point origin = Clock::now();
+    for (int step = 1; step <= 40; ++step) {
+        sessions.tickDue(origin + std::chrono::milliseconds(50 * step));
+    }
+    REQUIRE(pinned->engine.getSimTime() == Catch::Approx(2.0));
+    REQUIRE(fast->engine.getSimTime() == Catch::Approx(4.0));
+
+    // A session that falls behind ticks once and skips the backlog
+    REQUIRE(sessions.tickDue(origin + std::chrono::seconds(5)) == 2);
+    REQUIRE(sessions.tickDue(origin + std::chrono::seconds(5)) == 0);
+
+    std::string error;
+    auto third = sessions.create(makeDefaultIntersectionConfig(), inputs, 0.1, std::chrono::milliseconds(100));
+    REQUIRE(third);
+    REQUIRE(sessions.create(makeDefaultIntersectionConfig(), inputs, 0.1, std::chrono::milliseconds(100), &error) ==
+            nullptr);
+    REQUIRE(error == "session limit reached");
+    REQUIRE(sessions.list().size() == 3);
+
+    REQUIRE_FALSE(sessions.destroy("default"));
+    REQUIRE(sessions.destroy(third->id));
+    REQUIRE(sessions.find(third->id) == nullptr);
+
+    // Nobody looked the unpinned session up for longer than the timeout; the pinned one stays regardless.
+    REQUIRE(sessions.evictIdle(Clock::now() + std::chrono::seconds(11)) == 1);
+    REQUIRE(sessions.find(fast->id) == nullptr);
+    REQUIRE(sessions.find("default") == pinned);
+    REQUIRE(sessions.size() == 1);
+
+    // The workers tick on the real clock
+    auto live = sessions.create(makeDefaultIntersectionConfig(), inputs, 0.1, std::chrono::milliseconds(20));
+    REQUIRE(live);
+    live->engine.start();
+    sessions.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    sessions.stop();
+    std::lock_guard<std::mutex> lock(live->mutex);
+    REQUIRE(live->engine.getSimTime() > 0.0);
+}
+
+TEST_CASE("Session workers keep sessions at home and steal ticks a busy worker falls behind on", "[sessions]") {
+    SimulationSessions::Limits limits;
+    limits.worker_count = 2;
+    SimulationSessions sessions(limits);
+
+    // Sessions go to the least loaded worker, so worker 0 gets the slow ones
+    const SessionInputs inputs{0.5, 10.0, 10.0, {}, SimulatorEngine::SchedulerMode::Adaptive};
+    std::vector<std::shared_ptr<SimulationSession>> created;
+    for (int i = 0; i < 4; ++i) {
+        auto session = sessions.create(makeDefaultIntersectionConfig(), inputs, 0.1, std::chrono::milliseconds(10));
+        REQUIRE(session);
+        session->engine.start();
+        if (i % 2 == 0) {
+            session->after_tick = [](SimulationSession&) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(15));
+            };
+        }
+        created.push_back(session);
+    }
+    const auto homes = sessions.list();
+    REQUIRE(homes.size() == 4);
+    for (const auto& info : homes) {
+        REQUIRE(info.home_worker == (info.id == created[0]->id || info.id == created[2]->id ? 0u : 1u));
+    }
+
+    sessions.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    sessions.stop();
+    const std::vector<SimulationWorkerStats> stats = sessions.workerStats();
+
+    REQUIRE(stats.size() == 2);
+    REQUIRE(stats[0].home_sessions == 2);
+    REQUIRE(stats[1].home_sessions == 2);
+    REQUIRE(stats[0].utilization > 0.5);
+    REQUIRE(stats[1].utilization <= 1.0);
+    REQUIRE(stats[1].stolen_ticks > 0);
+
+    uint64_t sim_ticks = 0;
+    for (const auto& session : created) {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        REQUIRE(session->engine.getSimTime() > 0.0);
+        sim_ticks += static_cast<uint64_t>(std::llround(session->engine.getSimTime() / 0.1));
+    }
+    REQUIRE(stats[0].ticks + stats[1].ticks == sim_ticks);
+}